@@ -1,29 +1,70 @@
 TEMPLATE = app
 TARGET = lspmonitor
 
-QT = core gui widgets
+QT = core gui widgets network concurrent
 
 CONFIG += c++20
 
+include(pipeline.pri)
+
 SOURCES += \
-    asciiparsing.cpp \
+    cancellationstats.cpp \
     communicationmodel.cpp \
     connectionstream.cpp \
-    framebuilder.cpp \
-    lspschemavalidator.cpp \
+    cpuattribution.cpp \
+    documentmirror.cpp \
+    documentrope.cpp \
+    interactionlatency.cpp \
+    jsondiff.cpp \
+    latencystats.cpp \
+    lineindex.cpp \
     main.cpp \
-    messagebuilder.cpp \
-    stdiomitm.cpp
+    metricsexporter.cpp \
+    overheadpanel.cpp \
+    proxyfilter.cpp \
+    rangechecker.cpp \
+    replay.cpp \
+    replaycomparison.cpp \
+    resourcesampler.cpp \
+    serversession.cpp \
+    spansummary.cpp \
+    stdiomitm.cpp \
+    stubserver.cpp \
+    textscan.cpp \
+    timelineview.cpp \
+    traceexporter.cpp \
+    workload.cpp
 
 HEADERS += \
-    asciiparsing.h \
+    cancellationstats.h \
     communicationmodel.h \
     connectionstream.h \
-    framebuilder.h \
-    lspschemavalidator.h \
-    messagebuilder.h \
-    option.h \
-    stdiomitm.h
+    cpuattribution.h \
+    documentmirror.h \
+    documentrope.h \
+    interactionlatency.h \
+    jsondiff.h \
+    latencystats.h \
+    lineindex.h \
+    metricsexporter.h \
+    overheadpanel.h \
+    proxyfilter.h \
+    rangechecker.h \
+    replay.h \
+    replaycomparison.h \
+    resourcesampler.h \
+    serversession.h \
+    spansummary.h \
+    stdiomitm.h \
+    stubserver.h \
+    textscan.h \
+    timelineview.h \
+    traceexporter.h \
+    workload.h
+
+OTHER_FILES += \
+    protocol/metaModel.json \
+    tools/generate_validators.py
 
 FORMS +=
 
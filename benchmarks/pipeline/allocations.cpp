@@ -0,0 +1,67 @@
+#include "allocations.h"
+
+#include <atomic>
+#include <cstdlib>
+
+namespace {
+    std::atomic<quint64> allocations {0};
+
+    std::atomic<quint64> bytes {0};
+
+    void count(size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+#ifdef __GLIBC__
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t elements, size_t size);
+    void* __libc_realloc(void *pointer, size_t size);
+    void __libc_free(void *pointer);
+
+    void* malloc(size_t size) {
+        count(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t elements, size_t size) {
+        count(elements * size);
+        return __libc_calloc(elements, size);
+    }
+
+    void* realloc(void *pointer, size_t size) {
+        count(size);
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void *pointer) {
+        __libc_free(pointer);
+    }
+}
+#endif
+
+namespace Allocations {
+
+Count Count::operator+(const Count &other) const {
+    return Count {allocations + other.allocations, bytes + other.bytes};
+}
+
+Count Count::operator-(const Count &other) const {
+    return Count {allocations - other.allocations, bytes - other.bytes};
+}
+
+Count current() {
+    return Count {allocations.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed)};
+}
+
+bool available() {
+#ifdef __GLIBC__
+    return true;
+#else
+    return false;
+#endif
+}
+
+}
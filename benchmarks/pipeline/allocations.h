@@ -0,0 +1,30 @@
+#ifndef ALLOCATIONS_H
+#define ALLOCATIONS_H
+
+#include <QtCore>
+
+/**
+ * Heap allocations made by the whole process since it started, counted by
+ * interposing malloc (which operator new and Qt's containers both use). Only
+ * glibc can be interposed on like this; elsewhere nothing is counted.
+ */
+namespace Allocations {
+
+struct Count {
+    quint64 allocations = 0;
+
+    quint64 bytes = 0;
+
+    Count operator+(const Count &other) const;
+
+    Count operator-(const Count &other) const;
+};
+
+Count current();
+
+/** If allocations are being counted at all */
+bool available();
+
+}
+
+#endif // ALLOCATIONS_H
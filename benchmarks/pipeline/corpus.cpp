@@ -0,0 +1,137 @@
+#include "corpus.h"
+#include "capture.h"
+
+#include <random>
+
+namespace {
+    QByteArray request(int id, const char *method, const QByteArray &params) {
+        return R"({"jsonrpc":"2.0","id":)" + QByteArray::number(id) + R"(,"method":")" + method + R"(","params":)" + params + "}";
+    }
+
+    QByteArray response(int id, const QByteArray &result) {
+        return R"({"jsonrpc":"2.0","id":)" + QByteArray::number(id) + R"(,"result":)" + result + "}";
+    }
+
+    QByteArray textDocumentPosition(int line, int character) {
+        return R"({"textDocument":{"uri":"file:///project/src/main.cpp"},"position":{"line":)" + QByteArray::number(line) + R"(,"character":)" + QByteArray::number(character) + "}}";
+    }
+}
+
+qint64 Corpus::bytes() const {
+    qint64 total = 0;
+    for (const Entry &entry : entries) {
+        total += entry.payload.size();
+    }
+    return total;
+}
+
+QByteArray Corpus::stream(Lsp::Entity sender) const {
+    QByteArray out;
+
+    for (const Entry &entry : entries) {
+        if (entry.sender == sender) {
+            out += "Content-Length: " + QByteArray::number(entry.payload.size()) + "\r\n\r\n" + entry.payload;
+        }
+    }
+
+    return out;
+}
+
+Corpus Corpus::tinyNotifications(int count) {
+    Corpus corpus {"tiny"};
+
+    for (int i = 0; i < count; i++) {
+        QByteArray payload = i % 2 == 0
+            ? R"({"jsonrpc":"2.0","method":"window/logMessage","params":{"type":4,"message":"Indexed file )" + QByteArray::number(i) + R"("}})"
+            : R"({"jsonrpc":"2.0","method":"$/progress","params":{"token":"indexing","value":{"kind":"report","percentage":)" + QByteArray::number(i % 100) + "}}}";
+        corpus.entries.append(Entry {Lsp::Entity::Server, payload});
+    }
+
+    return corpus;
+}
+
+Corpus Corpus::hovers(int count) {
+    Corpus corpus {"hover"};
+
+    QByteArray markdown = "```cpp\nclass Example final : public Base\n```\n";
+    while (markdown.size() < 2048) {
+        markdown += "Documentation of the symbol under the cursor, with `code`, a [link](https://example.com) and \\\"quotes\\\".\\n";
+    }
+    markdown.replace("\n", "\\n");
+
+    for (int i = 0; i < count; i++) {
+        corpus.entries.append(Entry {Lsp::Entity::Client, request(i, "textDocument/hover", textDocumentPosition(i % 1000, 8))});
+        corpus.entries.append(Entry {Lsp::Entity::Server, response(i, R"({"contents":{"kind":"markdown","value":")" + markdown + R"("},"range":{"start":{"line":)"
+            + QByteArray::number(i % 1000) + R"(,"character":4},"end":{"line":)" + QByteArray::number(i % 1000) + R"(,"character":11}}})")});
+    }
+
+    return corpus;
+}
+
+Corpus Corpus::semanticTokens(qint64 bytes) {
+    Corpus corpus {"semanticTokens"};
+    corpus.entries.append(Entry {Lsp::Entity::Client, request(1, "textDocument/semanticTokens/full", R"({"textDocument":{"uri":"file:///project/src/main.cpp"}})")});
+
+    std::mt19937 random (1);
+
+    QByteArray data;
+    data.reserve(bytes + 64);
+
+    // Five integers per token: line delta, start delta, length, type and modifiers
+    while (data.size() < bytes) {
+        int token[5] = {random() % 4 == 0 ? 1 : 0, int(random() % 40), int(1 + random() % 20), int(random() % 12), int(random() % 4)};
+        for (int value : token) {
+            data += QByteArray::number(value) + ',';
+        }
+    }
+    data.chop(1);
+
+    corpus.entries.append(Entry {Lsp::Entity::Server, response(1, R"({"resultId":"1","data":[)" + data + "]}")});
+    return corpus;
+}
+
+Corpus Corpus::completion(qint64 bytes) {
+    Corpus corpus {"completion"};
+    corpus.entries.append(Entry {Lsp::Entity::Client, request(1, "textDocument/completion", textDocumentPosition(120, 17))});
+
+    QByteArray items;
+    items.reserve(bytes + 256);
+
+    for (int i = 0; items.size() < bytes; i++) {
+        QByteArray label = "identifier" + QByteArray::number(i);
+        items += R"({"label":")" + label + R"(","kind":)" + QByteArray::number(1 + i % 25) + R"(,"detail":"int )" + label
+            + R"((const Example &)","sortText":")" + QByteArray::number(i).rightJustified(8, '0') + R"(","insertText":")" + label + R"("},)";
+    }
+    items.chop(1);
+
+    corpus.entries.append(Entry {Lsp::Entity::Server, response(1, R"({"isIncomplete":false,"items":[)" + items + "]}")});
+    return corpus;
+}
+
+option<Corpus> Corpus::fromCapture(const QString &path, QString *error) {
+    QFile file (path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return {};
+    }
+
+    Corpus corpus {"recorded"};
+
+    Capture::Reader reader (&file);
+    Capture::Record record;
+
+    while (reader.next(record)) {
+        if (record.kind == Capture::Record::Kind::ClientMessage) {
+            corpus.entries.append(Entry {Lsp::Entity::Client, record.data});
+        } else if (record.kind == Capture::Record::Kind::ServerMessage) {
+            corpus.entries.append(Entry {Lsp::Entity::Server, record.data});
+        }
+    }
+
+    if (reader.errorOccurred()) {
+        *error = reader.errorString();
+        return {};
+    }
+
+    return corpus;
+}
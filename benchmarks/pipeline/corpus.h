@@ -0,0 +1,47 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <QtCore>
+
+#include "lspschemavalidator.h"
+#include "option.h"
+
+/**
+ * Messages to push through the pipeline, in the order they were sent. The
+ * synthetic corpora are generated from a fixed seed, so every run measures
+ * the same bytes.
+ */
+struct Corpus {
+    struct Entry {
+        Lsp::Entity sender;
+
+        QByteArray payload;
+    };
+
+    QString name;
+
+    QVector<Entry> entries {};
+
+    /** Payload bytes of every message */
+    qint64 bytes() const;
+
+    /** What the sender writes: each of its messages, framed */
+    QByteArray stream(Lsp::Entity sender) const;
+
+    /** window/logMessage and $/progress notifications of about 100 bytes */
+    static Corpus tinyNotifications(int count);
+
+    /** textDocument/hover Requests, each answered with about 2 KB of markdown */
+    static Corpus hovers(int count);
+
+    /** One textDocument/semanticTokens/full Request, answered with a Response of about the given size */
+    static Corpus semanticTokens(qint64 bytes);
+
+    /** One textDocument/completion Request, answered with a CompletionList of about the given size */
+    static Corpus completion(qint64 bytes);
+
+    /** Every message in a capture */
+    static option<Corpus> fromCapture(const QString &path, QString *error);
+};
+
+#endif // CORPUS_H
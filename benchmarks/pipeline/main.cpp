@@ -0,0 +1,328 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "allocations.h"
+#include "corpus.h"
+#include "framebuilder.h"
+#include "histogram.h"
+#include "lspschemavalidator.h"
+#include "messagebuilder.h"
+#include "monotonic.h"
+
+namespace {
+
+/** One pass of a stage over a corpus */
+struct Run {
+    quint64 messages = 0;
+
+    /** Frames or messages the stage rejected */
+    quint64 errors = 0;
+
+    qint64 elapsedNs = 0;
+
+    /** Per message (ns) */
+    Histogram latency {};
+
+    Allocations::Count allocated {};
+};
+
+using Streams = std::map<Lsp::Entity, QByteArray>;
+
+using Frames = std::map<Lsp::Entity, std::vector<FrameBuilder::Frame>>;
+
+using Messages = std::map<Lsp::Entity, std::vector<MessageBuilder::Message>>;
+
+/**
+ * Feeds each sender's stream to a FrameBuilder in chunks of the size (0 for
+ * all at once). A frame's latency is from the chunk holding its first byte
+ * being handed in to the frame coming out.
+ */
+std::unique_ptr<Run> runFrames(const Streams &streams, qint64 chunk) {
+    auto run = std::make_unique<Run>();
+
+    for (auto &stream : streams) {
+        FrameBuilder::FrameBuilder builder;
+        QObject::connect(&builder, &FrameBuilder::FrameBuilder::emitFrame, [&](FrameBuilder::Frame frame){
+            run->latency.record(std::max<qint64>(monotonicNs() - frame.timing.firstByte, 0));
+            run->messages += 1;
+        });
+        QObject::connect(&builder, &FrameBuilder::FrameBuilder::emitError, [&]{ run->errors += 1; });
+
+        const QByteArray &bytes = stream.second;
+        qint64 step = chunk > 0 ? chunk : bytes.size();
+
+        Allocations::Count before = Allocations::current();
+        qint64 start = monotonicNs();
+
+        // Chunks borrow the stream's bytes, so splitting it costs nothing
+        for (qint64 offset = 0; offset < bytes.size(); offset += step) {
+            builder.onInput(QByteArray::fromRawData(bytes.constData() + offset, int(std::min<qint64>(step, bytes.size() - offset))));
+        }
+
+        run->elapsedNs += monotonicNs() - start;
+        run->allocated = run->allocated + (Allocations::current() - before);
+    }
+
+    return run;
+}
+
+std::unique_ptr<Run> runMessages(const Frames &frames) {
+    auto run = std::make_unique<Run>();
+
+    for (auto &sender : frames) {
+        MessageBuilder::MessageBuilder builder;
+        QObject::connect(&builder, &MessageBuilder::MessageBuilder::emitError, [&]{ run->errors += 1; });
+
+        for (const FrameBuilder::Frame &frame : sender.second) {
+            Allocations::Count before = Allocations::current();
+            qint64 start = monotonicNs();
+
+            builder.onFrame(frame);
+
+            qint64 elapsed = monotonicNs() - start;
+            run->allocated = run->allocated + (Allocations::current() - before);
+            run->elapsedNs += elapsed;
+            run->latency.record(elapsed);
+            run->messages += 1;
+        }
+    }
+
+    return run;
+}
+
+/** Validates the messages in the order the corpus has them, so Responses find their Requests */
+std::unique_ptr<Run> runValidation(const Corpus &corpus, const Messages &messages) {
+    auto run = std::make_unique<Run>();
+
+    Lsp::LspSchemaValidator client (Lsp::Entity::Client);
+    Lsp::LspSchemaValidator server (Lsp::Entity::Server);
+    client.linkWith(server);
+
+    // Messages that failed to parse are missing, so later ones may be validated slightly out of order
+    std::map<Lsp::Entity, int> next;
+
+    for (const Corpus::Entry &entry : corpus.entries) {
+        auto it = messages.find(entry.sender);
+        int &index = next[entry.sender];
+        if (it == messages.end() || index >= int(it->second.size())) {
+            continue;
+        }
+
+        auto &validator = entry.sender == Lsp::Entity::Client ? client : server;
+        const MessageBuilder::Message &message = it->second.at(index++);
+
+        Allocations::Count before = Allocations::current();
+        qint64 start = monotonicNs();
+
+        validator.onMessage(message);
+
+        qint64 elapsed = monotonicNs() - start;
+        run->allocated = run->allocated + (Allocations::current() - before);
+        run->elapsedNs += elapsed;
+        run->latency.record(elapsed);
+        run->messages += 1;
+    }
+
+    return run;
+}
+
+Frames collectFrames(const Streams &streams) {
+    Frames frames;
+
+    for (auto &stream : streams) {
+        FrameBuilder::FrameBuilder builder;
+        QObject::connect(&builder, &FrameBuilder::FrameBuilder::emitFrame, [&](FrameBuilder::Frame frame){ frames[stream.first].push_back(frame); });
+        builder.onInput(stream.second);
+    }
+
+    return frames;
+}
+
+Messages collectMessages(const Frames &frames) {
+    Messages messages;
+
+    for (auto &sender : frames) {
+        MessageBuilder::MessageBuilder builder;
+        QObject::connect(&builder, &MessageBuilder::MessageBuilder::emitMessage, [&](MessageBuilder::Message message){ messages[sender.first].push_back(message); });
+
+        for (const FrameBuilder::Frame &frame : sender.second) {
+            builder.onFrame(frame);
+        }
+    }
+
+    return messages;
+}
+
+/** The fastest of the iterations */
+template <typename Pass>
+std::unique_ptr<Run> fastest(int iterations, Pass pass) {
+    std::unique_ptr<Run> best;
+
+    for (int i = 0; i < iterations; i++) {
+        auto run = pass();
+        if (!best || run->elapsedNs < best->elapsedNs) {
+            best = std::move(run);
+        }
+    }
+
+    return best;
+}
+
+}
+
+int main(int argc, char **argv) {
+    QCoreApplication app (argc, argv);
+    QCoreApplication::setApplicationName("pipeline-bench");
+
+    QCommandLineParser parser {};
+    parser.setApplicationDescription("Measures the throughput, per message latency and allocations of each stage of the lspmonitor pipeline. "
+        "Prints a JSON object per corpus and stage on stdout, and a summary on stderr");
+    parser.addHelpOption();
+
+    QCommandLineOption corpusOpt ( "corpus", "Corpus to run: tiny, hover, semanticTokens or completion. Repeatable, all by default", "name" );
+    parser.addOption(corpusOpt);
+
+    QCommandLineOption captureOpt ( "capture", "Also run the messages of a capture, as the recorded corpus", "file" );
+    parser.addOption(captureOpt);
+
+    QCommandLineOption countOpt ( "count", "Messages in the tiny and hover corpora", "count", "20000" );
+    parser.addOption(countOpt);
+
+    QCommandLineOption sizeOpt ( "size", "MiB of the semanticTokens and completion Responses", "MiB", "16" );
+    parser.addOption(sizeOpt);
+
+    QCommandLineOption chunksOpt ( "chunks", "Comma separated chunk sizes (bytes) input is delivered in to the framing stage, 0 for all at once", "sizes", "1,4096,65536,0" );
+    parser.addOption(chunksOpt);
+
+    QCommandLineOption iterationsOpt ( "iterations", "Passes of each stage, of which the fastest is reported", "count", "3" );
+    parser.addOption(iterationsOpt);
+
+    QCommandLineOption outputOpt ( QStringList { "o", "output" }, "Output file for the results (stdout by default)", "file" );
+    parser.addOption(outputOpt);
+
+    parser.process(app);
+
+    int count = std::max(parser.value(countOpt).toInt(), 1);
+    qint64 size = qint64(parser.value(sizeOpt).toDouble() * 1024 * 1024);
+    int iterations = std::max(parser.value(iterationsOpt).toInt(), 1);
+
+    QVector<qint64> chunks;
+    for (const QString &chunk : parser.value(chunksOpt).split(',', Qt::SkipEmptyParts)) {
+        chunks.append(std::max<qint64>(chunk.trimmed().toLongLong(), 0));
+    }
+
+    QStringList names = parser.values(corpusOpt);
+    if (names.isEmpty()) {
+        names = QStringList {"tiny", "hover", "semanticTokens", "completion"};
+    }
+
+    QVector<Corpus> corpora;
+    for (const QString &name : names) {
+        if (name == "tiny") {
+            corpora.append(Corpus::tinyNotifications(count));
+        } else if (name == "hover") {
+            corpora.append(Corpus::hovers(count));
+        } else if (name == "semanticTokens") {
+            corpora.append(Corpus::semanticTokens(size));
+        } else if (name == "completion") {
+            corpora.append(Corpus::completion(size));
+        } else {
+            std::cerr << "Unknown corpus: " << name.toStdString() << std::endl;
+            return -1;
+        }
+    }
+
+    if (parser.isSet(captureOpt)) {
+        QString error;
+        auto recorded = Corpus::fromCapture(parser.value(captureOpt), &error);
+        if (!recorded) {
+            std::cerr << "Failed to read capture: " << error.toStdString() << std::endl;
+            return -1;
+        }
+        corpora.append(recorded.value());
+    }
+
+    QFile output;
+    if (parser.isSet(outputOpt)) {
+        output.setFileName(parser.value(outputOpt));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            std::cerr << "Unable to open output: " << output.errorString().toStdString() << std::endl;
+            return -1;
+        }
+    } else {
+        output.open(stdout, QIODevice::WriteOnly);
+    }
+
+    auto report = [&](const Corpus &corpus, const QString &stage, option<qint64> chunk, qint64 bytes, const Run &run) {
+        double seconds = run.elapsedNs / 1e9;
+        double mibPerSecond = seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+
+        QJsonObject result {
+            {"corpus", corpus.name},
+            {"stage", stage},
+            {"iterations", iterations},
+            {"messages", qint64(run.messages)},
+            {"errors", qint64(run.errors)},
+            {"bytes", bytes},
+            {"seconds", seconds},
+            {"mibPerSecond", mibPerSecond},
+            {"messagesPerSecond", seconds > 0 ? run.messages / seconds : 0},
+            {"latencyNs", QJsonObject {
+                {"p50", qint64(run.latency.percentile(0.5))},
+                {"p90", qint64(run.latency.percentile(0.9))},
+                {"p99", qint64(run.latency.percentile(0.99))},
+                {"p999", qint64(run.latency.percentile(0.999))},
+                {"max", qint64(run.latency.max())},
+            }},
+            {"allocations", Allocations::available() ? QJsonValue(qint64(run.allocated.allocations)) : QJsonValue()},
+            {"allocatedBytes", Allocations::available() ? QJsonValue(qint64(run.allocated.bytes)) : QJsonValue()},
+        };
+
+        if (chunk) {
+            result["chunk"] = chunk.value();
+        }
+
+        output.write(QJsonDocument(result).toJson(QJsonDocument::Compact) + "\n");
+        output.flush();
+
+        QString name = stage + (chunk ? "/" + (chunk.value() > 0 ? QString::number(chunk.value()) : QString("all")) : QString());
+        std::cerr << QString::asprintf("%-16s %-16s %10.1f MiB/s %12.0f msg/s  p50 %9.2f us  p99 %9.2f us  %8.2f allocs/msg",
+            corpus.name.toUtf8().constData(), name.toUtf8().constData(), mibPerSecond, seconds > 0 ? run.messages / seconds : 0,
+            run.latency.percentile(0.5) / 1000.0, run.latency.percentile(0.99) / 1000.0,
+            run.messages > 0 ? double(run.allocated.allocations) / run.messages : 0).toStdString() << std::endl;
+    };
+
+    for (const Corpus &corpus : corpora) {
+        Streams streams;
+        qint64 streamBytes = 0;
+        for (Lsp::Entity sender : {Lsp::Entity::Client, Lsp::Entity::Server}) {
+            QByteArray stream = corpus.stream(sender);
+            if (!stream.isEmpty()) {
+                streamBytes += stream.size();
+                streams[sender] = stream;
+            }
+        }
+
+        for (qint64 chunk : chunks) {
+            auto run = fastest(iterations, [&]{ return runFrames(streams, chunk); });
+            report(corpus, "frame", chunk, streamBytes, *run);
+        }
+
+        Frames frames = collectFrames(streams);
+        auto parsed = fastest(iterations, [&]{ return runMessages(frames); });
+        report(corpus, "message", {}, corpus.bytes(), *parsed);
+
+        Messages messages = collectMessages(frames);
+        auto validated = fastest(iterations, [&]{ return runValidation(corpus, messages); });
+        report(corpus, "validate", {}, corpus.bytes(), *validated);
+    }
+
+    return 0;
+}
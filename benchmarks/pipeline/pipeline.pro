@@ -0,0 +1,18 @@
+TEMPLATE = app
+TARGET = pipeline-bench
+
+QT = core gui widgets concurrent
+
+CONFIG += c++20 console
+CONFIG -= app_bundle
+
+include(../../pipeline.pri)
+
+SOURCES += \
+    allocations.cpp \
+    corpus.cpp \
+    main.cpp
+
+HEADERS += \
+    allocations.h \
+    corpus.h
@@ -0,0 +1,222 @@
+#include "client.h"
+
+#include "monotonic.h"
+
+namespace ProxyBench {
+
+namespace {
+    /** How long Requests still in flight when the load ends may take to be answered */
+    constexpr int drainTimeoutMs = 5000;
+
+    /** Longest initialize may take to be answered */
+    constexpr int initializeTimeoutMs = 10000;
+
+    /** The id of a Response, which lspmonitor forwards exactly as the echo server wrote it */
+    qint64 responseId(const QByteArray &payload) {
+        int start = payload.indexOf("\"id\":");
+        if (start < 0) {
+            return -1;
+        }
+        start += 5;
+
+        int end = start;
+        while (end < payload.size() && payload.at(end) >= '0' && payload.at(end) <= '9') {
+            end++;
+        }
+
+        bool ok = false;
+        qint64 id = payload.mid(start, end - start).toLongLong(&ok);
+        return ok ? id : -1;
+    }
+}
+
+Client::Client(QStringList command, QProcessEnvironment environment, Load load, QObject *parent) :
+    QObject(parent), command(command), environment(environment), load(load) {
+
+    requestTail = ",\"method\":\"textDocument/hover\",\"params\":{\"textDocument\":{\"uri\":\"file:///bench.txt\"},"
+        "\"position\":{\"line\":0,\"character\":0},\"workDoneToken\":\"" + QByteArray(int(load.size), 'x') + "\"}}";
+
+    connect(&process, &QProcess::readyReadStandardOutput, this, [this]{ frames.onInput(process.readAllStandardOutput()); });
+    connect(&frames, &FrameBuilder::FrameBuilder::emitFrame, this, &Client::onFrame);
+
+    tick.setTimerType(Qt::PreciseTimer);
+    tick.setInterval(1);
+    connect(&tick, &QTimer::timeout, this, &Client::onTick);
+
+    deadline.setSingleShot(true);
+    deadline.setTimerType(Qt::PreciseTimer);
+    connect(&deadline, &QTimer::timeout, this, &Client::startDraining);
+
+    drainTimeout.setSingleShot(true);
+    connect(&drainTimeout, &QTimer::timeout, this, &Client::finish);
+}
+
+std::unique_ptr<Result> Client::run() {
+    result = std::make_unique<Result>();
+
+    process.setProcessEnvironment(environment);
+    process.setStandardErrorFile(QProcess::nullDevice());
+    process.start(command.first(), command.mid(1));
+    if (!process.waitForStarted()) {
+        result->error = "Failed to start " + command.first() + ": " + process.errorString();
+        return std::move(result);
+    }
+
+    QEventLoop running;
+    loop = &running;
+
+    connect(&process, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), &running, [this]{
+        result->error = "Exited during the run";
+        finish();
+    });
+
+    write("{\"jsonrpc\":\"2.0\",\"id\":0,\"method\":\"initialize\",\"params\":{\"processId\":null,\"rootUri\":null,\"capabilities\":{}}}");
+    drainTimeout.start(initializeTimeoutMs);
+
+    running.exec();
+    loop = nullptr;
+
+    process.disconnect(&running);
+    tick.stop();
+    deadline.stop();
+    drainTimeout.stop();
+
+    // The echo server exits when stdin closes, and so when a lspmonitor that stays running is killed
+    process.closeWriteChannel();
+    if (!process.waitForFinished(1000)) {
+        process.kill();
+        process.waitForFinished();
+    }
+
+    if (phase == Phase::Initializing && result->error.isEmpty()) {
+        result->error = "initialize was not answered";
+    }
+
+    return std::move(result);
+}
+
+void Client::onFrame(FrameBuilder::Frame frame) {
+    qint64 id = responseId(frame.payload);
+
+    if (phase == Phase::Initializing) {
+        if (id != 0) {
+            return;
+        }
+
+        drainTimeout.stop();
+        write("{\"jsonrpc\":\"2.0\",\"method\":\"initialized\",\"params\":{}}");
+        write("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":"
+            "{\"uri\":\"file:///bench.txt\",\"languageId\":\"plaintext\",\"version\":1,\"text\":\"bench\\n\"}}}");
+
+        phase = Phase::Warmup;
+        while (warmupSent < std::min(load.warmup, load.window)) {
+            warmupSent += 1;
+            send();
+        }
+
+        if (load.warmup <= 0) {
+            startMeasuring();
+        }
+        return;
+    }
+
+    auto it = pending.find(id);
+    if (it == pending.end()) {
+        return;
+    }
+
+    Sent sent = it.value();
+    pending.erase(it);
+
+    if (id >= firstMeasured && phase != Phase::Warmup) {
+        result->received += 1;
+        result->bytes += sent.bytes + frame.payload.size();
+        result->roundTrip.record(std::max<qint64>(frame.timing.lastByte - sent.at, 0));
+        lastResponse = frame.timing.lastByte;
+    }
+
+    switch (phase) {
+        case Phase::Initializing:
+            break;
+        case Phase::Warmup:
+            if (warmupSent < load.warmup) {
+                warmupSent += 1;
+                send();
+            } else if (pending.isEmpty()) {
+                startMeasuring();
+            }
+            break;
+        case Phase::Measuring:
+            if (load.rate <= 0) {
+                send();
+            }
+            break;
+        case Phase::Draining:
+            if (pending.isEmpty()) {
+                finish();
+            }
+            break;
+    }
+}
+
+void Client::onTick() {
+    qint64 due = qint64(load.rate * (monotonicNs() - start) / 1e9);
+    while (qint64(result->sent) < due) {
+        send();
+    }
+}
+
+void Client::startMeasuring() {
+    phase = Phase::Measuring;
+    firstMeasured = nextId;
+    start = monotonicNs();
+    lastResponse = start;
+
+    if (load.rate > 0) {
+        tick.start();
+    } else {
+        for (int i = 0; i < load.window; i++) {
+            send();
+        }
+    }
+
+    deadline.start(int(load.durationMs));
+}
+
+void Client::startDraining() {
+    phase = Phase::Draining;
+    tick.stop();
+
+    if (pending.isEmpty()) {
+        finish();
+    } else {
+        drainTimeout.start(drainTimeoutMs);
+    }
+}
+
+void Client::finish() {
+    result->lost = phase == Phase::Draining ? pending.size() : 0;
+    result->elapsedNs = lastResponse - start;
+
+    if (loop) {
+        loop->quit();
+    }
+}
+
+void Client::send() {
+    qint64 id = nextId++;
+    if (phase == Phase::Measuring) {
+        result->sent += 1;
+    }
+
+    qint64 at = monotonicNs();
+    qint64 bytes = write("{\"jsonrpc\":\"2.0\",\"id\":" + QByteArray::number(id) + requestTail);
+    pending.insert(id, Sent {at, bytes});
+}
+
+qint64 Client::write(const QByteArray &payload) {
+    process.write("Content-Length: " + QByteArray::number(payload.size()) + "\r\n\r\n" + payload);
+    return payload.size();
+}
+
+}
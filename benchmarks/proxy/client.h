@@ -0,0 +1,142 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <QEventLoop>
+#include <QObject>
+#include <QProcess>
+#include <QTimer>
+
+#include <memory>
+
+#include "framebuilder.h"
+#include "histogram.h"
+
+namespace ProxyBench {
+
+/** The load a run offers */
+struct Load {
+    /** Bytes of padding in each Request, echoed back in its Response */
+    qint64 size = 1024;
+
+    /** Requests per second, or 0 to keep `window` in flight, each sent as soon as one is answered */
+    double rate = 0;
+
+    int window = 16;
+
+    qint64 durationMs = 5000;
+
+    /** Requests answered (as fast as possible) before measuring starts */
+    int warmup = 200;
+};
+
+struct Result {
+    quint64 sent = 0;
+
+    quint64 received = 0;
+
+    /** Requests still unanswered once the drain timeout passed */
+    quint64 lost = 0;
+
+    /** From the first measured Request being sent to the last Response arriving */
+    qint64 elapsedNs = 0;
+
+    /** Payload bytes of the answered Requests and their Responses */
+    qint64 bytes = 0;
+
+    /** From writing a Request to reading the chunk that completes its Response (ns) */
+    Histogram roundTrip {};
+
+    /** Why the run failed, if it did */
+    QString error {};
+};
+
+/**
+ * A synthetic client for the echo server, connected directly or through
+ * lspmonitor. After initialize and a didOpen, it sends hover Requests padded
+ * to the load's size, at its rate or closed loop, and times every round trip.
+ */
+class Client : public QObject {
+    Q_OBJECT
+
+public:
+    Client(QStringList command, QProcessEnvironment environment, Load load, QObject *parent = nullptr);
+
+    /** Starts the command, runs the load against it and stops it */
+    std::unique_ptr<Result> run();
+
+private slots:
+    void onFrame(FrameBuilder::Frame frame);
+
+    /** Sends the Requests due by now at the load's rate */
+    void onTick();
+
+private:
+    /** A Request waiting for its Response */
+    struct Sent {
+        /** When it was written (ns, monotonic) */
+        qint64 at;
+
+        qint64 bytes;
+    };
+
+    enum class Phase {
+        Initializing,
+        Warmup,
+        Measuring,
+        Draining,
+    };
+
+    void startMeasuring();
+
+    void startDraining();
+
+    void finish();
+
+    void send();
+
+    /** Frames and writes a message, returning the payload's size */
+    qint64 write(const QByteArray &payload);
+
+    QStringList command;
+
+    QProcessEnvironment environment;
+
+    Load load;
+
+    QProcess process {};
+
+    FrameBuilder::FrameBuilder frames {};
+
+    std::unique_ptr<Result> result;
+
+    Phase phase = Phase::Initializing;
+
+    /** The padded params after the id, built once */
+    QByteArray requestTail {};
+
+    qint64 nextId = 1;
+
+    /** Ids from this one on are measured */
+    qint64 firstMeasured = 0;
+
+    /** By id */
+    QHash<qint64, Sent> pending {};
+
+    int warmupSent = 0;
+
+    qint64 start = 0;
+
+    qint64 lastResponse = 0;
+
+    QTimer tick {};
+
+    QTimer deadline {};
+
+    QTimer drainTimeout {};
+
+    QEventLoop *loop = nullptr;
+};
+
+}
+
+#endif // CLIENT_H
@@ -0,0 +1,127 @@
+#include "echo.h"
+
+#include <QByteArray>
+
+#include <cerrno>
+#include <unistd.h>
+
+namespace Echo {
+
+namespace {
+    bool writeAll(const QByteArray &data) {
+        qint64 written = 0;
+        while (written < data.size()) {
+            ssize_t n = ::write(STDOUT_FILENO, data.constData() + written, data.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            written += n;
+        }
+        return true;
+    }
+
+    /** The Content-Length of a header block, or -1 */
+    qint64 contentLength(const QByteArray &headers) {
+        for (const QByteArray &line : headers.split('\n')) {
+            int colon = line.indexOf(':');
+            if (colon > 0 && line.left(colon).trimmed().toLower() == "content-length") {
+                bool ok = false;
+                qint64 length = line.mid(colon + 1).trimmed().toLongLong(&ok);
+                return ok ? length : -1;
+            }
+        }
+        return -1;
+    }
+
+    /** The raw JSON of a member, up to the next ',' or '}', which is enough for the ids the client sends */
+    QByteArray scalar(const QByteArray &payload, const QByteArray &name) {
+        int start = payload.indexOf("\"" + name + "\":");
+        if (start < 0) {
+            return {};
+        }
+        start += name.size() + 3;
+
+        int end = start;
+        while (end < payload.size() && payload.at(end) != ',' && payload.at(end) != '}') {
+            end++;
+        }
+        return payload.mid(start, end - start);
+    }
+
+    /** The Response to a Request, or nothing for a notification. The client's messages are found in without parsing the JSON */
+    QByteArray respond(const QByteArray &request) {
+        QByteArray id = scalar(request, "id");
+        if (id.isEmpty()) {
+            return {};
+        }
+
+        QByteArray result;
+        if (scalar(request, "method") == "\"initialize\"") {
+            result = "{\"capabilities\":{\"hoverProvider\":true}}";
+        } else {
+            // The token is padding the client never escapes
+            QByteArray token;
+            int start = request.indexOf("\"workDoneToken\":\"");
+            if (start >= 0) {
+                start += 17;
+                token = request.mid(start, request.indexOf('"', start) - start);
+            }
+            result = "{\"contents\":{\"kind\":\"plaintext\",\"value\":\"" + token + "\"}}";
+        }
+
+        return "{\"jsonrpc\":\"2.0\",\"id\":" + id + ",\"result\":" + result + "}";
+    }
+}
+
+int run() {
+    QByteArray buffer;
+    char chunk[65536];
+
+    for (;;) {
+        ssize_t n = ::read(STDIN_FILENO, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        buffer.append(chunk, int(n));
+
+        // Answer every whole message read so far in one write
+        QByteArray out;
+        int offset = 0;
+        for (;;) {
+            int headersEnd = buffer.indexOf("\r\n\r\n", offset);
+            if (headersEnd < 0) {
+                break;
+            }
+
+            qint64 length = contentLength(buffer.mid(offset, headersEnd - offset));
+            if (length < 0) {
+                return 1;
+            }
+
+            int payloadStart = headersEnd + 4;
+            if (buffer.size() - payloadStart < length) {
+                break;
+            }
+
+            QByteArray response = respond(QByteArray::fromRawData(buffer.constData() + payloadStart, int(length)));
+            if (!response.isEmpty()) {
+                out += "Content-Length: " + QByteArray::number(response.size()) + "\r\n\r\n" + response;
+            }
+            offset = payloadStart + int(length);
+        }
+
+        buffer.remove(0, offset);
+
+        if (!out.isEmpty() && !writeAll(out)) {
+            return 1;
+        }
+    }
+}
+
+}
@@ -0,0 +1,17 @@
+#ifndef ECHO_H
+#define ECHO_H
+
+namespace Echo {
+
+/**
+ * A trivial language server on stdin and stdout: each Request is answered at
+ * once, a hover with the Request's workDoneToken as its contents, so the
+ * Response is as large as the Request. Notifications are dropped. Reads and
+ * writes block, so the server adds as little as possible to a round trip.
+ * Returns when stdin closes.
+ */
+int run();
+
+}
+
+#endif // ECHO_H
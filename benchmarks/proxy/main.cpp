@@ -0,0 +1,227 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#include "client.h"
+#include "echo.h"
+#include "option.h"
+
+namespace {
+
+/** How lspmonitor is run between the client and the echo server */
+struct Mode {
+    QString name;
+
+    /** Arguments before the server command, or none to connect the client directly */
+    option<QStringList> arguments;
+
+    /** Whether the GUI needs a platform, which is offscreen when there is no display */
+    bool gui = false;
+};
+
+option<Mode> parseMode(const QString &name, const QString &recordPath) {
+    if (name == "direct") {
+        return Mode {name, {}};
+    } else if (name == "gui") {
+        return Mode {name, QStringList {}, true};
+    } else if (name == "headless") {
+        return Mode {name, QStringList {"--headless"}};
+    } else if (name == "record") {
+        return Mode {name, QStringList {"--headless", "--record", recordPath}};
+    } else if (name == "forward") {
+        return Mode {name, QStringList {"--headless", "--no-analysis"}};
+    }
+    return {};
+}
+
+QJsonObject percentilesUs(const Histogram &histogram) {
+    return QJsonObject {
+        {"p50", histogram.percentile(0.5) / 1000.0},
+        {"p99", histogram.percentile(0.99) / 1000.0},
+        {"p999", histogram.percentile(0.999) / 1000.0},
+        {"max", histogram.max() / 1000.0},
+    };
+}
+
+}
+
+int main(int argc, char **argv) {
+    // The echo server is this binary too, so it starts without Qt in the way
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--echo") == 0) {
+            return Echo::run();
+        }
+    }
+
+    QCoreApplication app (argc, argv);
+    QCoreApplication::setApplicationName("proxy-bench");
+
+    QCommandLineParser parser {};
+    parser.setApplicationDescription("Measures what lspmonitor adds to the round trip and takes from the throughput of a client and server, "
+        "by running a synthetic client against an echo server directly and through lspmonitor in each mode. "
+        "Prints a JSON object per mode, size and rate on stdout, and a summary on stderr");
+    parser.addHelpOption();
+
+    QCommandLineOption lspmonitorOpt ( "lspmonitor", "Path to the lspmonitor binary", "path", QCoreApplication::applicationDirPath() + "/../../lspmonitor" );
+    parser.addOption(lspmonitorOpt);
+
+    QCommandLineOption modeOpt ( "mode", "Mode to run: direct, gui, headless, record or forward (--no-analysis). Repeatable, all by default", "name" );
+    parser.addOption(modeOpt);
+
+    QCommandLineOption sizesOpt ( "sizes", "Comma separated bytes of padding in each Request, and again in each Response", "sizes", "64,4096,65536,1048576" );
+    parser.addOption(sizesOpt);
+
+    QCommandLineOption ratesOpt ( "rates", "Comma separated Requests per second, 0 for as many as are answered (the maximum throughput)", "rates", "0,100,1000" );
+    parser.addOption(ratesOpt);
+
+    QCommandLineOption windowOpt ( "window", "Requests in flight at the rate 0", "count", "16" );
+    parser.addOption(windowOpt);
+
+    QCommandLineOption durationOpt ( "duration", "Seconds each mode, size and rate is measured for", "seconds", "5" );
+    parser.addOption(durationOpt);
+
+    QCommandLineOption warmupOpt ( "warmup", "Requests answered before measuring starts", "count", "200" );
+    parser.addOption(warmupOpt);
+
+    QCommandLineOption outputOpt ( QStringList { "o", "output" }, "Output file for the results (stdout by default)", "file" );
+    parser.addOption(outputOpt);
+
+    parser.process(app);
+
+    QTemporaryDir recordings;
+    if (!recordings.isValid()) {
+        std::cerr << "Unable to create a directory for recordings: " << recordings.errorString().toStdString() << std::endl;
+        return -1;
+    }
+
+    QStringList names = parser.values(modeOpt);
+    if (names.isEmpty()) {
+        names = QStringList {"direct", "gui", "headless", "record", "forward"};
+    }
+
+    // Direct first, so the others can be compared with it
+    if (names.removeAll("direct") > 0) {
+        names.prepend("direct");
+    }
+
+    QVector<Mode> modes;
+    for (const QString &name : names) {
+        auto mode = parseMode(name, recordings.filePath("capture.log"));
+        if (!mode) {
+            std::cerr << "Unknown mode: " << name.toStdString() << std::endl;
+            return -1;
+        }
+        modes.append(mode.value());
+    }
+
+    QVector<qint64> sizes;
+    for (const QString &size : parser.value(sizesOpt).split(',', Qt::SkipEmptyParts)) {
+        sizes.append(std::max<qint64>(size.trimmed().toLongLong(), 0));
+    }
+
+    QVector<double> rates;
+    for (const QString &rate : parser.value(ratesOpt).split(',', Qt::SkipEmptyParts)) {
+        rates.append(std::max(rate.trimmed().toDouble(), 0.0));
+    }
+
+    QFile output;
+    if (parser.isSet(outputOpt)) {
+        output.setFileName(parser.value(outputOpt));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            std::cerr << "Unable to open output: " << output.errorString().toStdString() << std::endl;
+            return -1;
+        }
+    } else {
+        output.open(stdout, QIODevice::WriteOnly);
+    }
+
+    QString lspmonitor = parser.value(lspmonitorOpt);
+    QStringList echo {QCoreApplication::applicationFilePath(), "--echo"};
+
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    QProcessEnvironment guiEnvironment = environment;
+    if (!environment.contains("DISPLAY") && !environment.contains("WAYLAND_DISPLAY") && !environment.contains("QT_QPA_PLATFORM")) {
+        guiEnvironment.insert("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    int failures = 0;
+
+    for (qint64 size : sizes) {
+        for (double rate : rates) {
+            // The direct round trip at this size and rate, which the others add to
+            option<QJsonObject> baseline;
+
+            for (const Mode &mode : modes) {
+                ProxyBench::Load load;
+                load.size = size;
+                load.rate = rate;
+                load.window = std::max(parser.value(windowOpt).toInt(), 1);
+                load.durationMs = qint64(std::max(parser.value(durationOpt).toDouble(), 0.1) * 1000);
+                load.warmup = std::max(parser.value(warmupOpt).toInt(), 0);
+
+                QStringList command = echo;
+                if (mode.arguments) {
+                    command = QStringList {lspmonitor} + mode.arguments.value() + QStringList {"--"} + echo;
+                }
+
+                ProxyBench::Client client (command, mode.gui ? guiEnvironment : environment, load);
+                auto run = client.run();
+
+                double seconds = run->elapsedNs / 1e9;
+                double messagesPerSecond = seconds > 0 ? run->received / seconds : 0;
+                double mibPerSecond = seconds > 0 ? run->bytes / (1024.0 * 1024.0) / seconds : 0;
+                QJsonObject roundTrip = percentilesUs(run->roundTrip);
+
+                QJsonObject result {
+                    {"mode", mode.name},
+                    {"size", size},
+                    {"rate", rate},
+                    {"window", rate > 0 ? QJsonValue() : QJsonValue(load.window)},
+                    {"sent", qint64(run->sent)},
+                    {"received", qint64(run->received)},
+                    {"lost", qint64(run->lost)},
+                    {"seconds", seconds},
+                    {"messagesPerSecond", messagesPerSecond},
+                    {"mibPerSecond", mibPerSecond},
+                    {"roundTripUs", roundTrip},
+                };
+
+                if (!run->error.isEmpty()) {
+                    result["error"] = run->error;
+                    failures += 1;
+                } else if (!mode.arguments) {
+                    baseline = roundTrip;
+                } else if (baseline) {
+                    QJsonObject added;
+                    for (const QString &key : {"p50", "p99", "p999"}) {
+                        added[key] = roundTrip.value(key).toDouble() - baseline->value(key).toDouble();
+                    }
+                    result["addedUs"] = added;
+                }
+
+                output.write(QJsonDocument(result).toJson(QJsonDocument::Compact) + "\n");
+                output.flush();
+
+                if (!run->error.isEmpty()) {
+                    std::cerr << QString::asprintf("%-9s %9lld B %8s  %s", mode.name.toUtf8().constData(), size,
+                        rate > 0 ? QString::number(rate).toUtf8().constData() : "max", run->error.toUtf8().constData()).toStdString() << std::endl;
+                    continue;
+                }
+
+                std::cerr << QString::asprintf("%-9s %9lld B %8s %10.0f msg/s %9.1f MiB/s  p50 %9.1f us  p99 %9.1f us  p99.9 %9.1f us%s",
+                    mode.name.toUtf8().constData(), size, rate > 0 ? QString::number(rate).toUtf8().constData() : "max",
+                    messagesPerSecond, mibPerSecond, roundTrip.value("p50").toDouble(), roundTrip.value("p99").toDouble(),
+                    roundTrip.value("p999").toDouble(), run->lost > 0 ? QString::asprintf("  %llu lost", run->lost).toUtf8().constData() : "").toStdString() << std::endl;
+            }
+        }
+    }
+
+    return failures > 0 ? 1 : 0;
+}
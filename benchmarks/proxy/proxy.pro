@@ -0,0 +1,18 @@
+TEMPLATE = app
+TARGET = proxy-bench
+
+QT = core gui widgets concurrent
+
+CONFIG += c++20 console
+CONFIG -= app_bundle
+
+include(../../pipeline.pri)
+
+SOURCES += \
+    client.cpp \
+    echo.cpp \
+    main.cpp
+
+HEADERS += \
+    client.h \
+    echo.h
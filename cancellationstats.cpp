@@ -0,0 +1,142 @@
+#include "cancellationstats.h"
+#include "metrics.h"
+
+#include <QVBoxLayout>
+#include <QHeaderView>
+
+CancellationStats::MethodCancellation& CancellationStats::entry(const Lsp::Request &request) {
+    auto &entry = methods[Key(request.getSender(), request.getMethod())];
+    if (!entry) {
+        entry = std::make_unique<MethodCancellation>();
+    }
+    return *entry;
+}
+
+void CancellationStats::onRequestCancelled(const std::shared_ptr<Lsp::Request> &request) {
+    entry(*request).cancelled += 1;
+}
+
+void CancellationStats::onRequestTimeout(const std::shared_ptr<Lsp::Request> &request) {
+    if (request->isCancelled()) {
+        entry(*request).unanswered += 1;
+    }
+}
+
+void CancellationStats::onLspMessage(const std::shared_ptr<Lsp::Message> &message) {
+    if (message->getKind() != Lsp::Message::Kind::Response) {
+        return;
+    }
+
+    auto response = static_cast<Lsp::Response*>(message.get());
+    auto request = response->getRequest();
+    if (!request || !request->isCancelled()) {
+        return;
+    }
+
+    auto &stats = entry(*request);
+    stats.afterCancel.record(response->getTimeAfterCancel() / 1000);
+
+    auto code = response->tryGetErrorCode();
+    if (!code) {
+        stats.completed += 1;
+        stats.wasted.record(std::max<qint64>(response->getServerTime(), 0) / 1000);
+    } else if (code.value() == int(Lsp::ErrorCodes::RequestCancelled) || code.value() == int(Lsp::ErrorCodes::ContentModified)) {
+        stats.honoured += 1;
+    } else {
+        stats.failed += 1;
+    }
+}
+
+const std::map<CancellationStats::Key, std::unique_ptr<CancellationStats::MethodCancellation>>& CancellationStats::getMethods() const {
+    return methods;
+}
+
+void CancellationStats::appendOpenMetrics(QByteArray &out) const {
+    using namespace Metrics::Exposition;
+
+    auto labels = [](const Key &key) {
+        return "sender=\"" + escapeLabel(Metrics::Registry::senderLabel(key.first)) + "\",method=\"" + escapeLabel(key.second) + "\"";
+    };
+
+    family(out, "lspmonitor_cancelled_requests_total", "counter", "Requests cancelled with $/cancelRequest, by requesting entity, method and how the server answered");
+    for (auto &entry : methods) {
+        const std::pair<const char*, quint64> outcomes[] = {
+            {"honoured", entry.second->honoured},
+            {"completed", entry.second->completed},
+            {"failed", entry.second->failed},
+            {"unanswered", entry.second->unanswered},
+        };
+
+        for (auto &outcome : outcomes) {
+            sample(out, "lspmonitor_cancelled_requests_total", labels(entry.first) + ",outcome=\"" + outcome.first + "\"", outcome.second);
+        }
+    }
+
+    family(out, "lspmonitor_cancel_linger_seconds", "histogram", "Time from $/cancelRequest to the Response, by requesting entity and method");
+    for (auto &entry : methods) {
+        if (entry.second->afterCancel.count() > 0) {
+            histogram(out, "lspmonitor_cancel_linger_seconds", labels(entry.first), entry.second->afterCancel, 1e6);
+        }
+    }
+
+    family(out, "lspmonitor_cancel_wasted_seconds", "histogram", "Server time of cancelled Requests that were completed anyway, by requesting entity and method");
+    for (auto &entry : methods) {
+        if (entry.second->wasted.count() > 0) {
+            histogram(out, "lspmonitor_cancel_wasted_seconds", labels(entry.first), entry.second->wasted, 1e6);
+        }
+    }
+}
+
+CancellationPanel::CancellationPanel(const CancellationStats &stats, QWidget *parent) : QWidget(parent), stats(stats) {
+    auto layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(&table);
+
+    table.setColumnCount(10);
+    table.setHorizontalHeaderLabels({"Sender", "Method", "Cancelled", "Honoured", "Completed anyway", "Other error", "Unanswered", "p50 after cancel (ms)", "p99 after cancel (ms)", "Wasted server time (ms)"});
+    table.setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table.verticalHeader()->hide();
+    table.horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+
+    connect(&timer, &QTimer::timeout, this, &CancellationPanel::refresh);
+    timer.start(1000);
+}
+
+void CancellationPanel::refresh() {
+    if (!isVisible()) {
+        return;
+    }
+
+    auto millis = [](quint64 us) { return QString::number(us / 1000.0, 'f', 2); };
+
+    table.setRowCount(stats.getMethods().size());
+
+    int row = 0;
+    for (auto &entry : stats.getMethods()) {
+        const auto &cancellation = *entry.second;
+
+        QStringList cells {
+            entry.first.first == Lsp::Entity::Client ? "Client" : "Server",
+            entry.first.second,
+            QString::number(cancellation.cancelled),
+            QString::number(cancellation.honoured),
+            QString::number(cancellation.completed),
+            QString::number(cancellation.failed),
+            QString::number(cancellation.unanswered),
+            millis(cancellation.afterCancel.percentile(0.5)),
+            millis(cancellation.afterCancel.percentile(0.99)),
+            millis(cancellation.wasted.sum()),
+        };
+
+        for (int column = 0; column < cells.size(); column++) {
+            auto item = table.item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem();
+                table.setItem(row, column, item);
+            }
+            item->setText(cells[column]);
+        }
+
+        row += 1;
+    }
+}
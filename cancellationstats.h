@@ -0,0 +1,84 @@
+#ifndef CANCELLATIONSTATS_H
+#define CANCELLATIONSTATS_H
+
+#include <QWidget>
+#include <QTableWidget>
+#include <QTimer>
+
+#include <map>
+#include <memory>
+
+#include "histogram.h"
+#include "lspschemavalidator.h"
+
+/**
+ * Per-method outcomes of Requests cancelled with $/cancelRequest. A server
+ * that honours cancellation answers quickly with RequestCancelled (or
+ * ContentModified); one that ignores it keeps working and sends the result
+ * anyway, which is wasted work.
+ */
+class CancellationStats {
+public:
+    struct MethodCancellation {
+        quint64 cancelled = 0;
+
+        /** Answered with a RequestCancelled or ContentModified error */
+        quint64 honoured = 0;
+
+        /** Answered with a result, i.e. the work was completed anyway */
+        quint64 completed = 0;
+
+        /** Answered with some other error */
+        quint64 failed = 0;
+
+        /** Never answered within the request timeout */
+        quint64 unanswered = 0;
+
+        /** Last byte of the cancel to last byte of the Response (µs) */
+        Histogram afterCancel {};
+
+        /** Server time of the Requests that were completed anyway (µs) */
+        Histogram wasted {};
+    };
+
+    /** Keyed by the requesting entity and the method */
+    using Key = std::pair<Lsp::Entity, QString>;
+
+    void onRequestCancelled(const std::shared_ptr<Lsp::Request> &request);
+
+    void onRequestTimeout(const std::shared_ptr<Lsp::Request> &request);
+
+    void onLspMessage(const std::shared_ptr<Lsp::Message> &message);
+
+    const std::map<Key, std::unique_ptr<MethodCancellation>>& getMethods() const;
+
+    /** Appends the cancellation metrics in the OpenMetrics text format */
+    void appendOpenMetrics(QByteArray &out) const;
+
+private:
+    MethodCancellation& entry(const Lsp::Request &request);
+
+    std::map<Key, std::unique_ptr<MethodCancellation>> methods {};
+};
+
+/**
+ * Table of the CancellationStats of every method, refreshed periodically
+ */
+class CancellationPanel : public QWidget {
+    Q_OBJECT
+
+public:
+    CancellationPanel(const CancellationStats &stats, QWidget *parent = nullptr);
+
+public slots:
+    void refresh();
+
+private:
+    const CancellationStats &stats;
+
+    QTableWidget table {};
+
+    QTimer timer {};
+};
+
+#endif // CANCELLATIONSTATS_H
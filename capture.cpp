@@ -0,0 +1,116 @@
+#include "capture.h"
+
+namespace Capture {
+
+Record::Record(Kind kind, qint64 timestamp, QByteArray data, double value) : kind(kind), timestamp(timestamp), data(data), value(value) {}
+
+Reader::Reader(QIODevice *device) : device(device) {}
+
+bool Reader::next(Record &record) {
+    while (!device->atEnd()) {
+        QByteArray raw = device->readLine();
+        line += 1;
+
+        if (raw.endsWith('\n')) {
+            raw.chop(1);
+        }
+        if (raw.endsWith('\r')) {
+            raw.chop(1);
+        }
+
+        if (raw.isEmpty()) {
+            continue;
+        }
+
+        QByteArray marker = raw.left(3);
+        if (marker == "<--") {
+            record.kind = Record::Kind::ClientMessage;
+        } else if (marker == "-->") {
+            record.kind = Record::Kind::ServerMessage;
+        } else if (marker == "!!!") {
+            record.kind = Record::Kind::Stderr;
+        } else if (marker == "###") {
+            record.kind = Record::Kind::Counter;
+        } else {
+            error = "Unknown record marker on line " + QString::number(line);
+            return false;
+        }
+
+        int timestampEnd = raw.indexOf(' ', 4);
+        if (raw.size() < 5 || raw.at(3) != ' ' || timestampEnd < 0) {
+            timestampEnd = raw.size();
+        }
+
+        bool success = false;
+        record.timestamp = raw.mid(4, timestampEnd - 4).toLongLong(&success);
+        if (!success) {
+            error = "Invalid timestamp on line " + QString::number(line);
+            return false;
+        }
+
+        record.data = raw.mid(timestampEnd + 1);
+        record.value = 0;
+
+        if (record.kind == Record::Kind::Counter) {
+            int valueStart = record.data.lastIndexOf(' ');
+            record.value = record.data.mid(valueStart + 1).toDouble(&success);
+            if (valueStart < 0 || !success) {
+                error = "Invalid counter value on line " + QString::number(line);
+                return false;
+            }
+            record.data.truncate(valueStart);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Reader::errorOccurred() const {
+    return !error.isEmpty();
+}
+
+QString Reader::errorString() const {
+    return error;
+}
+
+Writer::Writer(QIODevice *device) : device(device) {}
+
+void Writer::write(const Record &record) {
+    QByteArray line;
+
+    switch (record.kind) {
+        case Record::Kind::ClientMessage:
+            line.append("<--");
+            break;
+        case Record::Kind::ServerMessage:
+            line.append("-->");
+            break;
+        case Record::Kind::Stderr:
+            line.append("!!!");
+            break;
+        case Record::Kind::Counter:
+            line.append("###");
+            break;
+    }
+
+    line.append(' ');
+    line.append(QByteArray::number(record.timestamp));
+    line.append(' ');
+    line.append(record.data);
+
+    if (record.kind == Record::Kind::Counter) {
+        line.append(' ');
+        line.append(QByteArray::number(record.value, 'g', 12));
+    }
+
+    line.append('\n');
+    device->write(line);
+}
+
+void Writer::writeMessage(bool fromClient, qint64 timestamp, const QJsonDocument &contents) {
+    write(Record(fromClient ? Record::Kind::ClientMessage : Record::Kind::ServerMessage, timestamp, contents.toJson(QJsonDocument::Compact)));
+}
+
+}
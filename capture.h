@@ -0,0 +1,77 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <QtCore>
+
+namespace Capture {
+
+/**
+ * A single line of a capture file. Captures are line based, with each line
+ * being a three character marker, the timestamp (ms since epoch), and the data:
+ *
+ *     <-- 1589000000000 {"jsonrpc":"2.0",...}     message sent by the client
+ *     --> 1589000000001 {"jsonrpc":"2.0",...}     message sent by the server
+ *     !!! 1589000000002 some server stderr text   line of server stderr
+ *     ### 1589000000003 server.cpu 12.5           sample of a named counter
+ */
+struct Record {
+    enum class Kind {
+        ClientMessage,
+        ServerMessage,
+        Stderr,
+        Counter,
+    } kind;
+
+    qint64 timestamp;
+
+    /** The message JSON, stderr text, or counter name */
+    QByteArray data;
+
+    /** The counter value (Counter records only) */
+    double value = 0;
+
+    Record() = default;
+
+    Record(Kind kind, qint64 timestamp, QByteArray data, double value = 0);
+};
+
+/**
+ * Reads records from a capture one at a time, so arbitrarily large captures
+ * can be processed in constant memory
+ */
+class Reader {
+public:
+    explicit Reader(QIODevice *device);
+
+    /** Reads the next record, returning false at the end of the capture or on error */
+    bool next(Record &record);
+
+    /** If reading stopped because of a malformed line */
+    bool errorOccurred() const;
+
+    QString errorString() const;
+
+private:
+    QIODevice *device;
+
+    long line = 0;
+
+    QString error {};
+};
+
+class Writer {
+public:
+    explicit Writer(QIODevice *device);
+
+    void write(const Record &record);
+
+    /** Convenience for Record::Kind::ClientMessage / ServerMessage */
+    void writeMessage(bool fromClient, qint64 timestamp, const QJsonDocument &contents);
+
+private:
+    QIODevice *device;
+};
+
+}
+
+#endif // CAPTURE_H
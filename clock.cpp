@@ -0,0 +1,50 @@
+#include "clock.h"
+#include "monotonic.h"
+
+#include <QDateTime>
+#include <QTimer>
+
+Clock* Clock::system() {
+    static SystemClock clock;
+    return &clock;
+}
+
+qint64 SystemClock::timestamp() const {
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+qint64 SystemClock::monotonic() const {
+    return monotonicNs();
+}
+
+void SystemClock::callAfter(qint64 delay, QObject *context, std::function<void()> function) {
+    QTimer::singleShot(int(std::max<qint64>(delay, 0)), context, std::move(function));
+}
+
+VirtualClock::VirtualClock(qint64 timestamp) : now(timestamp) {}
+
+qint64 VirtualClock::timestamp() const {
+    return now;
+}
+
+qint64 VirtualClock::monotonic() const {
+    return now * 1000000;
+}
+
+void VirtualClock::callAfter(qint64 delay, QObject *context, std::function<void()> function) {
+    calls.emplace(now + std::max<qint64>(delay, 0), Call {context, std::move(function)});
+}
+
+void VirtualClock::advanceTo(qint64 timestamp) {
+    // Calls may make more calls, which run too if they come due in time
+    while (!calls.empty() && calls.begin()->first <= timestamp) {
+        auto call = calls.extract(calls.begin());
+        now = std::max(now, call.key());
+
+        if (call.mapped().context) {
+            call.mapped().function();
+        }
+    }
+
+    now = std::max(now, timestamp);
+}
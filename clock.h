@@ -0,0 +1,77 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <QObject>
+#include <QPointer>
+
+#include <functional>
+#include <map>
+
+/**
+ * Where the pipeline gets the time from: the wall clock time messages are
+ * stamped with, the monotonic time their frames are timed by, and delays
+ * (such as the message list's debouncing). Everything defaults to the
+ * system clock; a VirtualClock makes analysis depend only on its input.
+ */
+class Clock {
+public:
+    virtual ~Clock() = default;
+
+    /** Wall clock time (ms since epoch) */
+    virtual qint64 timestamp() const = 0;
+
+    /** Monotonic time (ns), as used by FrameTiming */
+    virtual qint64 monotonic() const = 0;
+
+    /** Calls the function once delay (ms) has passed on this clock, unless context is destroyed first */
+    virtual void callAfter(qint64 delay, QObject *context, std::function<void()> function) = 0;
+
+    /** The real time */
+    static Clock* system();
+};
+
+class SystemClock : public Clock {
+public:
+    qint64 timestamp() const override;
+
+    qint64 monotonic() const override;
+
+    void callAfter(qint64 delay, QObject *context, std::function<void()> function) override;
+};
+
+/**
+ * A clock that only moves when it is told to, such as to the timestamps of a
+ * capture as it is read. Monotonic time is the wall clock time in ns, so it
+ * has the capture's ms resolution.
+ */
+class VirtualClock : public Clock {
+public:
+    explicit VirtualClock(qint64 timestamp = 0);
+
+    qint64 timestamp() const override;
+
+    qint64 monotonic() const override;
+
+    void callAfter(qint64 delay, QObject *context, std::function<void()> function) override;
+
+    /**
+     * Moves the clock forward to the time (ms since epoch), running the
+     * calls that come due in order, each with the clock at its own time.
+     * The clock never goes backwards.
+     */
+    void advanceTo(qint64 timestamp);
+
+private:
+    struct Call {
+        QPointer<QObject> context;
+
+        std::function<void()> function;
+    };
+
+    qint64 now;
+
+    /** By due time, and in the order they were made within the same time */
+    std::multimap<qint64, Call> calls {};
+};
+
+#endif // CLOCK_H
@@ -1,4 +1,8 @@
 #include "communicationmodel.h"
+#include "capture.h"
+#include "pipelineprofiler.h"
+
+#include <QBuffer>
 #include <QFileDialog>
 #include <QMessageBox>
 
@@ -34,42 +38,86 @@ QVariant CommunicationModel::data(const QModelIndex &index, int role) const {
     }
 }
 
+std::shared_ptr<Lsp::Message> CommunicationModel::messageAt(int row) const {
+    return messages[row];
+}
+
 void CommunicationModel::append(std::shared_ptr<Lsp::Message> msg) {
     append(QVector<std::shared_ptr<Lsp::Message>> { msg });
 }
 
 void CommunicationModel::append(QVector<std::shared_ptr<Lsp::Message>> msgs) {
-    int index = messages.size() + debounceBuffer.size();
+    PROFILE_STAGE(Profiling::Stage::ModelInsert);
+
+    int index = messages.size() + debounceBuffer.size() + dropped;
     for (auto msg : msgs) {
         msg->setIndex(index);
         index += 1;
     }
 
+    if (!retaining) {
+        dropped += msgs.size();
+        return;
+    }
+
     if (debouncing) {
         debounceBuffer.append(msgs);
         return;
     }
 
     debouncing = true;
-    QTimer::singleShot(debouncems, this, &CommunicationModel::onDebounceEnd);
+    clock->callAfter(debouncems, this, [this]{ onDebounceEnd(); });
 
     beginInsertRows(QModelIndex(), messages.size(), messages.size() + msgs.size() - 1);
     messages.append(msgs);
     endInsertRows();
 }
 
+void CommunicationModel::setClock(Clock *clock) {
+    this->clock = clock;
+}
+
+Clock* CommunicationModel::getClock() const {
+    return clock;
+}
+
+void CommunicationModel::setRetaining(bool retaining) {
+    this->retaining = retaining;
+}
+
+void CommunicationModel::appendStderr(qint64 timestamp, QString line) {
+    if (!retaining) {
+        return;
+    }
+
+    stderrLines.append({timestamp, line});
+}
+
+void CommunicationModel::refresh(std::shared_ptr<Lsp::Message> msg) {
+    int row = msg->getIndex();
+
+    // Still in the debounce buffer; it is painted fresh once inserted
+    if (row < 0 || row >= messages.size()) {
+        return;
+    }
+
+    emit dataChanged(index(row), index(row));
+}
+
 void CommunicationModel::onDebounceEnd() {
     if (debounceBuffer.isEmpty()) {
         debouncing = false;
         return;
     }
 
+    PROFILE_STAGE(Profiling::Stage::ModelInsert);
+
     beginInsertRows(QModelIndex(), messages.size(), messages.size() + debounceBuffer.size() - 1);
     messages.append(debounceBuffer);
     endInsertRows();
 
     debounceBuffer.clear();
-    QTimer::singleShot(debouncems, this, &CommunicationModel::onDebounceEnd);
+    clock->callAfter(debouncems, this, [this]{ onDebounceEnd(); });
 }
 
 void CommunicationModel::save() {
@@ -92,19 +140,24 @@ void CommunicationModel::save() {
 
 QByteArray CommunicationModel::serialize() {
     QByteArray data;
+    QBuffer buffer (&data);
+    buffer.open(QIODevice::WriteOnly);
+
+    Capture::Writer writer (&buffer);
+
+    // Messages and stderr lines are each in time order; merge them
+    auto line = stderrLines.begin();
 
     for (auto msg : messages) {
-        if (msg->getSender() == Lsp::Entity::Client) {
-            data.append("<--");
-        } else {
-            data.append("-->");
+        for (; line != stderrLines.end() && line->first <= msg->getTimestamp(); line++) {
+            writer.write(Capture::Record(Capture::Record::Kind::Stderr, line->first, line->second.toUtf8()));
         }
 
-        data.append(" " + QString::number(msg->getTimestamp()));
-
-        data.append(" " + msg->getContents().toJson(QJsonDocument::Compact));
+        writer.writeMessage(msg->getSender() == Lsp::Entity::Client, msg->getTimestamp(), msg->getContents());
+    }
 
-        data.append("\n");
+    for (; line != stderrLines.end(); line++) {
+        writer.write(Capture::Record(Capture::Record::Kind::Stderr, line->first, line->second.toUtf8()));
     }
 
     return data;
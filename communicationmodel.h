@@ -7,6 +7,7 @@
 #include <QIcon>
 #include <QSortFilterProxyModel>
 
+#include "clock.h"
 #include "lspschemavalidator.h"
 
 struct LspMessageItem {
@@ -33,11 +34,30 @@ public:
 
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 
+    std::shared_ptr<Lsp::Message> messageAt(int row) const;
+
+    /** The clock appends are debounced by, and views take the current time from */
+    void setClock(Clock *clock);
+
+    Clock* getClock() const;
+
+    /**
+     * Whether appended messages and stderr lines are kept. Without a view nothing
+     * reads them back, so headless modes turn this off and the model only numbers
+     * the messages, keeping its memory flat however long the session runs
+     */
+    void setRetaining(bool retaining);
+
 public slots:
     void append(std::shared_ptr<Lsp::Message> msg);
 
     void append(QVector<std::shared_ptr<Lsp::Message>> msgs);
 
+    void appendStderr(qint64 timestamp, QString line);
+
+    /** Repaints a message whose state changed after it was appended */
+    void refresh(std::shared_ptr<Lsp::Message> msg);
+
     void save();
 
     void entered(const QModelIndex &index);
@@ -50,8 +70,18 @@ private:
 
     QVector<std::shared_ptr<Lsp::Message>> debounceBuffer {};
 
+    /** Lines the server wrote to stderr, kept so they can be saved with the messages */
+    QVector<std::pair<qint64, QString>> stderrLines {};
+
     bool debouncing = false;
 
+    bool retaining = true;
+
+    /** Messages numbered while not retaining, so indexes stay unique */
+    int dropped = 0;
+
+    Clock *clock = Clock::system();
+
     int debouncems = 100;
 
     QByteArray serialize();
@@ -108,7 +138,17 @@ public:
         if (msg->getKind() == Lsp::Message::Kind::Response) {
             auto response = static_cast<Lsp::Response*>(msg.get());
             auto duration = response->getDuration();
-            sum += "(+" + QString::number(duration) + ") ";
+            if (response->getRequest()) {
+                auto server = response->getServerTime() / 1000000;
+                auto transfer = response->getTransferTime() / 1000000;
+                sum += "(+" + QString::number(duration) + ": " + QString::number(server) + " server, " + QString::number(transfer) + " transfer";
+                if (response->getTimeAfterCancel() >= 0) {
+                    sum += ", " + QString::number(response->getTimeAfterCancel() / 1000000) + " after cancel";
+                }
+                sum += ") ";
+            } else {
+                sum += "(+" + QString::number(duration) + ") ";
+            }
         }
 
         switch (msg->getSender()) {
@@ -135,6 +175,12 @@ public:
                 break;
             case Lsp::Message::Kind::Request:
                 sum += "Request (" + QString::number(msg->getContents()["id"].toInt()) + ", " + method + ")";
+                if (static_cast<Lsp::Request*>(msg.get())->isCancelled()) {
+                    sum += " [cancelled]";
+                }
+                if (static_cast<Lsp::Request*>(msg.get())->isTimedOut()) {
+                    sum += " [timed out]";
+                }
                 icon = requestClient;
                 break;
             case Lsp::Message::Kind::Response:
@@ -149,6 +195,10 @@ public:
                 break;
         }
 
+        if (msg->getBatchCount() > 0) {
+            sum += " [batch " + QString::number(msg->getBatchPosition() + 1) + "/" + QString::number(msg->getBatchCount()) + "]";
+        }
+
         sum += " with " + QString::number(msg->getIssueCount()) + " issues";
         QString text = sum;
 
@@ -305,6 +355,8 @@ public:
     DetailedViewWidget(QWidget *parent = nullptr) : QWidget(parent) {
         layout.addWidget(&methodLabel);
 
+        layout.addWidget(&issuesLabel);
+
         layout.addWidget(&contents);
 
         setLayout(&layout);
@@ -314,6 +366,9 @@ public slots:
     void onMessageChange(std::shared_ptr<Lsp::Message> msg) {
         methodLabel.setText(msg->tryGetMethod().value_or("NO METHOD") + " (" + QString::number(msg->getSize()) + "b)");
 
+        issuesLabel.setText(msg->getIssues().toString().trimmed());
+        issuesLabel.setVisible(!msg->getIssues().isEmpty());
+
         contents.setText(msg->getContents().toJson(QJsonDocument::Indented));
     };
 
@@ -322,6 +377,8 @@ private:
 
     QLabel methodLabel {};
 
+    QLabel issuesLabel {};
+
     QTextEdit contents {};
 
 };
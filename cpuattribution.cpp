@@ -0,0 +1,202 @@
+#include "cpuattribution.h"
+#include "metrics.h"
+
+#include <QVBoxLayout>
+#include <QHeaderView>
+
+void CpuAttribution::onLspMessage(const std::shared_ptr<Lsp::Message> &message) {
+    // Nothing can be attributed until resources are being sampled
+    if (!previous) {
+        return;
+    }
+
+    if (message->getKind() == Lsp::Message::Kind::Request && message->getSender() == Lsp::Entity::Client) {
+        auto request = static_cast<Lsp::Request*>(message.get());
+        if (!request->getId().isValid()) {
+            return;
+        }
+
+        QString key = idKey(request->getId());
+
+        // An answered Request's id may be reused before the next sample finishes it
+        auto it = inFlight.find(key);
+        if (it != inFlight.end() && it->second.end >= 0) {
+            finish(it->second);
+            inFlight.erase(it);
+        }
+
+        if (int(inFlight.size()) >= inFlightLimit) {
+            return;
+        }
+
+        inFlight.emplace(key, InFlight {request->getMethod(), request->getTiming().lastByte});
+    } else if (message->getKind() == Lsp::Message::Kind::Response && message->getSender() == Lsp::Entity::Server) {
+        auto request = static_cast<Lsp::Response*>(message.get())->getRequest();
+        if (!request) {
+            return;
+        }
+
+        auto it = inFlight.find(idKey(request->getId()));
+        if (it != inFlight.end() && it->second.end < 0) {
+            it->second.end = message->getTiming().lastByte;
+        }
+    }
+}
+
+void CpuAttribution::onRequestTimeout(const std::shared_ptr<Lsp::Request> &request) {
+    // The server may still be working on it, but it can't be told apart from the rest any more
+    auto it = inFlight.find(idKey(request->getId()));
+    if (it != inFlight.end() && it->second.end < 0) {
+        idleSeconds += it->second.cpuSeconds;
+        inFlight.erase(it);
+    }
+}
+
+void CpuAttribution::onSample(const ResourceSampler::Sample &sample) {
+    if (!previous) {
+        previous = sample;
+        return;
+    }
+
+    qint64 from = previous->monotonic;
+    qint64 to = sample.monotonic;
+    double used = std::max(sample.cpuSeconds - previous->cpuSeconds, 0.0);
+    previous = sample;
+
+    // Time each Request was in flight within the interval
+    double total = 0;
+    std::vector<std::pair<InFlight*, qint64>> shares;
+    shares.reserve(inFlight.size());
+
+    for (auto &entry : inFlight) {
+        InFlight &request = entry.second;
+        qint64 overlap = std::min(request.end < 0 ? to : request.end, to) - std::max(request.start, from);
+        if (overlap > 0) {
+            shares.emplace_back(&request, overlap);
+            total += overlap;
+        }
+    }
+
+    if (total == 0) {
+        idleSeconds += used;
+    } else {
+        for (auto &share : shares) {
+            share.first->cpuSeconds += used * share.second / total;
+        }
+    }
+
+    for (auto it = inFlight.begin(); it != inFlight.end();) {
+        const InFlight &request = it->second;
+        if (request.end < 0 || request.end > to) {
+            ++it;
+            continue;
+        }
+
+        finish(request);
+        it = inFlight.erase(it);
+    }
+}
+
+void CpuAttribution::finish(const InFlight &request) {
+    auto &method = methods[request.method];
+    if (!method) {
+        method = std::make_unique<MethodCpu>();
+    }
+
+    method->requests += 1;
+    method->cpuSeconds += request.cpuSeconds;
+    method->perRequest.record(quint64(request.cpuSeconds * 1e6));
+}
+
+QString CpuAttribution::idKey(const Lsp::Id &id) {
+    return id.isString() ? "s" + id.getString() : "n" + QString::number(id.getNumber());
+}
+
+const std::map<QString, std::unique_ptr<CpuAttribution::MethodCpu>>& CpuAttribution::getMethods() const {
+    return methods;
+}
+
+double CpuAttribution::getIdleSeconds() const {
+    return idleSeconds;
+}
+
+void CpuAttribution::appendOpenMetrics(QByteArray &out) const {
+    using namespace Metrics::Exposition;
+
+    if (!previous) {
+        return;
+    }
+
+    family(out, "lspmonitor_request_cpu_seconds", "histogram", "Server CPU time attributed to each Request from the client, by method");
+    for (auto &entry : methods) {
+        histogram(out, "lspmonitor_request_cpu_seconds", "method=\"" + escapeLabel(entry.first) + "\"", entry.second->perRequest, 1e6);
+    }
+
+    family(out, "lspmonitor_server_idle_cpu_seconds_total", "counter", "Server CPU time used while no Request from the client was in flight");
+    sample(out, "lspmonitor_server_idle_cpu_seconds_total", "", idleSeconds);
+}
+
+ResourcePanel::ResourcePanel(const ResourceSampler &sampler, const CpuAttribution &attribution, QWidget *parent) : QWidget(parent), sampler(sampler), attribution(attribution) {
+    auto layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(&summary);
+    layout->addWidget(&table);
+
+    table.setColumnCount(5);
+    table.setHorizontalHeaderLabels({"Method", "Requests", "CPU (s)", "Mean CPU (ms)", "p99 CPU (ms)"});
+    table.setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table.verticalHeader()->hide();
+    table.horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+
+    connect(&timer, &QTimer::timeout, this, &ResourcePanel::refresh);
+    timer.start(1000);
+}
+
+void ResourcePanel::refresh() {
+    if (!isVisible()) {
+        return;
+    }
+
+    if (sampler.getSamples().empty()) {
+        summary.setText(ResourceSampler::isSupported() ? "No samples of the server yet" : "Server resources can only be sampled on Linux");
+    } else {
+        const auto &last = sampler.getSamples().back();
+        summary.setText(QString("CPU %1% (%2 s total, %3 s idle), RSS %4 MiB, %5 threads in %6 processes, %7 MiB read, %8 MiB written")
+            .arg(sampler.cpuLoad() * 100, 0, 'f', 0)
+            .arg(last.cpuSeconds, 0, 'f', 1)
+            .arg(attribution.getIdleSeconds(), 0, 'f', 1)
+            .arg(last.residentBytes / (1024.0 * 1024.0), 0, 'f', 1)
+            .arg(last.threads)
+            .arg(last.processes)
+            .arg(last.readBytes / (1024.0 * 1024.0), 0, 'f', 1)
+            .arg(last.writeBytes / (1024.0 * 1024.0), 0, 'f', 1));
+    }
+
+    auto millis = [](quint64 us) { return QString::number(us / 1000.0, 'f', 2); };
+
+    table.setRowCount(attribution.getMethods().size());
+
+    int row = 0;
+    for (auto &entry : attribution.getMethods()) {
+        const auto &cpu = *entry.second;
+
+        QStringList cells {
+            entry.first,
+            QString::number(cpu.requests),
+            QString::number(cpu.cpuSeconds, 'f', 3),
+            QString::number(cpu.requests ? cpu.cpuSeconds * 1000 / cpu.requests : 0, 'f', 2),
+            millis(cpu.perRequest.percentile(0.99)),
+        };
+
+        for (int column = 0; column < cells.size(); column++) {
+            auto item = table.item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem();
+                table.setItem(row, column, item);
+            }
+            item->setText(cells[column]);
+        }
+
+        row += 1;
+    }
+}
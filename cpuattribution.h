@@ -0,0 +1,108 @@
+#ifndef CPUATTRIBUTION_H
+#define CPUATTRIBUTION_H
+
+#include <QWidget>
+#include <QLabel>
+#include <QTableWidget>
+#include <QTimer>
+
+#include <map>
+#include <memory>
+
+#include "histogram.h"
+#include "lspschemavalidator.h"
+#include "resourcesampler.h"
+
+/**
+ * Splits the server's CPU time between the client's Requests. The CPU used
+ * between two samples is shared by the Requests in flight in that interval, in
+ * proportion to how much of it each was in flight for; CPU used while nothing
+ * was in flight (such as diagnostics after a didChange) is counted as idle.
+ *
+ * A Request's share is final at the first sample after its Response, when it
+ * is added to the totals of its method.
+ */
+class CpuAttribution {
+public:
+    struct MethodCpu {
+        quint64 requests = 0;
+
+        double cpuSeconds = 0;
+
+        /** CPU time of each Request (µs) */
+        Histogram perRequest {};
+    };
+
+    /** Requests tracked at most, in case their Responses are never seen */
+    static constexpr int inFlightLimit = 4096;
+
+    void onLspMessage(const std::shared_ptr<Lsp::Message> &message);
+
+    void onRequestTimeout(const std::shared_ptr<Lsp::Request> &request);
+
+    void onSample(const ResourceSampler::Sample &sample);
+
+    const std::map<QString, std::unique_ptr<MethodCpu>>& getMethods() const;
+
+    /** CPU time used while no Request was in flight (s) */
+    double getIdleSeconds() const;
+
+    /** Appends the CPU attribution metrics in the OpenMetrics text format */
+    void appendOpenMetrics(QByteArray &out) const;
+
+private:
+    struct InFlight {
+        QString method;
+
+        /** Last byte of the Request, and of its Response or -1 (ns, monotonic) */
+        qint64 start;
+
+        qint64 end = -1;
+
+        double cpuSeconds = 0;
+    };
+
+    /**
+     * Keyed by the id of the Request (see idKey()), as the Request itself may be
+     * freed once it is dropped, e.g. when nothing keeps the log
+     */
+    std::map<QString, InFlight> inFlight {};
+
+    std::map<QString, std::unique_ptr<MethodCpu>> methods {};
+
+    option<ResourceSampler::Sample> previous {};
+
+    double idleSeconds = 0;
+
+    /** Adds a Request's share to the totals of its method */
+    void finish(const InFlight &request);
+
+    static QString idKey(const Lsp::Id &id);
+};
+
+/**
+ * The latest resource sample of the server, and a table of the CPU time
+ * attributed to each method, refreshed periodically
+ */
+class ResourcePanel : public QWidget {
+    Q_OBJECT
+
+public:
+    ResourcePanel(const ResourceSampler &sampler, const CpuAttribution &attribution, QWidget *parent = nullptr);
+
+public slots:
+    void refresh();
+
+private:
+    const ResourceSampler &sampler;
+
+    const CpuAttribution &attribution;
+
+    QLabel summary {};
+
+    QTableWidget table {};
+
+    QTimer timer {};
+};
+
+#endif // CPUATTRIBUTION_H
@@ -0,0 +1,250 @@
+#include "documentmirror.h"
+#include "metrics.h"
+
+qint64 DocumentMirror::Document::version() const {
+    return versions.back().number;
+}
+
+const DocumentRope& DocumentMirror::Document::text() const {
+    return versions.back().text;
+}
+
+void DocumentMirror::onLspMessage(const std::shared_ptr<Lsp::Message> &message) {
+    if (message->getKind() == Lsp::Message::Kind::Notification && message->getSender() == Lsp::Entity::Client) {
+        QString method = message->tryGetMethod().value_or(QString());
+        QJsonObject params = message->getContents().object().value("params").toObject();
+
+        if (method == "textDocument/didOpen") {
+            onDidOpen(*message, params);
+        } else if (method == "textDocument/didChange") {
+            onDidChange(*message, params);
+        } else if (method == "textDocument/didClose") {
+            onDidClose(*message, params);
+        }
+    } else if (message->getKind() == Lsp::Message::Kind::Response && message->getSender() == Lsp::Entity::Server) {
+        if (message->tryGetMethod() == QString("initialize")) {
+            onInitializeResult(message->getContents().object().value("result").toObject());
+        }
+    }
+}
+
+DocumentRope::Encoding DocumentMirror::getEncoding() const {
+    return encoding;
+}
+
+const DocumentMirror::Document* DocumentMirror::find(const QString &uri) const {
+    auto it = documents.find(uri);
+    return it != documents.end() ? it->second.get() : nullptr;
+}
+
+const DocumentMirror::Version* DocumentMirror::find(const QString &uri, qint64 version) const {
+    auto document = find(uri);
+    if (!document) {
+        return nullptr;
+    }
+
+    for (auto &entry : document->versions) {
+        if (entry.number == version) {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+const DocumentMirror::Version* DocumentMirror::findAt(const QString &uri, qint64 time) const {
+    auto document = find(uri);
+    if (!document) {
+        return nullptr;
+    }
+
+    for (auto it = document->versions.rbegin(); it != document->versions.rend(); ++it) {
+        if (it->receivedAt <= time) {
+            return &*it;
+        }
+    }
+
+    return nullptr;
+}
+
+const LineIndex& DocumentMirror::lineIndex(const Version &version) const {
+    if (!version.lines || version.lines->getEncoding() != encoding) {
+        version.lines = std::make_shared<const LineIndex>(LineIndex::build(version.text, encoding));
+    }
+
+    return *version.lines;
+}
+
+int DocumentMirror::openCount() const {
+    return documents.size();
+}
+
+void DocumentMirror::forgetDocuments() {
+    documents.clear();
+    incomplete = true;
+}
+
+void DocumentMirror::onDidOpen(Lsp::Message &message, const QJsonObject &params) {
+    QJsonObject item = params.value("textDocument").toObject();
+    QString uri = item.value("uri").toString();
+    if (uri.isEmpty()) {
+        return;
+    }
+
+    auto &document = documents[uri];
+    if (document) {
+        message.getIssues().member("params").member("textDocument").member("uri").warning("Document is already open");
+    }
+
+    document = std::make_unique<Document>();
+    document->uri = uri;
+    document->languageId = item.value("languageId").toString();
+    document->versions.push_back(Version {qint64(item.value("version").toDouble()), message.getTiming().lastByte, DocumentRope(item.value("text").toString()), nullptr});
+}
+
+void DocumentMirror::onDidChange(Lsp::Message &message, const QJsonObject &params) {
+    QJsonObject identifier = params.value("textDocument").toObject();
+
+    auto it = documents.find(identifier.value("uri").toString());
+    if (it == documents.end()) {
+        if (!incomplete) {
+            message.getIssues().member("params").member("textDocument").member("uri").error("Document is not open");
+        }
+        return;
+    }
+
+    Document &document = *it->second;
+
+    qint64 version = qint64(identifier.value("version").toDouble());
+    if (version <= document.version()) {
+        message.getIssues().member("params").member("textDocument").member("version").warning("Version is not greater than the previous version (" + QString::number(document.version()) + ")");
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    DocumentRope text = document.text();
+
+    QJsonArray contentChanges = params.value("contentChanges").toArray();
+    for (int i = 0; i < contentChanges.size(); i++) {
+        QJsonObject change = contentChanges.at(i).toObject();
+
+        auto changed = applyChange(text, change);
+        if (!changed) {
+            // The mirror keeps the previous version, rather than guessing at a partial edit
+            message.getIssues().member("params").member("contentChanges").element(i).member("range").error("Range is outside the document");
+            rejectedChanges += 1;
+            return;
+        }
+
+        qint64 inserted = change.value("text").toString().size();
+        insertedUnits += inserted;
+        removedUnits += std::max<qint64>(text.length() + inserted - changed->length(), 0);
+
+        text = changed.value();
+    }
+
+    changes += 1;
+    applyTime.record(timer.nsecsElapsed());
+
+    document.versions.push_back(Version {version, message.getTiming().lastByte, text, nullptr});
+    while (int(document.versions.size()) > historyLimit) {
+        document.versions.pop_front();
+    }
+}
+
+void DocumentMirror::onDidClose(Lsp::Message &message, const QJsonObject &params) {
+    QString uri = params.value("textDocument").toObject().value("uri").toString();
+
+    if (documents.erase(uri) == 0 && !incomplete) {
+        message.getIssues().member("params").member("textDocument").member("uri").error("Document is not open");
+    }
+}
+
+void DocumentMirror::onInitializeResult(const QJsonObject &result) {
+    QString kind = result.value("capabilities").toObject().value("positionEncoding").toString();
+
+    if (kind == "utf-8") {
+        encoding = DocumentRope::Encoding::Utf8;
+    } else if (kind == "utf-32") {
+        encoding = DocumentRope::Encoding::Utf32;
+    } else {
+        // The default, and the only encoding servers must support
+        encoding = DocumentRope::Encoding::Utf16;
+    }
+}
+
+option<DocumentRope> DocumentMirror::applyChange(const DocumentRope &text, const QJsonObject &change) const {
+    QString replacement = change.value("text").toString();
+
+    QJsonValue range = change.value("range");
+    if (range.isUndefined()) {
+        // The whole document
+        return DocumentRope(replacement);
+    }
+
+    auto start = toPosition(range.toObject().value("start"));
+    auto end = toPosition(range.toObject().value("end"));
+    if (!start || !end || start->line >= text.lineCount() || end->line >= text.lineCount()) {
+        return {};
+    }
+
+    auto offset = [&](DocumentRope::Position position) {
+        auto exact = text.offsetOf(position, encoding);
+        if (exact) {
+            return exact.value();
+        }
+
+        // Past the end of the line, which defaults back to the line length
+        return text.lineEnd(position.line);
+    };
+
+    qint64 startOffset = offset(start.value());
+    qint64 endOffset = offset(end.value());
+    if (endOffset < startOffset) {
+        return {};
+    }
+
+    return text.replaced(startOffset, endOffset, replacement);
+}
+
+option<DocumentRope::Position> DocumentMirror::toPosition(const QJsonValue &value) const {
+    QJsonValue line = value.toObject().value("line");
+    QJsonValue character = value.toObject().value("character");
+
+    if (!line.isDouble() || !character.isDouble() || line.toDouble() < 0 || character.toDouble() < 0) {
+        return {};
+    }
+
+    return DocumentRope::Position {qint64(line.toDouble()), qint64(character.toDouble())};
+}
+
+void DocumentMirror::appendOpenMetrics(QByteArray &out) const {
+    using namespace Metrics::Exposition;
+
+    family(out, "lspmonitor_documents_open", "gauge", "Documents the client has open");
+    sample(out, "lspmonitor_documents_open", "", documents.size());
+
+    family(out, "lspmonitor_document_changes_total", "counter", "textDocument/didChange notifications applied to the document mirror");
+    sample(out, "lspmonitor_document_changes_total", "", changes);
+
+    family(out, "lspmonitor_document_rejected_changes_total", "counter", "textDocument/didChange notifications with a range outside the document");
+    sample(out, "lspmonitor_document_rejected_changes_total", "", rejectedChanges);
+
+    family(out, "lspmonitor_document_edit_units_total", "counter", "UTF-16 code units inserted and removed by document changes");
+    sample(out, "lspmonitor_document_edit_units_total", "kind=\"inserted\"", insertedUnits);
+    sample(out, "lspmonitor_document_edit_units_total", "kind=\"removed\"", removedUnits);
+
+    family(out, "lspmonitor_document_apply_seconds", "histogram", "Time to apply a textDocument/didChange to the document mirror");
+    histogram(out, "lspmonitor_document_apply_seconds", "", applyTime, 1e9);
+
+    QVector<DocumentRope> ropes;
+    for (auto &entry : documents) {
+        for (auto &version : entry.second->versions) {
+            ropes.append(version.text);
+        }
+    }
+
+    family(out, "lspmonitor_document_retained_bytes", "gauge", "Memory held by every kept version of the open documents");
+    sample(out, "lspmonitor_document_retained_bytes", "", DocumentRope::retainedBytes(ropes));
+}
@@ -0,0 +1,119 @@
+#ifndef DOCUMENTMIRROR_H
+#define DOCUMENTMIRROR_H
+
+#include <QtCore>
+
+#include <deque>
+#include <map>
+#include <memory>
+
+#include "documentrope.h"
+#include "histogram.h"
+#include "lineindex.h"
+#include "lspschemavalidator.h"
+
+/**
+ * The content of every document the client has open, rebuilt from its
+ * textDocument/didOpen, didChange and didClose notifications. Recent versions
+ * of each document are kept (sharing their unchanged text), so positions in
+ * a message can be checked against the version it was sent for.
+ *
+ * Problems applying a change (a range outside the document, a version that
+ * doesn't increase, a change for a document that isn't open) are added as
+ * issues on the notification.
+ *
+ * Once analysis skipped notifications under load, the documents are
+ * forgotten, as their text is unknown. They are mirrored again when next
+ * opened, and changes to documents the mirror doesn't have are no longer
+ * issues, since they may have been opened while notifications were skipped.
+ */
+class DocumentMirror {
+public:
+    /** Versions of a document kept, including the current one */
+    static constexpr int historyLimit = 16;
+
+    struct Version {
+        qint64 number;
+
+        /** When the notification that made this version arrived (ns, monotonic) */
+        qint64 receivedAt;
+
+        DocumentRope text;
+
+        /** Built on first use, see lineIndex() */
+        mutable std::shared_ptr<const LineIndex> lines;
+    };
+
+    struct Document {
+        QString uri;
+
+        QString languageId;
+
+        /** Oldest first; the last is the current version */
+        std::deque<Version> versions;
+
+        qint64 version() const;
+
+        const DocumentRope& text() const;
+    };
+
+    void onLspMessage(const std::shared_ptr<Lsp::Message> &message);
+
+    /** The units of Position characters, as agreed on in initialize */
+    DocumentRope::Encoding getEncoding() const;
+
+    /** The open document, or nullptr */
+    const Document* find(const QString &uri) const;
+
+    /** A version of an open document, or nullptr if it isn't kept */
+    const Version* find(const QString &uri, qint64 version) const;
+
+    /** The latest version of an open document that had arrived by the time (ns, monotonic), or nullptr */
+    const Version* findAt(const QString &uri, qint64 time) const;
+
+    /** The line lengths of a version in the agreed encoding, built once per version */
+    const LineIndex& lineIndex(const Version &version) const;
+
+    int openCount() const;
+
+    /** Drops every document, after notifications that may have changed them were skipped */
+    void forgetDocuments();
+
+    /** Appends the document metrics in the OpenMetrics text format */
+    void appendOpenMetrics(QByteArray &out) const;
+
+private:
+    void onDidOpen(Lsp::Message &message, const QJsonObject &params);
+
+    void onDidChange(Lsp::Message &message, const QJsonObject &params);
+
+    void onDidClose(Lsp::Message &message, const QJsonObject &params);
+
+    void onInitializeResult(const QJsonObject &result);
+
+    /** Applies one TextDocumentContentChangeEvent, or returns nothing if its range is invalid */
+    option<DocumentRope> applyChange(const DocumentRope &text, const QJsonObject &change) const;
+
+    option<DocumentRope::Position> toPosition(const QJsonValue &value) const;
+
+    DocumentRope::Encoding encoding = DocumentRope::Encoding::Utf16;
+
+    std::map<QString, std::unique_ptr<Document>> documents {};
+
+    quint64 changes = 0;
+
+    /** UTF-16 units inserted and removed by changes */
+    quint64 insertedUnits = 0;
+
+    quint64 removedUnits = 0;
+
+    quint64 rejectedChanges = 0;
+
+    /** If notifications were skipped, so a document may be open without the mirror having it */
+    bool incomplete = false;
+
+    /** Time to apply each didChange (ns) */
+    Histogram applyTime {};
+};
+
+#endif // DOCUMENTMIRROR_H
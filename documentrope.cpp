@@ -0,0 +1,396 @@
+#include "documentrope.h"
+
+DocumentRope::Metrics DocumentRope::Metrics::of(QStringView text) {
+    TextScan::Counts counts = TextScan::count(text.data(), text.size());
+
+    Metrics metrics;
+    metrics.utf16 = text.size();
+    metrics.utf8 = counts.utf8;
+    metrics.utf32 = counts.utf32;
+    metrics.lineBreaks = counts.lineBreaks;
+    metrics.startsWithLineFeed = !text.isEmpty() && text.front() == '\n';
+    metrics.endsWithCarriageReturn = !text.isEmpty() && text.back() == '\r';
+    return metrics;
+}
+
+qint64 DocumentRope::Metrics::in(Encoding encoding) const {
+    switch (encoding) {
+        case Encoding::Utf8:
+            return utf8;
+        case Encoding::Utf16:
+            return utf16;
+        case Encoding::Utf32:
+            return utf32;
+    }
+
+    return utf16;
+}
+
+DocumentRope::Metrics DocumentRope::Metrics::operator+(const Metrics &other) const {
+    Metrics sum;
+    sum.utf16 = utf16 + other.utf16;
+    sum.utf8 = utf8 + other.utf8;
+    sum.utf32 = utf32 + other.utf32;
+    sum.lineBreaks = lineBreaks + other.lineBreaks;
+    sum.startsWithLineFeed = utf16 > 0 ? startsWithLineFeed : other.startsWithLineFeed;
+    sum.endsWithCarriageReturn = other.utf16 > 0 ? other.endsWithCarriageReturn : endsWithCarriageReturn;
+
+    // Both halves of a "\r\n" split between the two counted it
+    if (endsWithCarriageReturn && other.startsWithLineFeed) {
+        sum.lineBreaks -= 1;
+    }
+
+    return sum;
+}
+
+DocumentRope::DocumentRope() {}
+
+DocumentRope::DocumentRope(const QString &text) : root(text.isEmpty() ? nullptr : build(text, 0, text.size())) {}
+
+DocumentRope::DocumentRope(NodePtr root) : root(std::move(root)) {}
+
+qint64 DocumentRope::length() const {
+    return root ? root->metrics.utf16 : 0;
+}
+
+qint64 DocumentRope::length(Encoding encoding) const {
+    return root ? root->metrics.in(encoding) : 0;
+}
+
+qint64 DocumentRope::lineCount() const {
+    return (root ? root->metrics.lineBreaks : 0) + 1;
+}
+
+QString DocumentRope::toString() const {
+    return mid(0, length());
+}
+
+QString DocumentRope::mid(qint64 offset, qint64 length) const {
+    QString out;
+
+    offset = qBound<qint64>(0, offset, this->length());
+    length = qBound<qint64>(0, length, this->length() - offset);
+
+    out.reserve(length);
+    append(root, offset, length, out);
+    return out;
+}
+
+option<qint64> DocumentRope::offsetOf(Position position, Encoding encoding) const {
+    if (position.line < 0 || position.character < 0 || position.line >= lineCount()) {
+        return {};
+    }
+
+    qint64 start = lineStart(position.line);
+    qint64 end = lineEnd(position.line);
+
+    if (encoding == Encoding::Utf16) {
+        if (start + position.character > end) {
+            return {};
+        }
+        return start + position.character;
+    }
+
+    qint64 target = metricsBefore(start).in(encoding) + position.character;
+    if (target > metricsBefore(end).in(encoding)) {
+        return {};
+    }
+
+    return offsetAtMeasure(target, encoding);
+}
+
+DocumentRope::Position DocumentRope::positionOf(qint64 offset, Encoding encoding) const {
+    offset = qBound<qint64>(0, offset, length());
+
+    // Between the '\r' and '\n' of a line break is the end of the line it ends
+    if (offset > 0 && offset < length() && mid(offset - 1, 2) == QLatin1String("\r\n")) {
+        offset -= 1;
+    }
+
+    Metrics before = metricsBefore(offset);
+    qint64 line = before.lineBreaks;
+    qint64 start = lineStart(line);
+
+    if (encoding == Encoding::Utf16) {
+        return Position {line, offset - start};
+    }
+
+    return Position {line, before.in(encoding) - metricsBefore(start).in(encoding)};
+}
+
+qint64 DocumentRope::measure(qint64 offset, Encoding encoding) const {
+    return metricsBefore(qBound<qint64>(0, offset, length())).in(encoding);
+}
+
+option<DocumentRope::Position> DocumentRope::convert(Position position, Encoding from, Encoding to) const {
+    auto offset = offsetOf(position, from);
+    if (!offset) {
+        return {};
+    }
+
+    return positionOf(offset.value(), to);
+}
+
+DocumentRope DocumentRope::replaced(qint64 start, qint64 end, const QString &text) const {
+    start = qBound<qint64>(0, start, length());
+    end = qBound<qint64>(start, end, length());
+
+    auto head = split(root, start);
+    auto tail = split(head.second, end - start);
+
+    NodePtr inserted = text.isEmpty() ? nullptr : build(text, 0, text.size());
+    return DocumentRope(concat(concat(head.first, inserted), tail.second));
+}
+
+qint64 DocumentRope::retainedBytes(const QVector<DocumentRope> &ropes) {
+    QSet<const Node*> seen;
+    QVector<const Node*> pending;
+
+    for (const DocumentRope &rope : ropes) {
+        if (rope.root) {
+            pending.append(rope.root.get());
+        }
+    }
+
+    qint64 bytes = 0;
+
+    while (!pending.isEmpty()) {
+        const Node *node = pending.takeLast();
+        if (seen.contains(node)) {
+            continue;
+        }
+        seen.insert(node);
+
+        bytes += sizeof(Node) + node->text.size() * sizeof(QChar);
+
+        if (node->left) {
+            pending.append(node->left.get());
+            pending.append(node->right.get());
+        }
+    }
+
+    return bytes;
+}
+
+DocumentRope::NodePtr DocumentRope::leaf(const QString &text) {
+    return std::make_shared<const Node>(Node {nullptr, nullptr, text, Metrics::of(text), 1});
+}
+
+DocumentRope::NodePtr DocumentRope::branch(NodePtr left, NodePtr right) {
+    Metrics metrics = left->metrics + right->metrics;
+    int h = std::max(left->height, right->height) + 1;
+    return std::make_shared<const Node>(Node {std::move(left), std::move(right), QString(), metrics, h});
+}
+
+int DocumentRope::height(const NodePtr &node) {
+    return node ? node->height : 0;
+}
+
+DocumentRope::NodePtr DocumentRope::build(const QString &text, qint64 from, qint64 to) {
+    if (to - from <= maxChunk) {
+        return leaf(text.mid(from, to - from));
+    }
+
+    // Keep surrogate pairs within a chunk
+    qint64 middle = from + (to - from) / 2;
+    if (text.at(middle).isLowSurrogate()) {
+        middle += 1;
+    }
+
+    return concat(build(text, from, middle), build(text, middle, to));
+}
+
+DocumentRope::NodePtr DocumentRope::concat(NodePtr left, NodePtr right) {
+    if (!left) {
+        return right;
+    }
+
+    if (!right) {
+        return left;
+    }
+
+    // Small edits would otherwise leave behind ever smaller chunks
+    if (!left->left && !right->left && left->text.size() + right->text.size() <= maxChunk) {
+        return leaf(left->text + right->text);
+    }
+
+    if (left->height > right->height + 1) {
+        return balance(left->left, concat(left->right, right));
+    }
+
+    if (right->height > left->height + 1) {
+        return balance(concat(left, right->left), right->right);
+    }
+
+    return branch(left, right);
+}
+
+DocumentRope::NodePtr DocumentRope::balance(NodePtr left, NodePtr right) {
+    if (height(right) > height(left) + 1) {
+        if (height(right->left) > height(right->right)) {
+            return branch(branch(left, right->left->left), branch(right->left->right, right->right));
+        }
+        return branch(branch(left, right->left), right->right);
+    }
+
+    if (height(left) > height(right) + 1) {
+        if (height(left->right) > height(left->left)) {
+            return branch(branch(left->left, left->right->left), branch(left->right->right, right));
+        }
+        return branch(left->left, branch(left->right, right));
+    }
+
+    return branch(left, right);
+}
+
+std::pair<DocumentRope::NodePtr, DocumentRope::NodePtr> DocumentRope::split(const NodePtr &node, qint64 offset) {
+    if (!node) {
+        return {nullptr, nullptr};
+    }
+
+    if (offset <= 0) {
+        return {nullptr, node};
+    }
+
+    if (offset >= node->metrics.utf16) {
+        return {node, nullptr};
+    }
+
+    if (!node->left) {
+        return {leaf(node->text.left(offset)), leaf(node->text.mid(offset))};
+    }
+
+    qint64 leftLength = node->left->metrics.utf16;
+
+    if (offset <= leftLength) {
+        auto parts = split(node->left, offset);
+        return {parts.first, concat(parts.second, node->right)};
+    }
+
+    auto parts = split(node->right, offset - leftLength);
+    return {concat(node->left, parts.first), parts.second};
+}
+
+void DocumentRope::append(const NodePtr &node, qint64 offset, qint64 length, QString &out) {
+    if (!node || length <= 0) {
+        return;
+    }
+
+    if (!node->left) {
+        out.append(QStringView(node->text).mid(offset, length));
+        return;
+    }
+
+    qint64 leftLength = node->left->metrics.utf16;
+
+    if (offset < leftLength) {
+        qint64 fromLeft = std::min(length, leftLength - offset);
+        append(node->left, offset, fromLeft, out);
+        append(node->right, 0, length - fromLeft, out);
+    } else {
+        append(node->right, offset - leftLength, length, out);
+    }
+}
+
+DocumentRope::Metrics DocumentRope::metricsBefore(qint64 offset) const {
+    Metrics before;
+
+    const Node *node = root.get();
+    while (node && node->left) {
+        if (offset <= node->left->metrics.utf16) {
+            node = node->left.get();
+        } else {
+            offset -= node->left->metrics.utf16;
+            before = before + node->left->metrics;
+            node = node->right.get();
+        }
+    }
+
+    if (node) {
+        before = before + Metrics::of(QStringView(node->text).left(std::min<qint64>(offset, node->text.size())));
+    }
+
+    return before;
+}
+
+qint64 DocumentRope::offsetAtMeasure(qint64 target, Encoding encoding) const {
+    if (encoding == Encoding::Utf16) {
+        return target;
+    }
+
+    qint64 offset = 0;
+
+    const Node *node = root.get();
+    while (node && node->left) {
+        qint64 left = node->left->metrics.in(encoding);
+        if (target <= left) {
+            node = node->left.get();
+        } else {
+            target -= left;
+            offset += node->left->metrics.utf16;
+            node = node->right.get();
+        }
+    }
+
+    if (!node) {
+        return 0;
+    }
+
+    return offset + TextScan::prefixWithin(node->text.constData(), node->text.size(), target, encoding);
+}
+
+qint64 DocumentRope::lineStart(qint64 line) const {
+    if (line <= 0) {
+        return 0;
+    }
+
+    // Find the line'th line break; the line starts just after it
+    qint64 remaining = line;
+    qint64 offset = 0;
+
+    const Node *node = root.get();
+    while (node->left) {
+        const Metrics &left = node->left->metrics;
+        if (remaining <= left.lineBreaks) {
+            node = node->left.get();
+        } else {
+            remaining -= left.lineBreaks;
+
+            // The right side counts the '\n' of a "\r\n" the left side ends as a break of its own
+            if (left.endsWithCarriageReturn && node->right->metrics.startsWithLineFeed) {
+                remaining += 1;
+            }
+
+            offset += left.utf16;
+            node = node->right.get();
+        }
+    }
+
+    const QChar *text = node->text.constData();
+    qint64 size = node->text.size();
+
+    qint64 start = 0;
+    for (; remaining > 0 && start < size; remaining--) {
+        start = TextScan::skipLineBreak(text, size, TextScan::findLineBreak(text, size, start));
+    }
+
+    // The chunk ends with a '\r' whose '\n' starts the next chunk
+    if (start == size && text[size - 1] == '\r' && mid(offset + size, 1) == QLatin1String("\n")) {
+        start += 1;
+    }
+
+    return offset + start;
+}
+
+qint64 DocumentRope::lineEnd(qint64 line) const {
+    if (line + 1 >= lineCount()) {
+        return length();
+    }
+
+    qint64 next = lineStart(line + 1);
+    if (next >= 2 && mid(next - 2, 2) == QLatin1String("\r\n")) {
+        return next - 2;
+    }
+
+    return next - 1;
+}
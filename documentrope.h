@@ -0,0 +1,169 @@
+#ifndef DOCUMENTROPE_H
+#define DOCUMENTROPE_H
+
+#include <QtCore>
+
+#include <memory>
+
+#include "option.h"
+#include "textscan.h"
+
+/**
+ * An immutable text, stored as a balanced (AVL) tree of chunks. Every node
+ * caches the length of its text in each unit positions can be expressed in,
+ * and its number of line breaks, so edits and position lookups walk a single
+ * path down the tree: O(log n) plus a scan of one chunk.
+ *
+ * Edits return a new rope that shares every chunk and subtree the edit did not
+ * touch with the original, so keeping many versions of a document costs little
+ * more than the edits between them.
+ *
+ * Offsets are in UTF-16 code units (QString indices). Lines are ended by
+ * "\r\n", '\r' or '\n', as in LSP, and a "\r\n" split between chunks is still
+ * a single line break.
+ */
+class DocumentRope {
+public:
+    using Encoding = TextScan::Encoding;
+
+    /** A zero-based line and character, as in an LSP Position */
+    struct Position {
+        qint64 line;
+
+        qint64 character;
+    };
+
+    /** Chunks are split to at most this many UTF-16 code units */
+    static constexpr int maxChunk = 1024;
+
+    DocumentRope();
+
+    explicit DocumentRope(const QString &text);
+
+    /** Length in UTF-16 code units */
+    qint64 length() const;
+
+    /** Length in the given encoding's units */
+    qint64 length(Encoding encoding) const;
+
+    /** Number of lines (one more than the number of line breaks) */
+    qint64 lineCount() const;
+
+    QString toString() const;
+
+    QString mid(qint64 offset, qint64 length) const;
+
+    /** The offset of a position, or nothing if the line or character is past the end of the document or line */
+    option<qint64> offsetOf(Position position, Encoding encoding) const;
+
+    /** The offset of the end of the line before its line break, for a line that exists */
+    qint64 lineEnd(qint64 line) const;
+
+    /** The position of an offset, which is clamped to the document */
+    Position positionOf(qint64 offset, Encoding encoding) const;
+
+    /** The size of the text before the offset in the encoding's units, e.g. the UTF-8 byte offset */
+    qint64 measure(qint64 offset, Encoding encoding) const;
+
+    /** The same position counted in other units, or nothing if it is outside the document */
+    option<Position> convert(Position position, Encoding from, Encoding to) const;
+
+    /** Calls f with each chunk of the text, in order */
+    template <typename F>
+    void forEachChunk(F f) const;
+
+    /** A copy with the text between the offsets (clamped to the document) replaced */
+    DocumentRope replaced(qint64 start, qint64 end, const QString &text) const;
+
+    /** Heap bytes held by the ropes, counting chunks and nodes they share only once */
+    static qint64 retainedBytes(const QVector<DocumentRope> &ropes);
+
+private:
+    struct Metrics {
+        qint64 utf16 = 0;
+
+        qint64 utf8 = 0;
+
+        qint64 utf32 = 0;
+
+        qint64 lineBreaks = 0;
+
+        /** The ends of the text, where a "\r\n" may be split from the text next to it */
+        bool startsWithLineFeed = false;
+
+        bool endsWithCarriageReturn = false;
+
+        static Metrics of(QStringView text);
+
+        qint64 in(Encoding encoding) const;
+
+        Metrics operator+(const Metrics &other) const;
+    };
+
+    struct Node;
+
+    using NodePtr = std::shared_ptr<const Node>;
+
+    /** Leaves hold a chunk of text; internal nodes always have both children */
+    struct Node {
+        NodePtr left;
+
+        NodePtr right;
+
+        QString text;
+
+        Metrics metrics;
+
+        int height;
+    };
+
+    explicit DocumentRope(NodePtr root);
+
+    static NodePtr leaf(const QString &text);
+
+    static NodePtr branch(NodePtr left, NodePtr right);
+
+    static int height(const NodePtr &node);
+
+    static NodePtr build(const QString &text, qint64 from, qint64 to);
+
+    static NodePtr concat(NodePtr left, NodePtr right);
+
+    /** Joins subtrees whose heights differ by at most two, rotating if needed */
+    static NodePtr balance(NodePtr left, NodePtr right);
+
+    static std::pair<NodePtr, NodePtr> split(const NodePtr &node, qint64 offset);
+
+    static void append(const NodePtr &node, qint64 offset, qint64 length, QString &out);
+
+    /** The metrics of the text before the offset */
+    Metrics metricsBefore(qint64 offset) const;
+
+    /** The offset at which the text before it measures target units (or just under, if target is within a character) */
+    qint64 offsetAtMeasure(qint64 target, Encoding encoding) const;
+
+    /** The offset of the start of the line, which must exist */
+    qint64 lineStart(qint64 line) const;
+
+    NodePtr root;
+};
+
+template <typename F>
+void DocumentRope::forEachChunk(F f) const {
+    QVarLengthArray<const Node*, 64> pending;
+    if (root) {
+        pending.append(root.get());
+    }
+
+    while (!pending.isEmpty()) {
+        const Node *node = pending.takeLast();
+        if (node->left) {
+            pending.append(node->right.get());
+            pending.append(node->left.get());
+        } else {
+            f(QStringView(node->text));
+        }
+    }
+}
+
+#endif // DOCUMENTROPE_H
@@ -1,11 +1,31 @@
 #include "framebuilder.h"
 #include "asciiparsing.h"
+#include "pipelineprofiler.h"
 
 namespace FrameBuilder {
 
 Header::Header(QString name, QString value) : name(name), value(value) {}
 
-Frame::Frame(qint64 timestamp, size_t gStart, size_t gEnd, size_t pOff, QVector<Header> headers, QByteArray payload, bool recovery) : timestamp(timestamp), frameStart(gStart), frameEnd(gEnd), payloadStart(pOff), headers(headers), payload(payload), fromRecoveryMode(recovery) {}
+FrameTiming::FrameTiming(qint64 firstByte, qint64 headersEnd, qint64 lastByte) : firstByte(firstByte), headersEnd(headersEnd), lastByte(lastByte) {}
+
+FrameTiming FrameTiming::fromTimestamp(qint64 timestamp) {
+    qint64 ns = timestamp * 1000000;
+    return FrameTiming(ns, ns, ns);
+}
+
+qint64 FrameTiming::transferTime() const {
+    return lastByte - firstByte;
+}
+
+Frame::Frame(qint64 timestamp, FrameTiming timing, size_t gStart, size_t gEnd, size_t pOff, QVector<Header> headers, QByteArray payload, bool recovery) : timestamp(timestamp), timing(timing), frameStart(gStart), frameEnd(gEnd), payloadStart(pOff), headers(headers), payload(payload), fromRecoveryMode(recovery) {}
+
+bool Frame::mayBeRequest() const {
+    if (payloadDiscarded) {
+        return skippedRequestKeys;
+    }
+
+    return payload.contains("\"method\"") && payload.contains("\"id\"");
+}
 
 StreamError::StreamError(size_t gOffset, size_t lOffset, Kind kind) : globalOffset(gOffset), localOffset(lOffset), kind(kind) {}
 
@@ -33,13 +53,35 @@ QString StreamError::toQString() {
 FrameBuilder::FrameBuilder(QObject* parent) : QObject(parent) {}
 
 void FrameBuilder::onInput(QByteArray input) {
-    for (char c : input) {
+    onInputAt(input, clock->timestamp(), clock->monotonic());
+}
+
+void FrameBuilder::setClock(const Clock *clock) {
+    this->clock = clock;
+}
+
+void FrameBuilder::onInputAt(QByteArray input, qint64 timestamp, qint64 arrival) {
+    PROFILE_STAGE(Profiling::Stage::Frame);
+
+    chunkTimestamp = timestamp;
+    chunkTime = arrival;
+
+    for (int i = 0; i < input.size(); i++) {
+        if (offset == frameStart) {
+            timing.firstByte = chunkTime;
+        }
+
         switch (state) {
             case State::Headers:
-                appendHeader(c);
+                appendHeader(input[i]);
                 break;
             case State::Payload:
-                appendPayload(c);
+                if (discardingPayload) {
+                    long skipped = skipPayload(input.constData() + i, input.size() - i);
+                    i += skipped - 1;
+                } else {
+                    appendPayload(input[i]);
+                }
                 break;
         }
 
@@ -55,6 +97,10 @@ void FrameBuilder::operator<<(char c) {
     onInput(QByteArray().append(c));
 }
 
+void FrameBuilder::setDiscardPayloads(bool discard) {
+    discardPayloads = discard;
+}
+
 void FrameBuilder::appendHeader(char c) {
     switch (headersState) {
         case HeadersState::NameStart:
@@ -110,6 +156,7 @@ void FrameBuilder::appendHeader(char c) {
             }
 
             state = State::Payload;
+            timing.headersEnd = chunkTime;
             initialisePayload();
     }
 }
@@ -117,17 +164,27 @@ void FrameBuilder::appendHeader(char c) {
 void FrameBuilder::initialisePayload() {
     buffer.clear();
 
+    // Called while processing the last header byte
+    payloadStart = offset + 1;
+
     pending = getPayloadSizeFromHeaders();
     if (pending < 0) {
         return;
     }
 
+    discardingPayload = discardPayloads;
+    skippedMethodKey = false;
+    skippedIdKey = false;
+    skippedTail.clear();
+
     if (pending == 0) {
         emitPayload();
         return;
     }
 
-    buffer.reserve(pending);
+    if (!discardingPayload) {
+        buffer.reserve(pending);
+    }
 }
 
 void FrameBuilder::appendPayload(char c) {
@@ -138,10 +195,52 @@ void FrameBuilder::appendPayload(char c) {
     }
 }
 
+long FrameBuilder::skipPayload(const char *data, long count) {
+    long skipped = std::min(pending, count);
+    scanSkipped(data, skipped);
+
+    // The caller advances past the last skipped byte, as with every other byte
+    offset += skipped - 1;
+    pending -= skipped;
+    if (pending == 0) {
+        emitPayload();
+    }
+
+    return skipped;
+}
+
+void FrameBuilder::scanSkipped(const char *data, long count) {
+    static const QByteArray methodKey = "\"method\"";
+    static const QByteArray idKey = "\"id\"";
+
+    if (skippedMethodKey && skippedIdKey) {
+        return;
+    }
+
+    // Only the seam with the previous chunk is copied, the rest is searched in place
+    QByteArray seam = skippedTail + QByteArray(data, std::min<long>(count, methodKey.size() - 1));
+    QByteArray chunk = QByteArray::fromRawData(data, count);
+
+    skippedMethodKey = skippedMethodKey || seam.contains(methodKey) || chunk.contains(methodKey);
+    skippedIdKey = skippedIdKey || seam.contains(idKey) || chunk.contains(idKey);
+
+    skippedTail = (skippedTail + chunk.right(methodKey.size() - 1)).right(methodKey.size() - 1);
+}
+
 void FrameBuilder::emitPayload() {
-    emit emitFrame(Frame (QDateTime::currentMSecsSinceEpoch(), frameStart, offset, offset - buffer.size(), headers, buffer, recoveryState == 0));
+    timing.lastByte = chunkTime;
+
+    // Called while processing the last byte of the frame, which is at offset
+    size_t end = offset + 1;
+
+    Frame frame (chunkTimestamp, timing, frameStart, end, payloadStart, headers, buffer, recoveryState == 0);
+    frame.payloadDiscarded = discardingPayload;
+    frame.skippedRequestKeys = discardingPayload && skippedMethodKey && skippedIdKey;
+    emit emitFrame(frame);
+
+    discardingPayload = false;
 
-    frameStart = offset;
+    frameStart = end;
 
     state = State::Headers;
     headersState = HeadersState::NameStart;
@@ -192,7 +291,8 @@ void FrameBuilder::handleError(StreamError::Kind kind) {
     if (recoveryState == 0) {
         emit emitError(StreamError(offset, offset - frameStart, kind));
     }
-    frameStart = offset;
+    // The erroneous byte is consumed, so the next frame can start after it
+    frameStart = offset + 1;
     headers.clear();
     state = State::Headers;
     headersState = HeadersState::NameStart;
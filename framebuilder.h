@@ -3,6 +3,8 @@
 
 #include <QtCore>
 
+#include "clock.h"
+
 namespace FrameBuilder {
 
 /**
@@ -18,6 +20,32 @@ struct Header {
     Header(QString name, QString value);
 };
 
+/**
+ * Monotonic timestamps (ns, see Clock::monotonic()) of the points a frame passed
+ * through the stream. Bytes arrive in chunks, so each is the time the chunk
+ * holding that byte was read.
+ */
+struct FrameTiming {
+    /** When the first header byte arrived */
+    qint64 firstByte = 0;
+
+    /** When the blank line ending the headers arrived */
+    qint64 headersEnd = 0;
+
+    /** When the last payload byte arrived */
+    qint64 lastByte = 0;
+
+    FrameTiming() = default;
+
+    FrameTiming(qint64 firstByte, qint64 headersEnd, qint64 lastByte);
+
+    /** Timing for a frame where only the (ms) arrival time is known, such as one from a capture */
+    static FrameTiming fromTimestamp(qint64 timestamp);
+
+    /** How long the frame took to arrive, from first to last byte */
+    qint64 transferTime() const;
+};
+
 /**
  * Represents a whole message extracted from the stream
  */
@@ -25,6 +53,9 @@ struct Frame {
     /** The time this frame was fully received */
     qint64 timestamp;
 
+    /** Precise timing of the frame's arrival */
+    FrameTiming timing;
+
     /** The index into the stream this frame starts on (index of first header character) */
     size_t frameStart;
 
@@ -43,7 +74,20 @@ struct Frame {
     /** If the message was built in recovery mode */
     bool fromRecoveryMode;
 
-    Frame(qint64 timestamp, size_t frameStart, size_t frameEnd, size_t payloadStart, QVector<Header> headers, QByteArray payload, bool recovery=false);
+    /** If the payload was skipped rather than buffered (see FrameBuilder::setDiscardPayloads), leaving it empty */
+    bool payloadDiscarded = false;
+
+    /**
+     * If the payload has both an "id" and a "method" key, so may be a Request.
+     * A byte search rather than a parse, and only done for skipped payloads,
+     * as it is all that is known of them; see mayBeRequest()
+     */
+    bool skippedRequestKeys = false;
+
+    /** If the payload may be a Request, erring towards yes */
+    bool mayBeRequest() const;
+
+    Frame(qint64 timestamp, FrameTiming timing, size_t frameStart, size_t frameEnd, size_t payloadStart, QVector<Header> headers, QByteArray payload, bool recovery=false);
 };
 
 struct StreamError {
@@ -95,6 +139,16 @@ public:
     void operator<<(const QByteArray &data);
     void operator<<(char d);
 
+    /**
+     * Skip the payloads of frames that start after this is set instead of
+     * buffering them, so only the framing itself is tracked. Frames are still
+     * emitted, with an empty payload.
+     */
+    void setDiscardPayloads(bool discard);
+
+    /** The clock input passed to onInput() is timed by */
+    void setClock(const Clock *clock);
+
 signals:
     /** Fired for each well formed message in the stream */
     void emitFrame(Frame frame);
@@ -105,6 +159,9 @@ signals:
 public slots:
     void onInput(QByteArray input);
 
+    /** Input that was read earlier, at the given wall clock (ms) and monotonic (ns) times */
+    void onInputAt(QByteArray input, qint64 timestamp, qint64 arrival);
+
 private:
     enum class State {
         Headers,
@@ -127,6 +184,24 @@ private:
 
     size_t frameStart = 0;
 
+    /** When the chunk currently being processed arrived */
+    qint64 chunkTime = 0;
+
+    /** Wall clock time (ms) the chunk currently being processed arrived */
+    qint64 chunkTimestamp = 0;
+
+    /** Index into the stream of the current frame's payload */
+    size_t payloadStart = 0;
+
+    bool discardPayloads = false;
+
+    const Clock *clock = Clock::system();
+
+    /** If the payload of the current frame is being skipped */
+    bool discardingPayload = false;
+
+    FrameTiming timing {};
+
     QByteArray buffer;
 
     QVector<Header> headers;
@@ -146,6 +221,20 @@ private:
     void appendHeader(char c);
 
     void appendPayload(char c);
+
+    /** Skips up to count bytes of a discarded payload, returning how many were skipped */
+    long skipPayload(const char *data, long count);
+
+    /** Searches skipped bytes for the keys of a Request, see Frame::skippedRequestKeys */
+    void scanSkipped(const char *data, long count);
+
+    /** Keys of a Request found in the payload being skipped */
+    bool skippedMethodKey = false;
+
+    bool skippedIdKey = false;
+
+    /** The last bytes skipped, so keys split between chunks are found */
+    QByteArray skippedTail;
 };
 
 }
@@ -0,0 +1,121 @@
+#include "histogram.h"
+
+#include <cmath>
+
+Histogram::Histogram() {
+    reset();
+}
+
+int Histogram::bucketFor(quint64 value) {
+    if (value < subBucketCount) {
+        return int(value);
+    }
+
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - subBucketBits;
+    int subBucket = int(value >> shift) - subBucketCount;
+
+    return (shift + 1) * subBucketCount + subBucket;
+}
+
+quint64 Histogram::bucketLowerBound(int bucket) {
+    if (bucket < subBucketCount) {
+        return quint64(bucket);
+    }
+
+    int shift = bucket / subBucketCount - 1;
+    int subBucket = bucket % subBucketCount;
+
+    return quint64(subBucketCount + subBucket) << shift;
+}
+
+quint64 Histogram::bucketUpperBound(int bucket) {
+    if (bucket < subBucketCount) {
+        return quint64(bucket);
+    }
+
+    int shift = bucket / subBucketCount - 1;
+    return bucketLowerBound(bucket) + ((quint64(1) << shift) - 1);
+}
+
+void Histogram::record(quint64 value) {
+    buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    valueSum.fetch_add(value, std::memory_order_relaxed);
+
+    quint64 current = maxValue.load(std::memory_order_relaxed);
+    while (value > current && !maxValue.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+void Histogram::merge(const Histogram &other) {
+    for (int i = 0; i < bucketCount; i++) {
+        quint64 count = other.buckets[i].load(std::memory_order_relaxed);
+        if (count > 0) {
+            buckets[i].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    total.fetch_add(other.count(), std::memory_order_relaxed);
+    valueSum.fetch_add(other.sum(), std::memory_order_relaxed);
+
+    quint64 otherMax = other.max();
+    quint64 current = maxValue.load(std::memory_order_relaxed);
+    while (otherMax > current && !maxValue.compare_exchange_weak(current, otherMax, std::memory_order_relaxed)) {}
+}
+
+void Histogram::reset() {
+    for (auto &bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+
+    total.store(0, std::memory_order_relaxed);
+    valueSum.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+quint64 Histogram::count() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+quint64 Histogram::sum() const {
+    return valueSum.load(std::memory_order_relaxed);
+}
+
+quint64 Histogram::max() const {
+    return maxValue.load(std::memory_order_relaxed);
+}
+
+double Histogram::mean() const {
+    quint64 n = count();
+    return n == 0 ? 0 : double(sum()) / n;
+}
+
+quint64 Histogram::percentile(double fraction) const {
+    quint64 n = count();
+    if (n == 0) {
+        return 0;
+    }
+
+    quint64 target = std::max<quint64>(1, std::ceil(fraction * n));
+    quint64 seen = 0;
+
+    for (int i = 0; i < bucketCount; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return std::min(bucketUpperBound(i), max());
+        }
+    }
+
+    return max();
+}
+
+quint64 Histogram::countAtOrBelow(quint64 value) const {
+    int last = bucketFor(value);
+    quint64 seen = 0;
+
+    for (int i = 0; i <= last; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+    }
+
+    return seen;
+}
@@ -0,0 +1,66 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QtCore>
+
+#include <array>
+#include <atomic>
+
+/**
+ * Log-linear histogram of non-negative integer values (e.g., latencies in µs).
+ *
+ * Each power of two is split into 16 linear sub-buckets, so any recorded value
+ * is reproduced to within ~6% regardless of magnitude, in fixed memory.
+ * Recording is a few relaxed atomic increments, so values may be recorded from
+ * any thread while another thread reads percentiles.
+ */
+class Histogram {
+public:
+    static constexpr int subBucketBits = 4;
+
+    static constexpr int subBucketCount = 1 << subBucketBits;
+
+    static constexpr int bucketCount = (64 - subBucketBits + 1) * subBucketCount;
+
+    Histogram();
+
+    void record(quint64 value);
+
+    /** Adds every value recorded in other into this histogram */
+    void merge(const Histogram &other);
+
+    void reset();
+
+    quint64 count() const;
+
+    quint64 sum() const;
+
+    quint64 max() const;
+
+    double mean() const;
+
+    /** The value at or below which the given fraction (0 to 1) of recorded values fall */
+    quint64 percentile(double fraction) const;
+
+    /** How many recorded values are less than or equal to value (approximate within a bucket) */
+    quint64 countAtOrBelow(quint64 value) const;
+
+    static int bucketFor(quint64 value);
+
+    /** The smallest value that falls in the bucket */
+    static quint64 bucketLowerBound(int bucket);
+
+    /** The largest value that falls in the bucket */
+    static quint64 bucketUpperBound(int bucket);
+
+private:
+    std::array<std::atomic<quint64>, bucketCount> buckets;
+
+    std::atomic<quint64> total {0};
+
+    std::atomic<quint64> valueSum {0};
+
+    std::atomic<quint64> maxValue {0};
+};
+
+#endif // HISTOGRAM_H
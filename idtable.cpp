@@ -0,0 +1,159 @@
+#include "idtable.h"
+
+namespace Lsp {
+
+IdTable::IdTable() {
+    rehash(16);
+}
+
+quint64 IdTable::hash(quint64 key) {
+    // splitmix64 finaliser; sequential ids would otherwise cluster
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+int IdTable::findSlot(quint64 key) const {
+    int mask = slots.size() - 1;
+
+    for (int i = hash(key) & mask;; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+
+        if (slot.state == SlotState::Empty) {
+            return -1;
+        }
+
+        if (slot.state == SlotState::Full && slot.key == key) {
+            return i;
+        }
+    }
+}
+
+quint32 IdTable::find(quint64 key) const {
+    int i = findSlot(key);
+    return i < 0 ? none : slots[i].row;
+}
+
+quint32 IdTable::insert(quint64 key, quint32 row) {
+    int existing = findSlot(key);
+    if (existing >= 0) {
+        quint32 previous = slots[existing].row;
+        slots[existing].row = row;
+        return previous;
+    }
+
+    // Keep the load (including tombstones) under 3/4
+    if ((used + 1) * 4 > slots.size() * 3) {
+        rehash((count + 1) * 2 > slots.size() / 2 ? slots.size() * 2 : slots.size());
+    }
+
+    int mask = slots.size() - 1;
+    int i = hash(key) & mask;
+    while (slots[i].state == SlotState::Full) {
+        i = (i + 1) & mask;
+    }
+
+    if (slots[i].state == SlotState::Empty) {
+        used += 1;
+    }
+
+    slots[i] = Slot {key, row, SlotState::Full};
+    count += 1;
+
+    return none;
+}
+
+quint32 IdTable::erase(quint64 key) {
+    int i = findSlot(key);
+    if (i < 0) {
+        return none;
+    }
+
+    slots[i].state = SlotState::Deleted;
+    count -= 1;
+    return slots[i].row;
+}
+
+int IdTable::size() const {
+    return count;
+}
+
+int IdTable::capacity() const {
+    return slots.size();
+}
+
+void IdTable::rehash(int capacity) {
+    QVector<Slot> old = slots;
+
+    slots = QVector<Slot>(capacity, Slot {0, none, SlotState::Empty});
+    count = 0;
+    used = 0;
+
+    int mask = capacity - 1;
+    for (const Slot &slot : old) {
+        if (slot.state != SlotState::Full) {
+            continue;
+        }
+
+        int i = hash(slot.key) & mask;
+        while (slots[i].state != SlotState::Empty) {
+            i = (i + 1) & mask;
+        }
+
+        slots[i] = slot;
+        count += 1;
+        used += 1;
+    }
+}
+
+quint32 StringInterner::intern(const QString &value) {
+    auto it = ids.find(value);
+    if (it != ids.end()) {
+        references[it.value()] += 1;
+        return it.value();
+    }
+
+    quint32 id;
+    if (!freeIds.isEmpty()) {
+        id = freeIds.takeLast();
+        strings[id] = value;
+        references[id] = 1;
+    } else {
+        id = strings.size();
+        strings.append(value);
+        references.append(1);
+    }
+
+    ids.insert(value, id);
+    return id;
+}
+
+option<quint32> StringInterner::find(const QString &value) const {
+    auto it = ids.find(value);
+    if (it == ids.end()) {
+        return {};
+    }
+    return it.value();
+}
+
+void StringInterner::release(quint32 id) {
+    if (id >= quint32(references.size()) || references[id] == 0) {
+        return;
+    }
+
+    references[id] -= 1;
+    if (references[id] == 0) {
+        ids.remove(strings[id]);
+        strings[id].clear();
+        freeIds.append(id);
+    }
+}
+
+int StringInterner::size() const {
+    return ids.size();
+}
+
+}
@@ -0,0 +1,92 @@
+#ifndef IDTABLE_H
+#define IDTABLE_H
+
+#include <QtCore>
+
+#include "option.h"
+
+namespace Lsp {
+
+/**
+ * Flat open addressing (linear probing) hash table from 64 bit keys to
+ * 32 bit rows. Slots are stored inline in a single array, so a lookup is
+ * usually a single cache line.
+ */
+class IdTable {
+public:
+    /** Returned when there is no row for a key */
+    static constexpr quint32 none = 0xFFFFFFFF;
+
+    IdTable();
+
+    quint32 find(quint64 key) const;
+
+    /** Inserts or replaces the row for key, returning the previous row (or none) */
+    quint32 insert(quint64 key, quint32 row);
+
+    /** Removes key, returning its row (or none) */
+    quint32 erase(quint64 key);
+
+    int size() const;
+
+    int capacity() const;
+
+private:
+    enum class SlotState : quint8 {
+        Empty,
+        Full,
+        Deleted,
+    };
+
+    struct Slot {
+        quint64 key;
+        quint32 row;
+        SlotState state;
+    };
+
+    QVector<Slot> slots;
+
+    /** Slots that are Full */
+    int count = 0;
+
+    /** Slots that are Full or Deleted (i.e., lengthen probe sequences) */
+    int used = 0;
+
+    static quint64 hash(quint64 key);
+
+    /** The slot holding key, or -1 */
+    int findSlot(quint64 key) const;
+
+    void rehash(int capacity);
+};
+
+/**
+ * Maps strings to small integers and back, with reference counts so ids
+ * of strings no longer in use are recycled
+ */
+class StringInterner {
+public:
+    /** Returns the id of the string, adding a reference to it */
+    quint32 intern(const QString &value);
+
+    /** Returns the id of the string, if it is currently interned */
+    option<quint32> find(const QString &value) const;
+
+    /** Removes a reference to the id, forgetting the string when none remain */
+    void release(quint32 id);
+
+    int size() const;
+
+private:
+    QHash<QString, quint32> ids {};
+
+    QVector<QString> strings {};
+
+    QVector<quint32> references {};
+
+    QVector<quint32> freeIds {};
+};
+
+}
+
+#endif // IDTABLE_H
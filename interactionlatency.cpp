@@ -0,0 +1,128 @@
+#include "interactionlatency.h"
+#include "metrics.h"
+
+void InteractionLatency::onLspMessage(const std::shared_ptr<Lsp::Message> &message) {
+    if (message->getSender() == Lsp::Entity::Client) {
+        onClientMessage(message);
+    } else {
+        onServerMessage(message);
+    }
+}
+
+const Histogram& InteractionLatency::getEditToDiagnostics() const {
+    return editToDiagnostics;
+}
+
+const Histogram& InteractionLatency::getEditToCompletion() const {
+    return editToCompletion;
+}
+
+quint64 InteractionLatency::getUnanswered() const {
+    return unanswered;
+}
+
+void InteractionLatency::onClientMessage(const std::shared_ptr<Lsp::Message> &message) {
+    QString method = message->tryGetMethod().value_or(QString());
+    if (!method.startsWith("textDocument/")) {
+        return;
+    }
+
+    QJsonObject identifier = message->getContents().object().value("params").toObject().value("textDocument").toObject();
+    QString uri = identifier.value("uri").toString();
+    qint64 at = message->getTiming().lastByte;
+
+    if (method == "textDocument/didChange") {
+        Chain &chain = chains[uri];
+
+        QJsonValue version = identifier.value("version");
+        chain.pending.push_back(Edit {version.isDouble() ? option<qint64>(qint64(version.toDouble())) : option<qint64>(), at});
+        chain.unpairedEdit = at;
+
+        while (int(chain.pending.size()) > pendingLimit) {
+            chain.pending.pop_front();
+            unanswered += 1;
+        }
+    } else if (method == "textDocument/didOpen" || method == "textDocument/didClose") {
+        auto it = chains.find(uri);
+        if (it != chains.end()) {
+            unanswered += it->second.pending.size();
+            chains.erase(it);
+        }
+    } else if (method == "textDocument/completion" && message->getKind() == Lsp::Message::Kind::Request) {
+        auto it = chains.find(uri);
+        if (it == chains.end() || !it->second.unpairedEdit) {
+            // Invoked explicitly rather than while typing
+            return;
+        }
+
+        completions.push_back(PendingCompletion {std::static_pointer_cast<Lsp::Request>(message), it->second.unpairedEdit.value()});
+        it->second.unpairedEdit = {};
+
+        while (int(completions.size()) > pendingLimit) {
+            completions.pop_front();
+        }
+    }
+}
+
+void InteractionLatency::onServerMessage(const std::shared_ptr<Lsp::Message> &message) {
+    if (message->getKind() == Lsp::Message::Kind::Notification && message->tryGetMethod() == QString("textDocument/publishDiagnostics")) {
+        QJsonObject params = message->getContents().object().value("params").toObject();
+        QJsonValue version = params.value("version");
+
+        onDiagnostics(params.value("uri").toString(), version.isDouble() ? option<qint64>(qint64(version.toDouble())) : option<qint64>(), message->getTiming().lastByte);
+    } else if (message->getKind() == Lsp::Message::Kind::Response && message->tryGetMethod() == QString("textDocument/completion")) {
+        onCompletionResponse(static_cast<Lsp::Response&>(*message));
+    }
+}
+
+void InteractionLatency::onDiagnostics(const QString &uri, option<qint64> version, qint64 at) {
+    auto it = chains.find(uri);
+    if (it == chains.end()) {
+        return;
+    }
+
+    auto &pending = it->second.pending;
+
+    // Edits are answered in order: everything up to the published version, or everything so far if it has none
+    while (!pending.empty()) {
+        const Edit &edit = pending.front();
+        if (version && edit.version && edit.version.value() > version.value()) {
+            break;
+        }
+
+        editToDiagnostics.record(std::max<qint64>(at - edit.at, 0) / 1000);
+        pending.pop_front();
+    }
+}
+
+void InteractionLatency::onCompletionResponse(Lsp::Response &response) {
+    auto request = response.getRequest();
+    if (!request) {
+        return;
+    }
+
+    for (auto it = completions.begin(); it != completions.end(); ++it) {
+        if (it->request.lock() != request) {
+            continue;
+        }
+
+        // A cancelled completion was overtaken by more typing, so the user never saw it
+        if (!request->isCancelled() && !response.tryGetErrorCode()) {
+            editToCompletion.record(std::max<qint64>(response.getTiming().lastByte - it->editAt, 0) / 1000);
+        }
+
+        completions.erase(it);
+        return;
+    }
+}
+
+void InteractionLatency::appendOpenMetrics(QByteArray &out) const {
+    using namespace Metrics::Exposition;
+
+    family(out, "lspmonitor_interaction_seconds", "histogram", "Time from a textDocument/didChange to the diagnostics or completion Response that follows it");
+    histogram(out, "lspmonitor_interaction_seconds", "kind=\"diagnostics\"", editToDiagnostics, 1e6);
+    histogram(out, "lspmonitor_interaction_seconds", "kind=\"completion\"", editToCompletion, 1e6);
+
+    family(out, "lspmonitor_interaction_unanswered_total", "counter", "Document edits dropped before any diagnostics were published for them");
+    sample(out, "lspmonitor_interaction_unanswered_total", "", unanswered);
+}
@@ -0,0 +1,89 @@
+#ifndef INTERACTIONLATENCY_H
+#define INTERACTIONLATENCY_H
+
+#include <QtCore>
+
+#include <deque>
+#include <map>
+#include <memory>
+
+#include "histogram.h"
+#include "lspschemavalidator.h"
+
+/**
+ * Latencies the user feels while typing, rather than those of single
+ * Requests (µs):
+ *
+ *  - Edit to diagnostics: from the last byte of the didChange making version
+ *    N of a document to the first publishDiagnostics for version N or later
+ *    (or, if the server doesn't send versions, the first one after the edit).
+ *    Every edit answered by a publish is counted, so a burst of keystrokes
+ *    is measured from each of them.
+ *  - Keystroke to completion: from the last didChange of a document to the
+ *    Response to the completion Request that follows it.
+ *
+ * Edits are tracked per document as a chain of versions; chains are bounded,
+ * and edits dropped from them (or from closed documents) are counted as
+ * unanswered.
+ */
+class InteractionLatency {
+public:
+    /** Pending edits kept per document, and completion Requests kept in flight */
+    static constexpr int pendingLimit = 256;
+
+    void onLspMessage(const std::shared_ptr<Lsp::Message> &message);
+
+    /** didChange to publishDiagnostics (µs) */
+    const Histogram& getEditToDiagnostics() const;
+
+    /** didChange to completion Response (µs) */
+    const Histogram& getEditToCompletion() const;
+
+    /** Edits that never got diagnostics before they were dropped */
+    quint64 getUnanswered() const;
+
+    /** Appends the interaction latency metrics in the OpenMetrics text format */
+    void appendOpenMetrics(QByteArray &out) const;
+
+private:
+    struct Edit {
+        /** The document version, if the client sent one */
+        option<qint64> version;
+
+        /** Last byte of the didChange (ns, monotonic) */
+        qint64 at;
+    };
+
+    struct Chain {
+        std::deque<Edit> pending {};
+
+        /** The last edit, until a completion Request has been paired with it */
+        option<qint64> unpairedEdit {};
+    };
+
+    struct PendingCompletion {
+        std::weak_ptr<Lsp::Request> request;
+
+        qint64 editAt;
+    };
+
+    void onClientMessage(const std::shared_ptr<Lsp::Message> &message);
+
+    void onServerMessage(const std::shared_ptr<Lsp::Message> &message);
+
+    void onDiagnostics(const QString &uri, option<qint64> version, qint64 at);
+
+    void onCompletionResponse(Lsp::Response &response);
+
+    std::map<QString, Chain> chains {};
+
+    std::deque<PendingCompletion> completions {};
+
+    Histogram editToDiagnostics {};
+
+    Histogram editToCompletion {};
+
+    quint64 unanswered = 0;
+};
+
+#endif // INTERACTIONLATENCY_H
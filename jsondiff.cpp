@@ -0,0 +1,78 @@
+#include "jsondiff.h"
+
+namespace JsonDiff {
+
+namespace {
+    QString escapeToken(QString token) {
+        return token.replace("~", "~0").replace("/", "~1");
+    }
+
+    QString summarise(const QJsonValue &value) {
+        if (value.isUndefined()) {
+            return "(missing)";
+        }
+
+        QByteArray json;
+        if (value.isObject()) {
+            json = QJsonDocument(value.toObject()).toJson(QJsonDocument::Compact);
+        } else if (value.isArray()) {
+            json = QJsonDocument(value.toArray()).toJson(QJsonDocument::Compact);
+        } else {
+            // Scalars can only be serialised inside an array
+            json = QJsonDocument(QJsonArray {value}).toJson(QJsonDocument::Compact).mid(1).chopped(1);
+        }
+
+        QString text = QString::fromUtf8(json);
+        return text.size() > 60 ? text.left(57) + "..." : text;
+    }
+
+    void compare(const QString &path, const QJsonValue &before, const QJsonValue &after, int limit, QVector<Difference> &out) {
+        if (out.size() >= limit) {
+            return;
+        }
+
+        if (before.type() != after.type()) {
+            out.append(Difference {path, before, after});
+            return;
+        }
+
+        if (before.isObject()) {
+            QJsonObject a = before.toObject();
+            QJsonObject b = after.toObject();
+
+            // Keys of both, in order (QJsonObject keys are sorted)
+            QStringList keys = a.keys();
+            for (const QString &key : b.keys()) {
+                if (!a.contains(key)) {
+                    keys.append(key);
+                }
+            }
+            std::sort(keys.begin(), keys.end());
+
+            for (const QString &key : keys) {
+                compare(path + "/" + escapeToken(key), a.value(key), b.value(key), limit, out);
+            }
+        } else if (before.isArray()) {
+            QJsonArray a = before.toArray();
+            QJsonArray b = after.toArray();
+
+            for (int i = 0; i < std::max(a.size(), b.size()); i++) {
+                compare(path + "/" + QString::number(i), i < a.size() ? a.at(i) : QJsonValue(QJsonValue::Undefined), i < b.size() ? b.at(i) : QJsonValue(QJsonValue::Undefined), limit, out);
+            }
+        } else if (before != after) {
+            out.append(Difference {path, before, after});
+        }
+    }
+}
+
+QString Difference::toString() const {
+    return (path.isEmpty() ? "/" : path) + ": " + summarise(before) + " -> " + summarise(after);
+}
+
+QVector<Difference> diff(const QJsonValue &before, const QJsonValue &after, int limit) {
+    QVector<Difference> out;
+    compare(QString(), before, after, limit, out);
+    return out;
+}
+
+}
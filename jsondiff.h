@@ -0,0 +1,32 @@
+#ifndef JSONDIFF_H
+#define JSONDIFF_H
+
+#include <QtCore>
+
+/**
+ * Structural differences between two JSON documents: objects are compared
+ * member by member and arrays element by element, so a change deep inside a
+ * large result is reported at its own location rather than as a change of
+ * the whole value.
+ */
+namespace JsonDiff {
+
+struct Difference {
+    /** JSON pointer to the location, e.g. "/result/items/3/label" */
+    QString path;
+
+    /** Undefined if the location only exists on the other side */
+    QJsonValue before;
+
+    QJsonValue after;
+
+    /** One line description, e.g. "/result/0/kind: 3 -> 2" */
+    QString toString() const;
+};
+
+/** The differences between the values, in document order, stopping after limit */
+QVector<Difference> diff(const QJsonValue &before, const QJsonValue &after, int limit = 16);
+
+}
+
+#endif // JSONDIFF_H
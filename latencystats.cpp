@@ -0,0 +1,97 @@
+#include "latencystats.h"
+
+#include <QVBoxLayout>
+#include <QHeaderView>
+
+void LatencyStats::onLspMessage(const std::shared_ptr<Lsp::Message> &message) {
+    if (message->getKind() != Lsp::Message::Kind::Response) {
+        return;
+    }
+
+    auto response = static_cast<Lsp::Response*>(message.get());
+    auto request = response->getRequest();
+
+    // Cancelled Requests are accounted for by CancellationStats
+    if (!request || request->isCancelled()) {
+        return;
+    }
+
+    auto &entry = methods[Key(request->getSender(), request->getMethod())];
+    if (!entry) {
+        entry = std::make_unique<MethodLatency>();
+    }
+
+    qint64 total = response->getTiming().lastByte - request->getTiming().lastByte;
+
+    entry->total.record(std::max<qint64>(total, 0) / 1000);
+    entry->server.record(std::max<qint64>(response->getServerTime(), 0) / 1000);
+    entry->transfer.record(std::max<qint64>(response->getTransferTime(), 0) / 1000);
+}
+
+const std::map<LatencyStats::Key, std::unique_ptr<LatencyStats::MethodLatency>>& LatencyStats::getMethods() const {
+    return methods;
+}
+
+LatencyPanel::LatencyPanel(const LatencyStats &stats, const InteractionLatency &interactions, QWidget *parent) : QWidget(parent), stats(stats), interactions(interactions) {
+    auto layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(&table);
+
+    table.setColumnCount(9);
+    table.setHorizontalHeaderLabels({"Sender", "Method", "Count", "p50 total (ms)", "p99 total (ms)", "p50 server (ms)", "p99 server (ms)", "p50 transfer (ms)", "p99 transfer (ms)"});
+    table.setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table.verticalHeader()->hide();
+    table.horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+
+    connect(&timer, &QTimer::timeout, this, &LatencyPanel::refresh);
+    timer.start(1000);
+}
+
+void LatencyPanel::refresh() {
+    if (!isVisible()) {
+        return;
+    }
+
+    auto millis = [](quint64 us) { return QString::number(us / 1000.0, 'f', 2); };
+
+    QVector<QStringList> rows;
+
+    // Interactions span several messages, so they have no server or transfer split
+    auto interaction = [&](const QString &name, const Histogram &latency) {
+        rows.append({"Client", name, QString::number(latency.count()), millis(latency.percentile(0.5)), millis(latency.percentile(0.99)), "", "", "", ""});
+    };
+
+    interaction("didChange → publishDiagnostics", interactions.getEditToDiagnostics());
+    interaction("didChange → completion", interactions.getEditToCompletion());
+
+    for (auto &entry : stats.getMethods()) {
+        const auto &latency = *entry.second;
+
+        rows.append({
+            entry.first.first == Lsp::Entity::Client ? "Client" : "Server",
+            entry.first.second,
+            QString::number(latency.total.count()),
+            millis(latency.total.percentile(0.5)),
+            millis(latency.total.percentile(0.99)),
+            millis(latency.server.percentile(0.5)),
+            millis(latency.server.percentile(0.99)),
+            millis(latency.transfer.percentile(0.5)),
+            millis(latency.transfer.percentile(0.99)),
+        });
+    }
+
+    table.setRowCount(rows.size());
+
+    for (int row = 0; row < rows.size(); row++) {
+        const QStringList &cells = rows[row];
+
+        for (int column = 0; column < cells.size(); column++) {
+            auto item = table.item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem();
+                table.setItem(row, column, item);
+            }
+            item->setText(cells[column]);
+        }
+    }
+}
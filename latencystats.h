@@ -0,0 +1,68 @@
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+#include <QWidget>
+#include <QTableWidget>
+#include <QTimer>
+
+#include <map>
+#include <memory>
+
+#include "histogram.h"
+#include "interactionlatency.h"
+#include "lspschemavalidator.h"
+
+/**
+ * Per-method latency distributions of Requests (µs). The total time is split
+ * into the time the server took before it started sending the Response, and
+ * the time the Response took to arrive once started (which dominates for
+ * multi-MB responses).
+ */
+class LatencyStats {
+public:
+    struct MethodLatency {
+        /** Last byte of Request to last byte of Response */
+        Histogram total {};
+
+        /** Last byte of Request to first byte of Response */
+        Histogram server {};
+
+        /** First byte of Response to last byte of Response */
+        Histogram transfer {};
+    };
+
+    /** Keyed by the requesting entity and the method */
+    using Key = std::pair<Lsp::Entity, QString>;
+
+    void onLspMessage(const std::shared_ptr<Lsp::Message> &message);
+
+    const std::map<Key, std::unique_ptr<MethodLatency>>& getMethods() const;
+
+private:
+    std::map<Key, std::unique_ptr<MethodLatency>> methods {};
+};
+
+/**
+ * Table of the LatencyStats of every method, after the edit to diagnostics
+ * and completion latencies, refreshed periodically
+ */
+class LatencyPanel : public QWidget {
+    Q_OBJECT
+
+public:
+    LatencyPanel(const LatencyStats &stats, const InteractionLatency &interactions, QWidget *parent = nullptr);
+
+public slots:
+    void refresh();
+
+private:
+    const LatencyStats &stats;
+
+    const InteractionLatency &interactions;
+
+    QTableWidget table {};
+
+    QTimer timer {};
+};
+
+#endif // LATENCYSTATS_H
@@ -0,0 +1,55 @@
+#include "lineindex.h"
+
+LineIndex LineIndex::build(const DocumentRope &text, DocumentRope::Encoding encoding) {
+    LineIndex index;
+    index.encoding = encoding;
+    index.lengths.clear();
+    index.lengths.reserve(text.lineCount());
+
+    // Lines can span chunks, so the current line's length carries over between them,
+    // and so can a "\r\n"
+    qint64 current = 0;
+    bool afterCarriageReturn = false;
+
+    text.forEachChunk([&](QStringView chunk) {
+        const QChar *data = chunk.data();
+        qint64 from = afterCarriageReturn && chunk.front() == '\n' ? 1 : 0;
+        afterCarriageReturn = chunk.back() == '\r';
+
+        while (true) {
+            qint64 lineBreak = TextScan::findLineBreak(data, chunk.size(), from);
+            current += TextScan::measure(data + from, lineBreak - from, encoding);
+
+            if (lineBreak == chunk.size()) {
+                break;
+            }
+
+            index.lengths.append(quint32(std::min<qint64>(current, std::numeric_limits<quint32>::max())));
+            current = 0;
+            from = TextScan::skipLineBreak(data, chunk.size(), lineBreak);
+        }
+    });
+
+    index.lengths.append(quint32(std::min<qint64>(current, std::numeric_limits<quint32>::max())));
+    return index;
+}
+
+DocumentRope::Encoding LineIndex::getEncoding() const {
+    return encoding;
+}
+
+qint64 LineIndex::lineCount() const {
+    return lengths.size();
+}
+
+qint64 LineIndex::lineLength(qint64 line) const {
+    if (line < 0 || line >= lengths.size()) {
+        return -1;
+    }
+
+    return lengths.at(line);
+}
+
+bool LineIndex::contains(DocumentRope::Position position) const {
+    return position.character >= 0 && position.character <= lineLength(position.line);
+}
@@ -0,0 +1,36 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <QtCore>
+
+#include "documentrope.h"
+
+/**
+ * The length of every line of one version of a document, in the units of one
+ * position encoding (excluding its "\r\n", '\r' or '\n'). Built in a single
+ * pass over the rope so that checking many positions against the same version
+ * costs a lookup each, rather than a walk down the rope.
+ */
+class LineIndex {
+public:
+    LineIndex() = default;
+
+    static LineIndex build(const DocumentRope &text, DocumentRope::Encoding encoding);
+
+    DocumentRope::Encoding getEncoding() const;
+
+    qint64 lineCount() const;
+
+    /** The length of the line in the encoding's units, or -1 if there is no such line */
+    qint64 lineLength(qint64 line) const;
+
+    /** Whether the position is within the document, allowing the end of each line */
+    bool contains(DocumentRope::Position position) const;
+
+private:
+    DocumentRope::Encoding encoding = DocumentRope::Encoding::Utf16;
+
+    QVector<quint32> lengths {0};
+};
+
+#endif // LINEINDEX_H
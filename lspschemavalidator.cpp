@@ -1,6 +1,13 @@
 #include "lspschemavalidator.h"
+#include "pipelineprofiler.h"
+#include "lspvalidators.h"
+#include "validationpolicy.h"
 
 #include <QException>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <vector>
 
 namespace Lsp {
 
@@ -15,23 +22,24 @@ bool Id::isString() const { return kind == Kind::String; }
 int Id::getNumber() const { return numberId; }
 QString Id::getString() const { return stringId; }
 
-Context::Context(MessageBuilder::Message message, Entity sender) : Context(message.timestamp, sender, message.contents, message.size) {}
-Context::Context(qint64 timestamp, Entity sender, QJsonDocument contents, int size) : timestamp(timestamp), sender(sender), contents(contents), size(size) {}
+Context::Context(MessageBuilder::Message message, Entity sender) : Context(message.timestamp, message.timing, sender, message.contents, message.size) {}
+Context::Context(qint64 timestamp, Entity sender, QJsonDocument contents, int size) : Context(timestamp, FrameBuilder::FrameTiming::fromTimestamp(timestamp), sender, contents, size) {}
+Context::Context(qint64 timestamp, FrameBuilder::FrameTiming timing, Entity sender, QJsonDocument contents, int size) : timestamp(timestamp), timing(timing), sender(sender), contents(contents), size(size) {}
 
-Message::Message(Context c) : sender(c.sender), timestamp(c.timestamp), size(c.size) {}
-SchemaJson* Message::getIssues() { return issues.get(); }
+Message::Message(Context c) : sender(c.sender), timestamp(c.timestamp), timing(c.timing), issues(std::move(c.issues)), size(c.size) {}
+SchemaIssues& Message::getIssues() { return issues; }
+const SchemaIssues& Message::getIssues() const { return issues; }
 Entity Message::getSender() const { return sender; }
 qint64 Message::getTimestamp() const { return timestamp; }
+const FrameBuilder::FrameTiming& Message::getTiming() const { return timing; }
+qint64 Message::getTransferTime() const { return timing.transferTime(); }
 void Message::setIndex(int index) { this->index = index; }
 int Message::getIndex() const { return index; }
-int Message::getIssueCount() const {
-    if (issues) {
-        return issues->issueCount();
-    } else {
-        return 0;
-    }
-}
+int Message::getIssueCount() const { return issues.issueCount(); }
 int Message::getSize() const { return size; }
+int Message::getBatchPosition() const { return batchPosition; }
+int Message::getBatchCount() const { return batchCount; }
+void Message::setBatch(int position, int count) { batchPosition = position; batchCount = count; }
 
 GenericMessage::GenericMessage(Context c) : Message(c), contents(c.contents) {}
 option<QString> GenericMessage::tryGetMethod() const { return {}; }
@@ -51,8 +59,13 @@ Message::Kind Request::getKind() const { return Kind::Request; }
 option<QString> Request::tryGetMethod() const { return getMethod(); }
 QString Request::getMethod() const { return method; }
 Id Request::getId() const { return id; }
-std::shared_ptr<Response> Request::getResponse() { return response; }
+std::shared_ptr<Response> Request::getResponse() { return response.lock(); }
 void Request::setResponse(std::shared_ptr<Response> response) { this->response = response; }
+bool Request::isTimedOut() const { return timedOut; }
+void Request::setTimedOut(bool timedOut) { this->timedOut = timedOut; }
+std::shared_ptr<Notification> Request::getCancellation() const { return cancellation; }
+void Request::setCancellation(std::shared_ptr<Notification> cancellation) { this->cancellation = cancellation; }
+bool Request::isCancelled() const { return cancellation != nullptr; }
 
 GenericRequest::GenericRequest(Context c, QString method, Id id) : Request(c, method, id), contents(c.contents) {}
 QJsonDocument GenericRequest::getContents() const { return contents; }
@@ -75,153 +88,138 @@ qint64 Response::getDuration() const {
 
     return getTimestamp() - request->getTimestamp();
 }
+qint64 Response::getServerTime() const {
+    if (!request) {
+        return -1;
+    }
 
-GenericResponse::GenericResponse(Context c, Id id) : Response(c, id), contents(c.contents) {}
-QJsonDocument GenericResponse::getContents() const { return contents; }
-
-LspSchemaValidator::LspSchemaValidator(Lsp::Entity sender, QObject* parent) : QObject(parent), sender(sender) {}
-
-SchemaIssue::SchemaIssue(Severity severity, QString msg) : severity(severity), message(msg) {}
-SchemaIssue SchemaIssue::error(QString msg) { return SchemaIssue(Severity::Error, msg); }
-
-SchemaJson::SchemaJson() : SchemaJson(Kind::Empty) {}
-SchemaJson SchemaJson::makeObject() { return SchemaJson(Kind::Object); }
-SchemaJson SchemaJson::makeArray() { return SchemaJson(Kind::Array); }
-bool SchemaJson::isObject() const { return kind == Kind::Object; }
-bool SchemaJson::isArray() const { return kind == Kind::Array; }
+    return getTiming().firstByte - request->getTiming().lastByte;
+}
+qint64 Response::getTimeAfterCancel() const {
+    if (!request || !request->isCancelled()) {
+        return -1;
+    }
 
-SchemaJson SchemaJson::member(QString key) {
-    if (kind != Kind::Object) {
-        throw QUnhandledException();
+    // Clamped, as the Response may already have been on its way when the cancel arrived
+    return std::max<qint64>(getTiming().lastByte - request->getCancellation()->getTiming().lastByte, 0);
+}
+option<int> Response::tryGetErrorCode() const {
+    QJsonValue error = getContents().object().value("error");
+    if (!error.isObject() || !error.toObject().value("code").isDouble()) {
+        return {};
     }
 
-    return mapProperties[key].second;
+    return error.toObject().value("code").toInt();
 }
 
-SchemaJson::SchemaJson(Kind kind) {
-    this->kind = kind;
+GenericResponse::GenericResponse(Context c, Id id) : Response(c, id), contents(c.contents) {}
+QJsonDocument GenericResponse::getContents() const { return contents; }
 
-    switch (kind) {
-        case Kind::Object:
-            mapProperties = {};
-            break;
-        case Kind::Array:
-            arrayValues = {};
-            break;
-        case Kind::Empty:
-            break;
-    }
+LspSchemaValidator::LspSchemaValidator(Lsp::Entity sender, QObject* parent) : QObject(parent), sender(sender) {
+    idTracker.setTimeout(defaultRequestTimeout);
 }
 
-SchemaJson::SchemaJson(const SchemaJson& other) {
-    localIssues = other.localIssues;
-    kind = other.kind;
-    switch (other.kind) {
-        case Kind::Object:
-            mapProperties = other.mapProperties;
-            break;
-        case Kind::Array:
-            arrayValues = other.arrayValues;
-            break;
-        case Kind::Empty:
-            break;
-    }
-}
+void LspSchemaValidator::onMessage(MessageBuilder::Message message) {
+    PROFILE_STAGE(Profiling::Stage::Validate);
 
-void SchemaJson::intoObject() {
-    if (kind == Kind::Object) {
-        return;
+    // Both sides expire on any message, so a quiet sender's stale Requests are freed too
+    expireRequests(message.timestamp);
+    if (other) {
+        other->expireRequests(message.timestamp);
     }
 
-    if (kind != Kind::Empty) {
-        throw QUnhandledException();
-    }
+    QJsonDocument root = message.contents;
 
-    kind = Kind::Object;
-    mapProperties = {};
+    if (root.isArray()) {
+        onMessageBatch(message, root.array());
+    } else if (root.isObject()) {
+        onMessageObject(message, root.object());
+    } else {
+        Context c (message, sender);
+        auto lsp = std::make_shared<GenericMessage>(c);
+        lsp->getIssues().error("Unexpected message JSON type");
+        emit emitLspMessage(lsp);
+    }
 }
 
-void SchemaJson::intoArray() {
-    if (kind == Kind::Array) {
+void LspSchemaValidator::onMessageBatch(MessageBuilder::Message message, QJsonArray batch) {
+    if (batch.isEmpty()) {
+        Context c (message, sender);
+        auto lsp = std::make_shared<GenericMessage>(c);
+        lsp->getIssues().error("Batch must not be empty");
+        emit emitLspMessage(lsp);
         return;
     }
 
-    if (kind != Kind::Empty) {
-        throw QUnhandledException();
-    }
+    struct Element {
+        QJsonValue value;
 
-    kind = Kind::Array;
-    arrayValues = {};
-}
+        Context c;
 
-void SchemaJson::error(QString msg) {
-    localIssues.append(SchemaIssue::error(msg));
-}
+        Envelope envelope;
+    };
 
-void SchemaJson::keyError(QString key, QString msg) {
-    if (kind != Kind::Object) {
-        throw QUnhandledException();
-    }
+    int count = batch.size();
 
-    mapProperties[key].first.append(SchemaIssue::error(msg));
-}
+    std::vector<Element> elements;
+    elements.reserve(count);
 
-int SchemaJson::issueCount() const {
-    int count = localIssues.size();
+    for (int i = 0; i < count; i++) {
+        QJsonValue value = batch.at(i);
+        QJsonDocument contents = value.isObject() ? QJsonDocument(value.toObject()) : QJsonDocument();
+        elements.push_back(Element {value, Context(message.timestamp, message.timing, sender, contents, 0), Envelope()});
 
-    if (isObject()) {
-        for (auto it = mapProperties.begin(); it != mapProperties.end(); it++) {
-            count += it->second.first.size();
-            count += it->second.second.issueCount();
+        if (!value.isObject()) {
+            elements.back().c.issues.error("Batch element must be an object");
         }
-    } else if (isArray()) {
-        for (auto child : arrayValues) {
-            count += child.issueCount();
+    }
+
+    // Analysis of the elements is independent, tracking their ids is not
+    // Elements may be anything from a tiny notification to a huge result, so
+    // each is sized as it serializes (compact, without the batch's separators)
+    auto analyse = [this](Element &element) {
+        if (element.c.contents.isObject()) {
+            element.c.size = element.c.contents.toJson(QJsonDocument::Compact).size();
+            element.envelope = analyseObject(element.c, element.c.contents.object());
+        } else {
+            element.c.size = std::max(QJsonDocument(QJsonArray {element.value}).toJson(QJsonDocument::Compact).size() - 2, 0);
         }
+    };
+
+    if (count > 1 && message.size >= parallelBatchBytes) {
+        QtConcurrent::blockingMap(elements, analyse);
+    } else {
+        std::for_each(elements.begin(), elements.end(), analyse);
     }
 
-    return count;
-}
+    for (int i = 0; i < count; i++) {
+        Element &element = elements[i];
 
-void LspSchemaValidator::onMessage(MessageBuilder::Message message) {
-    QJsonDocument root = message.contents;
+        std::shared_ptr<Message> result;
+        if (element.c.contents.isObject()) {
+            result = buildMessage(std::move(element.c), element.envelope);
+        } else {
+            result = std::make_shared<GenericMessage>(std::move(element.c));
+        }
 
-    if (root.isArray()) {
-        onMessageBatch(message, root.array());
-    } else if (root.isObject()) {
-        onMessageObject(message, root.object());
-    } else {
-        Context c (message, sender);
-        auto lsp = std::make_shared<GenericMessage>(c);
-        lsp->getIssues()->error("Unexpected message JSON type");
-        emit emitLspMessage(lsp);
+        result->setBatch(i, count);
+        emit emitLspMessage(result);
     }
-}
 
-void LspSchemaValidator::onMessageBatch(MessageBuilder::Message message, QJsonArray batch) {
-    // TODO: Add support
-    throw QUnhandledException();
-    // Batched messages, for now just turn them into individual messages
-//    for (QJsonValue entry : batch) {
-//        if (entry.isObject()) {
-//            onMessage(MessageBuilder::Message(message.timestamp, QJsonDocument(entry.toObject())));
-//        } else {
-//            // Note: Fallthrough / recursive call not used because constructing a meaningful Message with the
-//            // QJsonDocument incompatible value is difficult. Also it may cause a child array to be interpreted
-//            // as a batch itself, which is forbidden
-////            auto errMsg = std::make_shared<LspMessage>(message);
-////            errMsg->issues.error("Unexpected message JSON type");
-////            emitLspMessage(errMsg);
-//            throw QUnhandledException();
-//        }
-//    }
+    emit emitBatch(sender, count, message.size);
 }
 
 void LspSchemaValidator::onMessageObject(MessageBuilder::Message message, QJsonObject contents) {
-    std::shared_ptr<Message> result;
-
     Context c (message, sender);
 
+    Envelope envelope = analyseObject(c, contents);
+
+    emit emitLspMessage(buildMessage(std::move(c), envelope));
+}
+
+LspSchemaValidator::Envelope LspSchemaValidator::analyseObject(Context &c, const QJsonObject &contents) {
+    Envelope envelope;
+
     // Ensure "jsonrpc" member correct
     validateJsonrpcMember(c, contents);
 
@@ -231,52 +229,86 @@ void LspSchemaValidator::onMessageObject(MessageBuilder::Message message, QJsonO
     auto methodIt = contents.find("method");
     auto idIt = contents.find("id");
 
-    option<QString> method;
-    option<QJsonDocument> params {};
-    option<Id> id;
+    // Requests and Notifications have a method, Responses don't
+    bool isCall = methodIt != contents.end();
 
-    if (methodIt.value().isString()) {
-        method = methodIt.value().toString();
-    } else {
-        issues.keyError("method", "Expected method to be a string");
+    if (isCall) {
+        if (methodIt.value().isString()) {
+            envelope.method = methodIt.value().toString();
+        } else {
+            issues.keyError("method", "Expected method to be a string");
+        }
     }
 
     if (idIt != contents.end()) {
         if (idIt.value().isString()) {
-            id = idIt.value().toString();
+            envelope.id = idIt.value().toString();
         } else if (idIt.value().isDouble()) {
-            id = idIt.value().toInt();
+            envelope.id = idIt.value().toInt();
         } else {
             issues.keyError("id", "Expected id to be a string or number");
-            id = Id();
+            envelope.id = Id();
         }
     }
 
     for (auto it = contents.begin(); it != contents.end(); it++) {
-        if (it.key() == "jsonrpc" || it.key() == "method" || it.key() == "id" || it.key() == "params") {
+        if (it.key() == "jsonrpc" || it.key() == "id") {
+            continue;
+        }
+
+        if (isCall ? (it.key() == "method" || it.key() == "params") : (it.key() == "result" || it.key() == "error")) {
             continue;
         }
 
         issues.keyError(it.key(), "Unexpected member '" + it.key() + "'");
     }
 
-    if (method) {
-        if (id) {
+    if (!isCall && envelope.id) {
+        bool hasResult = contents.contains("result");
+        bool hasError = contents.contains("error");
+
+        if (hasResult && hasError) {
+            issues.keyError("error", "'error' member not permitted when there is a 'result'");
+        } else if (hasError) {
+            validateResponseError(contents.value("error"), issues);
+        } else if (!hasResult) {
+            issues.error("'result' or 'error' member required on Response");
+        }
+    }
+
+    if (envelope.method) {
+        if (envelope.id) {
             // method + id == Request
-            result = buildRequest(c, method.value(), id.value());
+            validateRequest(envelope.method.value(), contents, issues);
         } else {
             // method == Notification
-            result = buildNotification(c, method.value());
+            validateNotification(envelope.method.value(), contents, issues);
         }
-    } else if (id) {
-        // id == Response
-        result = buildResponse(c, id.value());
-    } else {
+    } else if (!envelope.id) {
         issues.error("Could not identify message kind");
-        result = std::make_shared<GenericMessage>(c);
     }
 
-    emitLspMessage(result);
+    return envelope;
+}
+
+std::shared_ptr<Message> LspSchemaValidator::buildMessage(Context c, const Envelope &envelope) {
+    if (envelope.method && !Validators::findMethod(envelope.method.value()) && !uncheckedMethods.contains(envelope.method.value())) {
+        uncheckedMethods.insert(envelope.method.value());
+        c.issues.member("method").info("Method is not in protocol/metaModel.json, so its messages are not checked");
+    }
+
+    if (envelope.method) {
+        if (envelope.id) {
+            return buildRequest(std::move(c), envelope.method.value(), envelope.id.value());
+        } else {
+            return buildNotification(std::move(c), envelope.method.value());
+        }
+    } else if (envelope.id) {
+        // id == Response
+        return buildResponse(std::move(c), envelope.id.value());
+    } else {
+        return std::make_shared<GenericMessage>(std::move(c));
+    }
 }
 
 void LspSchemaValidator::validateJsonrpcMember(Context &c, const QJsonObject &contents) {
@@ -290,14 +322,14 @@ void LspSchemaValidator::validateJsonrpcMember(Context &c, const QJsonObject &co
     }
 }
 
-void LspSchemaValidator::validateResponseError(QJsonValue errorMethod, SchemaJson &rootIssues) {
+void LspSchemaValidator::validateResponseError(QJsonValue errorMethod, SchemaIssues &rootIssues) {
     if (!errorMethod.isObject()) {
         rootIssues.keyError("error", "'error' method must be an object");
         return;
     }
 
     QJsonObject err = errorMethod.toObject();
-    SchemaJson errIssues = rootIssues.member("error");
+    auto errIssues = rootIssues.member("error");
 
     bool hasCode = false;
     bool hasMessage = false;
@@ -351,25 +383,64 @@ void LspSchemaValidator::validateResponseError(QJsonValue errorMethod, SchemaJso
     }
 }
 
-void LspSchemaValidator::validateNotification(QString method, option<QJsonDocument> params, SchemaJson &issues) {
-//    issues.error("I don't like notifications");
+void LspSchemaValidator::validateNotification(QString method, const QJsonObject &contents, SchemaIssues &issues) {
+    validateCall(method, false, contents, issues);
 }
 
-void LspSchemaValidator::validateRequest(option<Id> id, QString method, option<QJsonDocument> params, SchemaJson &issues, std::shared_ptr<LspMessage> msg) {
-//    if (id) {
-//        auto existing = idTracker.insert(id.value(), msg);
-//        if (existing) {
-//            issues.member("id").error("This ID value is already in use for an existing request (" + existing->contents["method"].toString() + ")");
-//        }
-//    }
+void LspSchemaValidator::validateRequest(QString method, const QJsonObject &contents, SchemaIssues &issues) {
+    validateCall(method, true, contents, issues);
+}
+
+void LspSchemaValidator::validateCall(QString method, bool isRequest, const QJsonObject &contents, SchemaIssues &issues) {
+    auto info = Validators::findMethod(method);
+    if (!info) {
+        // The model in protocol/ only covers the common methods, so a missing
+        // method may well be part of the specification. buildMessage() says so
+        return;
+    }
+
+    if (info->isRequest != isRequest) {
+        issues.member("method").error(isRequest ? "Method is a Notification, but was sent as a Request" : "Method is a Request, but was sent as a Notification");
+    }
+
+    if ((info->direction == Validators::Direction::ClientToServer && sender != Entity::Client) || (info->direction == Validators::Direction::ServerToClient && sender != Entity::Server)) {
+        issues.member("method").error(sender == Entity::Client ? "Method is only sent by the server" : "Method is only sent by the client");
+    }
+
+    QJsonValue params = contents.value(QLatin1String("params"));
+
+    if (!info->params) {
+        if (!params.isUndefined()) {
+            issues.member("params").warning("Method does not take params");
+        }
+    } else if (params.isUndefined()) {
+        issues.error("Missing required member 'params'");
+    } else if (!policy || policy->shouldValidateDeeply(method)) {
+        info->params(params, issues.member("params"));
+    }
 }
 
-void LspSchemaValidator::validateResponseSuccess(Id id, QJsonValue result, SchemaJson &issues, std::shared_ptr<LspMessage> msg) {
+void LspSchemaValidator::validateResponseSuccess(QString method, QJsonValue result, SchemaIssues &issues) {
+    auto info = Validators::findMethod(method);
+    if (!info || !info->result) {
+        return;
+    }
 
+    if (policy && !policy->shouldValidateDeeply(method)) {
+        return;
+    }
+
+    info->result(result, issues.member("result"));
 }
 
 std::shared_ptr<Notification> LspSchemaValidator::buildNotification(Context c, QString method) {
-    return std::make_unique<GenericNotification>(c, method);
+    auto result = std::make_shared<GenericNotification>(c, method);
+
+    if (method == "$/cancelRequest") {
+        linkCancellation(result, c.contents.object().value("params"));
+    }
+
+    return result;
 
 //    if (it.key() == "params") {
 //        if (it.value().isObject()) {
@@ -384,12 +455,40 @@ std::shared_ptr<Notification> LspSchemaValidator::buildNotification(Context c, Q
 //    }
 }
 
+void LspSchemaValidator::linkCancellation(std::shared_ptr<Notification> cancellation, QJsonValue params) {
+    QJsonValue idValue = params.toObject().value("id");
+
+    Id id;
+    if (idValue.isString()) {
+        id = idValue.toString();
+    } else if (idValue.isDouble()) {
+        id = idValue.toInt();
+    } else {
+        return;
+    }
+
+    // The sender cancels its own Requests. A cancel for an already answered Request
+    // is an expected race, not an issue.
+    auto request = idTracker.peek(id);
+    if (!request || request.value()->isCancelled()) {
+        return;
+    }
+
+    request.value()->setCancellation(cancellation);
+    emit emitRequestCancelled(request.value());
+}
+
 std::shared_ptr<Request> LspSchemaValidator::buildRequest(Context c, QString method, Id id) {
     auto result = std::make_shared<GenericRequest>(c, method, id);
 
+    // A null or structured id was already reported, and no Response could be matched to it
+    if (!id.isValid()) {
+        return result;
+    }
+
     auto existing = idTracker.insert(id, result);
     if (existing) {
-        c.issues.member("id").error("ID already in use");
+        result->getIssues().member("id").error("ID already in use");
     }
 
     return result;
@@ -402,10 +501,20 @@ std::shared_ptr<Response> LspSchemaValidator::buildResponse(Context c, Id id) {
     if (request) {
         response->setRequest(request.value());
 
+        QJsonObject contents = c.contents.object();
+        if (contents.contains("result") && !contents.contains("error")) {
+            validateResponseSuccess(request.value()->getMethod(), contents.value("result"), response->getIssues());
+        }
+
         // TODO: Alert model that the response has changed / handle in model
         request.value()->setResponse(response);
+    } else if (unmatchedExpected > 0) {
+        // Its Request was skipped under load, or dropped after
+        unmatchedExpected -= 1;
+    } else if (idTracker.getTimeout() > 0) {
+        response->getIssues().member("id").error("ID does not correspond to any pending Request (it may have timed out)");
     } else {
-        c.issues.member("id").error("ID does not correspond to any pending Request");
+        response->getIssues().member("id").error("ID does not correspond to any pending Request");
     }
 
     return response;
@@ -455,62 +564,197 @@ std::shared_ptr<Response> LspSchemaValidator::buildResponse(Context c, Id id) {
 //    }
 }
 
-template <typename T>
-option<T> IdTracker<T>::insert(Id id, T msg) {
-    option<T> ret {};
-
+option<quint64> IdTracker::findKey(const Id &id) const {
     if (id.isNumber()) {
-        auto it = numberIds.find(id.getNumber());
-        if (it != numberIds.end()) {
-            ret = it.value();
-        }
-        numberIds[id.getNumber()] = msg;
+        return quint64(quint32(id.getNumber()));
     } else if (id.isString()) {
-        auto it = stringIds.find(id.getString());
-        if (it != stringIds.end()) {
-            ret = it.value();
+        auto interned = strings.find(id.getString());
+        if (interned) {
+            return stringKeyBase + interned.value();
         }
-        stringIds[id.getString()] = msg;
+    }
+
+    return {};
+}
+
+option<std::shared_ptr<Request>> IdTracker::insert(Id id, std::shared_ptr<Request> msg) {
+    quint64 key;
+    if (id.isNumber()) {
+        key = quint64(quint32(id.getNumber()));
+    } else if (id.isString()) {
+        key = stringKeyBase + strings.intern(id.getString());
+    } else {
+        return {};
+    }
+
+    quint32 row;
+    if (!freeRows.isEmpty()) {
+        row = freeRows.takeLast();
+        rows[row].request = msg;
+        rows[row].key = key;
     } else {
-        throw QUnhandledException();
+        row = rows.size();
+        rows.append(Row {msg, key, 0});
+    }
+
+    if (timeout > 0) {
+        expiries.push_back(Expiry {msg->getTimestamp() + timeout, row, rows[row].generation});
+    }
+
+    option<std::shared_ptr<Request>> ret {};
+
+    quint32 previous = table.insert(key, row);
+    if (previous != IdTable::none) {
+        ret = rows[previous].request;
+
+        // The replaced row held its own reference to the interned string
+        freeRow(previous);
+        if (key >= stringKeyBase) {
+            strings.release(quint32(key - stringKeyBase));
+        }
     }
 
     return ret;
 }
 
-template <typename T>
-option<T> IdTracker<T>::retrieve(Id id) {
-    option<T> ret {};
+option<std::shared_ptr<Request>> IdTracker::take(const Id &id) {
+    auto key = findKey(id);
+    if (!key) {
+        return {};
+    }
 
-    if (id.isNumber()) {
-        auto it = other->numberIds.find(id.getNumber());
-        if (it != other->numberIds.end()) {
-            ret = it.value();
-            other->numberIds.erase(it);
+    quint32 row = table.erase(key.value());
+    if (row == IdTable::none) {
+        return {};
+    }
+
+    std::shared_ptr<Request> request = rows[row].request;
+    freeRow(row);
+
+    if (key.value() >= stringKeyBase) {
+        strings.release(quint32(key.value() - stringKeyBase));
+    }
+
+    return request;
+}
+
+option<std::shared_ptr<Request>> IdTracker::retrieve(Id id) {
+    return other->take(id);
+}
+
+option<std::shared_ptr<Request>> IdTracker::peek(Id id) const {
+    auto key = findKey(id);
+    if (!key) {
+        return {};
+    }
+
+    quint32 row = table.find(key.value());
+    if (row == IdTable::none) {
+        return {};
+    }
+
+    return rows[row].request;
+}
+
+QVector<std::shared_ptr<Request>> IdTracker::expire(qint64 now) {
+    QVector<std::shared_ptr<Request>> expired;
+
+    while (!expiries.empty() && expiries.front().deadline <= now) {
+        Expiry expiry = expiries.front();
+        expiries.pop_front();
+
+        Row &row = rows[expiry.row];
+        if (row.generation != expiry.generation || !row.request) {
+            // Answered (or replaced) before it expired
+            continue;
         }
-    } else if (id.isString()) {
-        auto it = other->stringIds.find(id.getString());
-        if (it != other->stringIds.end()) {
-            ret = it.value();
-            other->stringIds.erase(it);
+
+        expired.append(row.request);
+
+        quint64 key = row.key;
+        table.erase(key);
+        freeRow(expiry.row);
+
+        if (key >= stringKeyBase) {
+            strings.release(quint32(key - stringKeyBase));
         }
     }
 
-    return ret;
+    return expired;
+}
+
+QVector<std::shared_ptr<Request>> IdTracker::clear() {
+    QVector<std::shared_ptr<Request>> cleared;
+
+    for (int row = 0; row < rows.size(); row++) {
+        if (!rows[row].request) {
+            continue;
+        }
+
+        cleared.append(rows[row].request);
+
+        quint64 key = rows[row].key;
+        table.erase(key);
+        freeRow(quint32(row));
+
+        if (key >= stringKeyBase) {
+            strings.release(quint32(key - stringKeyBase));
+        }
+    }
+
+    return cleared;
+}
+
+void IdTracker::freeRow(quint32 row) {
+    rows[row].request.reset();
+    rows[row].generation += 1;
+    freeRows.append(row);
+}
+
+int IdTracker::pendingCount() const {
+    return table.size();
+}
+
+void IdTracker::setTimeout(qint64 timeout) {
+    this->timeout = timeout;
 }
 
-template <typename T>
-void IdTracker<T>::linkWith(IdTracker<T> &other) {
+qint64 IdTracker::getTimeout() const {
+    return timeout;
+}
+
+void IdTracker::linkWith(IdTracker &other) {
     this->other = &other;
     other.other = this;
 }
 
 void LspSchemaValidator::linkWith(LspSchemaValidator &other) {
     idTracker.linkWith(other.idTracker);
+    this->other = &other;
+    other.other = this;
 }
 
-LspMessage::LspMessage(MessageBuilder::Message msg) : LspMessage(Kind::Unknown, SchemaJson::makeObject(), msg) {}
+void LspSchemaValidator::setRequestTimeout(qint64 timeout) {
+    idTracker.setTimeout(timeout);
+}
+
+QVector<std::shared_ptr<Request>> LspSchemaValidator::dropPendingRequests() {
+    return idTracker.clear();
+}
 
-LspMessage::LspMessage(LspMessage::Kind kind, SchemaJson issues, MessageBuilder::Message msg) : kind(kind), issues(issues), timestamp(msg.timestamp), contents(msg.contents) {}
+void LspSchemaValidator::expectUnmatchedResponses(int count) {
+    unmatchedExpected += count;
+}
+
+void LspSchemaValidator::setPolicy(ValidationPolicy *policy) {
+    this->policy = policy;
+}
+
+void LspSchemaValidator::expireRequests(qint64 now) {
+    for (auto &request : idTracker.expire(now)) {
+        request->setTimedOut(true);
+        emit emitRequestTimeout(request);
+    }
+}
 
 }
@@ -3,12 +3,18 @@
 
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QSet>
 
+#include <deque>
 #include <map>
 
 #include "option.h"
+#include "idtable.h"
+#include "schemaissues.h"
 #include "messagebuilder.h"
 
+class ValidationPolicy;
+
 namespace Lsp {
 
 /**
@@ -134,134 +140,17 @@ enum class InitializeError {
     Other,
 };
 
-struct SchemaIssue {
-    enum class Severity {
-        Error = 1,
-        Warning = 2,
-        Info = 3,
-    } severity;
-
-    QString message;
-
-    static SchemaIssue error(QString msg);
-
-    SchemaIssue(Severity severity, QString message);
-};
-
-/**
- * JSON like tree structure that is a subset of the message, with
- * entries nesting to reach all schema issues
- */
-class SchemaJson {
-public:
-    QVector<SchemaIssue> localIssues;
-
-    bool isObject() const;
-
-    bool isArray() const;
-
-    void error(QString msg);
-
-    void keyError(QString key, QString msg);
-
-    void intoObject();
-
-    void intoArray();
-
-    int issueCount() const;
-
-    int hintCount() const;
-
-    int warningCount() const;
-
-    int errorCount() const;
-
-    SchemaJson member(QString key);
-
-    static SchemaJson makeObject();
-
-    static SchemaJson makeArray();
-
-    static SchemaJson makeValue();
-
-    SchemaJson();
-
-    SchemaJson(const SchemaJson&);
-
-private:
-    enum class Kind {
-        Object,
-        Array,
-        Empty,
-    } kind;
-
-    // TODO: Make union without segfaulting
-    std::map<QString, std::pair<QVector<SchemaIssue>, SchemaJson>> mapProperties;
-    QVector<SchemaJson> arrayValues;
-
-    SchemaJson(Kind kind);
-};
-
-/**
- * Represents a JSON document, annotated with JSON-RPC / LSP specific
- * information such as message kind, schema violations, etc.
- */
-struct LspMessage {
-    /** Which entity sent the message */
-    Entity sender;
-
-    /** What kind of JSON-RPC message this is */
-    enum class Kind {
-        /** The message is a Notification (no acknowlegement required) */
-        Notification,
-
-        /** The message is a request (expects a response) */
-        Request,
-
-        /** The message is a response (matches with previous request) */
-        Response,
-
-        /** The message is a list of messages send in a single array */
-        Batch, // TODO: Support this. For now, just split into individual messages
-
-        /** The message does not conform to the set of known kinds */
-        Unknown,
-    } kind;
-
-    /** Any issues with the message */
-    SchemaJson issues;
-
-    /** The time the message completed arriving */
-    qint64 timestamp;
-
-    /** The JSON representation of the message */
-    QJsonDocument contents;
-
-    /** The method associated with this message (the method of the Request if a Response) */
-    QString method;
-
-    /** A unique identifier, also the index of the message in the Model */
-    int index = -1;
-
-    // TODO: Remove & turn message kinds into sub classes
-    std::shared_ptr<LspMessage> match;
-
-    LspMessage() = default;
-
-    LspMessage(MessageBuilder::Message msg);
-
-    LspMessage(Kind kind, SchemaJson issues, MessageBuilder::Message msg);
-};
-
 struct Context {
     qint64 timestamp;
+    FrameBuilder::FrameTiming timing;
     Entity sender;
     QJsonDocument contents;
-    SchemaJson issues = SchemaJson::makeObject();
+    SchemaIssues issues {};
     int size;
 
     Context(MessageBuilder::Message msg, Entity sender);
     Context(qint64 timestamp, Entity sender, QJsonDocument contents, int size);
+    Context(qint64 timestamp, FrameBuilder::FrameTiming timing, Entity sender, QJsonDocument contents, int size);
 };
 
 /**
@@ -283,8 +172,8 @@ public:
         /** The message is a response (matches with previous request) */
         Response,
 
-        /** The message is a list of messages send in a single array */
-        Batch, // TODO: Support this. For now, just split into individual messages
+        /** Unused; batches are split into their elements (see getBatchCount()) */
+        Batch,
 
         /** The message does not conform to the set of known kinds */
         Unknown,
@@ -294,14 +183,32 @@ public:
 
     qint64 getTimestamp() const;
 
+    /** Precise (monotonic ns) timing of the message's arrival */
+    const FrameBuilder::FrameTiming& getTiming() const;
+
+    /** How long the message took to arrive, from first to last byte (ns) */
+    qint64 getTransferTime() const;
+
     int getIndex() const;
 
     void setIndex(int index);
 
-    SchemaJson* getIssues();
+    SchemaIssues& getIssues();
+
+    const SchemaIssues& getIssues() const;
 
     int getIssueCount() const;
 
+    /**
+     * Elements of a batch share the timing of its frame, and split its size
+     * evenly. Not in a batch, the position is -1 and the count 0.
+     */
+    int getBatchPosition() const;
+
+    int getBatchCount() const;
+
+    void setBatch(int position, int count);
+
     int getSize() const;
 
     virtual option<QString> tryGetMethod() const = 0;
@@ -319,13 +226,19 @@ private:
     /** When the message was fully received */
     qint64 timestamp;
 
-    /** Any issues with the message's LSP compliance (nullptr if none) */
-    std::unique_ptr<SchemaJson> issues;
+    FrameBuilder::FrameTiming timing;
+
+    /** Any issues with the message's LSP compliance */
+    SchemaIssues issues;
 
     /** The index of the message in the overall sequence */
     int index = -1;
 
     int size = -1;
+
+    int batchPosition = -1;
+
+    int batchCount = 0;
 };
 
 /**
@@ -391,12 +304,29 @@ public:
 
     void setResponse(std::shared_ptr<Response> response);
 
+    /** Whether the Request went unanswered for longer than the request timeout */
+    bool isTimedOut() const;
+
+    void setTimedOut(bool timedOut);
+
+    /** The $/cancelRequest Notification sent for this Request (nullptr if not cancelled) */
+    std::shared_ptr<Notification> getCancellation() const;
+
+    void setCancellation(std::shared_ptr<Notification> cancellation);
+
+    bool isCancelled() const;
+
 private:
-    std::shared_ptr<Response> response;
+    /** Weak, as the Response holds the Request (the model owns both) */
+    std::weak_ptr<Response> response;
+
+    std::shared_ptr<Notification> cancellation;
 
     QString method;
 
     Id id;
+
+    bool timedOut = false;
 };
 
 class GenericRequest : public Request {
@@ -422,6 +352,22 @@ public:
     /** Get the duration between the original Requeat and this Response */
     qint64 getDuration() const;
 
+    /**
+     * Get the time the server spent before starting to send this Response: from
+     * the last byte of the Request to the first byte of the Response (ns)
+     */
+    qint64 getServerTime() const;
+
+    /**
+     * Get how long the server kept going after the Request was cancelled: from the
+     * last byte of the $/cancelRequest to the last byte of this Response (ns), or
+     * -1 if the Request wasn't cancelled
+     */
+    qint64 getTimeAfterCancel() const;
+
+    /** The error code of this Response, if it is an error Response */
+    option<int> tryGetErrorCode() const;
+
     std::shared_ptr<Request> getRequest();
 
     void setRequest(std::shared_ptr<Request> request);
@@ -446,36 +392,91 @@ private:
  * Tracks active message ID's, so we can link them to requests and detect
  * duplicates
  *
+ * Ids are mapped to keys (numbers directly, strings through an interner) in a
+ * flat open addressing table of row indices into a slab of pending Requests.
+ * Requests that are never answered expire after the timeout, so the tracker
+ * stays bounded over long sessions.
+ *
  * Definitely not thread safe. Needs to be linked with another, so responses
  * can be matched with requests of the other, and vice versa
  */
-template <typename T>
 class IdTracker {
 public:
     IdTracker() = default;
 
     /** Links the two stores, so that retrievals work on the other one */
-    void linkWith(IdTracker<T> &other);
+    void linkWith(IdTracker &other);
+
+    /** How long (ms) a Request may stay pending before it expires. 0 disables expiry */
+    void setTimeout(qint64 timeout);
+
+    qint64 getTimeout() const;
 
     /**
      * Inserts the request into the tracker, returning a pointer to the old message stored
-     * under that ID if it exists.
+     * under that ID if it exists. Requests with an invalid ID are not tracked.
      */
-    option<T> insert(Id id, T msg);
+    option<std::shared_ptr<Request>> insert(Id id, std::shared_ptr<Request> msg);
 
     /**
-     * Returns a pointer to the message stored under that ID if it exists, and
-     * removes the message from the tracker.
+     * Returns a pointer to the message stored under that ID in the other tracker if it
+     * exists, and removes the message from it.
      */
-    option<T> retrieve(Id id);
+    option<std::shared_ptr<Request>> retrieve(Id id);
+
+    /** Returns the message stored under that ID in this tracker, without removing it */
+    option<std::shared_ptr<Request>> peek(Id id) const;
+
+    /** Removes and returns every Request whose timeout elapsed at or before now (ms) */
+    QVector<std::shared_ptr<Request>> expire(qint64 now);
+
+    /** Removes and returns every pending Request */
+    QVector<std::shared_ptr<Request>> clear();
+
+    int pendingCount() const;
 
 private:
-    QMap<QString, T> stringIds {};
-    QMap<int, T> numberIds {};
+    struct Row {
+        std::shared_ptr<Request> request;
 
-    IdTracker<T> *other;
-};
+        quint64 key;
+
+        /** Incremented whenever the row is freed, invalidating queued expiries */
+        quint32 generation;
+    };
+
+    struct Expiry {
+        qint64 deadline;
+
+        quint32 row;
+
+        quint32 generation;
+    };
+
+    /** Number ids are below 2^32, string ids are offset above it */
+    static constexpr quint64 stringKeyBase = quint64(1) << 32;
+
+    option<quint64> findKey(const Id &id) const;
 
+    option<std::shared_ptr<Request>> take(const Id &id);
+
+    void freeRow(quint32 row);
+
+    IdTable table {};
+
+    StringInterner strings {};
+
+    QVector<Row> rows {};
+
+    QVector<quint32> freeRows {};
+
+    /** Deadlines are pushed in arrival order, so the front always expires first */
+    std::deque<Expiry> expiries {};
+
+    qint64 timeout = 0;
+
+    IdTracker *other = nullptr;
+};
 
 /**
  * Takes in Messages and validates them against the LSP spec,
@@ -490,46 +491,114 @@ class LspSchemaValidator : public QObject {
     Q_OBJECT
 
 public:
+    /** Long enough for any sane Request, short enough that abandoned ones don't accumulate */
+    static constexpr qint64 defaultRequestTimeout = 5 * 60 * 1000;
+
     LspSchemaValidator(Entity sender, QObject* parent = nullptr);
 
     void linkWith(LspSchemaValidator &other);
 
+    /** How long (ms) Requests from this sender may go unanswered before they time out. 0 disables */
+    void setRequestTimeout(qint64 timeout);
+
+    /** Decides which params and results are validated. Without one, all of them are */
+    void setPolicy(ValidationPolicy *policy);
+
+    /**
+     * Stops tracking the pending Requests from this sender, after analysis
+     * skipped messages that may have answered them. Returns the Requests dropped.
+     */
+    QVector<std::shared_ptr<Request>> dropPendingRequests();
+
+    /**
+     * Expects up to count more Responses from this sender that match no pending
+     * Request, because their Requests were dropped or skipped, and doesn't
+     * report them as issues.
+     */
+    void expectUnmatchedResponses(int count);
+
 signals:
     void emitLspMessage(std::shared_ptr<Message> message);
 
+    /** A Request from this sender went unanswered for longer than the request timeout */
+    void emitRequestTimeout(std::shared_ptr<Request> request);
+
+    /** This sender cancelled one of its pending Requests with $/cancelRequest */
+    void emitRequestCancelled(std::shared_ptr<Request> request);
+
+    /** A batch was received, after its elements were emitted. Bytes is the size of its frame */
+    void emitBatch(Entity sender, int elements, int bytes);
+
 public slots:
     void onMessage(MessageBuilder::Message message);
 
 private:
+    /** Batches at least this big (bytes) have their elements analysed in parallel */
+    static constexpr int parallelBatchBytes = 64 * 1024;
+
+    /** What identifies a message, found by analyseObject() */
+    struct Envelope {
+        option<QString> method;
+
+        option<Id> id;
+    };
+
     void onMessageBatch(MessageBuilder::Message message, QJsonArray batch);
 
     void onMessageObject(MessageBuilder::Message message, QJsonObject contents);
 
+    /**
+     * Checks the envelope and params of a message, writing the issues to the
+     * context. Depends only on the message itself (not on other messages or
+     * the id tracker), so it may be run on the analysis pool.
+     */
+    Envelope analyseObject(Context &c, const QJsonObject &contents);
+
+    /** Builds the message and tracks its id. Must be called in message order */
+    std::shared_ptr<Message> buildMessage(Context c, const Envelope &envelope);
+
     void validateJsonrpcMember(Context &c, const QJsonObject &contents);
 
-    void validateNotification(QString method, option<QJsonDocument> params, SchemaJson& issues);
+    void validateNotification(QString method, const QJsonObject &contents, SchemaIssues &issues);
+
+    void validateRequest(QString method, const QJsonObject &contents, SchemaIssues &issues);
 
-    void validateRequest(option<Id> id, QString method, option<QJsonDocument> params, SchemaJson &issues, std::shared_ptr<LspMessage> msg);
+    /** Checks the method is used as specified, and validates its params with the generated validators */
+    void validateCall(QString method, bool isRequest, const QJsonObject &contents, SchemaIssues &issues);
 
-    void validateResponseSuccess(Id id, QJsonValue result, SchemaJson& issues, std::shared_ptr<LspMessage> msg);
+    void validateResponseSuccess(QString method, QJsonValue result, SchemaIssues &issues);
 
-    void validateResponseError(QJsonValue errorMethod, SchemaJson& rootIssues);
+    void validateResponseError(QJsonValue errorMethod, SchemaIssues &rootIssues);
 
     std::shared_ptr<Notification> buildNotification(Context c, QString method);
 
+    void linkCancellation(std::shared_ptr<Notification> cancellation, QJsonValue params);
+
     std::shared_ptr<Request> buildRequest(Context c, QString method, Id id);
 
     std::shared_ptr<Response> buildResponse(Context c, Id id);
 
     Entity sender;
 
-    IdTracker<std::shared_ptr<Request>> idTracker {};
+    void expireRequests(qint64 now);
+
+    /** The validator of the other sender, whose Requests expire along with this one's */
+    LspSchemaValidator *other = nullptr;
+
+    IdTracker idTracker {};
+
+    ValidationPolicy *policy = nullptr;
+
+    /** Unmatched Responses still expected, see expectUnmatchedResponses() */
+    int unmatchedExpected = 0;
+
+    /** Methods missing from the model, which are reported on their first message only */
+    QSet<QString> uncheckedMethods {};
 
 };
 
 }
 
-Q_DECLARE_METATYPE(std::shared_ptr<Lsp::LspMessage>);
 Q_DECLARE_METATYPE(std::shared_ptr<Lsp::Message>);
 
 #endif // LSPSCHEMAVALIDATOR_H
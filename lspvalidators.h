@@ -0,0 +1,51 @@
+#ifndef LSPVALIDATORS_H
+#define LSPVALIDATORS_H
+
+#include <QJsonValue>
+
+#include "schemaissues.h"
+
+/**
+ * Validators for the params and results of every LSP method. The
+ * implementation (lspvalidators_generated.cpp) is generated at build time
+ * from protocol/metaModel.json by tools/generate_validators.py.
+ *
+ * Validators walk the parsed message once, looking members up by Latin-1
+ * key and only building strings (JSON pointers, messages) when they report
+ * an issue.
+ */
+namespace Lsp::Validators {
+
+/** Writes any issues with value to the cursor */
+using Validator = void (*)(const QJsonValue &value, const SchemaIssues::Cursor &at);
+
+enum class Direction {
+    ClientToServer,
+    ServerToClient,
+    Both,
+};
+
+struct MethodInfo {
+    const char *method;
+
+    Direction direction;
+
+    /** Request (expects a Response) or Notification */
+    bool isRequest;
+
+    /** nullptr if the method takes no params */
+    Validator params;
+
+    /** nullptr for Notifications */
+    Validator result;
+};
+
+/** The validators for the method, or nullptr if it is not part of the specification */
+const MethodInfo* findMethod(const QString &method);
+
+/** The LSP version of the metaModel the validators were generated from */
+const char* specVersion();
+
+}
+
+#endif // LSPVALIDATORS_H
@@ -16,6 +16,9 @@
 #include <QVBoxLayout>
 #include <QWindow>
 #include <QPushButton>
+#include <QTabWidget>
+#include <QStatusBar>
+#include <cstring>
 
 #include <QStringListModel>
 #include <QStyledItemDelegate>
@@ -24,13 +27,222 @@
 #include "communicationmodel.h"
 #include "connectionstream.h"
 #include "stdiomitm.h"
+#include "timelineview.h"
+#include "traceexporter.h"
+#include "metricsexporter.h"
+#include "overheadpanel.h"
+#include "latencystats.h"
+#include "cpuattribution.h"
+#include "validationpolicy.h"
+#include "replay.h"
+#include "replaycomparison.h"
+#include "serversession.h"
+#include "stubserver.h"
+#include "workload.h"
+
+/**
+ * Checks for an option before the application (and so the parser) exists. Used to
+ * pick between a GUI and a plain core application for modes that have no window.
+ */
+static bool hasArgument(int argc, char** argv, const char *name) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--") == 0) {
+            return false;
+        }
+
+        // Either the bare option or its "name=value" form, not any option it prefixes
+        size_t length = std::strlen(name);
+        if (std::strncmp(argv[i], name, length) == 0 && (argv[i][length] == '\0' || argv[i][length] == '=')) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int exportTrace(QString capturePath, QString format, QString outputPath) {
+    QFile capture (capturePath);
+    if (!capture.open(QIODevice::ReadOnly)) {
+        std::cerr << "Unable to open capture: " << capture.errorString().toStdString() << std::endl;
+        return -1;
+    }
+
+    QFile output (outputPath);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "Unable to open output: " << output.errorString().toStdString() << std::endl;
+        return -1;
+    }
+
+    std::unique_ptr<Trace::TraceWriter> writer;
+    if (format == "chrome") {
+        writer = std::make_unique<Trace::ChromeTraceWriter>(&output);
+    } else if (format == "perfetto") {
+        writer = std::make_unique<Trace::PerfettoTraceWriter>(&output);
+    } else {
+        std::cerr << "Unknown trace format: " << format.toStdString() << std::endl;
+        return -1;
+    }
+
+    Trace::TraceExporter exporter (*writer);
+
+    QString error;
+    if (!exporter.exportCapture(&capture, &error)) {
+        std::cerr << "Failed to read capture: " << error.toStdString() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+/** Every metric of the mitm in the OpenMetrics text format */
+static QByteArray renderMetrics(StdioMitm *mitm) {
+    QByteArray out = mitm->metrics.toOpenMetrics();
+    mitm->interactions.appendOpenMetrics(out);
+    mitm->cancellation.appendOpenMetrics(out);
+    mitm->policy.appendOpenMetrics(out);
+    mitm->documents.appendOpenMetrics(out);
+    mitm->ranges.appendOpenMetrics(out);
+    mitm->resources.appendOpenMetrics(out);
+    mitm->cpu.appendOpenMetrics(out);
+    mitm->filter.appendOpenMetrics(out);
+    return out;
+}
+
+/** Runs a capture through the analysis on a virtual clock, and writes the resulting metrics */
+static int analyseCapture(QString capturePath, qint64 requestTimeout, QString outputPath) {
+    QFile capture (capturePath);
+    if (!capture.open(QIODevice::ReadOnly)) {
+        std::cerr << "Unable to open capture: " << capture.errorString().toStdString() << std::endl;
+        return -1;
+    }
+
+    VirtualClock clock;
+    StdioMitm mitm (nullptr);
+    mitm.setRequestTimeout(requestTimeout);
+    mitm.messages.setRetaining(false);
+
+    QString error;
+    if (!mitm.analyseCapture(&capture, clock, &error)) {
+        std::cerr << "Failed to read capture: " << error.toStdString() << std::endl;
+        return -1;
+    }
+
+    return writeReport(QString::fromUtf8(renderMetrics(&mitm)), outputPath) ? 0 : -1;
+}
+
+/** Replays a capture against one server, returning the finished replay or nullptr */
+static std::unique_ptr<Replay::Engine> runReplay(const QString &capturePath, const QStringList &command, Replay::Options options, bool keepResponses) {
+    QFile capture (capturePath);
+    if (!capture.open(QIODevice::ReadOnly)) {
+        std::cerr << "Unable to open capture: " << capture.errorString().toStdString() << std::endl;
+        return nullptr;
+    }
+
+    auto engine = std::make_unique<Replay::Engine>(options);
+    engine->setKeepResponses(keepResponses);
+
+    QString error;
+    if (!engine->load(&capture, &error)) {
+        std::cerr << "Failed to read capture: " << error.toStdString() << std::endl;
+        return nullptr;
+    }
+
+    QEventLoop loop;
+    QObject::connect(engine.get(), &Replay::Engine::emitFinished, &loop, &QEventLoop::quit, Qt::QueuedConnection);
+    engine->start(command);
+    loop.exec();
+
+    return engine;
+}
+
+static bool writeReport(const QString &report, const QString &outputPath) {
+    if (outputPath.isEmpty()) {
+        std::cout << report.toStdString();
+        return true;
+    }
+
+    QFile output (outputPath);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "Unable to open output: " << output.errorString().toStdString() << std::endl;
+        return false;
+    }
+
+    output.write(report.toUtf8());
+    return true;
+}
+
+/**
+ * Replays a capture against the server, or if a candidate is given, against the
+ * server as a baseline and then the candidate. Returns 1 if the candidate regressed
+ */
+static int replay(QString capturePath, QStringList command, QStringList candidate, Replay::Options options, double alpha, QString outputPath) {
+    auto baseline = runReplay(capturePath, command, options, !candidate.isEmpty());
+    if (!baseline) {
+        return -1;
+    }
+
+    if (candidate.isEmpty()) {
+        return writeReport(baseline->report(), outputPath) ? 0 : -1;
+    }
+
+    auto compared = runReplay(capturePath, candidate, options, true);
+    if (!compared) {
+        return -1;
+    }
+
+    Replay::Comparison comparison (*baseline, *compared, alpha);
+
+    QString report = "Baseline: " + command.join(' ') + "\n" + baseline->report()
+        + "\nCandidate: " + candidate.join(' ') + "\n" + compared->report()
+        + "\n" + comparison.report();
+
+    if (!writeReport(report, outputPath)) {
+        return -1;
+    }
+
+    return comparison.hasRegressions() ? 1 : 0;
+}
+
+/** Generates the scenario's load on a project with the server, and reports its latency */
+static int generateWorkload(QString scenarioPath, QString projectPath, QStringList command, QString outputPath) {
+    QFile file (scenarioPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "Unable to open scenario: " << file.errorString().toStdString() << std::endl;
+        return -1;
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument json = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!json.isObject()) {
+        std::cerr << "Failed to read scenario: " << parseError.errorString().toStdString() << std::endl;
+        return -1;
+    }
+
+    QString error;
+    auto scenario = Workload::Scenario::fromJson(json.object(), &error);
+    if (!scenario) {
+        std::cerr << "Invalid scenario: " << error.toStdString() << std::endl;
+        return -1;
+    }
+
+    Workload::Generator generator (scenario.value(), projectPath);
+
+    QEventLoop loop;
+    QObject::connect(&generator, &Workload::Generator::emitFinished, &loop, &QEventLoop::quit, Qt::QueuedConnection);
+    generator.start(command);
+    loop.exec();
+
+    return writeReport(generator.report(), outputPath) ? 0 : -1;
+}
 
 int main(int argc, char** argv) {
     // Currently causing bugs when enabled
     // std::ios_base::sync_with_stdio(false);
     std::cin.tie(nullptr);
 
-    QApplication* app = new QApplication(argc, argv);
+    bool headless = hasArgument(argc, argv, "--export-trace") || hasArgument(argc, argv, "--headless") || hasArgument(argc, argv, "--replay") || hasArgument(argc, argv, "--workload") || hasArgument(argc, argv, "--stub") || hasArgument(argc, argv, "--analyse");
+
+    QCoreApplication* app = headless ? new QCoreApplication(argc, argv) : new QApplication(argc, argv);
     QCoreApplication::setApplicationName("lspmonitor");
     QCoreApplication::setApplicationVersion("0.0.0");
 
@@ -42,26 +254,211 @@ int main(int argc, char** argv) {
     QCommandLineOption guiOpt ( "gui", "Launch an untied GUI instance to monitor the communications" );
     parser.addOption(guiOpt);
 
+    QCommandLineOption headlessOpt ( "headless", "Run the proxy without a GUI" );
+    parser.addOption(headlessOpt);
+
+    QCommandLineOption metricsPortOpt ( "metrics-port", "Serve Prometheus metrics on localhost:<port>", "port" );
+    parser.addOption(metricsPortOpt);
+
+    QCommandLineOption metricsFileOpt ( "metrics-textfile", "Periodically write Prometheus metrics to a file (for node_exporter)", "file" );
+    parser.addOption(metricsFileOpt);
+
+    QCommandLineOption metricsIntervalOpt ( "metrics-interval", "Seconds between writes of --metrics-textfile", "seconds", "15" );
+    parser.addOption(metricsIntervalOpt);
+
+    QCommandLineOption recordOpt ( "record", "Stream all messages and server stderr to a capture file", "file" );
+    parser.addOption(recordOpt);
+
+    QCommandLineOption exportTraceOpt ( "export-trace", "Convert a capture to a trace file instead of launching a server", "capture" );
+    parser.addOption(exportTraceOpt);
+
+    QCommandLineOption traceFormatOpt ( "trace-format", "Trace format for --export-trace: chrome (default) or perfetto", "format", "chrome" );
+    parser.addOption(traceFormatOpt);
+
+    QCommandLineOption analyseOpt ( "analyse", "Run a capture through the analysis at its recorded times instead of launching a server, and write the metrics", "capture" );
+    parser.addOption(analyseOpt);
+
+    QCommandLineOption outputOpt ( QStringList { "o", "output" }, "Output file for --export-trace or --analyse, or for the --replay or --workload report (stdout by default)", "file" );
+    parser.addOption(outputOpt);
+
+    QCommandLineOption requestTimeoutOpt ( "request-timeout", "Seconds before an unanswered Request is marked timed out (0 to never)", "seconds", QString::number(Lsp::LspSchemaValidator::defaultRequestTimeout / 1000) );
+    parser.addOption(requestTimeoutOpt);
+
+    QCommandLineOption validationOpt ( "validation", "What is validated: full (default) or envelope (only the JSON-RPC envelope)", "mode", "full" );
+    parser.addOption(validationOpt);
+
+    QCommandLineOption sampleRateOpt ( "sample-rate", "Fraction of messages with the method to validate the params / result of, e.g. textDocument/semanticTokens/full=0.1. Use * for every other method. Repeatable", "method=rate" );
+    parser.addOption(sampleRateOpt);
+
+    QCommandLineOption queueLimitOpt ( "analysis-queue-limit", "MiB of unanalysed input at which analysis starts to degrade (0 to never)", "MiB", QString::number(ValidationPolicy::defaultQueueLimit / (1024 * 1024)) );
+    parser.addOption(queueLimitOpt);
+
+    QCommandLineOption noAnalysisOpt ( "no-analysis", "Only forward messages, without analysing or recording them" );
+    parser.addOption(noAnalysisOpt);
+
+    QCommandLineOption supersedeOpt ( "supersede", "What to do with a Request superseded by a newer one of the same method for the same document: "
+        "off (default), cancel (send $/cancelRequest on the client's behalf) or answer (hold newer Requests until the older is answered, answering any they replace with RequestCancelled)", "mode", "off" );
+    parser.addOption(supersedeOpt);
+
+    QCommandLineOption supersedeMethodsOpt ( "supersede-methods", "Comma separated methods --supersede applies to", "methods", ProxyFilter::defaultSupersedable.join(',') );
+    parser.addOption(supersedeMethodsOpt);
+
+    QCommandLineOption responseCacheOpt ( "response-cache", "MiB of results to keep for answering repeated Requests for an unchanged document version from the proxy (0, the default, to never)", "MiB", "0" );
+    parser.addOption(responseCacheOpt);
+
+    QCommandLineOption responseCacheMethodsOpt ( "response-cache-methods", "Comma separated methods --response-cache applies to", "methods", ProxyFilter::defaultCacheable.join(',') );
+    parser.addOption(responseCacheMethodsOpt);
+
+    QCommandLineOption coalesceChangesOpt ( "coalesce-changes", "Requests the server must have unanswered for textDocument/didChange notifications to be held and merged until it catches up (0, the default, to never)", "requests", "0" );
+    parser.addOption(coalesceChangesOpt);
+
+    QCommandLineOption resourceIntervalOpt ( "resource-interval", "Milliseconds between samples of the server's CPU, memory, threads and I/O (0 to never, Linux only)", "ms", QString::number(ResourceSampler::defaultInterval) );
+    parser.addOption(resourceIntervalOpt);
+
+    QCommandLineOption replayOpt ( "replay", "Drive the server with the client side of a capture, and report its latency", "capture" );
+    parser.addOption(replayOpt);
+
+    QCommandLineOption replaySpeedOpt ( "replay-speed", "Multiplier on the recorded pace for --replay, or 0 for as fast as possible", "factor", "1" );
+    parser.addOption(replaySpeedOpt);
+
+    QCommandLineOption replayWindowOpt ( "replay-window", "Requests in flight at most when replaying as fast as possible", "count", "1" );
+    parser.addOption(replayWindowOpt);
+
+    QCommandLineOption replayCompareOpt ( "replay-compare", "A second server to replay the capture against after the first, comparing their latency and Responses. Exits with 1 if it is significantly slower", "command" );
+    parser.addOption(replayCompareOpt);
+
+    QCommandLineOption replayAlphaOpt ( "replay-alpha", "Significance level of --replay-compare, before correcting for the number of methods", "alpha", QString::number(Replay::Comparison::defaultAlpha) );
+    parser.addOption(replayAlphaOpt);
+
+    QCommandLineOption workloadOpt ( "workload", "Drive the server with synthetic load described by a scenario file, and report its latency", "scenario" );
+    parser.addOption(workloadOpt);
+
+    QCommandLineOption projectOpt ( "project", "Project directory --workload opens files from", "directory", "." );
+    parser.addOption(projectOpt);
+
+    QCommandLineOption stubOpt ( "stub", "Act as a language server on stdio, answering by the rules in a file (no server is started)", "rules" );
+    parser.addOption(stubOpt);
+
     parser.process(*app->instance());
 
+    if (parser.isSet(exportTraceOpt)) {
+        if (!parser.isSet(outputOpt)) {
+            std::cerr << "No output file given for --export-trace, exiting" << std::endl;
+            return -1;
+        }
+
+        return exportTrace(parser.value(exportTraceOpt), parser.value(traceFormatOpt), parser.value(outputOpt));
+    }
+
+    if (parser.isSet(analyseOpt)) {
+        return analyseCapture(parser.value(analyseOpt), qint64(parser.value(requestTimeoutOpt).toDouble() * 1000), parser.value(outputOpt));
+    }
+
+    if (parser.isSet(stubOpt)) {
+        QString error;
+        auto rules = Stub::Rules::load(parser.value(stubOpt), &error);
+        if (!rules) {
+            std::cerr << error.toStdString() << std::endl;
+            return -1;
+        }
+
+        Stub::Server *stub = new Stub::Server(rules.value());
+        QObject::connect(stub, &Stub::Server::emitFinished, app, [](int exitCode){ QCoreApplication::exit(exitCode); }, Qt::QueuedConnection);
+        stub->start();
+
+        return app->exec();
+    }
+
     QStringList args = parser.positionalArguments();
     if (args.size() < 1) {
         std::cerr << "No server path given, exiting" << std::endl;
         return -1;
     }
 
-    QString target = args[0];
-    std::cerr << "opening target: " << target.toStdString() << std::endl;
+    if (parser.isSet(replayOpt)) {
+        Replay::Options options;
+        options.speed = std::max(parser.value(replaySpeedOpt).toDouble(), 0.0);
+        options.window = std::max(parser.value(replayWindowOpt).toInt(), 1);
 
-    QProcess *serverProcess = new QProcess(app);
-    serverProcess->setProgram(target);
-    serverProcess->setArguments(args.mid(1, args.size() - 2));
-    serverProcess->start();
+        QStringList candidate = QProcess::splitCommand(parser.value(replayCompareOpt));
+        return replay(parser.value(replayOpt), args, candidate, options, parser.value(replayAlphaOpt).toDouble(), parser.value(outputOpt));
+    }
+
+    if (parser.isSet(workloadOpt)) {
+        return generateWorkload(parser.value(workloadOpt), parser.value(projectOpt), args, parser.value(outputOpt));
+    }
+
+    std::cerr << "opening target: " << args[0].toStdString() << std::endl;
+
+    QProcess *serverProcess = spawnServer(args, app);
 
     StdioMitm *mitm = new StdioMitm(serverProcess, nullptr);
+    mitm->setRequestTimeout(qint64(parser.value(requestTimeoutOpt).toDouble() * 1000));
+    mitm->setResourceInterval(parser.value(resourceIntervalOpt).toInt());
+    mitm->setAnalysisEnabled(!parser.isSet(noAnalysisOpt));
+
+    // Nothing shows the log without a window, so it isn't kept
+    mitm->messages.setRetaining(!headless);
+
+    auto mode = ValidationPolicy::parseMode(parser.value(validationOpt));
+    if (!mode) {
+        std::cerr << "Unknown validation mode: " << parser.value(validationOpt).toStdString() << std::endl;
+        return -1;
+    }
+    mitm->policy.setMode(mode.value());
+    mitm->policy.setQueueLimit(qint64(parser.value(queueLimitOpt).toDouble() * 1024 * 1024));
+
+    auto supersede = ProxyFilter::parseSupersede(parser.value(supersedeOpt));
+    if (!supersede) {
+        std::cerr << "Unknown supersede mode: " << parser.value(supersedeOpt).toStdString() << std::endl;
+        return -1;
+    }
+    mitm->filter.setSupersede(supersede.value());
+    mitm->filter.setSupersedable(parser.value(supersedeMethodsOpt).split(',', Qt::SkipEmptyParts));
+    mitm->filter.setCacheLimit(qint64(parser.value(responseCacheOpt).toDouble() * 1024 * 1024));
+    mitm->filter.setCacheable(parser.value(responseCacheMethodsOpt).split(',', Qt::SkipEmptyParts));
+    mitm->filter.setCoalesceBacklog(parser.value(coalesceChangesOpt).toInt());
+
+    for (const QString &rate : parser.values(sampleRateOpt)) {
+        int split = rate.lastIndexOf('=');
+        bool ok = false;
+        double value = split > 0 ? rate.mid(split + 1).toDouble(&ok) : 0;
+        if (!ok) {
+            std::cerr << "Invalid sample rate, expected method=rate: " << rate.toStdString() << std::endl;
+            return -1;
+        }
+
+        if (rate.left(split) == "*") {
+            mitm->policy.setDefaultSampleRate(value);
+        } else {
+            mitm->policy.setSampleRate(rate.left(split), value);
+        }
+    }
+
+    if (parser.isSet(recordOpt) && !mitm->startRecording(parser.value(recordOpt))) {
+        return -1;
+    }
+
+    auto metrics = [=]{ return renderMetrics(mitm); };
+
+    if (parser.isSet(metricsPortOpt)) {
+        auto metricsServer = new MetricsHttpServer(metrics, app);
+        if (!metricsServer->listen(parser.value(metricsPortOpt).toUShort())) {
+            std::cerr << "Unable to serve metrics: " << metricsServer->errorString().toStdString() << std::endl;
+            return -1;
+        }
+    }
+
+    if (parser.isSet(metricsFileOpt)) {
+        new MetricsTextfile(metrics, parser.value(metricsFileOpt), parser.value(metricsIntervalOpt).toInt() * 1000, app);
+    }
 
     mitm->start();
 
+    if (headless) {
+        return app->exec();
+    }
+
     FilteredCommModel *filtered = new FilteredCommModel();
     filtered->setSourceModel(&mitm->messages);
 
@@ -73,8 +470,13 @@ int main(int argc, char** argv) {
     auto mainLayout = new QVBoxLayout (mainWidget);
     mainLayout->setContentsMargins(0, 0, 0, 0);
 
-    auto logSplitter = new QSplitter(mainWidget);
-    mainLayout->addWidget(logSplitter);
+    auto timelineSplitter = new QSplitter(mainWidget);
+    mainLayout->addWidget(timelineSplitter);
+
+    timelineSplitter->setOrientation(Qt::Vertical);
+
+    auto logSplitter = new QSplitter(timelineSplitter);
+    timelineSplitter->addWidget(logSplitter);
 
     logSplitter->setOrientation(Qt::Horizontal);
 
@@ -122,6 +524,26 @@ int main(int argc, char** argv) {
 
     QObject::connect(logView->selectionModel(), &QItemSelectionModel::currentChanged, [=](const QModelIndex& current, const QModelIndex &){ detailView->onMessageChange(qvariant_cast<LspMessageItem>(current.data()).message); });
 
+    auto analysisTabs = new QTabWidget(timelineSplitter);
+    timelineSplitter->addWidget(analysisTabs);
+
+    auto timeline = new TimelineView(analysisTabs);
+    analysisTabs->addTab(timeline, "Timeline");
+    timeline->setModel(&mitm->messages);
+    timeline->setResources(&mitm->resources);
+
+    analysisTabs->addTab(new LatencyPanel(mitm->latency, mitm->interactions, analysisTabs), "Latency");
+
+    analysisTabs->addTab(new CancellationPanel(mitm->cancellation, analysisTabs), "Cancellation");
+
+    analysisTabs->addTab(new ResourcePanel(mitm->resources, mitm->cpu, analysisTabs), "Server resources");
+
+    analysisTabs->addTab(new OverheadPanel(analysisTabs), "Proxy overhead");
+
+    QObject::connect(timeline, &TimelineView::spanSelected, [=](int index){ logView->setCurrentIndex(filtered->mapFromSource(mitm->messages.index(index))); });
+
+    window->statusBar()->addWidget(new ValidationStatusLabel(mitm->policy, window));
+
     mainWidget->setLayout(mainLayout);
     window->show();
 
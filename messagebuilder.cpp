@@ -1,13 +1,15 @@
 #include "messagebuilder.h"
 #include "asciiparsing.h"
+#include "pipelineprofiler.h"
 
 #include <QTextCodec>
 #include <QJsonValue>
 
 namespace MessageBuilder {
 
-Message::Message(FrameBuilder::Frame frame, QJsonDocument contents) : Message(frame.timestamp, contents, frame.frameEnd - frame.frameStart) {}
-Message::Message(qint64 timestamp, QJsonDocument contents, int size) : timestamp(timestamp), contents(contents), size(size) {}
+Message::Message(FrameBuilder::Frame frame, QJsonDocument contents) : Message(frame.timestamp, frame.timing, contents, frame.frameEnd - frame.frameStart) {}
+Message::Message(qint64 timestamp, QJsonDocument contents, int size) : Message(timestamp, FrameBuilder::FrameTiming::fromTimestamp(timestamp), contents, size) {}
+Message::Message(qint64 timestamp, FrameBuilder::FrameTiming timing, QJsonDocument contents, int size) : timestamp(timestamp), timing(timing), contents(contents), size(size) {}
 
 
 HeaderParser::HeaderParser(QString value) : value(value) {}
@@ -195,6 +197,8 @@ QString getEncoding(const QVector<FrameBuilder::Header> &headers) {
 }
 
 void MessageBuilder::onFrame(FrameBuilder::Frame frame) {
+    PROFILE_STAGE(Profiling::Stage::Parse);
+
     QString encoding = getEncoding(frame.headers);
 
     QByteArray jsonInput = frame.payload;
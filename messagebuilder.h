@@ -64,6 +64,9 @@ struct Message {
     /** The time that the message frame was fully received by */
     qint64 timestamp;
 
+    /** Precise timing of the frame's arrival */
+    FrameBuilder::FrameTiming timing;
+
     /** The contents of the message */
     QJsonDocument contents;
 
@@ -72,6 +75,7 @@ struct Message {
 
     Message(FrameBuilder::Frame frame, QJsonDocument contents);
     Message(qint64 timestamp, QJsonDocument contents, int size);
+    Message(qint64 timestamp, FrameBuilder::FrameTiming timing, QJsonDocument contents, int size);
 };
 
 /**
@@ -0,0 +1,288 @@
+#include "metrics.h"
+#include "pipelineprofiler.h"
+
+namespace Metrics {
+
+MethodStats::MethodStats(QString method) : method(method) {}
+
+MethodTable::MethodTable() {
+    for (auto &slot : slots) {
+        slot.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+MethodTable::~MethodTable() {
+    for (auto &slot : slots) {
+        delete slot.load(std::memory_order_relaxed);
+    }
+}
+
+MethodStats& MethodTable::get(const QString &method) {
+    uint hash = qHash(method);
+
+    for (int probe = 0; probe < capacity; probe++) {
+        auto &slot = slots[(hash + probe) % capacity];
+        MethodStats *stats = slot.load(std::memory_order_acquire);
+
+        if (!stats) {
+            auto fresh = new MethodStats(method);
+            if (slot.compare_exchange_strong(stats, fresh, std::memory_order_acq_rel)) {
+                return *fresh;
+            }
+
+            // Lost the race; stats now holds the winner, which may be for our method
+            delete fresh;
+        }
+
+        if (stats->method == method) {
+            return *stats;
+        }
+    }
+
+    return overflow;
+}
+
+DirectionStats& Registry::direction(Lsp::Entity sender) {
+    return sender == Lsp::Entity::Client ? client : server;
+}
+
+const DirectionStats& Registry::direction(Lsp::Entity sender) const {
+    return sender == Lsp::Entity::Client ? client : server;
+}
+
+QString Registry::senderLabel(Lsp::Entity sender) {
+    return sender == Lsp::Entity::Client ? "client" : "server";
+}
+
+void Registry::onForwarded(Lsp::Entity sender, qint64 bytes, qint64 nanoseconds) {
+    auto &stats = direction(sender);
+    stats.streamBytes.add(bytes);
+    stats.forwarding.record(std::max<qint64>(nanoseconds, 0));
+}
+
+void Registry::onFrameError(Lsp::Entity sender, FrameBuilder::StreamError error) {
+    direction(sender).frameErrors[int(error.kind)].add();
+}
+
+void Registry::onParseError(Lsp::Entity sender) {
+    direction(sender).parseErrors.add();
+}
+
+void Registry::onBatch(Lsp::Entity sender, int elements, int bytes) {
+    auto &stats = direction(sender);
+    stats.batches.add();
+    stats.batchElements.add(elements);
+    stats.batchBytes.add(bytes);
+}
+
+void Registry::onLspMessage(const std::shared_ptr<Lsp::Message> &message) {
+    auto &stats = direction(message->getSender());
+    auto &method = stats.methods.get(message->tryGetMethod().value_or("unknown"));
+
+    method.messages.add();
+    method.bytes.add(message->getSize());
+
+    if (message->getKind() == Lsp::Message::Kind::Request) {
+        stats.outstandingRequests.add(1);
+    } else if (message->getKind() == Lsp::Message::Kind::Response) {
+        auto response = static_cast<Lsp::Response*>(message.get());
+        auto request = response->getRequest();
+
+        if (request) {
+            auto &requester = direction(request->getSender());
+            requester.outstandingRequests.add(-1);
+            if (request->isCancelled()) {
+                return;
+            }
+
+            auto &methodStats = requester.methods.get(request->getMethod());
+
+            qint64 total = response->getTiming().lastByte - request->getTiming().lastByte;
+            methodStats.latency.record(std::max<qint64>(total, 0) / 1000);
+            methodStats.serverTime.record(std::max<qint64>(response->getServerTime(), 0) / 1000);
+        }
+    }
+}
+
+void Registry::onRequestTimeout(const std::shared_ptr<Lsp::Request> &request) {
+    auto &stats = direction(request->getSender());
+    stats.outstandingRequests.add(-1);
+    stats.timedOutRequests.add();
+}
+
+void Registry::onRequestUntracked(const std::shared_ptr<Lsp::Request> &request) {
+    auto &stats = direction(request->getSender());
+    stats.outstandingRequests.add(-1);
+    stats.untrackedRequests.add();
+}
+
+void Registry::onProxyAnswer(const std::shared_ptr<Lsp::Request> &request) {
+    auto &stats = direction(request->getSender());
+    stats.outstandingRequests.add(-1);
+    stats.proxyAnswers.add();
+}
+
+namespace Exposition {
+
+QByteArray escapeLabel(const QString &value) {
+    QByteArray escaped;
+
+    for (char c : value.toUtf8()) {
+        switch (c) {
+            case '\\':
+                escaped.append("\\\\");
+                break;
+            case '"':
+                escaped.append("\\\"");
+                break;
+            case '\n':
+                escaped.append("\\n");
+                break;
+            default:
+                escaped.append(c);
+        }
+    }
+
+    return escaped;
+}
+
+void family(QByteArray &out, const char *name, const char *type, const char *help) {
+    out.append("# HELP ").append(name).append(' ').append(help).append('\n');
+    out.append("# TYPE ").append(name).append(' ').append(type).append('\n');
+}
+
+void sample(QByteArray &out, const QByteArray &name, const QByteArray &labels, double value) {
+    out.append(name);
+    if (!labels.isEmpty()) {
+        out.append('{').append(labels).append('}');
+    }
+    out.append(' ').append(QByteArray::number(value, 'g', 15)).append('\n');
+}
+
+void histogram(QByteArray &out, const char *name, const QByteArray &labels, const Histogram &histogram, double unitsPerSecond) {
+    static const double bounds[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30};
+
+    QByteArray bucketName = QByteArray(name) + "_bucket";
+    QByteArray prefix = labels.isEmpty() ? QByteArray() : labels + ",";
+
+    for (double bound : bounds) {
+        quint64 count = histogram.countAtOrBelow(quint64(bound * unitsPerSecond));
+        sample(out, bucketName, prefix + "le=\"" + QByteArray::number(bound) + "\"", count);
+    }
+
+    sample(out, bucketName, prefix + "le=\"+Inf\"", histogram.count());
+    sample(out, QByteArray(name) + "_sum", labels, histogram.sum() / unitsPerSecond);
+    sample(out, QByteArray(name) + "_count", labels, histogram.count());
+}
+
+}
+
+QByteArray Registry::toOpenMetrics() const {
+    using namespace Exposition;
+
+    QByteArray out;
+
+    const Lsp::Entity senders[] = { Lsp::Entity::Client, Lsp::Entity::Server };
+
+    family(out, "lspmonitor_stream_bytes_total", "counter", "Raw bytes forwarded, by sender");
+    for (auto sender : senders) {
+        sample(out, "lspmonitor_stream_bytes_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).streamBytes.get());
+    }
+
+    family(out, "lspmonitor_messages_total", "counter", "LSP messages seen, by sender and method");
+    for (auto sender : senders) {
+        direction(sender).methods.forEach([&](const MethodStats &stats) {
+            sample(out, "lspmonitor_messages_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\",method=\"" + escapeLabel(stats.method) + "\"", stats.messages.get());
+        });
+    }
+
+    family(out, "lspmonitor_message_bytes_total", "counter", "Framed bytes of LSP messages, by sender and method");
+    for (auto sender : senders) {
+        direction(sender).methods.forEach([&](const MethodStats &stats) {
+            sample(out, "lspmonitor_message_bytes_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\",method=\"" + escapeLabel(stats.method) + "\"", stats.bytes.get());
+        });
+    }
+
+    family(out, "lspmonitor_batches_total", "counter", "JSON-RPC batches, by sender");
+    for (auto sender : senders) {
+        sample(out, "lspmonitor_batches_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).batches.get());
+    }
+
+    family(out, "lspmonitor_batch_elements_total", "counter", "Messages received as elements of a batch, by sender");
+    for (auto sender : senders) {
+        sample(out, "lspmonitor_batch_elements_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).batchElements.get());
+    }
+
+    family(out, "lspmonitor_batch_bytes_total", "counter", "Framed bytes of batches, by sender");
+    for (auto sender : senders) {
+        sample(out, "lspmonitor_batch_bytes_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).batchBytes.get());
+    }
+
+    family(out, "lspmonitor_request_duration_seconds", "histogram", "Time from Request to Response, by requesting entity and method");
+    for (auto sender : senders) {
+        direction(sender).methods.forEach([&](const MethodStats &stats) {
+            if (stats.latency.count() > 0) {
+                histogram(out, "lspmonitor_request_duration_seconds", "sender=\"" + escapeLabel(senderLabel(sender)) + "\",method=\"" + escapeLabel(stats.method) + "\"", stats.latency, 1e6);
+            }
+        });
+    }
+
+    family(out, "lspmonitor_request_server_seconds", "histogram", "Time from Request to the first byte of its Response, by requesting entity and method");
+    for (auto sender : senders) {
+        direction(sender).methods.forEach([&](const MethodStats &stats) {
+            if (stats.serverTime.count() > 0) {
+                histogram(out, "lspmonitor_request_server_seconds", "sender=\"" + escapeLabel(senderLabel(sender)) + "\",method=\"" + escapeLabel(stats.method) + "\"", stats.serverTime, 1e6);
+            }
+        });
+    }
+
+    family(out, "lspmonitor_outstanding_requests", "gauge", "Requests waiting on a Response, by requesting entity");
+    for (auto sender : senders) {
+        sample(out, "lspmonitor_outstanding_requests", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).outstandingRequests.get());
+    }
+
+    family(out, "lspmonitor_timed_out_requests_total", "counter", "Requests never answered within the request timeout, by requesting entity");
+    for (auto sender : senders) {
+        sample(out, "lspmonitor_timed_out_requests_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).timedOutRequests.get());
+    }
+
+    family(out, "lspmonitor_untracked_requests_total", "counter", "Requests no longer tracked because analysis was shed under load, by requesting entity");
+    for (auto sender : senders) {
+        sample(out, "lspmonitor_untracked_requests_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).untrackedRequests.get());
+    }
+
+    family(out, "lspmonitor_proxy_answered_requests_total", "counter", "Requests answered by the proxy itself, left out of the latency metrics, by requesting entity");
+    for (auto sender : senders) {
+        sample(out, "lspmonitor_proxy_answered_requests_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).proxyAnswers.get());
+    }
+
+    family(out, "lspmonitor_frame_errors_total", "counter", "Errors framing the byte stream into messages, by sender and kind");
+    for (auto sender : senders) {
+        for (int kind = 0; kind < int(direction(sender).frameErrors.size()); kind++) {
+            QString kindName = FrameBuilder::StreamError::kindToQString(FrameBuilder::StreamError::Kind(kind));
+            sample(out, "lspmonitor_frame_errors_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\",kind=\"" + escapeLabel(kindName) + "\"", direction(sender).frameErrors[kind].get());
+        }
+    }
+
+    family(out, "lspmonitor_parse_errors_total", "counter", "Frames whose payload could not be parsed as JSON, by sender");
+    for (auto sender : senders) {
+        sample(out, "lspmonitor_parse_errors_total", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).parseErrors.get());
+    }
+
+    family(out, "lspmonitor_forwarding_duration_seconds", "histogram", "Time the proxy spends forwarding each chunk, by sender");
+    for (auto sender : senders) {
+        histogram(out, "lspmonitor_forwarding_duration_seconds", "sender=\"" + escapeLabel(senderLabel(sender)) + "\"", direction(sender).forwarding, 1e9);
+    }
+
+#ifdef LSPMONITOR_PROFILING
+    family(out, "lspmonitor_pipeline_stage_seconds", "histogram", "Self time of each stage of the proxy's analysis pipeline");
+    for (int stage = 0; stage < Profiling::stageCount; stage++) {
+        auto name = Profiling::stageName(Profiling::Stage(stage));
+        histogram(out, "lspmonitor_pipeline_stage_seconds", "stage=\"" + escapeLabel(name) + "\"", Profiling::histogram(Profiling::Stage(stage)), 1e9);
+    }
+#endif
+
+    return out;
+}
+
+}
@@ -0,0 +1,197 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QtCore>
+
+#include <array>
+#include <atomic>
+
+#include "histogram.h"
+#include "framebuilder.h"
+#include "lspschemavalidator.h"
+
+namespace Metrics {
+
+class Counter {
+public:
+    void add(quint64 amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+
+    quint64 get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> value {0};
+};
+
+class Gauge {
+public:
+    void add(qint64 amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+
+    void set(qint64 amount) { value.store(amount, std::memory_order_relaxed); }
+
+    qint64 get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> value {0};
+};
+
+/**
+ * Everything tracked for a single method sent by a single entity
+ */
+struct MethodStats {
+    explicit MethodStats(QString method);
+
+    const QString method;
+
+    Counter messages {};
+
+    Counter bytes {};
+
+    /** Request -> Response latency (µs), for Requests with this method */
+    Histogram latency {};
+
+    /** Request -> first byte of Response (µs), for Requests with this method */
+    Histogram serverTime {};
+};
+
+/**
+ * Fixed capacity open addressing table of MethodStats. Lookups and inserts
+ * never lock; an insert race is resolved by compare-and-swap, with the loser
+ * discarding its entry. Entries are never removed.
+ *
+ * Methods beyond the capacity are counted under "other", so a misbehaving
+ * peer can't grow the table without bound.
+ */
+class MethodTable {
+public:
+    static constexpr int capacity = 512;
+
+    MethodTable();
+
+    ~MethodTable();
+
+    MethodTable(const MethodTable&) = delete;
+
+    MethodStats& get(const QString &method);
+
+    /** Calls f with every MethodStats in the table */
+    template <typename F>
+    void forEach(F f) const;
+
+private:
+    std::array<std::atomic<MethodStats*>, capacity> slots;
+
+    MethodStats overflow {"other"};
+};
+
+template <typename F>
+void MethodTable::forEach(F f) const {
+    for (auto &slot : slots) {
+        MethodStats *stats = slot.load(std::memory_order_acquire);
+        if (stats) {
+            f(*stats);
+        }
+    }
+
+    if (overflow.messages.get() > 0) {
+        f(overflow);
+    }
+}
+
+/**
+ * Metrics for one direction of the proxy (everything sent by one entity)
+ */
+struct DirectionStats {
+    /** Raw bytes seen on the stream, regardless of framing */
+    Counter streamBytes {};
+
+    /** Time taken to forward each chunk to the other side (ns) */
+    Histogram forwarding {};
+
+    /** Frame errors, indexed by FrameBuilder::StreamError::Kind */
+    std::array<Counter, 6> frameErrors {};
+
+    /** Frames that could not be parsed as JSON */
+    Counter parseErrors {};
+
+    /** JSON-RPC batches, with the total elements and framed bytes of all of them */
+    Counter batches {};
+
+    Counter batchElements {};
+
+    Counter batchBytes {};
+
+    /** Requests sent that are still waiting on a Response */
+    Gauge outstandingRequests {};
+
+    /** Requests sent that were never answered within the request timeout */
+    Counter timedOutRequests {};
+
+    /** Requests no longer tracked because analysis skipped messages that may have answered them */
+    Counter untrackedRequests {};
+
+    /** Requests the proxy answered itself, rather than the other entity */
+    Counter proxyAnswers {};
+
+    MethodTable methods {};
+};
+
+/**
+ * The metrics of a running proxy. Every update is a relaxed atomic operation,
+ * so the forwarding path never waits on a scrape.
+ */
+class Registry {
+public:
+    DirectionStats& direction(Lsp::Entity sender);
+
+    const DirectionStats& direction(Lsp::Entity sender) const;
+
+    void onForwarded(Lsp::Entity sender, qint64 bytes, qint64 nanoseconds);
+
+    void onFrameError(Lsp::Entity sender, FrameBuilder::StreamError error);
+
+    void onParseError(Lsp::Entity sender);
+
+    void onBatch(Lsp::Entity sender, int elements, int bytes);
+
+    void onLspMessage(const std::shared_ptr<Lsp::Message> &message);
+
+    void onRequestTimeout(const std::shared_ptr<Lsp::Request> &request);
+
+    /** The Request was dropped from tracking after analysis skipped messages (see ValidationPolicy) */
+    void onRequestUntracked(const std::shared_ptr<Lsp::Request> &request);
+
+    /** The Request was answered by the proxy (see ProxyFilter), so its latency isn't the server's */
+    void onProxyAnswer(const std::shared_ptr<Lsp::Request> &request);
+
+    /** Renders every metric in the OpenMetrics / Prometheus text exposition format */
+    QByteArray toOpenMetrics() const;
+
+    static QString senderLabel(Lsp::Entity sender);
+
+private:
+    DirectionStats client {};
+
+    DirectionStats server {};
+};
+
+/**
+ * Helpers for rendering the text exposition format, shared with other
+ * components that append their own metrics
+ */
+namespace Exposition {
+    QByteArray escapeLabel(const QString &value);
+
+    void family(QByteArray &out, const char *name, const char *type, const char *help);
+
+    void sample(QByteArray &out, const QByteArray &name, const QByteArray &labels, double value);
+
+    /**
+     * Writes a histogram family sample set, converting the recorded values to
+     * seconds using the given number of recorded units per second
+     */
+    void histogram(QByteArray &out, const char *name, const QByteArray &labels, const Histogram &histogram, double unitsPerSecond);
+}
+
+}
+
+#endif // METRICS_H
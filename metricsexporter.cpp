@@ -0,0 +1,70 @@
+#include "metricsexporter.h"
+
+#include <QTcpSocket>
+#include <QSaveFile>
+#include <iostream>
+
+MetricsHttpServer::MetricsHttpServer(std::function<QByteArray()> render, QObject *parent) : QObject(parent), render(render) {
+    connect(&server, &QTcpServer::newConnection, this, &MetricsHttpServer::onNewConnection);
+}
+
+bool MetricsHttpServer::listen(quint16 port) {
+    return server.listen(QHostAddress::LocalHost, port);
+}
+
+QString MetricsHttpServer::errorString() const {
+    return server.errorString();
+}
+
+void MetricsHttpServer::onNewConnection() {
+    while (QTcpSocket *socket = server.nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+
+        connect(socket, &QTcpSocket::readyRead, socket, [=]() {
+            // Only the request line matters; wait until the headers are complete
+            if (!socket->canReadLine() || !socket->peek(socket->bytesAvailable()).contains("\r\n\r\n")) {
+                return;
+            }
+
+            QByteArray requestLine = socket->readLine();
+            socket->readAll();
+
+            QByteArray body;
+            QByteArray status;
+
+            if (requestLine.startsWith("GET ")) {
+                status = "200 OK";
+                body = render();
+            } else {
+                status = "405 Method Not Allowed";
+            }
+
+            QByteArray response;
+            response.append("HTTP/1.1 ").append(status).append("\r\n");
+            response.append("Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n");
+            response.append("Content-Length: ").append(QByteArray::number(body.size())).append("\r\n");
+            response.append("Connection: close\r\n\r\n");
+            response.append(body);
+
+            socket->write(response);
+            socket->disconnectFromHost();
+        });
+    }
+}
+
+MetricsTextfile::MetricsTextfile(std::function<QByteArray()> render, QString path, int intervalMs, QObject *parent) : QObject(parent), render(render), path(path) {
+    connect(&timer, &QTimer::timeout, this, &MetricsTextfile::write);
+    timer.start(intervalMs);
+}
+
+void MetricsTextfile::write() {
+    QSaveFile file (path);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        std::cerr << "Unable to write metrics file: " << file.errorString().toStdString() << std::endl;
+        return;
+    }
+
+    file.write(render());
+    file.commit();
+}
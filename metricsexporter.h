@@ -0,0 +1,55 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QTcpServer>
+
+#include <functional>
+
+/**
+ * Serves the rendered metrics over HTTP for Prometheus to scrape. Listens on
+ * localhost only; any GET request is answered with the current metrics.
+ */
+class MetricsHttpServer : public QObject {
+    Q_OBJECT
+
+public:
+    MetricsHttpServer(std::function<QByteArray()> render, QObject *parent = nullptr);
+
+    bool listen(quint16 port);
+
+    QString errorString() const;
+
+private slots:
+    void onNewConnection();
+
+private:
+    std::function<QByteArray()> render;
+
+    QTcpServer server {};
+};
+
+/**
+ * Periodically rewrites a file with the rendered metrics, for node_exporter's
+ * textfile collector. The file is replaced atomically so a scrape never sees
+ * a partial write.
+ */
+class MetricsTextfile : public QObject {
+    Q_OBJECT
+
+public:
+    MetricsTextfile(std::function<QByteArray()> render, QString path, int intervalMs, QObject *parent = nullptr);
+
+public slots:
+    void write();
+
+private:
+    std::function<QByteArray()> render;
+
+    QString path;
+
+    QTimer timer {};
+};
+
+#endif // METRICSEXPORTER_H
@@ -0,0 +1,17 @@
+#ifndef MONOTONIC_H
+#define MONOTONIC_H
+
+#include <QtCore>
+
+#include <chrono>
+
+/**
+ * Nanoseconds from an arbitrary fixed point, never going backwards
+ * (CLOCK_MONOTONIC on Linux). Only meaningful relative to other values
+ * from this function.
+ */
+inline qint64 monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // MONOTONIC_H
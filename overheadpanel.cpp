@@ -0,0 +1,62 @@
+#include "overheadpanel.h"
+#include "pipelineprofiler.h"
+
+#include <QVBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+
+OverheadPanel::OverheadPanel(QWidget *parent) : QWidget(parent) {
+    auto layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+#ifndef LSPMONITOR_PROFILING
+    layout->addWidget(new QLabel("lspmonitor was built without profiling (CONFIG+=no_profiling)", this));
+#endif
+
+    layout->addWidget(&table);
+
+    table.setColumnCount(8);
+    table.setHorizontalHeaderLabels({"Stage", "Count", "Mean (µs)", "p50 (µs)", "p99 (µs)", "p99.9 (µs)", "Max (µs)", "Total (ms)"});
+    table.setRowCount(Profiling::stageCount);
+    table.setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table.verticalHeader()->hide();
+    table.horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+
+    connect(&timer, &QTimer::timeout, this, &OverheadPanel::refresh);
+    timer.start(1000);
+
+    refresh();
+}
+
+void OverheadPanel::refresh() {
+    if (!isVisible()) {
+        return;
+    }
+
+    auto micros = [](double ns) { return QString::number(ns / 1000, 'f', 1); };
+
+    for (int row = 0; row < Profiling::stageCount; row++) {
+        auto stage = Profiling::Stage(row);
+        const Histogram &histogram = Profiling::histogram(stage);
+
+        QStringList cells {
+            Profiling::stageName(stage),
+            QString::number(histogram.count()),
+            micros(histogram.mean()),
+            micros(histogram.percentile(0.5)),
+            micros(histogram.percentile(0.99)),
+            micros(histogram.percentile(0.999)),
+            micros(histogram.max()),
+            QString::number(histogram.sum() / 1e6, 'f', 1),
+        };
+
+        for (int column = 0; column < cells.size(); column++) {
+            auto item = table.item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem();
+                table.setItem(row, column, item);
+            }
+            item->setText(cells[column]);
+        }
+    }
+}
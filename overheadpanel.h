@@ -0,0 +1,27 @@
+#ifndef OVERHEADPANEL_H
+#define OVERHEADPANEL_H
+
+#include <QWidget>
+#include <QTableWidget>
+#include <QTimer>
+
+/**
+ * Shows how much time lspmonitor spends in each stage of its own pipeline,
+ * from the Profiling stage histograms
+ */
+class OverheadPanel : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit OverheadPanel(QWidget *parent = nullptr);
+
+public slots:
+    void refresh();
+
+private:
+    QTableWidget table {};
+
+    QTimer timer {};
+};
+
+#endif // OVERHEADPANEL_H
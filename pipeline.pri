@@ -0,0 +1,47 @@
+# The framing, parsing and validation pipeline (and captures), shared by the app and the benchmarks
+
+INCLUDEPATH += $$PWD
+
+# Self-instrumentation of the pipeline stages; build with CONFIG+=no_profiling to compile it out
+!no_profiling: DEFINES += LSPMONITOR_PROFILING
+
+SOURCES += \
+    $$PWD/asciiparsing.cpp \
+    $$PWD/capture.cpp \
+    $$PWD/clock.cpp \
+    $$PWD/framebuilder.cpp \
+    $$PWD/histogram.cpp \
+    $$PWD/idtable.cpp \
+    $$PWD/lspschemavalidator.cpp \
+    $$PWD/messagebuilder.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/pipelineprofiler.cpp \
+    $$PWD/schemaissues.cpp \
+    $$PWD/validationpolicy.cpp
+
+HEADERS += \
+    $$PWD/asciiparsing.h \
+    $$PWD/capture.h \
+    $$PWD/clock.h \
+    $$PWD/framebuilder.h \
+    $$PWD/histogram.h \
+    $$PWD/idtable.h \
+    $$PWD/lspschemavalidator.h \
+    $$PWD/lspvalidators.h \
+    $$PWD/messagebuilder.h \
+    $$PWD/metrics.h \
+    $$PWD/monotonic.h \
+    $$PWD/option.h \
+    $$PWD/pipelineprofiler.h \
+    $$PWD/schemaissues.h \
+    $$PWD/validationpolicy.h
+
+# Validators for the LSP methods in protocol/metaModel.json (a subset of the official model)
+METAMODEL = $$PWD/protocol/metaModel.json
+
+lspvalidators.input = METAMODEL
+lspvalidators.output = lspvalidators_generated.cpp
+lspvalidators.commands = python3 $$PWD/tools/generate_validators.py ${QMAKE_FILE_IN} ${QMAKE_FILE_OUT}
+lspvalidators.depends = $$PWD/tools/generate_validators.py
+lspvalidators.variable_out = SOURCES
+QMAKE_EXTRA_COMPILERS += lspvalidators
@@ -0,0 +1,56 @@
+#include "pipelineprofiler.h"
+#include "monotonic.h"
+
+#include <array>
+
+namespace Profiling {
+
+static std::array<Histogram, stageCount> histograms;
+
+thread_local ScopedStage *ScopedStage::current = nullptr;
+
+QString stageName(Stage stage) {
+    switch (stage) {
+        case Stage::Forward:
+            return "forward";
+        case Stage::Frame:
+            return "frame";
+        case Stage::Parse:
+            return "parse";
+        case Stage::Validate:
+            return "validate";
+        case Stage::Dispatch:
+            return "dispatch";
+        case Stage::ModelInsert:
+            return "model_insert";
+    }
+
+    return "unknown";
+}
+
+Histogram& histogram(Stage stage) {
+    return histograms[int(stage)];
+}
+
+void reset() {
+    for (auto &histogram : histograms) {
+        histogram.reset();
+    }
+}
+
+ScopedStage::ScopedStage(Stage stage) : stage(stage), start(monotonicNs()), parent(current) {
+    current = this;
+}
+
+ScopedStage::~ScopedStage() {
+    qint64 total = monotonicNs() - start;
+
+    histograms[int(stage)].record(std::max<qint64>(total - childTime, 0));
+
+    if (parent) {
+        parent->childTime += total;
+    }
+    current = parent;
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef PIPELINEPROFILER_H
+#define PIPELINEPROFILER_H
+
+#include <QtCore>
+
+#include "histogram.h"
+
+/**
+ * Measures how long lspmonitor itself spends in each stage of the pipeline.
+ *
+ * Stages are nested (each stage's signal synchronously runs the next stage),
+ * so a ScopedStage subtracts the time spent in stages started inside it. The
+ * recorded histograms therefore hold the self time of each stage, in ns.
+ *
+ * Build with CONFIG+=no_profiling to compile all instrumentation out.
+ */
+namespace Profiling {
+
+enum class Stage {
+    /** Writing a chunk to the other side (InputStream::emitInput -> OutputStream) */
+    Forward,
+
+    /** Splitting chunks into frames (InputStream::emitInput -> FrameBuilder::emitFrame) */
+    Frame,
+
+    /** Decoding and parsing frame payloads (FrameBuilder::emitFrame -> MessageBuilder::emitMessage) */
+    Parse,
+
+    /** Classifying and validating messages (MessageBuilder::emitMessage -> LspSchemaValidator::emitLspMessage) */
+    Validate,
+
+    /** Handling validated messages: recording, metrics, etc. (LspSchemaValidator::emitLspMessage -> CommunicationModel::append) */
+    Dispatch,
+
+    /**
+     * Inserting into the model shown in the GUI (CommunicationModel::append, and
+     * CommunicationModel::onDebounceEnd, which inserts the rows buffered while
+     * debouncing along with the views' updates)
+     */
+    ModelInsert,
+};
+
+constexpr int stageCount = 6;
+
+QString stageName(Stage stage);
+
+/** The self time histogram of the stage (ns) */
+Histogram& histogram(Stage stage);
+
+/** Clears every stage histogram */
+void reset();
+
+class ScopedStage {
+public:
+    explicit ScopedStage(Stage stage);
+
+    ~ScopedStage();
+
+    ScopedStage(const ScopedStage&) = delete;
+
+private:
+    Stage stage;
+
+    qint64 start;
+
+    /** Time spent in stages nested in this one */
+    qint64 childTime = 0;
+
+    ScopedStage *parent;
+
+    static thread_local ScopedStage *current;
+};
+
+}
+
+#ifdef LSPMONITOR_PROFILING
+#define PROFILE_STAGE(stage) Profiling::ScopedStage profileScope (stage)
+#else
+#define PROFILE_STAGE(stage)
+#endif
+
+#endif // PIPELINEPROFILER_H
@@ -0,0 +1,761 @@
+#include "proxyfilter.h"
+#include "metrics.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include <cstring>
+
+namespace {
+    /** The index of the quote closing the string whose opening quote is at start */
+    int stringEnd(const QByteArray &json, int start) {
+        for (int i = start + 1; i < json.size(); i++) {
+            if (json.at(i) == '\\') {
+                i++;
+            } else if (json.at(i) == '"') {
+                return i;
+            }
+        }
+        return json.size();
+    }
+
+    int skipSpace(const QByteArray &json, int i) {
+        while (i < json.size() && (json.at(i) == ' ' || json.at(i) == '\t' || json.at(i) == '\n' || json.at(i) == '\r')) {
+            i++;
+        }
+        return i;
+    }
+
+    /** The index just past the value starting at start */
+    int valueEnd(const QByteArray &json, int start) {
+        int depth = 0;
+        int i = start;
+        for (; i < json.size(); i++) {
+            char c = json.at(i);
+            if (c == '"') {
+                i = stringEnd(json, i);
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (depth == 0) {
+                    break;
+                }
+                depth--;
+            } else if (c == ',' && depth == 0) {
+                break;
+            }
+        }
+        return i;
+    }
+
+    QJsonValue parseValue(const QByteArray &raw) {
+        return QJsonDocument::fromJson("[" + raw + "]").array().at(0);
+    }
+
+    /** Text whose length is the same in every position encoding, and that stays on one line */
+    bool isPlainLine(const QString &text) {
+        for (QChar c : text) {
+            if (c.unicode() >= 0x80 || c == '\n' || c == '\r') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The single change with the effect of two, if the second only edits the
+     * end of the text the first inserted: typing on, or deleting back into it.
+     */
+    option<QJsonObject> joinChanges(const QJsonObject &first, const QJsonObject &second) {
+        QString firstText = first.value("text").toString();
+        QString secondText = second.value("text").toString();
+        if (!first.contains("range") || !second.contains("range") || !isPlainLine(firstText) || !isPlainLine(secondText)) {
+            return {};
+        }
+
+        QJsonObject start = first.value("range").toObject().value("start").toObject();
+        QJsonObject secondStart = second.value("range").toObject().value("start").toObject();
+        QJsonObject secondEnd = second.value("range").toObject().value("end").toObject();
+
+        qint64 line = qint64(start.value("line").toDouble());
+        qint64 character = qint64(start.value("character").toDouble());
+        qint64 insertedEnd = character + firstText.size();
+
+        if (qint64(secondStart.value("line").toDouble()) != line || qint64(secondEnd.value("line").toDouble()) != line) {
+            return {};
+        }
+
+        qint64 from = qint64(secondStart.value("character").toDouble());
+        if (qint64(secondEnd.value("character").toDouble()) != insertedEnd || from < character) {
+            return {};
+        }
+
+        QJsonObject joined = first;
+        joined["text"] = firstText.left(int(from - character)) + secondText;
+        return joined;
+    }
+}
+
+ProxyFilter::Envelope ProxyFilter::scanEnvelope(const QByteArray &json) {
+    Envelope envelope;
+    bool hasId = false;
+
+    int i = skipSpace(json, 0);
+    if (i >= json.size() || json.at(i) != '{') {
+        return envelope;
+    }
+
+    i = skipSpace(json, i + 1);
+    while (i < json.size() && json.at(i) == '"') {
+        int keyEnd = stringEnd(json, i);
+        const char *key = json.constData() + i + 1;
+        int keyLength = keyEnd - i - 1;
+
+        int colon = skipSpace(json, keyEnd + 1);
+        if (colon >= json.size() || json.at(colon) != ':') {
+            return Envelope {};
+        }
+
+        int start = skipSpace(json, colon + 1);
+        auto is = [&](const char *name){ return keyLength == int(std::strlen(name)) && std::memcmp(key, name, keyLength) == 0; };
+
+        if (is("method")) {
+            // A Request or notification from the server
+            return Envelope {};
+        } else if (is("result")) {
+            envelope.isResponse = true;
+            envelope.resultStart = start;
+            if (hasId) {
+                return envelope;
+            }
+        }
+
+        int end = valueEnd(json, start);
+        if (is("id")) {
+            envelope.id = json.mid(start, end - start).trimmed();
+            hasId = true;
+        } else if (is("error")) {
+            envelope.isResponse = true;
+            envelope.error = json.mid(start, end - start);
+        }
+
+        i = skipSpace(json, end);
+        if (i < json.size() && json.at(i) == ',') {
+            i = skipSpace(json, i + 1);
+        }
+    }
+
+    if (!hasId) {
+        envelope.isResponse = false;
+    }
+    return envelope;
+}
+
+const QStringList ProxyFilter::defaultSupersedable {
+    "textDocument/documentHighlight",
+    "textDocument/hover",
+    "textDocument/codeAction",
+    "textDocument/inlayHint",
+};
+
+const QStringList ProxyFilter::defaultCacheable {
+    "textDocument/hover",
+    "textDocument/documentSymbol",
+    "textDocument/foldingRange",
+    "textDocument/semanticTokens/full",
+    "textDocument/documentLink",
+};
+
+qint64 ProxyFilter::CacheEntry::bytes() const {
+    return sizeof(CacheEntry) + (key.size() + uri.size() + method.size()) * sizeof(QChar) + result.size();
+}
+
+ProxyFilter::ProxyFilter(QObject *parent) : QObject(parent) {
+    setSupersedable(defaultSupersedable);
+    setCacheable(defaultCacheable);
+
+    connect(&clientFrames, &FrameBuilder::FrameBuilder::emitFrame, this, &ProxyFilter::onClientFrame);
+    connect(&serverFrames, &FrameBuilder::FrameBuilder::emitFrame, this, &ProxyFilter::onServerFrame);
+}
+
+option<ProxyFilter::Supersede> ProxyFilter::parseSupersede(const QString &name) {
+    if (name == "off") {
+        return Supersede::Off;
+    } else if (name == "cancel") {
+        return Supersede::Cancel;
+    } else if (name == "answer") {
+        return Supersede::Answer;
+    }
+
+    return {};
+}
+
+void ProxyFilter::setSupersede(Supersede mode) {
+    supersede = mode;
+}
+
+void ProxyFilter::setSupersedable(const QStringList &methods) {
+    supersedable = QSet<QString>(methods.begin(), methods.end());
+}
+
+void ProxyFilter::setCacheLimit(qint64 bytes) {
+    cacheLimit = std::max<qint64>(bytes, 0);
+}
+
+void ProxyFilter::setCacheable(const QStringList &methods) {
+    cacheable = QSet<QString>(methods.begin(), methods.end());
+}
+
+void ProxyFilter::setCoalesceBacklog(int requests) {
+    coalesceBacklog = std::max(requests, 0);
+}
+
+void ProxyFilter::setRequestTimeout(qint64 timeout) {
+    requestTimeout = std::max<qint64>(timeout, 0);
+}
+
+void ProxyFilter::setClock(Clock *clock) {
+    this->clock = clock;
+    clientFrames.setClock(clock);
+    serverFrames.setClock(clock);
+}
+
+bool ProxyFilter::isActive() const {
+    return supersede != Supersede::Off || cacheLimit > 0 || coalesceBacklog > 0;
+}
+
+void ProxyFilter::onClientInput(QByteArray data) {
+    clientFrames.onInput(data);
+}
+
+void ProxyFilter::onServerInput(QByteArray data) {
+    emit emitToClient(data);
+    serverBytes += data.size();
+
+    serverFrames.onInput(data);
+    flushToClient();
+}
+
+void ProxyFilter::onClientFrame(FrameBuilder::Frame frame) {
+    QJsonDocument document = QJsonDocument::fromJson(frame.payload);
+    if (!document.isObject()) {
+        // Batches and malformed messages are passed on for the server to deal with
+        emit emitToServer(encode(frame));
+        return;
+    }
+
+    QJsonObject message = document.object();
+    QJsonValue id = message.value("id");
+    QString method = message.value("method").toString();
+
+    if (!method.isEmpty() && !id.isUndefined()) {
+        onClientRequest(frame, message);
+        return;
+    }
+
+    if (method == "$/cancelRequest" && onClientCancel(message.value("params").toObject().value("id"))) {
+        return;
+    }
+
+    QJsonObject params = message.value("params").toObject();
+    onNotification(method, params);
+
+    if (method == "textDocument/didChange" && holdChange(params)) {
+        return;
+    }
+
+    // Held changes go first, unless the message can't depend on them
+    if (!method.startsWith("$/")) {
+        releaseChanges(params.value("textDocument").toObject().value("uri").toString(), Release::Message);
+    }
+
+    emit emitToServer(encode(frame));
+}
+
+void ProxyFilter::onServerFrame(FrameBuilder::Frame frame) {
+    serverFrameEnd = frame.frameEnd;
+
+    if (pending.isEmpty()) {
+        return;
+    }
+
+    Envelope envelope = scanEnvelope(frame.payload);
+    // A null id answers a message that couldn't be read, which isn't tracked
+    if (envelope.isResponse && envelope.id != "null") {
+        onResponse(idKey(parseValue(envelope.id)), frame.payload, envelope);
+    }
+}
+
+void ProxyFilter::onClientRequest(const FrameBuilder::Frame &frame, const QJsonObject &request) {
+    QJsonValue id = request.value("id");
+    QString method = request.value("method").toString();
+
+    QString cached = cacheKey(method, request.value("params").toObject());
+    if (!cached.isEmpty()) {
+        auto hit = cacheIndex.find(cached);
+        if (hit != cacheIndex.end()) {
+            cacheStats[method].hits += 1;
+            cache.splice(cache.begin(), cache, hit.value());
+
+            // The cached result, under the id of this Request
+            QByteArray rawId = QJsonDocument(QJsonArray {id}).toJson(QJsonDocument::Compact);
+            sendToClient("{\"jsonrpc\":\"2.0\",\"id\":" + rawId.mid(1, rawId.size() - 2) + ",\"result\":" + hit.value()->result + "}");
+            return;
+        }
+
+        cacheStats[method].misses += 1;
+    }
+
+    releaseChanges(request.value("params").toObject().value("textDocument").toObject().value("uri").toString(), Release::Message);
+
+    QString slotKey;
+    if (supersede != Supersede::Off && supersedable.contains(method)) {
+        QString uri = request.value("params").toObject().value("textDocument").toObject().value("uri").toString();
+        if (!uri.isEmpty()) {
+            slotKey = method + ' ' + uri;
+        }
+    }
+
+    if (slotKey.isEmpty()) {
+        forward(id, method, QString(), cached, encode(frame));
+        return;
+    }
+
+    Slot &slot = methodSlots[slotKey];
+    auto previous = slot.forwarded.isEmpty() ? pending.end() : pending.find(slot.forwarded);
+
+    if (supersede == Supersede::Cancel) {
+        if (previous != pending.end() && !previous->cancelled) {
+            previous->cancelled = true;
+            savings[method].cancelled += 1;
+
+            QJsonObject cancel {
+                {"jsonrpc", "2.0"},
+                {"method", "$/cancelRequest"},
+                {"params", QJsonObject {{"id", previous->id}}},
+            };
+            emit emitToServer(encode(cancel));
+        }
+
+        forward(id, method, slotKey, cached, encode(frame));
+        return;
+    }
+
+    if (previous == pending.end()) {
+        forward(id, method, slotKey, cached, encode(frame));
+        return;
+    }
+
+    if (slot.held) {
+        answerHeld(slot.held.value(), -32800, "Superseded by a newer request");
+    }
+    slot.held = Held {id, method, cached, encode(frame)};
+}
+
+bool ProxyFilter::onClientCancel(const QJsonValue &id) {
+    QString key = idKey(id);
+
+    for (Slot &slot : methodSlots) {
+        if (slot.held && idKey(slot.held->id) == key) {
+            answerHeld(slot.held.value(), -32800, "Request cancelled");
+            slot.held.reset();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ProxyFilter::onNotification(const QString &method, const QJsonObject &params) {
+    QJsonObject document = params.value("textDocument").toObject();
+    QString uri = document.value("uri").toString();
+
+    // A held Request would reach the server after the change, with positions in the old text
+    if (method == "textDocument/didChange" || method == "textDocument/didClose") {
+        for (auto it = methodSlots.begin(); it != methodSlots.end(); ++it) {
+            if (it->held && it.key().section(' ', 1) == uri) {
+                answerHeld(it->held.value(), -32801, "Content modified");
+                it->held.reset();
+            }
+        }
+    }
+
+    if (cacheLimit <= 0) {
+        return;
+    }
+
+    if (method == "textDocument/didOpen") {
+        versions.insert(uri, qint64(document.value("version").toDouble()));
+    } else if (method == "textDocument/didChange") {
+        versions.insert(uri, qint64(document.value("version").toDouble()));
+        invalidate(uri);
+    } else if (method == "textDocument/didClose") {
+        versions.remove(uri);
+        invalidate(uri);
+    } else if (method == "workspace/didChangeWatchedFiles") {
+        // Results may depend on any file on disk, such as an included header
+        invalidate(QString());
+    }
+}
+
+void ProxyFilter::onResponse(const QString &key, const QByteArray &payload, const Envelope &envelope) {
+    auto it = pending.find(key);
+    if (it == pending.end()) {
+        return;
+    }
+
+    Pending request = it.value();
+    pending.erase(it);
+
+    if (request.cancelled) {
+        int code = envelope.error.isEmpty() ? 0 : parseValue(envelope.error).toObject().value("code").toInt();
+
+        // RequestCancelled or ContentModified
+        if (code == -32800 || code == -32801) {
+            savings[request.method].honoured += 1;
+        } else if (envelope.error.isEmpty()) {
+            savings[request.method].completed += 1;
+        }
+    }
+
+    if (!request.cache.isEmpty() && envelope.error.isEmpty() && envelope.resultStart >= 0) {
+        int end = valueEnd(payload, envelope.resultStart);
+        store(request.cache, request.method, payload.mid(envelope.resultStart, end - envelope.resultStart));
+    }
+
+    onSettled(key, request);
+}
+
+void ProxyFilter::expire(const QString &key, quint64 serial) {
+    auto it = pending.find(key);
+    if (it == pending.end() || it->serial != serial) {
+        return;
+    }
+
+    // The server may still answer, which then matches nothing
+    Pending request = it.value();
+    pending.erase(it);
+    expired += 1;
+
+    onSettled(key, request);
+}
+
+void ProxyFilter::onSettled(const QString &key, const Pending &request) {
+    if (!heldChanges.isEmpty() && pending.size() < coalesceBacklog) {
+        releaseChanges(QString(), Release::CaughtUp);
+    }
+
+    if (request.slot.isEmpty()) {
+        return;
+    }
+
+    auto slot = methodSlots.find(request.slot);
+    if (slot == methodSlots.end() || slot->forwarded != key) {
+        return;
+    }
+
+    slot->forwarded.clear();
+
+    if (slot->held) {
+        Held held = slot->held.value();
+        slot->held.reset();
+        forward(held.id, held.method, request.slot, held.cache, held.message);
+    } else {
+        methodSlots.erase(slot);
+    }
+}
+
+void ProxyFilter::forward(const QJsonValue &id, const QString &method, const QString &slot, const QString &cache, const QByteArray &message) {
+    QString key = idKey(id);
+    quint64 serial = ++forwarded;
+    pending.insert(key, Pending {id, method, slot, false, cache, serial});
+
+    if (!slot.isEmpty()) {
+        methodSlots[slot].forwarded = key;
+    }
+
+    if (requestTimeout > 0) {
+        clock->callAfter(requestTimeout, this, [this, key, serial]{ expire(key, serial); });
+    }
+
+    emit emitToServer(message);
+}
+
+QString ProxyFilter::cacheKey(const QString &method, const QJsonObject &params) const {
+    if (cacheLimit <= 0 || !cacheable.contains(method)) {
+        return QString();
+    }
+
+    QString uri = params.value("textDocument").toObject().value("uri").toString();
+    auto version = versions.find(uri);
+    if (version == versions.end()) {
+        return QString();
+    }
+
+    // Tokens name the client's own progress reports, so they don't change the result
+    QJsonObject normalized = params;
+    normalized.remove("textDocument");
+    normalized.remove("workDoneToken");
+    normalized.remove("partialResultToken");
+
+    // Object keys are kept sorted, so equal params serialise the same. URIs have no spaces
+    return method + ' ' + uri + ' ' + QString::number(version.value()) + ' ' + QString::fromUtf8(QJsonDocument(normalized).toJson(QJsonDocument::Compact));
+}
+
+void ProxyFilter::store(const QString &key, const QString &method, const QByteArray &result) {
+    QString uri = key.section(' ', 1, 1);
+
+    // The document changed while the Request was in flight, so the result is already stale
+    if (versions.value(uri, -1) != key.section(' ', 2, 2).toLongLong()) {
+        return;
+    }
+
+    CacheEntry entry {key, uri, method, result};
+    if (entry.bytes() > cacheLimit) {
+        // It would only push everything else out, then itself
+        return;
+    }
+
+    auto existing = cacheIndex.find(key);
+    if (existing != cacheIndex.end()) {
+        evict(existing.value());
+    }
+
+    cache.push_front(entry);
+    cacheIndex.insert(key, cache.begin());
+    cacheBytes += cache.front().bytes();
+
+    while (cacheBytes > cacheLimit && !cache.empty()) {
+        evict(std::prev(cache.end()));
+        evicted += 1;
+    }
+}
+
+void ProxyFilter::invalidate(const QString &uri) {
+    for (auto it = cache.begin(); it != cache.end();) {
+        auto next = std::next(it);
+        if (uri.isEmpty() || it->uri == uri) {
+            evict(it);
+            invalidated += 1;
+        }
+        it = next;
+    }
+}
+
+void ProxyFilter::evict(std::list<CacheEntry>::iterator entry) {
+    cacheBytes -= entry->bytes();
+    cacheIndex.remove(entry->key);
+    cache.erase(entry);
+}
+
+void ProxyFilter::answerHeld(const Held &held, int code, const QString &message) {
+    MethodSavings &saved = savings[held.method];
+    saved.answered += 1;
+    saved.unforwardedBytes += held.message.size();
+
+    QJsonObject response {
+        {"jsonrpc", "2.0"},
+        {"id", held.id},
+        {"error", QJsonObject {{"code", code}, {"message", message}}},
+    };
+    sendToClient(QJsonDocument(response).toJson(QJsonDocument::Compact));
+}
+
+bool ProxyFilter::holdChange(const QJsonObject &params) {
+    if (coalesceBacklog <= 0) {
+        return false;
+    }
+
+    QJsonObject document = params.value("textDocument").toObject();
+    QString uri = document.value("uri").toString();
+
+    auto held = heldChanges.find(uri);
+    if (held == heldChanges.end()) {
+        if (pending.size() < coalesceBacklog) {
+            return false;
+        }
+        held = heldChanges.insert(uri, HeldChanges {{}, {}, 0, clock->monotonic()});
+    }
+
+    held->textDocument = document;
+    held->notifications += 1;
+    for (const QJsonValue &change : params.value("contentChanges").toArray()) {
+        appendChange(held->changes, change.toObject());
+    }
+
+    if (!holding) {
+        // Calls on the clock can't be cancelled, so one made stale by a release is told apart by its number
+        holding = true;
+        quint64 hold = ++holds;
+        clock->callAfter(maxHoldMs, this, [this, hold]{
+            if (holding && hold == holds) {
+                releaseChanges(QString(), Release::Timeout);
+            }
+        });
+    }
+
+    return true;
+}
+
+void ProxyFilter::releaseChanges(const QString &uri, Release reason) {
+    if (heldChanges.isEmpty()) {
+        return;
+    }
+
+    auto release = [&](const HeldChanges &held) {
+        QJsonObject notification {
+            {"jsonrpc", "2.0"},
+            {"method", "textDocument/didChange"},
+            {"params", QJsonObject {{"textDocument", held.textDocument}, {"contentChanges", held.changes}}},
+        };
+        emit emitToServer(encode(notification));
+
+        changesForwarded += 1;
+        changesCoalesced += held.notifications - 1;
+        releases[reason] += 1;
+        holdTime.record(std::max<qint64>(clock->monotonic() - held.since, 0));
+    };
+
+    if (uri.isEmpty()) {
+        for (const HeldChanges &held : heldChanges) {
+            release(held);
+        }
+        heldChanges.clear();
+    } else {
+        auto held = heldChanges.find(uri);
+        if (held == heldChanges.end()) {
+            return;
+        }
+        release(held.value());
+        heldChanges.erase(held);
+    }
+
+    if (heldChanges.isEmpty()) {
+        holding = false;
+    }
+}
+
+void ProxyFilter::appendChange(QJsonArray &changes, const QJsonObject &change) {
+    if (!change.contains("range")) {
+        // The whole document, which makes the changes before it redundant
+        eventsJoined += changes.size();
+        changes = QJsonArray {change};
+        return;
+    }
+
+    if (!changes.isEmpty()) {
+        auto joined = joinChanges(changes.last().toObject(), change);
+        if (joined) {
+            changes.replace(changes.size() - 1, joined.value());
+            eventsJoined += 1;
+            return;
+        }
+    }
+
+    changes.append(change);
+}
+
+void ProxyFilter::sendToClient(const QByteArray &payload) {
+    toClient += encode(payload);
+    flushToClient();
+}
+
+void ProxyFilter::flushToClient() {
+    if (!toClient.isEmpty() && serverFrameEnd == serverBytes) {
+        emit emitAnswerToClient(toClient);
+        toClient.clear();
+    }
+}
+
+QString ProxyFilter::idKey(const QJsonValue &id) {
+    return id.isString() ? "s" + id.toString() : "n" + QString::number(id.toDouble(), 'g', 17);
+}
+
+QByteArray ProxyFilter::encode(const FrameBuilder::Frame &frame) {
+    QByteArray out;
+    for (const FrameBuilder::Header &header : frame.headers) {
+        out += header.name.toUtf8() + ": " + header.value.toUtf8() + "\r\n";
+    }
+    return out + "\r\n" + frame.payload;
+}
+
+QByteArray ProxyFilter::encode(const QJsonObject &message) {
+    return encode(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+QByteArray ProxyFilter::encode(const QByteArray &payload) {
+    return "Content-Length: " + QByteArray::number(payload.size()) + "\r\n\r\n" + payload;
+}
+
+void ProxyFilter::appendOpenMetrics(QByteArray &out) const {
+    using namespace Metrics::Exposition;
+
+    auto labels = [](const QString &method) {
+        return "method=\"" + escapeLabel(method) + "\"";
+    };
+
+    family(out, "lspmonitor_superseded_requests_total", "counter", "Requests superseded by a newer one for the same document, by method and whether the proxy cancelled them or answered them itself");
+    for (auto &entry : savings) {
+        sample(out, "lspmonitor_superseded_requests_total", labels(entry.first) + ",action=\"cancelled\"", entry.second.cancelled);
+        sample(out, "lspmonitor_superseded_requests_total", labels(entry.first) + ",action=\"answered\"", entry.second.answered);
+    }
+
+    family(out, "lspmonitor_superseded_cancel_outcomes_total", "counter", "How the server answered Requests the proxy cancelled, by method");
+    for (auto &entry : savings) {
+        sample(out, "lspmonitor_superseded_cancel_outcomes_total", labels(entry.first) + ",outcome=\"honoured\"", entry.second.honoured);
+        sample(out, "lspmonitor_superseded_cancel_outcomes_total", labels(entry.first) + ",outcome=\"completed\"", entry.second.completed);
+    }
+
+    family(out, "lspmonitor_superseded_unforwarded_bytes_total", "counter", "Bytes of superseded Requests the server was never sent, by method");
+    for (auto &entry : savings) {
+        sample(out, "lspmonitor_superseded_unforwarded_bytes_total", labels(entry.first), entry.second.unforwardedBytes);
+    }
+
+    int held = 0;
+    for (const Slot &slot : methodSlots) {
+        held += slot.held ? 1 : 0;
+    }
+
+    family(out, "lspmonitor_proxy_expired_requests_total", "counter", "Requests the proxy forwarded and stopped waiting for, as the server didn't answer them within the request timeout");
+    sample(out, "lspmonitor_proxy_expired_requests_total", "", expired);
+
+    family(out, "lspmonitor_held_requests", "gauge", "Requests waiting for an older one of the same method for the same document to be answered");
+    sample(out, "lspmonitor_held_requests", "", held);
+
+    family(out, "lspmonitor_coalesced_changes_total", "counter", "textDocument/didChange notifications held while the server was backlogged, by whether they were forwarded or merged into the one forwarded");
+    sample(out, "lspmonitor_coalesced_changes_total", "result=\"forwarded\"", changesForwarded);
+    sample(out, "lspmonitor_coalesced_changes_total", "result=\"merged\"", changesCoalesced);
+
+    family(out, "lspmonitor_coalesced_change_events_joined_total", "counter", "Change events joined into the one before them, or made redundant by a whole document change");
+    sample(out, "lspmonitor_coalesced_change_events_joined_total", "", eventsJoined);
+
+    family(out, "lspmonitor_coalesced_change_releases_total", "counter", "Times held changes were forwarded, by why");
+    const std::pair<Release, const char*> reasons[] = {
+        {Release::CaughtUp, "caught_up"},
+        {Release::Message, "message"},
+        {Release::Timeout, "timeout"},
+    };
+    for (auto &reason : reasons) {
+        auto it = releases.find(reason.first);
+        sample(out, "lspmonitor_coalesced_change_releases_total", QByteArray("reason=\"") + reason.second + "\"", it != releases.end() ? it->second : 0);
+    }
+
+    family(out, "lspmonitor_coalesced_change_hold_seconds", "histogram", "Time from the first held change of a merged textDocument/didChange to it being forwarded");
+    histogram(out, "lspmonitor_coalesced_change_hold_seconds", "", holdTime, 1e9);
+
+    family(out, "lspmonitor_response_cache_requests_total", "counter", "Cacheable Requests, by method and whether the proxy answered them from the response cache");
+    for (auto &entry : cacheStats) {
+        sample(out, "lspmonitor_response_cache_requests_total", labels(entry.first) + ",result=\"hit\"", entry.second.hits);
+        sample(out, "lspmonitor_response_cache_requests_total", labels(entry.first) + ",result=\"miss\"", entry.second.misses);
+    }
+
+    family(out, "lspmonitor_response_cache_entries", "gauge", "Results in the response cache");
+    sample(out, "lspmonitor_response_cache_entries", "", cache.size());
+
+    family(out, "lspmonitor_response_cache_bytes", "gauge", "Memory held by the response cache");
+    sample(out, "lspmonitor_response_cache_bytes", "", cacheBytes);
+
+    family(out, "lspmonitor_response_cache_evictions_total", "counter", "Results dropped from the response cache, because their document changed or to make room");
+    sample(out, "lspmonitor_response_cache_evictions_total", "reason=\"invalidated\"", invalidated);
+    sample(out, "lspmonitor_response_cache_evictions_total", "reason=\"capacity\"", evicted);
+}
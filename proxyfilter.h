@@ -0,0 +1,374 @@
+#ifndef PROXYFILTER_H
+#define PROXYFILTER_H
+
+#include <QObject>
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include <list>
+#include <map>
+
+#include "clock.h"
+#include "framebuilder.h"
+#include "histogram.h"
+#include "option.h"
+
+/**
+ * Sits in the forwarding path when a policy that changes the traffic is
+ * enabled. Client messages are then framed before being forwarded, so they
+ * can be held, answered by the proxy or joined by messages of its own. The
+ * server's output is still forwarded in chunks as it arrives, and is framed
+ * only to see which Requests were answered and where messages for the client
+ * can go between its frames.
+ *
+ * With no policy enabled the mitm forwards chunks untouched, and the filter
+ * is never used.
+ */
+class ProxyFilter : public QObject {
+    Q_OBJECT
+
+public:
+    /** What happens to a Request when a newer one of the same method for the same document arrives */
+    enum class Supersede {
+        Off,
+
+        /** Every Request is forwarded at once, and the older one cancelled with $/cancelRequest on the client's behalf */
+        Cancel,
+
+        /**
+         * One Request per method and document is forwarded at a time. A newer
+         * one waits for it to be answered, and replaces any already waiting,
+         * which is answered with RequestCancelled without ever being forwarded.
+         */
+        Answer,
+    };
+
+    /** The methods clients send on every cursor move, whose answers are only wanted for the latest position */
+    static const QStringList defaultSupersedable;
+
+    /** Methods whose results only depend on the version of the document they are for */
+    static const QStringList defaultCacheable;
+
+    ProxyFilter(QObject *parent = nullptr);
+
+    /** Parses "off", "cancel" or "answer" */
+    static option<Supersede> parseSupersede(const QString &name);
+
+    void setSupersede(Supersede mode);
+
+    void setSupersedable(const QStringList &methods);
+
+    /**
+     * Answers Requests for the cacheable methods from earlier Responses to the
+     * same Request for the same document version, holding up to the bytes of
+     * results. 0 disables the cache.
+     */
+    void setCacheLimit(qint64 bytes);
+
+    void setCacheable(const QStringList &methods);
+
+    /**
+     * Holds incremental textDocument/didChange notifications while the server
+     * has at least the backlog of Requests unanswered, merging those for the
+     * same document into one. They are forwarded once it catches up, or before
+     * anything else about the document. 0 disables coalescing.
+     */
+    void setCoalesceBacklog(int requests);
+
+    /**
+     * How long (ms) a forwarded Request is waited for before the filter stops
+     * tracking it, so a Request the server never answers doesn't block its
+     * slot or count towards the backlog for good. 0 disables expiry.
+     */
+    void setRequestTimeout(qint64 timeout);
+
+    /** The clock forwarded Requests expire by, and held changes are timed by */
+    void setClock(Clock *clock);
+
+    /** Whether any policy is enabled, so traffic has to pass through the filter */
+    bool isActive() const;
+
+    /** Appends the filter's metrics in the OpenMetrics text format */
+    void appendOpenMetrics(QByteArray &out) const;
+
+signals:
+    /** Whole messages for the server */
+    void emitToServer(QByteArray data);
+
+    /** Chunks of the server's output, for the client */
+    void emitToClient(QByteArray data);
+
+    /** Messages the proxy answers the client with itself, between the frames of the server's output */
+    void emitAnswerToClient(QByteArray data);
+
+public slots:
+    void onClientInput(QByteArray data);
+
+    void onServerInput(QByteArray data);
+
+private slots:
+    void onClientFrame(FrameBuilder::Frame frame);
+
+    void onServerFrame(FrameBuilder::Frame frame);
+
+private:
+    /** A client Request the server hasn't answered */
+    struct Pending {
+        QJsonValue id;
+
+        QString method;
+
+        /** The method and document it may be superseded within, if any */
+        QString slot;
+
+        /** Whether the proxy cancelled it */
+        bool cancelled = false;
+
+        /** The cache key its result is stored under, if it is cacheable */
+        QString cache {};
+
+        /** Tells it from a later Request reusing its id, when its timeout comes */
+        quint64 serial = 0;
+    };
+
+    /** A Request waiting for the one before it in its slot to be answered */
+    struct Held {
+        QJsonValue id;
+
+        QString method;
+
+        QString cache;
+
+        QByteArray message;
+    };
+
+    /** The Requests of one method for one document */
+    struct Slot {
+        /** The id key of the latest Request forwarded, while it is unanswered */
+        QString forwarded;
+
+        option<Held> held;
+    };
+
+    struct MethodSavings {
+        /** Cancelled on the client's behalf */
+        quint64 cancelled = 0;
+
+        /** Of those, answered with RequestCancelled (or ContentModified) */
+        quint64 honoured = 0;
+
+        /** Of those, answered with a result anyway */
+        quint64 completed = 0;
+
+        /** Answered by the proxy, and never forwarded */
+        quint64 answered = 0;
+
+        quint64 unforwardedBytes = 0;
+    };
+
+    /** A result, and the Request it answers */
+    struct CacheEntry {
+        QString key;
+
+        QString uri;
+
+        QString method;
+
+        /** The raw JSON of the result */
+        QByteArray result;
+
+        /** Roughly what the entry takes up */
+        qint64 bytes() const;
+    };
+
+    /** didChange notifications held for one document, merged */
+    struct HeldChanges {
+        /** The identifier of the latest, so the merged notification has its version */
+        QJsonObject textDocument;
+
+        QJsonArray changes;
+
+        int notifications = 0;
+
+        /** When the first was held (ns, monotonic) */
+        qint64 since = 0;
+    };
+
+    /** Why held changes were forwarded */
+    enum class Release {
+        /** The server's backlog went below the limit */
+        CaughtUp,
+
+        /** A Request or notification about the document arrived */
+        Message,
+
+        /** They were held for the longest allowed */
+        Timeout,
+    };
+
+    /** Longest a change is held, so a server that never answers doesn't lose edits */
+    static constexpr int maxHoldMs = 500;
+
+    struct MethodCache {
+        quint64 hits = 0;
+
+        quint64 misses = 0;
+    };
+
+    /** What the filter needs of a server message, found without parsing all of it */
+    struct Envelope {
+        /** The raw id, if the message is a Response */
+        QByteArray id;
+
+        /** The raw error of a Response, if it is one */
+        QByteArray error;
+
+        /** Where the result starts, if there is one */
+        int resultStart = -1;
+
+        bool isResponse = false;
+    };
+
+    /**
+     * Scans the top level members of a message. Responses from most servers
+     * start with their id, so a large result usually isn't scanned at all: the
+     * scan stops once the id and the start of a result have been seen.
+     */
+    static Envelope scanEnvelope(const QByteArray &json);
+
+    void onClientRequest(const FrameBuilder::Frame &frame, const QJsonObject &request);
+
+    /** Handles a $/cancelRequest for a held Request, returning false if it is for the server */
+    bool onClientCancel(const QJsonValue &id);
+
+    /** Answers held Requests for a document that changes, tracks the versions of open documents and invalidates the cache as they change */
+    void onNotification(const QString &method, const QJsonObject &params);
+
+    void onResponse(const QString &key, const QByteArray &payload, const Envelope &envelope);
+
+    /** Stops tracking a Request the server didn't answer within the request timeout */
+    void expire(const QString &key, quint64 serial);
+
+    /** Once a Request is no longer pending, forwards what waited for it: held changes and the next Request in its slot */
+    void onSettled(const QString &key, const Pending &request);
+
+    /** Forwards a Request, tracking it until it is answered */
+    void forward(const QJsonValue &id, const QString &method, const QString &slot, const QString &cache, const QByteArray &message);
+
+    /** The key of a Request in the cache, or an empty string if it can't be cached */
+    QString cacheKey(const QString &method, const QJsonObject &params) const;
+
+    void store(const QString &key, const QString &method, const QByteArray &result);
+
+    /** Drops the cached results for a document, or every result if uri is empty */
+    void invalidate(const QString &uri);
+
+    void evict(std::list<CacheEntry>::iterator entry);
+
+    /** Answers a held Request with an error, so it is never forwarded */
+    void answerHeld(const Held &held, int code, const QString &message);
+
+    /** Holds a didChange if the server is backlogged or one is already held for the document, returning false otherwise */
+    bool holdChange(const QJsonObject &params);
+
+    /** Forwards the changes held for a document, or for every document if uri is empty */
+    void releaseChanges(const QString &uri, Release reason);
+
+    /** Adds a change event after the others, joining it to the last where that is exact */
+    void appendChange(QJsonArray &changes, const QJsonObject &change);
+
+    /** Queues a message for the client, written as soon as the server's output is between frames */
+    void sendToClient(const QByteArray &payload);
+
+    void flushToClient();
+
+    static QString idKey(const QJsonValue &id);
+
+    /** The bytes of a frame as forwarded, with its original headers */
+    static QByteArray encode(const FrameBuilder::Frame &frame);
+
+    static QByteArray encode(const QJsonObject &message);
+
+    static QByteArray encode(const QByteArray &payload);
+
+    Supersede supersede = Supersede::Off;
+
+    QSet<QString> supersedable {};
+
+    FrameBuilder::FrameBuilder clientFrames {};
+
+    FrameBuilder::FrameBuilder serverFrames {};
+
+    /** By id key */
+    QHash<QString, Pending> pending {};
+
+    /** Requests forwarded, numbering them for Pending::serial */
+    quint64 forwarded = 0;
+
+    /** Forwarded Requests that expired unanswered */
+    quint64 expired = 0;
+
+    /** As the validators' default */
+    qint64 requestTimeout = 5 * 60 * 1000;
+
+    Clock *clock = Clock::system();
+
+    /** By method and URI */
+    QHash<QString, Slot> methodSlots {};
+
+    /** Bytes of server output forwarded, and where its last complete frame ended */
+    quint64 serverBytes = 0;
+
+    quint64 serverFrameEnd = 0;
+
+    /** Messages for the client waiting for the server's output to be between frames */
+    QByteArray toClient {};
+
+    std::map<QString, MethodSavings> savings {};
+
+    qint64 cacheLimit = 0;
+
+    QSet<QString> cacheable {};
+
+    /** The version of each open document, while the cache is enabled */
+    QHash<QString, qint64> versions {};
+
+    /** Most recently used first */
+    std::list<CacheEntry> cache {};
+
+    QHash<QString, std::list<CacheEntry>::iterator> cacheIndex {};
+
+    qint64 cacheBytes = 0;
+
+    std::map<QString, MethodCache> cacheStats {};
+
+    /** Entries dropped because their document changed, and to make room */
+    quint64 invalidated = 0;
+
+    quint64 evicted = 0;
+
+    int coalesceBacklog = 0;
+
+    /** By URI */
+    QHash<QString, HeldChanges> heldChanges {};
+
+    /** Whether the longest hold is being timed, and how many times it has been */
+    bool holding = false;
+
+    quint64 holds = 0;
+
+    /** didChange notifications forwarded (merged or not), and those merged into another */
+    quint64 changesForwarded = 0;
+
+    quint64 changesCoalesced = 0;
+
+    /** Change events joined into the one before them, or made redundant by a whole document change */
+    quint64 eventsJoined = 0;
+
+    std::map<Release, quint64> releases {};
+
+    /** From the first change of a merged notification being held to it being forwarded (ns) */
+    Histogram holdTime {};
+};
+
+#endif // PROXYFILTER_H
@@ -0,0 +1,151 @@
+#include "rangechecker.h"
+#include "metrics.h"
+
+RangeChecker::RangeChecker(const DocumentMirror &documents) : documents(documents) {}
+
+void RangeChecker::onLspMessage(const std::shared_ptr<Lsp::Message> &message) {
+    if (message->getSender() != Lsp::Entity::Server) {
+        return;
+    }
+
+    QString method = message->tryGetMethod().value_or(QString());
+
+    if (message->getKind() == Lsp::Message::Kind::Notification && method == "textDocument/publishDiagnostics") {
+        checkDiagnostics(*message);
+    } else if (message->getKind() == Lsp::Message::Kind::Response && (method == "textDocument/semanticTokens/full" || method == "textDocument/semanticTokens/range")) {
+        checkSemanticTokens(static_cast<Lsp::Response&>(*message));
+    }
+}
+
+void RangeChecker::checkDiagnostics(Lsp::Message &message) {
+    QJsonObject params = message.getContents().object().value("params").toObject();
+    QString uri = params.value("uri").toString();
+
+    // Without a version the diagnostics may be for an older version than the latest, so problems are only warnings
+    QJsonValue versionValue = params.value("version");
+    bool versioned = versionValue.isDouble();
+
+    const DocumentMirror::Version *version = versioned
+        ? documents.find(uri, qint64(versionValue.toDouble()))
+        : documents.findAt(uri, message.getTiming().lastByte);
+
+    if (!version) {
+        unchecked += 1;
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const LineIndex &lines = documents.lineIndex(*version);
+    QJsonArray diagnostics = params.value("diagnostics").toArray();
+    int invalidInMessage = 0;
+
+    for (int i = 0; i < diagnostics.size(); i++) {
+        QJsonObject range = diagnostics.at(i).toObject().value("range").toObject();
+
+        for (const char *end : {"start", "end"}) {
+            QJsonObject position = range.value(end).toObject();
+            DocumentRope::Position p {qint64(position.value("line").toDouble()), qint64(position.value("character").toDouble())};
+
+            checked += 1;
+            if (lines.contains(p) || !onInvalid(invalidInMessage)) {
+                continue;
+            }
+
+            QString msg = p.line >= lines.lineCount()
+                ? "Line is past the end of the document (" + QString::number(lines.lineCount()) + " lines)"
+                : "Character is past the end of the line (" + QString::number(lines.lineLength(p.line)) + " units)";
+
+            // Cursors refer to their parents, so the path is built and used in one expression
+            auto add = versioned ? &SchemaIssues::Cursor::error : &SchemaIssues::Cursor::warning;
+            (message.getIssues().member("params").member("diagnostics").element(i).member("range").member(end).*add)(msg);
+        }
+    }
+
+    summarise(message, invalidInMessage);
+    checkTime.record(timer.nsecsElapsed());
+}
+
+void RangeChecker::checkSemanticTokens(Lsp::Response &response) {
+    auto request = response.getRequest();
+    QJsonArray data = response.getContents().object().value("result").toObject().value("data").toArray();
+    if (!request || data.isEmpty()) {
+        return;
+    }
+
+    QString uri = request->getContents().object().value("params").toObject().value("textDocument").toObject().value("uri").toString();
+
+    // The server computes the tokens for the version it had when the Request arrived
+    const DocumentMirror::Version *version = documents.findAt(uri, request->getTiming().lastByte);
+    if (!version) {
+        unchecked += 1;
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const LineIndex &lines = documents.lineIndex(*version);
+    int invalidInMessage = 0;
+
+    // Tokens are five integers each, positioned relative to the previous token
+    qint64 line = 0;
+    qint64 start = 0;
+
+    for (int i = 0; i + 4 < data.size(); i += 5) {
+        qint64 deltaLine = qint64(data.at(i).toDouble());
+        qint64 deltaStart = qint64(data.at(i + 1).toDouble());
+        qint64 length = qint64(data.at(i + 2).toDouble());
+
+        line += deltaLine;
+        start = deltaLine == 0 ? start + deltaStart : deltaStart;
+
+        checked += 1;
+        qint64 lineLength = lines.lineLength(line);
+        if (lineLength >= 0 && start + length <= lineLength) {
+            continue;
+        }
+
+        if (!onInvalid(invalidInMessage)) {
+            continue;
+        }
+
+        QString msg = lineLength < 0
+            ? "Token " + QString::number(i / 5) + " is on line " + QString::number(line) + ", past the end of the document (" + QString::number(lines.lineCount()) + " lines)"
+            : "Token " + QString::number(i / 5) + " ends at character " + QString::number(start + length) + ", past the end of line " + QString::number(line) + " (" + QString::number(lineLength) + " units)";
+
+        response.getIssues().member("result").member("data").element(i).error(msg);
+    }
+
+    summarise(response, invalidInMessage);
+    checkTime.record(timer.nsecsElapsed());
+}
+
+bool RangeChecker::onInvalid(int &invalidInMessage) {
+    invalid += 1;
+    invalidInMessage += 1;
+    return invalidInMessage <= issueLimit;
+}
+
+void RangeChecker::summarise(Lsp::Message &message, int invalidInMessage) {
+    if (invalidInMessage > issueLimit) {
+        message.getIssues().root().info(QString::number(invalidInMessage - issueLimit) + " more positions are outside the document");
+    }
+}
+
+void RangeChecker::appendOpenMetrics(QByteArray &out) const {
+    using namespace Metrics::Exposition;
+
+    family(out, "lspmonitor_range_checked_total", "counter", "Positions in diagnostics and semantic tokens checked against the document mirror");
+    sample(out, "lspmonitor_range_checked_total", "", checked);
+
+    family(out, "lspmonitor_range_invalid_total", "counter", "Positions in diagnostics and semantic tokens outside the document");
+    sample(out, "lspmonitor_range_invalid_total", "", invalid);
+
+    family(out, "lspmonitor_range_unchecked_total", "counter", "Messages for a document or version the document mirror doesn't have");
+    sample(out, "lspmonitor_range_unchecked_total", "", unchecked);
+
+    family(out, "lspmonitor_range_check_seconds", "histogram", "Time to check the positions in one message");
+    histogram(out, "lspmonitor_range_check_seconds", "", checkTime, 1e9);
+}
@@ -0,0 +1,61 @@
+#ifndef RANGECHECKER_H
+#define RANGECHECKER_H
+
+#include <QtCore>
+
+#include <memory>
+
+#include "documentmirror.h"
+#include "histogram.h"
+#include "lspschemavalidator.h"
+
+/**
+ * Checks the positions servers send against the document mirror, in the
+ * position encoding agreed on in initialize: the ranges of every diagnostic in
+ * textDocument/publishDiagnostics, and the tokens in textDocument/semanticTokens
+ * results. Positions past the end of a line or document are added as issues on
+ * the message.
+ *
+ * Each message is checked against the version it was computed for: the version
+ * diagnostics name, or else the latest version that had arrived before the
+ * message (or before the Request, for semantic tokens). Messages for documents
+ * or versions the mirror doesn't have are counted, not checked.
+ */
+class RangeChecker {
+public:
+    /** Issues added to one message; the rest are summarised in one more */
+    static constexpr int issueLimit = 10;
+
+    explicit RangeChecker(const DocumentMirror &documents);
+
+    void onLspMessage(const std::shared_ptr<Lsp::Message> &message);
+
+    /** Appends the range checking metrics in the OpenMetrics text format */
+    void appendOpenMetrics(QByteArray &out) const;
+
+private:
+    void checkDiagnostics(Lsp::Message &message);
+
+    void checkSemanticTokens(Lsp::Response &response);
+
+    /** Counts a position outside the document, returning whether an issue should still be added for it */
+    bool onInvalid(int &invalidInMessage);
+
+    /** Adds the summary of the issues that weren't added */
+    void summarise(Lsp::Message &message, int invalidInMessage);
+
+    const DocumentMirror &documents;
+
+    /** Positions checked, including the tokens of semantic tokens */
+    quint64 checked = 0;
+
+    quint64 invalid = 0;
+
+    /** Messages for a document or version the mirror doesn't have */
+    quint64 unchecked = 0;
+
+    /** Time to check each message (ns) */
+    Histogram checkTime {};
+};
+
+#endif // RANGECHECKER_H
@@ -0,0 +1,401 @@
+#include "replay.h"
+#include "monotonic.h"
+
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include <iostream>
+
+namespace Replay {
+
+QString latencyTable(const std::map<QString, std::unique_ptr<MethodReport>> &methods, const QHash<QString, int> &unanswered) {
+    // Only a replay has recorded latencies to compare with
+    bool recorded = std::any_of(methods.begin(), methods.end(), [](auto &entry) { return entry.second->recorded.count() > 0; });
+
+    QString out = QString::asprintf("%-40s %7s %7s %7s %9s %9s %9s %9s",
+        "Method", "Sent", "Errors", "Lost", "p50 ms", "p90 ms", "p99 ms", "Max ms");
+    out += recorded ? QString::asprintf(" %12s %12s\n", "Rec. p50 ms", "Rec. p99 ms") : QString("\n");
+
+    auto millis = [](quint64 us) { return us / 1000.0; };
+
+    for (auto &entry : methods) {
+        const MethodReport &report = *entry.second;
+        if (report.sent == 0) {
+            continue;
+        }
+
+        out += QString::asprintf("%-40s %7llu %7llu %7d %9.2f %9.2f %9.2f %9.2f",
+            entry.first.toUtf8().constData(),
+            (unsigned long long) report.sent,
+            (unsigned long long) report.errors,
+            unanswered.value(entry.first),
+            millis(report.latency.percentile(0.5)),
+            millis(report.latency.percentile(0.9)),
+            millis(report.latency.percentile(0.99)),
+            millis(report.latency.max()));
+
+        if (recorded) {
+            out += QString::asprintf(" %12.2f %12.2f", millis(report.recorded.percentile(0.5)), millis(report.recorded.percentile(0.99)));
+        }
+        out += "\n";
+    }
+
+    return out;
+}
+
+Engine::Engine(Options options, QObject *parent) : QObject(parent), options(options) {
+    timer.setSingleShot(true);
+    connect(&timer, &QTimer::timeout, this, &Engine::sendDue);
+
+    drainTimer.setSingleShot(true);
+    connect(&drainTimer, &QTimer::timeout, this, &Engine::finish);
+}
+
+bool Engine::load(QIODevice *capture, QString *error) {
+    Capture::Reader reader (capture);
+    Capture::Record record;
+
+    // Recorded Requests waiting on a Response, to pair them up by id
+    QHash<QString, std::pair<QString, qint64>> clientRequests;
+    QHash<QString, QString> serverRequests;
+
+    while (reader.next(record)) {
+        if (record.kind != Capture::Record::Kind::ClientMessage && record.kind != Capture::Record::Kind::ServerMessage) {
+            continue;
+        }
+
+        QJsonObject message = QJsonDocument::fromJson(record.data).object();
+        bool isResponse = !message.contains("method") && message.contains("id");
+        QString key = idKey(message.value("id"));
+
+        if (record.kind == Capture::Record::Kind::ClientMessage) {
+            if (isResponse) {
+                auto it = serverRequests.find(key);
+                if (it != serverRequests.end()) {
+                    answers[it.value()].push_back(message);
+                    serverRequests.erase(it);
+                }
+            } else if (message.contains("method")) {
+                script.push_back(Step {record.timestamp, message});
+
+                if (message.contains("id")) {
+                    clientRequests.insert(key, {message.value("method").toString(), record.timestamp});
+                }
+            }
+        } else {
+            if (isResponse) {
+                auto it = clientRequests.find(key);
+                if (it != clientRequests.end()) {
+                    method(it->first).recorded.record(std::max<qint64>(record.timestamp - it->second, 0) * 1000);
+                    clientRequests.erase(it);
+                }
+            } else if (message.contains("id")) {
+                serverRequests.insert(key, message.value("method").toString());
+            }
+        }
+    }
+
+    if (reader.errorOccurred()) {
+        *error = reader.errorString();
+        return false;
+    }
+
+    if (script.empty()) {
+        *error = "The capture has no messages from the client";
+        return false;
+    }
+
+    return true;
+}
+
+void Engine::setKeepResponses(bool keep) {
+    keepResponses = keep;
+}
+
+void Engine::start(const QStringList &command) {
+    server = std::make_unique<ServerSession>(command, this);
+    connect(server.get(), &ServerSession::emitMessage, this, &Engine::onServerMessage);
+    connect(server.get(), &ServerSession::emitFinished, this, &Engine::onServerFinished);
+
+    if (keepResponses) {
+        responses.resize(script.size());
+    }
+
+    anchorTimestamp = script.front().timestamp;
+    anchorNs = monotonicNs();
+    firstSentNs = anchorNs;
+    lastReceivedNs = anchorNs;
+
+    sendDue();
+}
+
+QStringList Engine::getScriptMethods() const {
+    QStringList methods;
+    for (const Step &step : script) {
+        methods.append(step.message.value("method").toString());
+    }
+    return methods;
+}
+
+const QVector<QJsonObject>& Engine::getResponses() const {
+    return responses;
+}
+
+const std::map<QString, std::unique_ptr<MethodReport>>& Engine::getMethods() const {
+    return methods;
+}
+
+const QHash<QString, int>& Engine::getUnanswered() const {
+    return unanswered;
+}
+
+qint64 Engine::getDuration() const {
+    return lastReceivedNs - firstSentNs;
+}
+
+QString Engine::report() const {
+    quint64 requests = 0;
+    for (auto &entry : methods) {
+        requests += entry.second->sent;
+    }
+
+    QString pace = options.speed > 0
+        ? QString("at %1x the recorded pace").arg(options.speed)
+        : QString("as fast as possible, with up to %1 Requests in flight").arg(options.window);
+
+    QString out = QString("Replayed %1 messages (%2 Requests) in %3 s, %4\n\n")
+        .arg(next).arg(requests).arg(getDuration() / 1e9, 0, 'f', 2).arg(pace);
+
+    return out + latencyTable(methods, unanswered);
+}
+
+void Engine::sendDue() {
+    if (finishing) {
+        return;
+    }
+
+    while (next < script.size() && !barrier) {
+        const Step &step = script[next];
+
+        if (options.speed > 0) {
+            qint64 due = anchorNs + qint64((step.timestamp - anchorTimestamp) * 1e6 / options.speed);
+            qint64 now = monotonicNs();
+            if (due > now) {
+                timer.start(int((due - now + 999999) / 1000000));
+                return;
+            }
+        } else if (step.message.contains("id") && pending.size() >= options.window) {
+            // Resumed when a Response arrives
+            return;
+        }
+
+        send(step.message);
+        next += 1;
+    }
+
+    if (next < script.size()) {
+        return;
+    }
+
+    if (pending.isEmpty()) {
+        finish();
+    } else if (!drainTimer.isActive()) {
+        drainTimer.start(options.drainTimeout);
+    }
+}
+
+void Engine::onServerMessage(QJsonObject message, qint64 arrival) {
+    lastReceivedNs = arrival;
+
+    if (!message.contains("method")) {
+        onResponse(message, arrival);
+    } else if (message.contains("id")) {
+        answer(message);
+    }
+}
+
+void Engine::onServerFinished(int exitCode) {
+    if (!finishing) {
+        std::cerr << "Server exited with code " << exitCode << " before the replay finished" << std::endl;
+    }
+
+    for (auto &request : pending) {
+        unanswered[request.method] += 1;
+    }
+    pending.clear();
+
+    finishing = true;
+    timer.stop();
+    drainTimer.stop();
+
+    if (!finished) {
+        finished = true;
+        emit emitFinished();
+    }
+}
+
+QString Engine::idKey(const QJsonValue &id) {
+    return id.isString() ? "s" + id.toString() : "n" + QString::number(id.toDouble(), 'g', 17);
+}
+
+MethodReport& Engine::method(const QString &name) {
+    auto &report = methods[name];
+    if (!report) {
+        report = std::make_unique<MethodReport>();
+    }
+    return *report;
+}
+
+void Engine::send(QJsonObject message) {
+    QString name = message.value("method").toString();
+
+    if (message.contains("id")) {
+        qint64 live = nextId++;
+        liveIds.insert(idKey(message.value("id")), live);
+        message["id"] = live;
+
+        pending.insert(live, Pending {name, monotonicNs(), int(next)});
+        method(name).sent += 1;
+
+        // Nothing else may be sent before initialize is answered, or after shutdown
+        if (name == "initialize" || name == "shutdown") {
+            barrier = live;
+        }
+
+        // The recorded client is long gone, and a server watching its process would exit
+        if (name == "initialize") {
+            QJsonObject params = message.value("params").toObject();
+            if (params.contains("processId") && !params.value("processId").isNull()) {
+                params["processId"] = qint64(QCoreApplication::applicationPid());
+                message["params"] = params;
+            }
+        }
+    } else if (name == "$/cancelRequest") {
+        QJsonObject params = message.value("params").toObject();
+        auto it = liveIds.find(idKey(params.value("id")));
+        if (it != liveIds.end()) {
+            params["id"] = it.value();
+            message["params"] = params;
+        }
+    } else if (name == "exit") {
+        exitSent = true;
+    }
+
+    server->send(message);
+}
+
+void Engine::answer(const QJsonObject &request) {
+    QString name = request.value("method").toString();
+    QJsonObject response {{"jsonrpc", "2.0"}, {"id", request.value("id")}};
+
+    auto &recorded = answers[name];
+    if (!recorded.empty()) {
+        QJsonObject answer = recorded.front();
+        recorded.pop_front();
+
+        if (answer.contains("error")) {
+            response["error"] = answer.value("error");
+        } else {
+            response["result"] = answer.value("result");
+        }
+    } else if (name == "workspace/configuration") {
+        QJsonArray result;
+        for (int i = 0; i < request.value("params").toObject().value("items").toArray().size(); i++) {
+            result.append(QJsonValue::Null);
+        }
+        response["result"] = result;
+    } else {
+        response["result"] = QJsonValue::Null;
+    }
+
+    server->send(response);
+}
+
+void Engine::onResponse(const QJsonObject &response, qint64 arrival) {
+    QJsonValue id = response.value("id");
+    if (!id.isDouble()) {
+        return;
+    }
+
+    qint64 live = qint64(id.toDouble());
+
+    if (finishing) {
+        // The shutdown sent by finish()
+        if (live == nextId - 1 && !exitSent) {
+            server->send(QJsonObject {{"jsonrpc", "2.0"}, {"method", "exit"}});
+            exitSent = true;
+        }
+        return;
+    }
+
+    auto it = pending.find(live);
+    if (it == pending.end()) {
+        return;
+    }
+
+    MethodReport &report = method(it->method);
+    quint64 latency = std::max<qint64>(arrival - it->sentAt, 0) / 1000;
+    report.latency.record(latency);
+    report.samples.append(latency);
+    if (response.contains("error")) {
+        report.errors += 1;
+    }
+
+    if (keepResponses) {
+        QJsonObject kept = response;
+        kept.remove("id");
+        kept.remove("jsonrpc");
+        responses[it->step] = kept;
+    }
+
+    pending.erase(it);
+
+    if (barrier == live) {
+        barrier = {};
+
+        // Waiting doesn't count against the pace, so the schedule restarts from the next message if it is now late
+        qint64 now = monotonicNs();
+        if (options.speed > 0 && next < script.size() && anchorNs + qint64((script[next].timestamp - anchorTimestamp) * 1e6 / options.speed) < now) {
+            anchorTimestamp = script[next].timestamp;
+            anchorNs = now;
+        }
+    }
+
+    sendDue();
+}
+
+void Engine::finish() {
+    if (finishing) {
+        return;
+    }
+
+    finishing = true;
+    timer.stop();
+    drainTimer.stop();
+
+    for (auto &request : pending) {
+        unanswered[request.method] += 1;
+    }
+    pending.clear();
+
+    if (server->getProcess()->state() == QProcess::NotRunning) {
+        onServerFinished(server->getProcess()->exitCode());
+        return;
+    }
+
+    if (!exitSent) {
+        bool shutdownSent = methods.count("shutdown") && methods.at("shutdown")->sent > 0;
+        if (shutdownSent) {
+            server->send(QJsonObject {{"jsonrpc", "2.0"}, {"method", "exit"}});
+            exitSent = true;
+        } else {
+            server->send(QJsonObject {{"jsonrpc", "2.0"}, {"id", nextId++}, {"method", "shutdown"}});
+        }
+    }
+
+    // A server that ignores exit is not waited for
+    QTimer::singleShot(5000, server->getProcess(), &QProcess::kill);
+}
+
+}
@@ -0,0 +1,195 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <QObject>
+#include <QTimer>
+#include <QJsonObject>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "capture.h"
+#include "histogram.h"
+#include "option.h"
+#include "serversession.h"
+
+namespace Replay {
+
+struct Options {
+    /** Multiplier on the recorded pace, or 0 to send as fast as the window allows */
+    double speed = 1;
+
+    /** Requests sent but not yet answered at most, when sending as fast as possible */
+    int window = 1;
+
+    /** How long (ms) to wait for outstanding Responses once everything has been sent */
+    int drainTimeout = 30000;
+};
+
+/** The latencies of one method's Requests (µs) */
+struct MethodReport {
+    quint64 sent = 0;
+
+    quint64 errors = 0;
+
+    /** Last byte sent to last byte of the Response */
+    Histogram latency {};
+
+    /** The same, as recorded in the capture (ms resolution) */
+    Histogram recorded {};
+
+    /** Every latency, in the order the Responses arrived */
+    QVector<quint64> samples {};
+};
+
+/** A table of the latency of each method, with the recorded latency if there is any */
+QString latencyTable(const std::map<QString, std::unique_ptr<MethodReport>> &methods, const QHash<QString, int> &unanswered);
+
+/**
+ * Drives a server with the client side of a capture, and measures how long it
+ * takes to answer each Request.
+ *
+ * Client messages are sent at their recorded pace (scaled by the speed), or
+ * as fast as possible while at most a window of Requests is unanswered. The
+ * initialize and shutdown Requests are always waited for before sending
+ * anything else. Request ids are renumbered, and $/cancelRequest rewritten to
+ * match.
+ *
+ * Requests from the server are answered with the client's recorded Responses
+ * to the same method, in order, or with a null result (a list of nulls for
+ * workspace/configuration) once those run out. If the capture doesn't end
+ * the session, the server is shut down once every Request is answered.
+ *
+ * Responses can be kept, indexed by the position of their Request in the
+ * capture, to compare what two servers answered.
+ */
+class Engine : public QObject {
+    Q_OBJECT
+
+public:
+    explicit Engine(Options options, QObject *parent = nullptr);
+
+    /** Reads the session to replay from a capture */
+    bool load(QIODevice *capture, QString *error);
+
+    /** Keep every Response (without its id), see getResponses() */
+    void setKeepResponses(bool keep);
+
+    /** Spawns the server and starts sending */
+    void start(const QStringList &command);
+
+    /** The method of each message of the capture that is sent */
+    QStringList getScriptMethods() const;
+
+    /** The Response to each message of the capture, empty if it got none (or isn't a Request) */
+    const QVector<QJsonObject>& getResponses() const;
+
+    /** Keyed by method */
+    const std::map<QString, std::unique_ptr<MethodReport>>& getMethods() const;
+
+    /** Requests never answered, by method */
+    const QHash<QString, int>& getUnanswered() const;
+
+    /** Time from the first message sent to the last Response (ns) */
+    qint64 getDuration() const;
+
+    /** The latency report, as a table */
+    QString report() const;
+
+signals:
+    void emitFinished();
+
+private slots:
+    /** Sends every message that is due, and schedules the next */
+    void sendDue();
+
+    void onServerMessage(QJsonObject message, qint64 arrival);
+
+    void onServerFinished(int exitCode);
+
+private:
+    struct Step {
+        /** Recorded time (ms since epoch) */
+        qint64 timestamp;
+
+        QJsonObject message;
+    };
+
+    struct Pending {
+        QString method;
+
+        qint64 sentAt;
+
+        /** Index of the Request in the script */
+        int step;
+    };
+
+    /** A JSON-RPC id as a hash key, keeping 1 and "1" apart */
+    static QString idKey(const QJsonValue &id);
+
+    MethodReport& method(const QString &name);
+
+    void send(QJsonObject message);
+
+    void answer(const QJsonObject &request);
+
+    void onResponse(const QJsonObject &response, qint64 arrival);
+
+    /** Sends shutdown and exit if the capture didn't, then waits for the server to exit */
+    void finish();
+
+    std::unique_ptr<ServerSession> server;
+
+    Options options;
+
+    bool keepResponses = false;
+
+    QVector<QJsonObject> responses {};
+
+    std::vector<Step> script {};
+
+    size_t next = 0;
+
+    /** The client's recorded Responses to each method of server Request, oldest first */
+    QHash<QString, std::deque<QJsonObject>> answers {};
+
+    /** Live id -> Request */
+    QHash<qint64, Pending> pending {};
+
+    /** Recorded id -> live id, for $/cancelRequest */
+    QHash<QString, qint64> liveIds {};
+
+    qint64 nextId = 1;
+
+    /** The Request everything else waits on (initialize or shutdown), if any */
+    option<qint64> barrier {};
+
+    /** Recorded and monotonic (ns) time the schedule is measured from */
+    qint64 anchorTimestamp = 0;
+
+    qint64 anchorNs = 0;
+
+    qint64 firstSentNs = 0;
+
+    qint64 lastReceivedNs = 0;
+
+    bool exitSent = false;
+
+    bool finishing = false;
+
+    bool finished = false;
+
+    QTimer timer {};
+
+    QTimer drainTimer {};
+
+    std::map<QString, std::unique_ptr<MethodReport>> methods {};
+
+    QHash<QString, int> unanswered {};
+};
+
+}
+
+#endif // REPLAY_H
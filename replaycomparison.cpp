@@ -0,0 +1,226 @@
+#include "replaycomparison.h"
+
+#include <cmath>
+
+namespace Replay {
+
+namespace {
+    double median(QVector<quint64> values) {
+        if (values.isEmpty()) {
+            return 0;
+        }
+
+        std::sort(values.begin(), values.end());
+        int middle = values.size() / 2;
+        return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+    }
+}
+
+MannWhitney mannWhitney(const QVector<quint64> &first, const QVector<quint64> &second) {
+    MannWhitney result;
+
+    double n1 = first.size();
+    double n2 = second.size();
+    if (n1 == 0 || n2 == 0) {
+        return result;
+    }
+
+    // Rank both samples together, giving ties their average rank
+    QVector<std::pair<quint64, bool>> values;
+    values.reserve(first.size() + second.size());
+    for (quint64 value : first) {
+        values.append({value, true});
+    }
+    for (quint64 value : second) {
+        values.append({value, false});
+    }
+    std::sort(values.begin(), values.end());
+
+    double firstRanks = 0;
+    double ties = 0;
+
+    for (int i = 0; i < values.size();) {
+        int j = i;
+        while (j < values.size() && values[j].first == values[i].first) {
+            j++;
+        }
+
+        double rank = (i + 1 + j) / 2.0;
+        for (int k = i; k < j; k++) {
+            if (values[k].second) {
+                firstRanks += rank;
+            }
+        }
+
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+
+    double n = n1 + n2;
+    result.u = firstRanks - n1 * (n1 + 1) / 2;
+
+    double mean = n1 * n2 / 2;
+    double variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+    if (variance <= 0) {
+        // Every value is the same
+        return result;
+    }
+
+    // With a continuity correction towards the mean
+    double deviation = result.u - mean;
+    deviation -= deviation > 0 ? 0.5 : (deviation < 0 ? -0.5 : 0);
+
+    result.z = deviation / std::sqrt(variance);
+    result.p = std::erfc(std::abs(result.z) / std::sqrt(2.0));
+    return result;
+}
+
+Comparison::Comparison(const Engine &baseline, const Engine &candidate, double alpha) : alpha(alpha) {
+    static const QVector<quint64> none;
+
+    for (auto &entry : baseline.getMethods()) {
+        methods[entry.first];
+    }
+    for (auto &entry : candidate.getMethods()) {
+        methods[entry.first];
+    }
+
+    auto samplesOf = [](const Engine &engine, const QString &method) -> const QVector<quint64>& {
+        auto it = engine.getMethods().find(method);
+        return it != engine.getMethods().end() ? it->second->samples : none;
+    };
+
+    int tested = 0;
+    for (auto &entry : methods) {
+        const auto &a = samplesOf(baseline, entry.first);
+        const auto &b = samplesOf(candidate, entry.first);
+
+        MethodComparison &method = entry.second;
+        method.baselineCount = a.size();
+        method.candidateCount = b.size();
+        method.baselineMedian = median(a);
+        method.candidateMedian = median(b);
+
+        if (a.size() >= minSamples && b.size() >= minSamples) {
+            method.test = mannWhitney(a, b);
+            tested += 1;
+        }
+    }
+
+    threshold = alpha / std::max(tested, 1);
+
+    for (auto &entry : methods) {
+        MethodComparison &method = entry.second;
+        if (method.baselineCount < minSamples || method.candidateCount < minSamples) {
+            continue;
+        }
+
+        double change = method.baselineMedian > 0 ? method.candidateMedian / method.baselineMedian - 1 : 0;
+
+        if (method.test.p >= threshold || std::abs(change) <= minChange) {
+            method.verdict = Verdict::Unchanged;
+        } else {
+            method.verdict = change > 0 ? Verdict::Slower : Verdict::Faster;
+        }
+    }
+
+    // Responses are compared Request by Request, as both replays sent the same ones
+    QStringList scriptMethods = baseline.getScriptMethods();
+    const auto &before = baseline.getResponses();
+    const auto &after = candidate.getResponses();
+
+    for (int i = 0; i < std::min(before.size(), after.size()); i++) {
+        if (before[i].isEmpty() || after[i].isEmpty()) {
+            continue;
+        }
+
+        MethodComparison &method = methods[scriptMethods.value(i)];
+        method.answered += 1;
+
+        auto differences = JsonDiff::diff(before[i], after[i], 1);
+        if (differences.isEmpty()) {
+            continue;
+        }
+
+        method.differing += 1;
+        if (method.examples.size() < examplesPerMethod) {
+            method.examples.append("message " + QString::number(i + 1) + " " + differences.first().toString());
+        }
+    }
+}
+
+const std::map<QString, Comparison::MethodComparison>& Comparison::getMethods() const {
+    return methods;
+}
+
+bool Comparison::hasRegressions() const {
+    for (auto &entry : methods) {
+        if (entry.second.verdict == Verdict::Slower) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QString Comparison::report() const {
+    QString out = QString("Baseline against candidate, significant at p < %1 (%2 corrected for the methods tested) and a change of over %3%\n\n")
+        .arg(alpha).arg(threshold, 0, 'g', 3).arg(minChange * 100);
+
+    out += QString::asprintf("%-40s %7s %7s %11s %11s %8s %10s %-10s %9s\n",
+        "Method", "Base n", "Cand n", "Base p50 ms", "Cand p50 ms", "Change", "p", "Verdict", "Differing");
+
+    for (auto &entry : methods) {
+        const MethodComparison &method = entry.second;
+
+        const char *verdict = "";
+        switch (method.verdict) {
+            case Verdict::Untested:
+                verdict = "untested";
+                break;
+            case Verdict::Unchanged:
+                verdict = "unchanged";
+                break;
+            case Verdict::Faster:
+                verdict = "FASTER";
+                break;
+            case Verdict::Slower:
+                verdict = "SLOWER";
+                break;
+        }
+
+        double change = method.baselineMedian > 0 ? (method.candidateMedian / method.baselineMedian - 1) * 100 : 0;
+
+        out += QString::asprintf("%-40s %7d %7d %11.2f %11.2f %7.1f%% %10.2g %-10s %4d/%-4d\n",
+            entry.first.toUtf8().constData(),
+            method.baselineCount,
+            method.candidateCount,
+            method.baselineMedian / 1000,
+            method.candidateMedian / 1000,
+            change,
+            method.test.p,
+            verdict,
+            method.differing,
+            method.answered);
+    }
+
+    bool anyDiffering = false;
+    for (auto &entry : methods) {
+        if (entry.second.examples.isEmpty()) {
+            continue;
+        }
+
+        if (!anyDiffering) {
+            out += "\nDiffering Responses (baseline -> candidate):\n";
+            anyDiffering = true;
+        }
+
+        for (const QString &example : entry.second.examples) {
+            out += "  " + entry.first + ", " + example + "\n";
+        }
+    }
+
+    return out;
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef REPLAYCOMPARISON_H
+#define REPLAYCOMPARISON_H
+
+#include <QtCore>
+
+#include "jsondiff.h"
+#include "replay.h"
+
+namespace Replay {
+
+/** Result of a two-sided Mann-Whitney U test (normal approximation, corrected for ties) */
+struct MannWhitney {
+    /** U of the first sample: how often its values exceed the second's */
+    double u = 0;
+
+    double z = 0;
+
+    double p = 1;
+};
+
+MannWhitney mannWhitney(const QVector<quint64> &first, const QVector<quint64> &second);
+
+/**
+ * Compares the replays of the same capture against a baseline and a candidate
+ * server: each method's latencies with a Mann-Whitney U test, and the
+ * Responses to each Request structurally.
+ *
+ * A method has regressed when its latencies differ significantly (at alpha,
+ * Bonferroni corrected for the number of methods tested) and the candidate's
+ * median is slower by more than minChange. Methods with fewer than minSamples
+ * Requests on either side aren't tested.
+ */
+class Comparison {
+public:
+    static constexpr double defaultAlpha = 0.01;
+
+    static constexpr double minChange = 0.05;
+
+    static constexpr int minSamples = 8;
+
+    /** Differences shown for each method with differing Responses */
+    static constexpr int examplesPerMethod = 3;
+
+    enum class Verdict {
+        Untested,
+        Unchanged,
+        Faster,
+        Slower,
+    };
+
+    struct MethodComparison {
+        int baselineCount = 0;
+
+        int candidateCount = 0;
+
+        /** Median latencies (µs) */
+        double baselineMedian = 0;
+
+        double candidateMedian = 0;
+
+        MannWhitney test {};
+
+        Verdict verdict = Verdict::Untested;
+
+        /** Requests answered by both, and those answered differently */
+        int answered = 0;
+
+        int differing = 0;
+
+        QStringList examples {};
+    };
+
+    Comparison(const Engine &baseline, const Engine &candidate, double alpha = defaultAlpha);
+
+    const std::map<QString, MethodComparison>& getMethods() const;
+
+    bool hasRegressions() const;
+
+    /** The comparison, as a table followed by the differing Responses */
+    QString report() const;
+
+private:
+    double alpha;
+
+    /** Corrected for the number of methods tested */
+    double threshold = 1;
+
+    std::map<QString, MethodComparison> methods {};
+};
+
+}
+
+#endif // REPLAYCOMPARISON_H
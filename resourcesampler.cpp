@@ -0,0 +1,172 @@
+#include "resourcesampler.h"
+#include "metrics.h"
+#include "monotonic.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+namespace {
+    /** Reads a (small) /proc file without buffering, returning an empty array on failure */
+    QByteArray readProcFile(const QString &path) {
+        QFile file (path);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            return QByteArray();
+        }
+
+        return file.readAll();
+    }
+
+    /** The number after a "key:" line of a status or io file */
+    qint64 fieldValue(const QByteArray &contents, const QByteArray &key) {
+        int start = contents.startsWith(key) ? 0 : contents.indexOf("\n" + key);
+        if (start < 0) {
+            return 0;
+        }
+        start = contents.indexOf(':', start) + 1;
+
+        int end = contents.indexOf('\n', start);
+        QByteArray value = contents.mid(start, end < 0 ? -1 : end - start).trimmed();
+
+        // "VmRSS:	  1234 kB"
+        return value.split(' ').first().toLongLong();
+    }
+}
+
+ResourceSampler::ResourceSampler(QObject *parent) : QObject(parent) {
+#ifdef Q_OS_LINUX
+    ticksPerSecond = sysconf(_SC_CLK_TCK);
+#endif
+
+    connect(&timer, &QTimer::timeout, this, &ResourceSampler::takeSample);
+}
+
+bool ResourceSampler::isSupported() {
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ResourceSampler::start(qint64 pid, int interval) {
+    if (!isSupported() || pid <= 0 || interval <= 0) {
+        return;
+    }
+
+    this->pid = pid;
+    timer.start(interval);
+    takeSample();
+}
+
+void ResourceSampler::stop() {
+    timer.stop();
+}
+
+const std::deque<ResourceSampler::Sample>& ResourceSampler::getSamples() const {
+    return samples;
+}
+
+double ResourceSampler::cpuLoad() const {
+    if (samples.size() < 2) {
+        return 0;
+    }
+
+    const Sample &last = samples[samples.size() - 1];
+    const Sample &previous = samples[samples.size() - 2];
+
+    qint64 elapsed = last.monotonic - previous.monotonic;
+    return elapsed > 0 ? std::max(last.cpuSeconds - previous.cpuSeconds, 0.0) * 1e9 / elapsed : 0;
+}
+
+void ResourceSampler::takeSample() {
+    Sample sample;
+    sample.timestamp = QDateTime::currentMSecsSinceEpoch();
+    sample.monotonic = monotonicNs();
+
+    // Walk the tree breadth first from the server
+    QVector<qint64> pending {pid};
+    for (int i = 0; i < pending.size(); i++) {
+        if (!addProcess(pending[i], sample, pending) && i == 0) {
+            // The server itself has exited
+            stop();
+            return;
+        }
+    }
+
+    samples.push_back(sample);
+    while (int(samples.size()) > historyLimit) {
+        samples.pop_front();
+    }
+
+    emit emitSample(sample);
+}
+
+bool ResourceSampler::addProcess(qint64 pid, Sample &sample, QVector<qint64> &children) const {
+    QString dir = "/proc/" + QString::number(pid);
+
+    QByteArray stat = readProcFile(dir + "/stat");
+    if (stat.isEmpty()) {
+        return false;
+    }
+
+    // The command name may contain spaces and parentheses, so fields are counted from the last ')'
+    QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 15) {
+        return false;
+    }
+
+    // utime, stime, cutime and cstime are fields 14 to 17 of stat, counting the pid as field 1
+    qint64 ticks = fields[11].toLongLong() + fields[12].toLongLong() + fields[13].toLongLong() + fields[14].toLongLong();
+    sample.cpuSeconds += ticks / ticksPerSecond;
+    sample.processes += 1;
+
+    QByteArray status = readProcFile(dir + "/status");
+    sample.residentBytes += fieldValue(status, "VmRSS") * 1024;
+    sample.threads += fieldValue(status, "Threads");
+
+    // Unreadable if the server changed user
+    QByteArray io = readProcFile(dir + "/io");
+    sample.readBytes += fieldValue(io, "read_bytes");
+    sample.writeBytes += fieldValue(io, "write_bytes");
+
+    for (const QString &task : QDir(dir + "/task").entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        for (const QByteArray &child : readProcFile(dir + "/task/" + task + "/children").split(' ')) {
+            if (!child.trimmed().isEmpty()) {
+                children.append(child.trimmed().toLongLong());
+            }
+        }
+    }
+
+    return true;
+}
+
+void ResourceSampler::appendOpenMetrics(QByteArray &out) const {
+    using namespace Metrics::Exposition;
+
+    if (samples.empty()) {
+        return;
+    }
+
+    const Sample &last = samples.back();
+
+    family(out, "lspmonitor_server_cpu_seconds_total", "counter", "CPU time used by the server and its child processes");
+    sample(out, "lspmonitor_server_cpu_seconds_total", "", last.cpuSeconds);
+
+    family(out, "lspmonitor_server_resident_bytes", "gauge", "Resident memory of the server and its child processes");
+    sample(out, "lspmonitor_server_resident_bytes", "", last.residentBytes);
+
+    family(out, "lspmonitor_server_threads", "gauge", "Threads of the server and its child processes");
+    sample(out, "lspmonitor_server_threads", "", last.threads);
+
+    family(out, "lspmonitor_server_processes", "gauge", "The server and its child processes");
+    sample(out, "lspmonitor_server_processes", "", last.processes);
+
+    family(out, "lspmonitor_server_io_bytes_total", "counter", "Bytes read from and written to storage by the server and its child processes");
+    sample(out, "lspmonitor_server_io_bytes_total", "direction=\"read\"", last.readBytes);
+    sample(out, "lspmonitor_server_io_bytes_total", "direction=\"write\"", last.writeBytes);
+}
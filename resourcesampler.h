@@ -0,0 +1,91 @@
+#ifndef RESOURCESAMPLER_H
+#define RESOURCESAMPLER_H
+
+#include <QObject>
+#include <QTimer>
+
+#include <deque>
+
+#include "option.h"
+
+/**
+ * Periodically samples the resources used by the server and every process it
+ * started, from /proc/<pid>/stat (CPU time), status (resident memory, threads)
+ * and io (storage reads and writes). Descendants are found through
+ * /proc/<pid>/task/<tid>/children.
+ *
+ * CPU time includes children that have exited and been waited for, so it only
+ * goes down if a process exits without being waited for. Only Linux has /proc;
+ * elsewhere nothing is sampled.
+ */
+class ResourceSampler : public QObject {
+    Q_OBJECT
+
+public:
+    /** Totals over the process tree at one moment */
+    struct Sample {
+        /** ms since epoch, like message timestamps */
+        qint64 timestamp = 0;
+
+        /** ns, monotonic, like message timing */
+        qint64 monotonic = 0;
+
+        /** User and system CPU time (s) */
+        double cpuSeconds = 0;
+
+        qint64 residentBytes = 0;
+
+        int threads = 0;
+
+        int processes = 0;
+
+        /** Bytes read from and written to storage (not pipes, so not the LSP traffic) */
+        qint64 readBytes = 0;
+
+        qint64 writeBytes = 0;
+    };
+
+    static constexpr int defaultInterval = 500;
+
+    /** Samples kept, an hour at the default interval */
+    static constexpr int historyLimit = 7200;
+
+    explicit ResourceSampler(QObject *parent = nullptr);
+
+    /** If resources can be sampled on this platform */
+    static bool isSupported();
+
+    /** Starts sampling the process and its descendants every interval (ms) */
+    void start(qint64 pid, int interval);
+
+    void stop();
+
+    /** Oldest first */
+    const std::deque<Sample>& getSamples() const;
+
+    /** CPU cores used on average between the last two samples */
+    double cpuLoad() const;
+
+    /** Appends the server resource metrics in the OpenMetrics text format */
+    void appendOpenMetrics(QByteArray &out) const;
+
+signals:
+    void emitSample(const ResourceSampler::Sample &sample);
+
+private slots:
+    void takeSample();
+
+private:
+    /** Adds the usage of one process to the sample, returning false if it has exited */
+    bool addProcess(qint64 pid, Sample &sample, QVector<qint64> &children) const;
+
+    qint64 pid = 0;
+
+    QTimer timer {};
+
+    std::deque<Sample> samples {};
+
+    double ticksPerSecond = 100;
+};
+
+#endif // RESOURCESAMPLER_H
@@ -0,0 +1,170 @@
+#include "schemaissues.h"
+
+namespace Lsp {
+
+namespace {
+    /** Cursor::index of the root, which has no pointer segment of its own */
+    constexpr int rootIndex = -2;
+
+    /** Cursor::index of a member of an object */
+    constexpr int memberIndex = -1;
+}
+
+SchemaIssues::Cursor::Cursor(SchemaIssues *owner, const Cursor *parent, QString key, int index) : owner(owner), parent(parent), key(key), index(index) {}
+
+SchemaIssues::Cursor SchemaIssues::Cursor::member(const QString &key) const {
+    return Cursor(owner, this, key, memberIndex);
+}
+
+SchemaIssues::Cursor SchemaIssues::Cursor::element(int index) const {
+    return Cursor(owner, this, QString(), index);
+}
+
+void SchemaIssues::Cursor::error(const QString &msg) const {
+    add(SchemaIssue::Severity::Error, false, msg);
+}
+
+void SchemaIssues::Cursor::warning(const QString &msg) const {
+    add(SchemaIssue::Severity::Warning, false, msg);
+}
+
+void SchemaIssues::Cursor::info(const QString &msg) const {
+    add(SchemaIssue::Severity::Info, false, msg);
+}
+
+void SchemaIssues::Cursor::keyError(const QString &key, const QString &msg) const {
+    member(key).add(SchemaIssue::Severity::Error, true, msg);
+}
+
+void SchemaIssues::Cursor::appendPointer(QString &pointer) const {
+    if (parent) {
+        parent->appendPointer(pointer);
+    }
+
+    if (index == rootIndex) {
+        return;
+    }
+
+    pointer.append('/');
+
+    if (index >= 0) {
+        pointer.append(QString::number(index));
+        return;
+    }
+
+    for (QChar c : key) {
+        if (c == '~') {
+            pointer.append("~0");
+        } else if (c == '/') {
+            pointer.append("~1");
+        } else {
+            pointer.append(c);
+        }
+    }
+}
+
+void SchemaIssues::Cursor::add(SchemaIssue::Severity severity, bool onKey, const QString &msg) const {
+    QString pointer;
+    appendPointer(pointer);
+    owner->add(pointer, severity, onKey, msg);
+}
+
+SchemaIssues::Cursor SchemaIssues::root() {
+    return Cursor(this, nullptr, QString(), rootIndex);
+}
+
+SchemaIssues::Cursor SchemaIssues::member(const QString &key) {
+    return Cursor(this, nullptr, key, memberIndex);
+}
+
+void SchemaIssues::error(const QString &msg) {
+    add(QString(), SchemaIssue::Severity::Error, false, msg);
+}
+
+void SchemaIssues::keyError(const QString &key, const QString &msg) {
+    member(key).add(SchemaIssue::Severity::Error, true, msg);
+}
+
+void SchemaIssues::add(const QString &pointer, SchemaIssue::Severity severity, bool onKey, const QString &msg) {
+    Entry entry;
+    entry.pointerOffset = intern(pointer);
+    entry.pointerLength = quint16(std::min<int>(pointer.size(), 0xFFFF));
+    entry.messageOffset = intern(msg);
+    entry.messageLength = quint16(std::min<int>(msg.size(), 0xFFFF));
+    entry.severity = severity;
+    entry.onKey = onKey;
+
+    entries.append(entry);
+    counts[int(severity) - 1] += 1;
+}
+
+quint32 SchemaIssues::intern(QStringView text) {
+    if (text.isEmpty()) {
+        return 0;
+    }
+
+    // Searching the arena for a repeat would make a message with many issues quadratic
+    quint32 offset = arena.size();
+    arena.append(text);
+    return offset;
+}
+
+bool SchemaIssues::isEmpty() const {
+    return entries.isEmpty();
+}
+
+int SchemaIssues::issueCount() const {
+    return entries.size();
+}
+
+int SchemaIssues::errorCount() const {
+    return counts[int(SchemaIssue::Severity::Error) - 1];
+}
+
+int SchemaIssues::warningCount() const {
+    return counts[int(SchemaIssue::Severity::Warning) - 1];
+}
+
+int SchemaIssues::infoCount() const {
+    return counts[int(SchemaIssue::Severity::Info) - 1];
+}
+
+const QVector<SchemaIssues::Entry>& SchemaIssues::getEntries() const {
+    return entries;
+}
+
+QStringView SchemaIssues::pointerOf(const Entry &entry) const {
+    return QStringView(arena).mid(entry.pointerOffset, entry.pointerLength);
+}
+
+QStringView SchemaIssues::messageOf(const Entry &entry) const {
+    return QStringView(arena).mid(entry.messageOffset, entry.messageLength);
+}
+
+QString SchemaIssues::toString() const {
+    QString out;
+
+    for (const Entry &entry : entries) {
+        switch (entry.severity) {
+            case SchemaIssue::Severity::Error:
+                out += "error";
+                break;
+            case SchemaIssue::Severity::Warning:
+                out += "warning";
+                break;
+            case SchemaIssue::Severity::Info:
+                out += "info";
+                break;
+        }
+
+        out += entry.onKey ? " at key " : " at ";
+        out += entry.pointerLength > 0 ? pointerOf(entry).toString() : QString("the root");
+        out += ": ";
+        out += messageOf(entry).toString();
+        out += '\n';
+    }
+
+    return out;
+}
+
+}
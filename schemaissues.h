@@ -0,0 +1,129 @@
+#ifndef SCHEMAISSUES_H
+#define SCHEMAISSUES_H
+
+#include <QtCore>
+
+#include <array>
+
+namespace Lsp {
+
+struct SchemaIssue {
+    enum class Severity {
+        Error = 1,
+        Warning = 2,
+        Info = 3,
+    };
+};
+
+/**
+ * The schema issues of a single message, as a flat list of entries that each
+ * locate the issue with a JSON pointer (RFC 6901) into the message.
+ *
+ * Pointer and message text is stored in a per-message arena (one string that
+ * entries index into), so a message without issues holds no allocations at
+ * all, and counts are kept as issues are added.
+ */
+class SchemaIssues {
+public:
+    struct Entry {
+        /** Offset and length of the JSON pointer in the arena */
+        quint32 pointerOffset;
+        quint16 pointerLength;
+
+        /** Length of the message in the arena */
+        quint16 messageLength;
+
+        /** Offset of the message in the arena */
+        quint32 messageOffset;
+
+        SchemaIssue::Severity severity;
+
+        /** The issue is with the member's key (e.g., it is not allowed) rather than its value */
+        bool onKey;
+    };
+
+    /**
+     * A location in the message that issues can be written to. Cursors refer to
+     * their parent cursor, so a cursor must not outlive its parent (cursors are
+     * meant to live on the stack while walking the message). The JSON pointer is
+     * only built if an issue is actually written.
+     */
+    class Cursor {
+    public:
+        Cursor member(const QString &key) const;
+
+        Cursor element(int index) const;
+
+        void error(const QString &msg) const;
+
+        void warning(const QString &msg) const;
+
+        void info(const QString &msg) const;
+
+        /** Adds an issue with the key of a member (as opposed to its value) */
+        void keyError(const QString &key, const QString &msg) const;
+
+    private:
+        friend class SchemaIssues;
+
+        Cursor(SchemaIssues *owner, const Cursor *parent, QString key, int index);
+
+        void appendPointer(QString &pointer) const;
+
+        void add(SchemaIssue::Severity severity, bool onKey, const QString &msg) const;
+
+        SchemaIssues *owner;
+
+        const Cursor *parent;
+
+        /** Set if the location is a member of an object */
+        QString key;
+
+        /** Set (>= 0) if the location is an element of an array */
+        int index;
+    };
+
+    /** The root of the message */
+    Cursor root();
+
+    Cursor member(const QString &key);
+
+    void error(const QString &msg);
+
+    void keyError(const QString &key, const QString &msg);
+
+    bool isEmpty() const;
+
+    int issueCount() const;
+
+    int errorCount() const;
+
+    int warningCount() const;
+
+    int infoCount() const;
+
+    const QVector<Entry>& getEntries() const;
+
+    QStringView pointerOf(const Entry &entry) const;
+
+    QStringView messageOf(const Entry &entry) const;
+
+    /** All issues, one per line, e.g. "error at /params/textDocument: Expected an object" */
+    QString toString() const;
+
+private:
+    void add(const QString &pointer, SchemaIssue::Severity severity, bool onKey, const QString &msg);
+
+    /** Appends the text to the arena, returning its offset */
+    quint32 intern(QStringView text);
+
+    QVector<Entry> entries {};
+
+    QString arena {};
+
+    std::array<int, 3> counts {};
+};
+
+}
+
+#endif // SCHEMAISSUES_H
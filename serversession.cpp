@@ -0,0 +1,62 @@
+#include "serversession.h"
+
+#include <QJsonDocument>
+
+#include <iostream>
+
+QProcess* spawnServer(const QStringList &command, QObject *parent) {
+    QProcess *process = new QProcess(parent);
+    process->setProgram(command.value(0));
+    process->setArguments(command.mid(1));
+    process->start();
+    return process;
+}
+
+ServerSession::ServerSession(const QStringList &command, QObject *parent) : QObject(parent) {
+    process = spawnServer(command, this);
+
+    serverIn = std::make_unique<ProcessStdinStream>(process, this);
+    serverOut = std::make_unique<ProcessStdoutStream>(process, this);
+
+    connect(serverIn.get(), &InputStream::emitInput, &frames, &FrameBuilder::FrameBuilder::onInput);
+    connect(&frames, &FrameBuilder::FrameBuilder::emitFrame, this, &ServerSession::onFrame);
+    connect(&frames, &FrameBuilder::FrameBuilder::emitError, this, [](FrameBuilder::StreamError error){ std::cerr << "Server framing error: " << error.toQString().toStdString() << std::endl; });
+
+    connect(process, &QProcess::readyReadStandardError, this, &ServerSession::onStderr);
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this](int exitCode, QProcess::ExitStatus){ emit emitFinished(exitCode); });
+
+    // A server that never started won't finish either
+    connect(process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error){
+        if (error == QProcess::FailedToStart) {
+            std::cerr << "Unable to start server: " << process->errorString().toStdString() << std::endl;
+            emit emitFinished(-1);
+        }
+    });
+
+    serverIn->start();
+}
+
+void ServerSession::send(const QJsonObject &message) {
+    QByteArray payload = QJsonDocument(message).toJson(QJsonDocument::Compact);
+    *serverOut << "Content-Length: " + QByteArray::number(payload.size()) + "\r\n\r\n" + payload;
+}
+
+QProcess* ServerSession::getProcess() const {
+    return process;
+}
+
+void ServerSession::onFrame(FrameBuilder::Frame frame) {
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(frame.payload, &error);
+
+    if (error.error != QJsonParseError::NoError || !document.isObject()) {
+        std::cerr << "Server sent a message that is not a JSON object: " << error.errorString().toStdString() << std::endl;
+        return;
+    }
+
+    emit emitMessage(document.object(), frame.timing.lastByte);
+}
+
+void ServerSession::onStderr() {
+    std::cerr << process->readAllStandardError().toStdString();
+}
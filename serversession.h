@@ -0,0 +1,58 @@
+#ifndef SERVERSESSION_H
+#define SERVERSESSION_H
+
+#include <QObject>
+#include <QProcess>
+#include <QJsonObject>
+
+#include <memory>
+
+#include "connectionstream.h"
+#include "framebuilder.h"
+
+/**
+ * Starts a language server: the program, followed by its arguments. Server
+ * stderr is left for the caller to read or forward.
+ */
+QProcess* spawnServer(const QStringList &command, QObject *parent);
+
+/**
+ * A language server driven by lspmonitor itself rather than by a client:
+ * messages are framed and written to its stdin, and every message it writes
+ * is parsed and emitted with its arrival time. Server stderr is passed
+ * through to our stderr.
+ */
+class ServerSession : public QObject {
+    Q_OBJECT
+
+public:
+    /** Spawns the server */
+    explicit ServerSession(const QStringList &command, QObject *parent = nullptr);
+
+    void send(const QJsonObject &message);
+
+    QProcess* getProcess() const;
+
+signals:
+    /** A message from the server, fully received at arrival (ns, monotonic) */
+    void emitMessage(QJsonObject message, qint64 arrival);
+
+    /** When the server exits, or fails to start (with -1) */
+    void emitFinished(int exitCode);
+
+private slots:
+    void onFrame(FrameBuilder::Frame frame);
+
+    void onStderr();
+
+private:
+    QProcess *process;
+
+    std::unique_ptr<InputStream> serverIn;
+
+    std::unique_ptr<OutputStream> serverOut;
+
+    FrameBuilder::FrameBuilder frames;
+};
+
+#endif // SERVERSESSION_H
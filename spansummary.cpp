@@ -0,0 +1,121 @@
+#include "spansummary.h"
+
+#include <limits>
+
+qint64 SpanSummary::bucketWidth(int level) {
+    return baseBucketWidth << (2 * level);
+}
+
+SpanSummary::SpanSummary() : levels(levelCount) {}
+
+int SpanSummary::open(qint64 start, int index, const QString &method, bool fromServer) {
+    // Keep spans ordered by start even if the wall clock jumps backwards
+    if (!spans.isEmpty() && start < spans.last().start) {
+        start = spans.last().start;
+    }
+
+    Span span {start, -1, allocateLane(start), index, internMethod(method), fromServer};
+    spans.append(span);
+    maxEnds.append(maxEnds.isEmpty() ? -1 : maxEnds.last());
+
+    int id = spans.size() - 1;
+    openSpans.insert(id);
+    return id;
+}
+
+void SpanSummary::close(int id, qint64 end) {
+    Span &span = spans[id];
+    if (span.end >= 0) {
+        return;
+    }
+
+    span.end = std::max(end, span.start);
+    laneEnds[span.lane] = span.end;
+    openSpans.remove(id);
+
+    // Only the spans started since this one can have a smaller running max
+    for (int i = id; i < maxEnds.size() && maxEnds[i] < span.end; i++) {
+        maxEnds[i] = span.end;
+    }
+
+    qint64 duration = span.end - span.start;
+
+    for (int level = 0; level < levelCount; level++) {
+        BucketKey key (span.start / bucketWidth(level), span.lane);
+        auto it = levels[level].find(key);
+
+        if (it == levels[level].end()) {
+            levels[level].emplace(key, SpanBucket {span.start, span.end, 1, span.method});
+            continue;
+        }
+
+        SpanBucket &bucket = it->second;
+        if (duration > bucket.maxEnd - bucket.minStart) {
+            bucket.method = span.method;
+        }
+        bucket.minStart = std::min(bucket.minStart, span.start);
+        bucket.maxEnd = std::max(bucket.maxEnd, span.end);
+        bucket.count += 1;
+    }
+}
+
+const QVector<Span>& SpanSummary::getSpans() const {
+    return spans;
+}
+
+const QStringList& SpanSummary::getMethods() const {
+    return methods;
+}
+
+const QSet<int>& SpanSummary::getOpenSpans() const {
+    return openSpans;
+}
+
+int SpanSummary::laneCount() const {
+    return laneEnds.size();
+}
+
+int SpanSummary::lowerBound(qint64 time) const {
+    auto it = std::lower_bound(spans.begin(), spans.end(), time, [](const Span &span, qint64 t) {
+        return span.start < t;
+    });
+
+    return it - spans.begin();
+}
+
+int SpanSummary::firstEndingAfter(qint64 time) const {
+    return std::lower_bound(maxEnds.begin(), maxEnds.end(), time) - maxEnds.begin();
+}
+
+int SpanSummary::levelFor(qint64 width) const {
+    for (int level = levelCount - 1; level >= 0; level--) {
+        if (bucketWidth(level) <= width) {
+            return level;
+        }
+    }
+
+    return -1;
+}
+
+int SpanSummary::allocateLane(qint64 start) {
+    for (int lane = 0; lane < laneEnds.size(); lane++) {
+        if (laneEnds[lane] <= start) {
+            laneEnds[lane] = std::numeric_limits<qint64>::max();
+            return lane;
+        }
+    }
+
+    laneEnds.append(std::numeric_limits<qint64>::max());
+    return laneEnds.size() - 1;
+}
+
+int SpanSummary::internMethod(const QString &method) {
+    auto it = methodIds.find(method);
+    if (it != methodIds.end()) {
+        return it.value();
+    }
+
+    methods.append(method);
+    methodIds.insert(method, methods.size() - 1);
+    return methods.size() - 1;
+}
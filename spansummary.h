@@ -0,0 +1,156 @@
+#ifndef SPANSUMMARY_H
+#define SPANSUMMARY_H
+
+#include <QtCore>
+
+#include <map>
+#include <vector>
+
+/**
+ * A single Request, covering the time it was received until the time
+ * its Response was received
+ */
+struct Span {
+    /** When the Request was received */
+    qint64 start;
+
+    /** When the Response was received, or -1 while the Request is pending */
+    qint64 end;
+
+    /** The lane the span is drawn in. Spans in the same lane never overlap */
+    int lane;
+
+    /** The index of the Request in the CommunicationModel */
+    int index;
+
+    /** The method of the Request, as an index into SpanSummary::getMethods() */
+    int method;
+
+    /** If the Request was sent by the server (e.g., workspace/configuration) */
+    bool fromServer;
+};
+
+/**
+ * Aggregate of every completed span in a single lane that starts in the
+ * same time bucket
+ */
+struct SpanBucket {
+    /** The earliest start of the aggregated spans */
+    qint64 minStart;
+
+    /** The latest end of the aggregated spans */
+    qint64 maxEnd;
+
+    /** The number of spans aggregated */
+    int count;
+
+    /** The method of the longest aggregated span */
+    int method;
+};
+
+/**
+ * Stores the spans of all Requests in a session, along with a precomputed
+ * multi-resolution summary of them.
+ *
+ * Each summary level divides time into buckets four times wider than the
+ * level below it. A completed span is folded into one bucket per level, so
+ * drawing any zoom level only needs to visit the buckets in view rather than
+ * every span.
+ */
+class SpanSummary {
+public:
+    /** The number of summary levels */
+    static constexpr int levelCount = 13;
+
+    /** The width of a bucket in the finest summary level (ms) */
+    static constexpr qint64 baseBucketWidth = 4;
+
+    /** The width of a bucket in the given level (ms) */
+    static qint64 bucketWidth(int level);
+
+    SpanSummary();
+
+    /** Adds a pending span, returning its index */
+    int open(qint64 start, int index, const QString &method, bool fromServer);
+
+    /** Marks the span as finished at the given time, and folds it into the summary */
+    void close(int span, qint64 end);
+
+    const QVector<Span>& getSpans() const;
+
+    const QStringList& getMethods() const;
+
+    /** The indices of all spans that are still pending */
+    const QSet<int>& getOpenSpans() const;
+
+    /** The number of lanes needed to draw every span without overlap */
+    int laneCount() const;
+
+    /** The index of the first span starting at or after time (spans are ordered by start) */
+    int lowerBound(qint64 time) const;
+
+    /** The index of the first completed span ending at or after time. No completed span before it does */
+    int firstEndingAfter(qint64 time) const;
+
+    /**
+     * The coarsest level with buckets no wider than the given duration,
+     * or -1 if even the finest level is too coarse
+     */
+    int levelFor(qint64 width) const;
+
+    /** Calls f with every bucket in the level that may overlap [from, to) */
+    template <typename F>
+    void forEachBucket(int level, qint64 from, qint64 to, F f) const;
+
+private:
+    using BucketKey = std::pair<qint64, int>;
+
+    QVector<Span> spans {};
+
+    QSet<int> openSpans {};
+
+    /**
+     * The latest end of the completed spans up to each span, -1 if there are
+     * none. It never decreases, so it can be searched for the first span that
+     * may reach into a range.
+     */
+    QVector<qint64> maxEnds {};
+
+    /** The end of the last span in each lane (max while the span is pending) */
+    QVector<qint64> laneEnds {};
+
+    QStringList methods {};
+
+    QHash<QString, int> methodIds {};
+
+    /** Buckets keyed by (bucket number, lane), one map per level */
+    std::vector<std::map<BucketKey, SpanBucket>> levels;
+
+    int allocateLane(qint64 start);
+
+    int internMethod(const QString &method);
+};
+
+template <typename F>
+void SpanSummary::forEachBucket(int level, qint64 from, qint64 to, F f) const {
+    const auto &buckets = levels[level];
+    qint64 width = bucketWidth(level);
+
+    // A bucket that starts before the range may still contain a span reaching
+    // into it, but none before the bucket of the first span that does
+    int first = firstEndingAfter(from);
+    if (first == spans.size()) {
+        return;
+    }
+
+    auto it = buckets.lower_bound(BucketKey(spans[first].start / width, 0));
+    auto end = buckets.lower_bound(BucketKey(to / width + 1, 0));
+
+    for (; it != end; it++) {
+        if (it->second.maxEnd >= from && it->second.minStart < to) {
+            f(it->first.second, it->second);
+        }
+    }
+}
+
+#endif // SPANSUMMARY_H
@@ -1,4 +1,5 @@
 #include "stdiomitm.h"
+#include "pipelineprofiler.h"
 
 #include <QtCore>
 #include <QString>
@@ -9,20 +10,55 @@ StdioMitm::StdioMitm(QProcess *server, QObject *parent) : QObject(parent), serve
     clientIn = std::make_unique<StdinStream>(this);
     clientOut = std::make_unique<StdoutStream>(this);
 
-    serverIn = std::make_unique<ProcessStdinStream>(server, this);
-    serverOut = std::make_unique<ProcessStdoutStream>(server, this);
+    // Chunks are forwarded as soon as they are read, and queued for analysis
+    // which happens in time slices between reads
+    connect(clientIn.get(), &InputStream::emitInput, this, &StdioMitm::onClientIn);
 
-    connect(clientIn.get(), &InputStream::emitInput, &clientFrames, &FrameBuilder::FrameBuilder::onInput);
-    connect(serverIn.get(), &InputStream::emitInput, &serverFrames, &FrameBuilder::FrameBuilder::onInput);
+    if (server) {
+        serverIn = std::make_unique<ProcessStdinStream>(server, this);
+        serverOut = std::make_unique<ProcessStdoutStream>(server, this);
 
-    connect(clientIn.get(), &InputStream::emitInput, serverOut.get(), &OutputStream::onOutput);
-    connect(serverIn.get(), &InputStream::emitInput, clientOut.get(), &OutputStream::onOutput);
+        connect(serverIn.get(), &InputStream::emitInput, this, &StdioMitm::onServerIn);
+
+        connect(server, &QProcess::readyReadStandardError, this, &StdioMitm::onServerStderr);
+        connect(server, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &StdioMitm::onServerFinish);
+    }
+
+    // What the client is sent is analysed, with the filter's own answers kept apart from the server's
+    connect(&filter, &ProxyFilter::emitToServer, this, [this](QByteArray data){
+        if (serverOut) {
+            serverOut->onOutput(data);
+        }
+    });
+    connect(&filter, &ProxyFilter::emitToClient, this, [this](QByteArray data){
+        clientOut->onOutput(data);
+        enqueueAnalysis(Lsp::Entity::Server, data);
+    });
+    connect(&filter, &ProxyFilter::emitAnswerToClient, this, [this](QByteArray data){
+        clientOut->onOutput(data);
+        enqueueAnalysis(Lsp::Entity::Server, data, true);
+    });
+
+    analysisTimer.setSingleShot(true);
+    analysisTimer.setInterval(0);
+    connect(&analysisTimer, &QTimer::timeout, this, &StdioMitm::drainAnalysis);
 
     connect(&clientFrames, &FrameBuilder::FrameBuilder::emitError, this, &StdioMitm::onClientFrameError);
     connect(&serverFrames, &FrameBuilder::FrameBuilder::emitError, this, &StdioMitm::onServerFrameError);
 
-    connect(&clientFrames, &FrameBuilder::FrameBuilder::emitFrame, &clientMessages, &MessageBuilder::MessageBuilder::onFrame);
-    connect(&serverFrames, &FrameBuilder::FrameBuilder::emitFrame, &serverMessages, &MessageBuilder::MessageBuilder::onFrame);
+    connect(&clientFrames, &FrameBuilder::FrameBuilder::emitFrame, this, &StdioMitm::onClientFrame);
+    connect(&serverFrames, &FrameBuilder::FrameBuilder::emitFrame, this, &StdioMitm::onServerFrame);
+
+    // The filter's answers are validated as the server's, which matches them with the client's Requests
+    connect(&proxyFrames, &FrameBuilder::FrameBuilder::emitFrame, &proxyMessages, &MessageBuilder::MessageBuilder::onFrame);
+    connect(&proxyMessages, &MessageBuilder::MessageBuilder::emitMessage, this, [this](MessageBuilder::Message message){
+        analysingProxyMessage = true;
+        serverValidator.onMessage(message);
+        analysingProxyMessage = false;
+    });
+
+    connect(&clientMessages, &MessageBuilder::MessageBuilder::emitError, this, [this]{ metrics.onParseError(Lsp::Entity::Client); });
+    connect(&serverMessages, &MessageBuilder::MessageBuilder::emitError, this, [this]{ metrics.onParseError(Lsp::Entity::Server); });
 
     connect(&clientMessages, &MessageBuilder::MessageBuilder::emitMessage, &clientValidator, &Lsp::LspSchemaValidator::onMessage);
     connect(&serverMessages, &MessageBuilder::MessageBuilder::emitMessage, &serverValidator, &Lsp::LspSchemaValidator::onMessage);
@@ -30,44 +66,276 @@ StdioMitm::StdioMitm(QProcess *server, QObject *parent) : QObject(parent), serve
     connect(&clientValidator, &Lsp::LspSchemaValidator::emitLspMessage, this, &StdioMitm::onClientLspMessage);
     connect(&serverValidator, &Lsp::LspSchemaValidator::emitLspMessage, this, &StdioMitm::onServerLspMessage);
 
-    connect(server, &QProcess::readyReadStandardError, this, &StdioMitm::onServerStderr);
-    connect(server, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &StdioMitm::onServerFinish);
+    connect(&clientValidator, &Lsp::LspSchemaValidator::emitRequestTimeout, this, &StdioMitm::onRequestTimeout);
+    connect(&serverValidator, &Lsp::LspSchemaValidator::emitRequestTimeout, this, &StdioMitm::onRequestTimeout);
+
+    connect(&clientValidator, &Lsp::LspSchemaValidator::emitRequestCancelled, this, &StdioMitm::onRequestCancelled);
+    connect(&serverValidator, &Lsp::LspSchemaValidator::emitRequestCancelled, this, &StdioMitm::onRequestCancelled);
+
+    connect(&clientValidator, &Lsp::LspSchemaValidator::emitBatch, this, [this](Lsp::Entity sender, int elements, int bytes){ metrics.onBatch(sender, elements, bytes); });
+    connect(&serverValidator, &Lsp::LspSchemaValidator::emitBatch, this, [this](Lsp::Entity sender, int elements, int bytes){ metrics.onBatch(sender, elements, bytes); });
+
+    connect(&policy, &ValidationPolicy::emitLevelChanged, this, &StdioMitm::onPolicyLevelChanged);
+
+    connect(&resources, &ResourceSampler::emitSample, this, &StdioMitm::onResourceSample);
 
     clientValidator.linkWith(serverValidator);
+    clientValidator.setPolicy(&policy);
+    serverValidator.setPolicy(&policy);
 }
 
 void StdioMitm::start() {
     clientIn->start();
+
+    if (!server) {
+        return;
+    }
+
     serverIn->start();
+
+    if (server->processId() > 0) {
+        resources.start(server->processId(), resourceInterval);
+    } else {
+        connect(server, &QProcess::started, this, [this]{ resources.start(server->processId(), resourceInterval); });
+    }
+}
+
+bool StdioMitm::startRecording(QString path) {
+    recordFile = std::make_unique<QFile>(path);
+    if (!recordFile->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "Unable to open recording file: " << recordFile->errorString().toStdString() << std::endl;
+        recordFile.reset();
+        return false;
+    }
+
+    recorder = std::make_unique<Capture::Writer>(recordFile.get());
+    return true;
+}
+
+void StdioMitm::setRequestTimeout(qint64 timeout) {
+    clientValidator.setRequestTimeout(timeout);
+    serverValidator.setRequestTimeout(timeout);
+    filter.setRequestTimeout(timeout);
+}
+
+void StdioMitm::setResourceInterval(int interval) {
+    resourceInterval = interval;
+}
+
+void StdioMitm::setClock(Clock *clock) {
+    this->clock = clock;
+    clientFrames.setClock(clock);
+    serverFrames.setClock(clock);
+    proxyFrames.setClock(clock);
+    messages.setClock(clock);
+    filter.setClock(clock);
+}
+
+void StdioMitm::setAnalysisEnabled(bool enabled) {
+    analysisEnabled = enabled;
+}
+
+bool StdioMitm::analyseCapture(QIODevice *capture, VirtualClock &clock, QString *error) {
+    setClock(&clock);
+
+    Capture::Reader reader (capture);
+    Capture::Record record;
+
+    while (reader.next(record)) {
+        clock.advanceTo(record.timestamp);
+
+        switch (record.kind) {
+            case Capture::Record::Kind::ClientMessage:
+            case Capture::Record::Kind::ServerMessage: {
+                // Framed again, so the message passes through every stage live input does
+                QByteArray frame = "Content-Length: " + QByteArray::number(record.data.size()) + "\r\n\r\n" + record.data;
+                auto &frames = record.kind == Capture::Record::Kind::ClientMessage ? clientFrames : serverFrames;
+                frames.onInput(frame);
+                break;
+            }
+            case Capture::Record::Kind::Stderr:
+                messages.appendStderr(record.timestamp, QString::fromUtf8(record.data));
+                break;
+            case Capture::Record::Kind::Counter:
+                break;
+        }
+    }
+
+    if (reader.errorOccurred()) {
+        *error = reader.errorString();
+        return false;
+    }
+
+    return true;
 }
 
 void StdioMitm::onClientIn(QByteArray data) {
-    serverOut->onOutput(data);
+    PROFILE_STAGE(Profiling::Stage::Forward);
+
+    QElapsedTimer timer;
+    timer.start();
+    if (filter.isActive()) {
+        filter.onClientInput(data);
+    } else if (serverOut) {
+        serverOut->onOutput(data);
+    }
+    metrics.onForwarded(Lsp::Entity::Client, data.size(), timer.nsecsElapsed());
+
+    enqueueAnalysis(Lsp::Entity::Client, data);
 }
 
 void StdioMitm::onServerIn(QByteArray buff) {
+    PROFILE_STAGE(Profiling::Stage::Forward);
+
+    QElapsedTimer timer;
+    timer.start();
+    if (filter.isActive()) {
+        // The filter passes the chunk on, and queues it for analysis with anything it adds
+        filter.onServerInput(buff);
+        metrics.onForwarded(Lsp::Entity::Server, buff.size(), timer.nsecsElapsed());
+        return;
+    }
     clientOut->onOutput(buff);
+    metrics.onForwarded(Lsp::Entity::Server, buff.size(), timer.nsecsElapsed());
+
+    enqueueAnalysis(Lsp::Entity::Server, buff);
+}
+
+void StdioMitm::enqueueAnalysis(Lsp::Entity sender, const QByteArray &data, bool fromProxy) {
+    if (!analysisEnabled) {
+        return;
+    }
+
+    analysisQueue.push_back(PendingInput {sender, data, clock->timestamp(), clock->monotonic(), fromProxy});
+    queuedBytes += data.size();
+    policy.onQueueSize(queuedBytes);
+
+    if (!analysisTimer.isActive()) {
+        analysisTimer.start();
+    }
+}
+
+void StdioMitm::drainAnalysis() {
+    QElapsedTimer slice;
+    slice.start();
+
+    while (!analysisQueue.empty() && slice.nsecsElapsed() < analysisSliceNs) {
+        PendingInput input = std::move(analysisQueue.front());
+        analysisQueue.pop_front();
+
+        queuedBytes -= input.data.size();
+        policy.onQueueSize(queuedBytes);
+
+        auto &frames = input.fromProxy ? proxyFrames : input.sender == Lsp::Entity::Client ? clientFrames : serverFrames;
+        frames.onInputAt(input.data, input.timestamp, input.arrival);
+    }
+
+    // Let the event loop read (and forward) more input before continuing
+    if (!analysisQueue.empty()) {
+        analysisTimer.start();
+    }
+}
+
+void StdioMitm::onPolicyLevelChanged(ValidationPolicy::Level level) {
+    std::cerr << "Analysis level changed to " << ValidationPolicy::levelName(level).toStdString() << std::endl;
+
+    // Shed frames are still recorded, which needs their payloads
+    bool discard = policy.shouldDiscardPayloads() && !recorder;
+    clientFrames.setDiscardPayloads(discard);
+    serverFrames.setDiscardPayloads(discard);
 }
 
 void StdioMitm::onServerStderr() {
     QByteArray buff = server->readAllStandardError();
     std::cerr << buff.toStdString() << std::endl;
+
+    qint64 timestamp = clock->timestamp();
+    for (QByteArray line : buff.split('\n')) {
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        messages.appendStderr(timestamp, QString::fromUtf8(line));
+
+        if (recorder) {
+            recorder->write(Capture::Record(Capture::Record::Kind::Stderr, timestamp, line));
+        }
+    }
 }
 
 void StdioMitm::onClientFrame(FrameBuilder::Frame frame) {
-    qDebug() << "got client frame";
+    if (!policy.shouldParse(frame)) {
+        onShedFrame(Lsp::Entity::Client, frame);
+        return;
+    }
+
+    resyncAfterShedding();
+    clientMessages.onFrame(frame);
 }
 
 void StdioMitm::onServerFrame(FrameBuilder::Frame frame) {
-    qDebug() << "got server frame";
+    if (!policy.shouldParse(frame)) {
+        onShedFrame(Lsp::Entity::Server, frame);
+        return;
+    }
+
+    resyncAfterShedding();
+    serverMessages.onFrame(frame);
+}
+
+void StdioMitm::onShedFrame(Lsp::Entity sender, const FrameBuilder::Frame &frame) {
+    // Only Requests can be answered by a Response that matches nothing tracked
+    if (frame.mayBeRequest()) {
+        (sender == Lsp::Entity::Client ? shedClientRequests : shedServerRequests) += 1;
+    }
+    shedFrames = true;
+
+    if (recorder && !frame.payloadDiscarded) {
+        // A record is a line, and JSON can only hold a raw line break as whitespace
+        QByteArray payload = frame.payload;
+        payload.replace('\r', ' ').replace('\n', ' ');
+
+        auto kind = sender == Lsp::Entity::Client ? Capture::Record::Kind::ClientMessage : Capture::Record::Kind::ServerMessage;
+        recorder->write(Capture::Record(kind, frame.timestamp, payload));
+    }
+}
+
+void StdioMitm::resyncAfterShedding() {
+    if (!shedFrames) {
+        return;
+    }
+
+    // The skipped messages may have answered the pending Requests, or been
+    // Requests whose Responses are still to come
+    auto clientRequests = clientValidator.dropPendingRequests();
+    auto serverRequests = serverValidator.dropPendingRequests();
+    serverValidator.expectUnmatchedResponses(clientRequests.size() + shedClientRequests);
+    clientValidator.expectUnmatchedResponses(serverRequests.size() + shedServerRequests);
+
+    for (auto &request : clientRequests + serverRequests) {
+        metrics.onRequestUntracked(request);
+        cpu.onRequestTimeout(request);
+    }
+
+    documents.forgetDocuments();
+
+    shedFrames = false;
+    shedClientRequests = 0;
+    shedServerRequests = 0;
 }
 
 void StdioMitm::onClientFrameError(FrameBuilder::StreamError error) {
     qDebug() << "got client frame error: " + error.toQString();
+    metrics.onFrameError(Lsp::Entity::Client, error);
 }
 
 void StdioMitm::onServerFrameError(FrameBuilder::StreamError error) {
     qDebug() << "got server frame error: " + error.toQString();
+    metrics.onFrameError(Lsp::Entity::Server, error);
 }
 
 void StdioMitm::onClientMessage(MessageBuilder::Message message) {
@@ -79,13 +347,82 @@ void StdioMitm::onServerMessage(MessageBuilder::Message message) {
 }
 
 void StdioMitm::onClientLspMessage(std::shared_ptr<Lsp::Message> message) {
+    PROFILE_STAGE(Profiling::Stage::Dispatch);
+
+    if (recorder) {
+        recorder->writeMessage(true, message->getTimestamp(), message->getContents());
+    }
+
+    metrics.onLspMessage(message);
+    latency.onLspMessage(message);
+    interactions.onLspMessage(message);
+    cpu.onLspMessage(message);
+    cancellation.onLspMessage(message);
+    documents.onLspMessage(message);
+    ranges.onLspMessage(message);
     messages.append(message);
 }
 
 void StdioMitm::onServerLspMessage(std::shared_ptr<Lsp::Message> message) {
+    PROFILE_STAGE(Profiling::Stage::Dispatch);
+
+    if (analysingProxyMessage) {
+        onProxyLspMessage(message);
+        return;
+    }
+
+    if (recorder) {
+        recorder->writeMessage(false, message->getTimestamp(), message->getContents());
+    }
+
+    metrics.onLspMessage(message);
+    latency.onLspMessage(message);
+    interactions.onLspMessage(message);
+    cpu.onLspMessage(message);
+    cancellation.onLspMessage(message);
+    documents.onLspMessage(message);
+    ranges.onLspMessage(message);
     messages.append(message);
 }
 
+void StdioMitm::onProxyLspMessage(std::shared_ptr<Lsp::Message> message) {
+    // Shown, and closes its Request, but says nothing about the server. It isn't
+    // recorded either, so a replay of the recording asks the server instead
+    if (message->getKind() == Lsp::Message::Kind::Response) {
+        auto request = static_cast<Lsp::Response*>(message.get())->getRequest();
+        if (request) {
+            metrics.onProxyAnswer(request);
+            cpu.onRequestTimeout(request);
+        }
+    }
+
+    messages.append(message);
+}
+
+void StdioMitm::onRequestTimeout(std::shared_ptr<Lsp::Request> request) {
+    metrics.onRequestTimeout(request);
+    cancellation.onRequestTimeout(request);
+    cpu.onRequestTimeout(request);
+    messages.refresh(request);
+}
+
+void StdioMitm::onRequestCancelled(std::shared_ptr<Lsp::Request> request) {
+    cancellation.onRequestCancelled(request);
+    messages.refresh(request);
+}
+
 void StdioMitm::onServerFinish(int exitCode, QProcess::ExitStatus exitStatus) {
     std::cerr << "Server closed with code " << exitCode << ", status " << exitStatus << std::endl;
+    resources.stop();
+}
+
+void StdioMitm::onResourceSample(const ResourceSampler::Sample &sample) {
+    cpu.onSample(sample);
+
+    if (recorder) {
+        double load = resources.cpuLoad() * 100;
+        recorder->write(Capture::Record(Capture::Record::Kind::Counter, sample.timestamp, "server.cpu", load));
+        recorder->write(Capture::Record(Capture::Record::Kind::Counter, sample.timestamp, "server.rss", sample.residentBytes));
+        recorder->write(Capture::Record(Capture::Record::Kind::Counter, sample.timestamp, "server.threads", sample.threads));
+    }
 }
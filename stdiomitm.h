@@ -10,17 +10,76 @@
 #include "messagebuilder.h"
 #include "lspschemavalidator.h"
 #include "communicationmodel.h"
+#include "capture.h"
+#include "metrics.h"
+#include "latencystats.h"
+#include "interactionlatency.h"
+#include "cancellationstats.h"
+#include "validationpolicy.h"
+#include "documentmirror.h"
+#include "rangechecker.h"
+#include "resourcesampler.h"
+#include "cpuattribution.h"
+#include "clock.h"
+#include "proxyfilter.h"
+
+#include <deque>
 
 class StdioMitm : public QObject
 {
     Q_OBJECT
 public:
+    /** The server may be nullptr when only analysing captures */
     explicit StdioMitm(QProcess *server, QObject *parent = nullptr);
 
     void start();
 
+    /** Streams every message and stderr line to a capture file as they arrive */
+    bool startRecording(QString path);
+
+    /** How long (ms) Requests may go unanswered before they time out. 0 disables */
+    void setRequestTimeout(qint64 timeout);
+
+    /** How often (ms) the server's resources are sampled once started. 0 disables */
+    void setResourceInterval(int interval);
+
+    /** The clock input is timed by, which must outlive the mitm */
+    void setClock(Clock *clock);
+
+    /** Whether forwarded input is analysed (and so recorded) at all, rather than only forwarded */
+    void setAnalysisEnabled(bool enabled);
+
+    /**
+     * Runs a capture through the analysis, as if each message had been
+     * forwarded at its recorded time: the clock is moved to each record's
+     * timestamp before it is analysed. The results depend only on the
+     * capture, however fast it is read.
+     */
+    bool analyseCapture(QIODevice *capture, VirtualClock &clock, QString *error);
+
     CommunicationModel messages {};
 
+    Metrics::Registry metrics {};
+
+    LatencyStats latency {};
+
+    InteractionLatency interactions {};
+
+    CancellationStats cancellation {};
+
+    ValidationPolicy policy {};
+
+    DocumentMirror documents {};
+
+    RangeChecker ranges {documents};
+
+    ResourceSampler resources {};
+
+    CpuAttribution cpu {};
+
+    /** Changes the traffic when one of its policies is enabled */
+    ProxyFilter filter {};
+
 
 public slots:
     void onClientIn(QByteArray data);
@@ -43,12 +102,56 @@ public slots:
 
     void onServerLspMessage(std::shared_ptr<Lsp::Message> message);
 
+    /** A message the filter answered the client with, in place of the server */
+    void onProxyLspMessage(std::shared_ptr<Lsp::Message> message);
+
+    void onRequestTimeout(std::shared_ptr<Lsp::Request> request);
+
+    void onRequestCancelled(std::shared_ptr<Lsp::Request> request);
+
     void onServerStderr();
 
     void onServerFinish(int exitCode, QProcess::ExitStatus exitStatus);
 
+    void onPolicyLevelChanged(ValidationPolicy::Level level);
+
+    void onResourceSample(const ResourceSampler::Sample &sample);
+
+    /** Analyses queued input until the queue is empty or the time slice is used up */
+    void drainAnalysis();
+
 
 private:
+    /** A chunk that was forwarded, but not yet analysed */
+    struct PendingInput {
+        Lsp::Entity sender;
+
+        QByteArray data;
+
+        /** Wall clock (ms) and monotonic (ns) arrival times */
+        qint64 timestamp;
+
+        qint64 arrival;
+
+        /** Made by the filter rather than the server */
+        bool fromProxy = false;
+    };
+
+    /** Longest the analysis may hold up the event loop (and so forwarding) at a time */
+    static constexpr qint64 analysisSliceNs = 4 * 1000 * 1000;
+
+    void enqueueAnalysis(Lsp::Entity sender, const QByteArray &data, bool fromProxy = false);
+
+    /** Records a frame the policy didn't let through to parsing, so the recording stays complete */
+    void onShedFrame(Lsp::Entity sender, const FrameBuilder::Frame &frame);
+
+    /**
+     * Once frames are parsed again after some were shed, stops tracking what
+     * the skipped messages may have changed: pending Requests and the open
+     * documents
+     */
+    void resyncAfterShedding();
+
     QProcess *server;
 
     std::unique_ptr<InputStream> clientIn;
@@ -67,9 +170,41 @@ private:
 
     MessageBuilder::MessageBuilder serverMessages;
 
+    /** The filter's own answers are framed apart from the server's output, which they are sent between */
+    FrameBuilder::FrameBuilder proxyFrames;
+
+    MessageBuilder::MessageBuilder proxyMessages;
+
+    /** Set while the server validator handles one of the filter's answers */
+    bool analysingProxyMessage = false;
+
     Lsp::LspSchemaValidator clientValidator;
 
     Lsp::LspSchemaValidator serverValidator;
+
+    std::unique_ptr<QFile> recordFile;
+
+    std::unique_ptr<Capture::Writer> recorder;
+
+    std::deque<PendingInput> analysisQueue {};
+
+    qint64 queuedBytes = 0;
+
+    QTimer analysisTimer {};
+
+    int resourceInterval = ResourceSampler::defaultInterval;
+
+    bool analysisEnabled = true;
+
+    /** If any frames were shed since the last one parsed */
+    bool shedFrames = false;
+
+    /** Shed frames from each sender that may have been Requests, see FrameBuilder::Frame::mayBeRequest() */
+    int shedClientRequests = 0;
+
+    int shedServerRequests = 0;
+
+    Clock *clock = Clock::system();
 };
 
 #endif // STDIOMITM_H
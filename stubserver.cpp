@@ -0,0 +1,487 @@
+#include "stubserver.h"
+#include "capture.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include <cmath>
+#include <iostream>
+
+namespace Stub {
+
+namespace {
+    QString idKey(const QJsonValue &id) {
+        return id.isString() ? "s" + id.toString() : "n" + QString::number(id.toDouble(), 'g', 17);
+    }
+
+    /** The server capability that advertises a method */
+    const QHash<QString, std::pair<QString, QJsonValue>>& providers() {
+        static const QHash<QString, std::pair<QString, QJsonValue>> providers {
+            {"textDocument/completion", {"completionProvider", QJsonObject {}}},
+            {"textDocument/hover", {"hoverProvider", true}},
+            {"textDocument/signatureHelp", {"signatureHelpProvider", QJsonObject {}}},
+            {"textDocument/definition", {"definitionProvider", true}},
+            {"textDocument/references", {"referencesProvider", true}},
+            {"textDocument/documentHighlight", {"documentHighlightProvider", true}},
+            {"textDocument/documentSymbol", {"documentSymbolProvider", true}},
+            {"textDocument/codeAction", {"codeActionProvider", true}},
+            {"textDocument/formatting", {"documentFormattingProvider", true}},
+            {"textDocument/rename", {"renameProvider", true}},
+            {"textDocument/foldingRange", {"foldingRangeProvider", true}},
+            {"textDocument/inlayHint", {"inlayHintProvider", true}},
+            {"textDocument/semanticTokens/full", {"semanticTokensProvider", QJsonObject {
+                {"legend", QJsonObject {{"tokenTypes", QJsonArray {}}, {"tokenModifiers", QJsonArray {}}}},
+                {"full", true},
+            }}},
+            {"workspace/symbol", {"workspaceSymbolProvider", true}},
+        };
+        return providers;
+    }
+
+    /** What a capture recorded of each method: the results the server gave, and how long it took (ms) */
+    struct Recorded {
+        QVector<QJsonValue> results;
+
+        QVector<double> latencies;
+    };
+
+    bool readCapture(const QString &path, std::map<QString, Recorded> &recorded, QString *error) {
+        QFile file (path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            *error = "Unable to open capture: " + file.errorString();
+            return false;
+        }
+
+        Capture::Reader reader (&file);
+        Capture::Record record;
+
+        QHash<QString, std::pair<QString, qint64>> requests;
+
+        while (reader.next(record)) {
+            if (record.kind != Capture::Record::Kind::ClientMessage && record.kind != Capture::Record::Kind::ServerMessage) {
+                continue;
+            }
+
+            QJsonObject message = QJsonDocument::fromJson(record.data).object();
+            if (!message.contains("id")) {
+                continue;
+            }
+
+            QString key = idKey(message.value("id"));
+
+            if (record.kind == Capture::Record::Kind::ClientMessage && message.contains("method")) {
+                requests.insert(key, {message.value("method").toString(), record.timestamp});
+            } else if (record.kind == Capture::Record::Kind::ServerMessage && !message.contains("method")) {
+                auto it = requests.find(key);
+                if (it == requests.end()) {
+                    continue;
+                }
+
+                Recorded &method = recorded[it->first];
+                method.latencies.append(std::max<qint64>(record.timestamp - it->second, 0));
+                if (message.contains("result")) {
+                    method.results.append(message.value("result"));
+                }
+
+                requests.erase(it);
+            }
+        }
+
+        if (reader.errorOccurred()) {
+            *error = "Failed to read capture: " + reader.errorString();
+            return false;
+        }
+
+        return true;
+    }
+}
+
+option<LatencyModel> LatencyModel::fromJson(const QJsonObject &json, const QVector<double> &recorded, QString *error) {
+    LatencyModel model;
+    QString distribution = json.value("distribution").toString("fixed");
+
+    if (distribution == "fixed") {
+        model.location = json.value("ms").toDouble(0);
+    } else if (distribution == "normal") {
+        model.distribution = Distribution::Normal;
+        model.location = json.value("mean").toDouble(0);
+        model.scale = json.value("stddev").toDouble(0);
+    } else if (distribution == "lognormal") {
+        model.distribution = Distribution::LogNormal;
+        model.location = json.value("median").toDouble(0);
+        model.scale = json.value("sigma").toDouble(0);
+
+        if (model.location <= 0) {
+            *error = "A lognormal latency needs a positive median";
+            return {};
+        }
+    } else if (distribution == "empirical") {
+        model.distribution = Distribution::Empirical;
+
+        if (json.contains("samples")) {
+            for (const QJsonValue &sample : json.value("samples").toArray()) {
+                model.samples.append(sample.toDouble());
+            }
+        } else {
+            model.samples = recorded;
+        }
+
+        if (model.samples.isEmpty()) {
+            *error = "An empirical latency needs samples, or a capture with Responses to the method";
+            return {};
+        }
+    } else {
+        *error = "Unknown latency distribution: " + distribution;
+        return {};
+    }
+
+    if (model.location < 0 || model.scale < 0 || std::any_of(model.samples.begin(), model.samples.end(), [](double sample) { return sample < 0; })) {
+        *error = "Latencies can't be negative";
+        return {};
+    }
+
+    return model;
+}
+
+double LatencyModel::next(std::mt19937 &random) const {
+    switch (distribution) {
+        case Distribution::Fixed:
+            return location;
+        case Distribution::Normal:
+            return std::max(std::normal_distribution<double>(location, scale)(random), 0.0);
+        case Distribution::LogNormal:
+            return std::lognormal_distribution<double>(std::log(location), scale)(random);
+        case Distribution::Empirical:
+            return samples.at(std::uniform_int_distribution<int>(0, samples.size() - 1)(random));
+    }
+
+    return location;
+}
+
+option<Rules> Rules::load(const QString &path, QString *error) {
+    QFile file (path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = "Unable to open rules: " + file.errorString();
+        return {};
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!document.isObject()) {
+        *error = "Failed to read rules: " + parseError.errorString();
+        return {};
+    }
+
+    QJsonObject json = document.object();
+
+    Rules rules;
+    rules.seed = quint32(json.value("seed").toDouble(rules.seed));
+
+    std::map<QString, Recorded> recorded;
+    if (json.contains("capture")) {
+        QString capture = QFileInfo(path).dir().absoluteFilePath(json.value("capture").toString());
+        if (!readCapture(capture, recorded, error)) {
+            return {};
+        }
+    }
+
+    QJsonObject methods = json.value("methods").toObject();
+    for (auto it = methods.begin(); it != methods.end(); ++it) {
+        QJsonObject entry = it.value().toObject();
+
+        // The fallback draws on every recorded latency
+        QVector<double> latencies;
+        for (auto &method : recorded) {
+            if (it.key() == "*" || method.first == it.key()) {
+                latencies += method.second.latencies;
+            }
+        }
+
+        auto latency = LatencyModel::fromJson(entry.value("latency").toObject(), latencies, error);
+        if (!latency) {
+            *error = it.key() + ": " + *error;
+            return {};
+        }
+
+        Rule rule;
+        rule.latency = latency.value();
+        rule.size = std::max(entry.value("size").toInt(0), 0);
+
+        if (entry.contains("result")) {
+            rule.results.append(entry.value("result"));
+        } else if (recorded.count(it.key())) {
+            rule.results = recorded[it.key()].results;
+        }
+
+        if (entry.contains("error")) {
+            rule.error = entry.value("error").toObject();
+        }
+
+        rules.methods[it.key()] = rule;
+    }
+
+    // Recorded methods without a rule of their own are answered as recorded, at the pace of "*"
+    for (auto &method : recorded) {
+        if (!rules.methods.count(method.first) && !method.second.results.isEmpty()) {
+            Rule rule = rules.methods.count("*") ? rules.methods["*"] : Rule {};
+            rule.results = method.second.results;
+            rules.methods[method.first] = rule;
+        }
+    }
+
+    Rule &initialize = rules.methods["initialize"];
+    if (initialize.results.isEmpty()) {
+        QJsonObject capabilities {{"textDocumentSync", QJsonObject {{"openClose", true}, {"change", 2}}}};
+        for (auto &method : rules.methods) {
+            auto provider = providers().find(method.first);
+            if (provider != providers().end()) {
+                capabilities.insert(provider->first, provider->second);
+            }
+        }
+
+        initialize.results.append(QJsonObject {
+            {"capabilities", capabilities},
+            {"serverInfo", QJsonObject {{"name", "lspmonitor-stub"}}},
+        });
+    }
+
+    QJsonObject overrides = json.value("capabilities").toObject();
+    for (QJsonValue &result : initialize.results) {
+        QJsonObject object = result.toObject();
+        QJsonObject capabilities = object.value("capabilities").toObject();
+        for (auto it = overrides.begin(); it != overrides.end(); ++it) {
+            capabilities.insert(it.key(), it.value());
+        }
+        object.insert("capabilities", capabilities);
+        result = object;
+    }
+
+    // Answered with null rather than by "*"
+    rules.methods.emplace("shutdown", Rule {});
+
+    return rules;
+}
+
+const Rule* Rules::find(const QString &method) const {
+    auto it = methods.find(method);
+    if (it == methods.end()) {
+        it = methods.find("*");
+    }
+    return it != methods.end() ? &it->second : nullptr;
+}
+
+Server::Server(Rules rules, QObject *parent) : QObject(parent), rules(std::move(rules)), random(this->rules.seed) {}
+
+void Server::start() {
+    clientIn = std::make_unique<StdinStream>(this);
+    clientOut = std::make_unique<StdoutStream>(this);
+
+    connect(clientIn.get(), &InputStream::emitInput, &frames, &FrameBuilder::FrameBuilder::onInput);
+    connect(&frames, &FrameBuilder::FrameBuilder::emitFrame, this, &Server::onFrame);
+    connect(&frames, &FrameBuilder::FrameBuilder::emitError, this, [](FrameBuilder::StreamError error){ std::cerr << "Client framing error: " << error.toQString().toStdString() << std::endl; });
+
+    clientIn->start();
+}
+
+void Server::onFrame(FrameBuilder::Frame frame) {
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(frame.payload, &error);
+
+    if (error.error != QJsonParseError::NoError || !document.isObject()) {
+        std::cerr << "Client sent a message that is not a JSON object: " << error.errorString().toStdString() << std::endl;
+        return;
+    }
+
+    QJsonObject message = document.object();
+    if (!message.contains("method")) {
+        // The stub makes no Requests, so there are no Responses to wait for
+        return;
+    }
+
+    if (message.contains("id")) {
+        onRequest(message);
+    } else {
+        onNotification(message);
+    }
+}
+
+void Server::onRequest(const QJsonObject &request) {
+    QString method = request.value("method").toString();
+    QJsonObject response {{"id", request.value("id")}};
+
+    const Rule *rule = rules.find(method);
+
+    if (shutdown) {
+        response["error"] = QJsonObject {{"code", -32600}, {"message", "The server is shutting down"}};
+        send(response);
+        return;
+    } else if (!rule) {
+        response["error"] = QJsonObject {{"code", -32601}, {"message", "No rule for " + method}};
+        send(response);
+        return;
+    }
+
+    if (method == "shutdown") {
+        shutdown = true;
+    }
+
+    if (rule->error) {
+        response["error"] = rule->error.value();
+    } else {
+        response["result"] = result(method, *rule);
+    }
+
+    QString key = idKey(request.value("id"));
+    quint64 serial = nextSerial++;
+    pending.insert(key, Pending {response, serial});
+
+    QTimer::singleShot(int(std::lround(rule->latency.next(random))), Qt::PreciseTimer, this, [this, key, serial](){ respond(key, serial); });
+}
+
+void Server::onNotification(const QJsonObject &notification) {
+    QString method = notification.value("method").toString();
+    QJsonObject params = notification.value("params").toObject();
+    QString uri = params.value("textDocument").toObject().value("uri").toString();
+
+    if (method == "$/cancelRequest") {
+        QJsonValue id = params.value("id");
+        if (pending.remove(idKey(id)) > 0) {
+            send(QJsonObject {{"id", id}, {"error", QJsonObject {{"code", -32800}, {"message", "Request cancelled"}}}});
+        }
+    } else if (method == "textDocument/didOpen") {
+        lineCounts[uri] = params.value("textDocument").toObject().value("text").toString().count('\n') + 1;
+        scheduleDiagnostics(uri);
+    } else if (method == "textDocument/didChange") {
+        qint64 &lines = lineCounts[uri];
+
+        for (const QJsonValue &value : params.value("contentChanges").toArray()) {
+            QJsonObject change = value.toObject();
+            qint64 inserted = change.value("text").toString().count('\n');
+
+            if (change.contains("range")) {
+                QJsonObject range = change.value("range").toObject();
+                qint64 removed = range.value("end").toObject().value("line").toInt() - range.value("start").toObject().value("line").toInt();
+                lines = std::max<qint64>(lines + inserted - removed, 1);
+            } else {
+                lines = inserted + 1;
+            }
+        }
+
+        scheduleDiagnostics(uri);
+    } else if (method == "textDocument/didClose") {
+        lineCounts.remove(uri);
+        diagnostics.remove(uri);
+
+        // Clearing is not delayed; nothing is computed for it
+        if (rules.methods.count("textDocument/publishDiagnostics")) {
+            send(QJsonObject {{"method", "textDocument/publishDiagnostics"}, {"params", QJsonObject {{"uri", uri}, {"diagnostics", QJsonArray {}}}}});
+        }
+    } else if (method == "exit") {
+        emit emitFinished(shutdown ? 0 : 1);
+    }
+}
+
+void Server::respond(const QString &key, quint64 serial) {
+    auto it = pending.find(key);
+    if (it == pending.end() || it->serial != serial) {
+        return;
+    }
+
+    send(it->response);
+    pending.erase(it);
+}
+
+void Server::scheduleDiagnostics(const QString &uri) {
+    auto rule = rules.methods.find("textDocument/publishDiagnostics");
+    if (rule == rules.methods.end()) {
+        return;
+    }
+
+    // Like a server that debounces, a change supersedes the diagnostics not yet published
+    quint64 serial = nextSerial++;
+    diagnostics.insert(uri, serial);
+
+    QTimer::singleShot(int(std::lround(rule->second.latency.next(random))), Qt::PreciseTimer, this, [this, uri, serial](){ publishDiagnostics(uri, serial); });
+}
+
+void Server::publishDiagnostics(const QString &uri, quint64 serial) {
+    if (diagnostics.value(uri, serial + 1) != serial) {
+        return;
+    }
+    diagnostics.remove(uri);
+
+    QString method = "textDocument/publishDiagnostics";
+    QJsonArray list = result(method, rules.methods.at(method)).toArray();
+
+    // Whatever the template said, keep every diagnostic within the document
+    qint64 lines = lineCounts.value(uri, 1);
+    for (int i = 0; i < list.size(); i++) {
+        QJsonObject position {{"line", i % lines}, {"character", 0}};
+        QJsonObject diagnostic = list.at(i).toObject();
+        diagnostic["range"] = QJsonObject {{"start", position}, {"end", position}};
+        list[i] = diagnostic;
+    }
+
+    send(QJsonObject {{"method", method}, {"params", QJsonObject {{"uri", uri}, {"diagnostics", list}}}});
+}
+
+QJsonValue Server::result(const QString &method, const Rule &rule) {
+    QJsonValue result;
+    if (!rule.results.isEmpty()) {
+        result = rule.results.at(answered[method]++ % rule.results.size());
+    }
+
+    return resized(method, result, rule.size);
+}
+
+QJsonValue Server::resized(const QString &method, QJsonValue result, int size) const {
+    if (size <= 0) {
+        return result;
+    }
+
+    bool completionList = result.isObject() && result.toObject().value("items").isArray();
+    QJsonArray templates = completionList ? result.toObject().value("items").toArray() : result.toArray();
+
+    if (templates.isEmpty()) {
+        if (method == "textDocument/completion") {
+            templates.append(QJsonObject {{"label", "item"}, {"kind", 6}});
+        } else if (method == "textDocument/publishDiagnostics") {
+            templates.append(QJsonObject {{"severity", 2}, {"source", "lspmonitor-stub"}, {"message", "Stub diagnostic"}});
+        } else if (!result.isArray()) {
+            // Nothing to make more of
+            return result;
+        }
+    }
+
+    QJsonArray list;
+    for (int i = 0; i < size && !templates.isEmpty(); i++) {
+        QJsonValue element = templates.at(i % templates.size());
+
+        // Copies get distinct labels, so clients don't merge them
+        if (i >= templates.size() && element.toObject().value("label").isString()) {
+            QJsonObject object = element.toObject();
+            object["label"] = object.value("label").toString() + QString::number(i);
+            element = object;
+        }
+
+        list.append(element);
+    }
+
+    if (completionList) {
+        QJsonObject object = result.toObject();
+        object["items"] = list;
+        return object;
+    }
+
+    return list;
+}
+
+void Server::send(const QJsonObject &message) {
+    QJsonObject framed = message;
+    framed.insert("jsonrpc", "2.0");
+
+    QByteArray payload = QJsonDocument(framed).toJson(QJsonDocument::Compact);
+    *clientOut << "Content-Length: " + QByteArray::number(payload.size()) + "\r\n\r\n" + payload;
+}
+
+}
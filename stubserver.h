@@ -0,0 +1,185 @@
+#ifndef STUBSERVER_H
+#define STUBSERVER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QJsonObject>
+
+#include <map>
+#include <memory>
+#include <random>
+
+#include "connectionstream.h"
+#include "framebuilder.h"
+#include "option.h"
+
+namespace Stub {
+
+/** How long the stub takes to answer (ms), drawn afresh for each message */
+class LatencyModel {
+public:
+    enum class Distribution {
+        Fixed,
+        Normal,
+        LogNormal,
+        /** Drawn from a list of latencies, such as those of a capture */
+        Empirical,
+    };
+
+    /**
+     * Reads a model, one of:
+     *
+     *     { "distribution": "fixed", "ms": 20 }
+     *     { "distribution": "normal", "mean": 20, "stddev": 5 }
+     *     { "distribution": "lognormal", "median": 20, "sigma": 0.5 }
+     *     { "distribution": "empirical", "samples": [12, 15, 40] }
+     *
+     * An empirical model without samples takes the recorded latencies, which
+     * must not be empty.
+     */
+    static option<LatencyModel> fromJson(const QJsonObject &json, const QVector<double> &recorded, QString *error);
+
+    double next(std::mt19937 &random) const;
+
+private:
+    Distribution distribution = Distribution::Fixed;
+
+    /** ms, mean or median */
+    double location = 0;
+
+    /** Standard deviation (ms), or sigma of the log */
+    double scale = 0;
+
+    QVector<double> samples {};
+};
+
+/** How one method is answered */
+struct Rule {
+    LatencyModel latency {};
+
+    /** Results given in turn, or none to answer with null */
+    QVector<QJsonValue> results {};
+
+    /** Answer with this error instead of a result */
+    option<QJsonObject> error {};
+
+    /** Elements a list result (or the items of a CompletionList) is resized to, 0 to leave it */
+    int size = 0;
+};
+
+/**
+ * What the stub answers, read from a JSON file:
+ *
+ *     {
+ *         "capture": "session.log",
+ *         "seed": 1,
+ *         "capabilities": { "completionProvider": { "triggerCharacters": ["."] } },
+ *         "methods": {
+ *             "textDocument/completion": { "latency": { "distribution": "lognormal", "median": 40, "sigma": 0.6 }, "size": 5000 },
+ *             "textDocument/hover": { "latency": { "distribution": "empirical" } },
+ *             "textDocument/publishDiagnostics": { "latency": { "distribution": "fixed", "ms": 300 }, "size": 1000 },
+ *             "*": { "latency": { "distribution": "normal", "mean": 5, "stddev": 2 } }
+ *         }
+ *     }
+ *
+ * Methods without a "result" are answered with the server's Responses to them
+ * in the capture, in turn, if there is a capture. The initialize result (and
+ * so the capabilities) comes from the capture too, or else advertises every
+ * method that has a rule, with "capabilities" merged over it. The "*" rule is
+ * for every method without one of its own.
+ *
+ * A publishDiagnostics rule makes the stub publish diagnostics for a document
+ * that long after each change to it, spread over its lines.
+ */
+struct Rules {
+    std::map<QString, Rule> methods {};
+
+    quint32 seed = 1;
+
+    /** Reads the rules and the capture they name (relative to the rules file) */
+    static option<Rules> load(const QString &path, QString *error);
+
+    /** The rule for a method, falling back to "*", or nullptr */
+    const Rule* find(const QString &method) const;
+};
+
+/**
+ * A language server on stdin and stdout that answers from Rules: each Request
+ * is answered after a latency drawn from its method's model, and a
+ * $/cancelRequest answers it at once with RequestCancelled. Used to benchmark
+ * clients against a server whose behaviour is known exactly.
+ */
+class Server : public QObject {
+    Q_OBJECT
+
+public:
+    Server(Rules rules, QObject *parent = nullptr);
+
+    void start();
+
+signals:
+    /** On exit, with 0 if it was preceded by shutdown as the specification asks */
+    void emitFinished(int exitCode);
+
+private slots:
+    void onFrame(FrameBuilder::Frame frame);
+
+private:
+    /** A Response waiting for its latency to pass */
+    struct Pending {
+        QJsonObject response;
+
+        /** Tells the timer it was set for this Response, and not one cancelled before it */
+        quint64 serial = 0;
+    };
+
+    void onRequest(const QJsonObject &request);
+
+    void onNotification(const QJsonObject &notification);
+
+    /** Sends the Response if it is still pending from the timer with the serial */
+    void respond(const QString &key, quint64 serial);
+
+    /** Schedules diagnostics for a document that has changed, replacing any not yet published */
+    void scheduleDiagnostics(const QString &uri);
+
+    void publishDiagnostics(const QString &uri, quint64 serial);
+
+    /** The next result of the rule, resized */
+    QJsonValue result(const QString &method, const Rule &rule);
+
+    /** Resizes a list result to the rule's size */
+    QJsonValue resized(const QString &method, QJsonValue result, int size) const;
+
+    void send(const QJsonObject &message);
+
+    Rules rules;
+
+    std::mt19937 random;
+
+    std::unique_ptr<InputStream> clientIn;
+
+    std::unique_ptr<OutputStream> clientOut;
+
+    FrameBuilder::FrameBuilder frames {};
+
+    /** By id key */
+    QHash<QString, Pending> pending {};
+
+    /** The serial of the diagnostics waiting to be published for each URI */
+    QHash<QString, quint64> diagnostics {};
+
+    quint64 nextSerial = 0;
+
+    /** Lines in each open document, tracked through its changes */
+    QHash<QString, qint64> lineCounts {};
+
+    /** How many results of each method were given, to take the next in turn */
+    QHash<QString, int> answered {};
+
+    bool shutdown = false;
+};
+
+}
+
+#endif // STUBSERVER_H
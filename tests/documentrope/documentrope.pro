@@ -0,0 +1,22 @@
+TEMPLATE = app
+TARGET = tst_documentrope
+
+QT = core concurrent testlib
+
+CONFIG += c++20 console testcase
+CONFIG -= app_bundle
+
+include(../../pipeline.pri)
+
+SOURCES += \
+    $$PWD/../../documentmirror.cpp \
+    $$PWD/../../documentrope.cpp \
+    $$PWD/../../lineindex.cpp \
+    $$PWD/../../textscan.cpp \
+    tst_documentrope.cpp
+
+HEADERS += \
+    $$PWD/../../documentmirror.h \
+    $$PWD/../../documentrope.h \
+    $$PWD/../../lineindex.h \
+    $$PWD/../../textscan.h
@@ -0,0 +1,179 @@
+#include <QtTest>
+
+#include <random>
+
+#include "documentmirror.h"
+#include "documentrope.h"
+
+class TestDocumentRope : public QObject {
+    Q_OBJECT
+
+private slots:
+    void lineBreaks();
+
+    void lineBreakSplitBetweenChunks();
+
+    void surrogatePairs();
+
+    void randomEdits();
+
+    void mirrorClampsToLineEnd();
+};
+
+using Encoding = DocumentRope::Encoding;
+
+namespace {
+
+bool operator==(const DocumentRope::Position &a, const DocumentRope::Position &b) {
+    return a.line == b.line && a.character == b.character;
+}
+
+/** The client's didOpen and didChange notifications, as the mirror is given them */
+std::shared_ptr<Lsp::Message> notification(QString method, QJsonObject params) {
+    QJsonObject contents {{"jsonrpc", "2.0"}, {"method", method}, {"params", params}};
+    return std::make_shared<Lsp::GenericNotification>(Lsp::Context(0, Lsp::Entity::Client, QJsonDocument(contents), 0), method);
+}
+
+/** The offset of a position in UTF-16 units, or -1 if it is outside the text */
+qint64 offsetOf(const DocumentRope &rope, qint64 line, qint64 character, Encoding encoding = Encoding::Utf16) {
+    return rope.offsetOf({line, character}, encoding).value_or(-1);
+}
+
+QJsonObject position(int line, int character) {
+    return QJsonObject {{"line", line}, {"character", character}};
+}
+
+}
+
+void TestDocumentRope::lineBreaks() {
+    DocumentRope rope (QStringLiteral("one\r\ntwo\rthree\nfour"));
+
+    QCOMPARE(rope.lineCount(), qint64(4));
+    QCOMPARE(rope.lineEnd(0), qint64(3));
+    QCOMPARE(rope.lineEnd(1), qint64(8));
+    QCOMPARE(rope.lineEnd(2), qint64(14));
+    QCOMPARE(rope.lineEnd(3), rope.length());
+
+    QCOMPARE(offsetOf(rope, 1, 0), qint64(5));
+    QCOMPARE(offsetOf(rope, 0, 3), qint64(3));
+    QCOMPARE(offsetOf(rope, 0, 4), qint64(-1));
+    QCOMPARE(offsetOf(rope, 4, 0), qint64(-1));
+
+    // Between the '\r' and '\n' is still the end of the first line
+    QVERIFY(rope.positionOf(4, Encoding::Utf16) == DocumentRope::Position({0, 3}));
+    QVERIFY(rope.positionOf(5, Encoding::Utf16) == DocumentRope::Position({1, 0}));
+}
+
+void TestDocumentRope::lineBreakSplitBetweenChunks() {
+    // The '\r' ends the first chunk, and the '\n' starts the second
+    QString text = QString(DocumentRope::maxChunk - 1, 'x') + "\r\ny";
+    DocumentRope rope (text);
+
+    QCOMPARE(rope.lineCount(), qint64(2));
+    QCOMPARE(rope.lineEnd(0), qint64(DocumentRope::maxChunk - 1));
+    QCOMPARE(offsetOf(rope, 1, 0), qint64(DocumentRope::maxChunk + 1));
+
+    // Joined by an edit rather than by building
+    DocumentRope joined = DocumentRope(QStringLiteral("a\r")).replaced(2, 2, QStringLiteral("\nb"));
+    QCOMPARE(joined.toString(), QStringLiteral("a\r\nb"));
+    QCOMPARE(joined.lineCount(), qint64(2));
+    QCOMPARE(joined.lineEnd(0), qint64(1));
+    QCOMPARE(offsetOf(joined, 1, 0), qint64(3));
+
+    // And split again
+    DocumentRope split = joined.replaced(2, 2, QStringLiteral("c"));
+    QCOMPARE(split.lineCount(), qint64(3));
+    QCOMPARE(offsetOf(split, 1, 0), qint64(2));
+    QCOMPARE(offsetOf(split, 2, 0), qint64(4));
+}
+
+void TestDocumentRope::surrogatePairs() {
+    // U+1F600 is two UTF-16 units, one UTF-32 unit and four UTF-8 bytes
+    DocumentRope rope (QString::fromUtf8("a\xF0\x9F\x98\x80" "b\r\n\xC3\xA9\xF0\x9F\x98\x80"));
+
+    QCOMPARE(rope.length(), qint64(9));
+    QCOMPARE(rope.length(Encoding::Utf32), qint64(7));
+    QCOMPARE(rope.length(Encoding::Utf8), qint64(14));
+
+    QCOMPARE(rope.measure(3, Encoding::Utf8), qint64(5));
+    QCOMPARE(rope.measure(3, Encoding::Utf32), qint64(2));
+
+    QCOMPARE(offsetOf(rope, 0, 2, Encoding::Utf32), qint64(3));
+    QCOMPARE(offsetOf(rope, 0, 5, Encoding::Utf8), qint64(3));
+    QCOMPARE(offsetOf(rope, 1, 2, Encoding::Utf32), qint64(9));
+    QCOMPARE(offsetOf(rope, 0, 4, Encoding::Utf32), qint64(-1));
+
+    QVERIFY(rope.positionOf(3, Encoding::Utf32) == DocumentRope::Position({0, 2}));
+    QVERIFY(rope.positionOf(9, Encoding::Utf8) == DocumentRope::Position({1, 6}));
+
+    auto converted = rope.convert({1, 1}, Encoding::Utf32, Encoding::Utf8);
+    QVERIFY(converted);
+    QVERIFY(converted.value() == DocumentRope::Position({1, 2}));
+}
+
+void TestDocumentRope::randomEdits() {
+    // Enough edits, some bigger than a chunk, to rebalance the tree many times over
+    std::mt19937 rng (1);
+    const QString alphabet = QString::fromUtf8("ab \r\n\xC3\xA9");
+
+    QString expected;
+    DocumentRope rope;
+
+    for (int i = 0; i < 4000; i++) {
+        qint64 start = rng() % (expected.size() + 1);
+        qint64 end = std::min<qint64>(start + rng() % 8, expected.size());
+
+        QString text;
+        int length = rng() % 16 == 0 ? rng() % (3 * DocumentRope::maxChunk) : rng() % 8;
+        for (int j = 0; j < length; j++) {
+            text += alphabet[rng() % alphabet.size()];
+        }
+
+        expected.replace(start, end - start, text);
+        rope = rope.replaced(start, end, text);
+
+        QCOMPARE(rope.length(), qint64(expected.size()));
+    }
+
+    QCOMPARE(rope.toString(), expected);
+
+    // Every line ends where the text says, "\r\n" counting once
+    qint64 line = 0;
+    for (qint64 i = 0; i < expected.size(); i++) {
+        if (expected[i] != '\r' && expected[i] != '\n') {
+            continue;
+        }
+
+        QCOMPARE(rope.lineEnd(line), qint64(i));
+        if (expected[i] == '\r' && i + 1 < expected.size() && expected[i + 1] == '\n') {
+            i += 1;
+        }
+
+        line += 1;
+        QCOMPARE(offsetOf(rope, line, 0), qint64(i + 1));
+    }
+
+    QCOMPARE(rope.lineCount(), qint64(line + 1));
+}
+
+void TestDocumentRope::mirrorClampsToLineEnd() {
+    DocumentMirror mirror;
+
+    QJsonObject item {{"uri", "file:///a"}, {"languageId", "text"}, {"version", 1}, {"text", "one\r\ntwo"}};
+    mirror.onLspMessage(notification("textDocument/didOpen", QJsonObject {{"textDocument", item}}));
+
+    // A character past the end of the line means the end of the line, before its "\r\n"
+    QJsonObject range {{"start", position(0, 10)}, {"end", position(0, 10)}};
+    QJsonObject change {{"range", range}, {"text", "!"}};
+    QJsonObject identifier {{"uri", "file:///a"}, {"version", 2}};
+    mirror.onLspMessage(notification("textDocument/didChange", QJsonObject {{"textDocument", identifier}, {"contentChanges", QJsonArray {change}}}));
+
+    auto document = mirror.find("file:///a");
+    QVERIFY(document);
+    QCOMPARE(document->version(), qint64(2));
+    QCOMPARE(document->text().toString(), QStringLiteral("one!\r\ntwo"));
+}
+
+QTEST_APPLESS_MAIN(TestDocumentRope)
+
+#include "tst_documentrope.moc"
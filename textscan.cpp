@@ -0,0 +1,255 @@
+#include "textscan.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace TextScan {
+
+namespace {
+    const char16_t* raw(const QChar *text) {
+        return reinterpret_cast<const char16_t*>(text);
+    }
+
+    bool isHighSurrogate(char16_t c) {
+        return (c & 0xFC00) == 0xD800;
+    }
+
+    bool isLowSurrogate(char16_t c) {
+        return (c & 0xFC00) == 0xDC00;
+    }
+
+    qint64 unitsOf(char16_t c, Encoding encoding) {
+        switch (encoding) {
+            case Encoding::Utf16:
+                return 1;
+            case Encoding::Utf32:
+                return isLowSurrogate(c) ? 0 : 1;
+            case Encoding::Utf8:
+                break;
+        }
+
+        if (c < 0x80) {
+            return 1;
+        } else if (c < 0x800) {
+            return 2;
+        } else if ((c & 0xF800) == 0xD800) {
+            return 2;
+        } else {
+            return 3;
+        }
+    }
+
+#ifdef __SSE2__
+    /** Lane masks (0 or -1) classifying eight code units */
+    struct Block {
+        __m128i ascii;
+
+        /** Below 0x800 (includes ascii) */
+        __m128i twoByte;
+
+        __m128i surrogate;
+
+        __m128i lowSurrogate;
+
+        __m128i lineFeed;
+
+        __m128i carriageReturn;
+    };
+
+    Block classify(const char16_t *text) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text));
+
+        // SSE2 has no unsigned 16 bit compare, but a saturating subtract is zero exactly when v <= bound
+        Block block;
+        block.ascii = _mm_cmpeq_epi16(_mm_subs_epu16(v, _mm_set1_epi16(0x7F)), zero);
+        block.twoByte = _mm_cmpeq_epi16(_mm_subs_epu16(v, _mm_set1_epi16(0x7FF)), zero);
+        block.surrogate = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(short(0xF800))), _mm_set1_epi16(short(0xD800)));
+        block.lowSurrogate = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(short(0xFC00))), _mm_set1_epi16(short(0xDC00)));
+        block.lineFeed = _mm_cmpeq_epi16(v, _mm_set1_epi16('\n'));
+        block.carriageReturn = _mm_cmpeq_epi16(v, _mm_set1_epi16('\r'));
+        return block;
+    }
+
+    /** Sum of the eight signed 16 bit lanes */
+    qint64 sum(__m128i lanes) {
+        __m128i quads = _mm_madd_epi16(lanes, _mm_set1_epi16(1));
+        quads = _mm_add_epi32(quads, _mm_shuffle_epi32(quads, _MM_SHUFFLE(1, 0, 3, 2)));
+        quads = _mm_add_epi32(quads, _mm_shuffle_epi32(quads, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(quads);
+    }
+
+    /** Units of eight code units: three bytes each, one less below 0x800 and again below 0x80, two for surrogates */
+    qint64 unitsOf(const Block &block, Encoding encoding) {
+        switch (encoding) {
+            case Encoding::Utf16:
+                return 8;
+            case Encoding::Utf32:
+                return 8 + sum(block.lowSurrogate);
+            case Encoding::Utf8:
+                break;
+        }
+
+        return 24 + sum(_mm_add_epi16(_mm_add_epi16(block.ascii, block.twoByte), block.surrogate));
+    }
+
+    /** Blocks that can be counted in 16 bit lanes, each counting at most one per block */
+    constexpr qint64 maxBlocks = 32767;
+#endif
+}
+
+Counts count(const QChar *text, qint64 length) {
+    const char16_t *p = raw(text);
+
+    Counts counts;
+    qint64 i = 0;
+
+    auto countUnit = [&](qint64 j) {
+        counts.utf8 += unitsOf(p[j], Encoding::Utf8);
+        counts.utf32 += unitsOf(p[j], Encoding::Utf32);
+
+        // "\r\n" is counted on its '\r'
+        if (p[j] == '\r' || (p[j] == '\n' && (j == 0 || p[j - 1] != '\r'))) {
+            counts.lineBreaks += 1;
+        }
+    };
+
+#ifdef __SSE2__
+    // Blocks are compared with the units one before them to find the '\n' of
+    // each "\r\n", which the first unit doesn't have
+    if (length > 0) {
+        countUnit(0);
+        i = 1;
+    }
+
+    while (length - i >= 8) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i ascii = zero;
+        __m128i twoByte = zero;
+        __m128i surrogate = zero;
+        __m128i lowSurrogate = zero;
+        __m128i lineBreak = zero;
+        __m128i crlf = zero;
+
+        qint64 blocks = std::min((length - i) / 8, maxBlocks);
+        for (qint64 b = 0; b < blocks; b++, i += 8) {
+            Block block = classify(p + i);
+
+            // Masks are -1 where set, so subtracting them counts
+            ascii = _mm_sub_epi16(ascii, block.ascii);
+            twoByte = _mm_sub_epi16(twoByte, block.twoByte);
+            surrogate = _mm_sub_epi16(surrogate, block.surrogate);
+            lowSurrogate = _mm_sub_epi16(lowSurrogate, block.lowSurrogate);
+            lineBreak = _mm_sub_epi16(lineBreak, _mm_or_si128(block.lineFeed, block.carriageReturn));
+
+            __m128i before = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i - 1));
+            crlf = _mm_sub_epi16(crlf, _mm_and_si128(block.lineFeed, _mm_cmpeq_epi16(before, _mm_set1_epi16('\r'))));
+        }
+
+        qint64 units = blocks * 8;
+        counts.utf8 += 3 * units - sum(ascii) - sum(twoByte) - sum(surrogate);
+        counts.utf32 += units - sum(lowSurrogate);
+        counts.lineBreaks += sum(lineBreak) - sum(crlf);
+    }
+#endif
+
+    for (; i < length; i++) {
+        countUnit(i);
+    }
+
+    return counts;
+}
+
+qint64 measure(const QChar *text, qint64 length, Encoding encoding) {
+    switch (encoding) {
+        case Encoding::Utf8:
+            return count(text, length).utf8;
+        case Encoding::Utf16:
+            return length;
+        case Encoding::Utf32:
+            return count(text, length).utf32;
+    }
+
+    return length;
+}
+
+qint64 findLineBreak(const QChar *text, qint64 length, qint64 from) {
+    const char16_t *p = raw(text);
+    qint64 i = std::max<qint64>(from, 0);
+
+#ifdef __SSE2__
+    const __m128i lineFeed = _mm_set1_epi16('\n');
+    const __m128i carriageReturn = _mm_set1_epi16('\r');
+
+    for (; length - i >= 8; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(v, lineFeed), _mm_cmpeq_epi16(v, carriageReturn)));
+        if (mask != 0) {
+            // Two mask bits per code unit
+            return i + qCountTrailingZeroBits(quint32(mask)) / 2;
+        }
+    }
+#endif
+
+    for (; i < length; i++) {
+        if (p[i] == '\n' || p[i] == '\r') {
+            return i;
+        }
+    }
+
+    return length;
+}
+
+qint64 skipLineBreak(const QChar *text, qint64 length, qint64 lineBreak) {
+    const char16_t *p = raw(text);
+
+    if (lineBreak >= length) {
+        return length;
+    }
+
+    if (p[lineBreak] == '\r' && lineBreak + 1 < length && p[lineBreak + 1] == '\n') {
+        return lineBreak + 2;
+    }
+
+    return lineBreak + 1;
+}
+
+qint64 prefixWithin(const QChar *text, qint64 length, qint64 target, Encoding encoding) {
+    const char16_t *p = raw(text);
+
+    qint64 i = 0;
+
+    if (encoding == Encoding::Utf16) {
+        i = qBound<qint64>(0, target, length);
+    } else {
+        qint64 measured = 0;
+
+#ifdef __SSE2__
+        // Skip whole blocks, then find the exact end within the block that passes the target
+        for (; length - i >= 8; i += 8) {
+            qint64 units = unitsOf(classify(p + i), encoding);
+            if (measured + units > target) {
+                break;
+            }
+            measured += units;
+        }
+#endif
+
+        for (; i < length; i++) {
+            qint64 units = unitsOf(p[i], encoding);
+            if (measured + units > target) {
+                break;
+            }
+            measured += units;
+        }
+    }
+
+    if (i > 0 && i < length && isLowSurrogate(p[i]) && isHighSurrogate(p[i - 1])) {
+        i -= 1;
+    }
+
+    return i;
+}
+
+}
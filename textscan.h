@@ -0,0 +1,55 @@
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <QtCore>
+
+/**
+ * Measuring UTF-16 text in the units LSP positions can be expressed in, eight
+ * code units at a time with SSE2 where it is available (every x86-64 target),
+ * and a code unit at a time otherwise.
+ *
+ * A surrogate pair is one UTF-32 unit, counted on its high surrogate, and four
+ * UTF-8 bytes, counted as two on each half. Totals are exact for valid text
+ * however it is split.
+ */
+namespace TextScan {
+
+/** The units a position's character is counted in (LSP PositionEncodingKind) */
+enum class Encoding {
+    Utf8,
+    Utf16,
+    Utf32,
+};
+
+struct Counts {
+    qint64 utf8 = 0;
+
+    qint64 utf32 = 0;
+
+    /**
+     * Line breaks: "\r\n", or a lone '\r' or '\n'. A text that starts with the
+     * '\n' of a "\r\n" split before it counts that '\n' as a break of its own.
+     */
+    qint64 lineBreaks = 0;
+};
+
+Counts count(const QChar *text, qint64 length);
+
+/** The size of the text in the encoding's units */
+qint64 measure(const QChar *text, qint64 length, Encoding encoding);
+
+/** Index of the first line break ('\r' or '\n') at or after from, or length if there is none */
+qint64 findLineBreak(const QChar *text, qint64 length, qint64 from);
+
+/** The index just past the line break at the index, which is two units on for "\r\n" */
+qint64 skipLineBreak(const QChar *text, qint64 length, qint64 lineBreak);
+
+/**
+ * The longest prefix of the text (in code units) that measures at most target
+ * units in the encoding, never ending between the halves of a surrogate pair
+ */
+qint64 prefixWithin(const QChar *text, qint64 length, qint64 target, Encoding encoding);
+
+}
+
+#endif // TEXTSCAN_H
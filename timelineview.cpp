@@ -0,0 +1,337 @@
+#include "timelineview.h"
+
+#include <QPainter>
+#include <QWheelEvent>
+#include <QMouseEvent>
+
+#include <cmath>
+#include <limits>
+
+TimelineView::TimelineView(QWidget *parent) : QWidget(parent) {
+    setMouseTracking(false);
+    setMinimumHeight(60);
+
+    // Keeps pending spans growing and the view following the latest activity
+    connect(&tick, &QTimer::timeout, this, &TimelineView::onTick);
+    tick.start(250);
+}
+
+void TimelineView::setModel(CommunicationModel *model) {
+    this->model = model;
+    connect(model, &QAbstractItemModel::rowsInserted, this, &TimelineView::onRowsInserted);
+}
+
+void TimelineView::setResources(const ResourceSampler *sampler) {
+    resources = sampler;
+}
+
+QSize TimelineView::sizeHint() const {
+    return QSize(600, 150);
+}
+
+void TimelineView::onRowsInserted(const QModelIndex &, int first, int last) {
+    for (int row = first; row <= last; row++) {
+        auto msg = model->messageAt(row);
+
+        if (msg->getKind() == Lsp::Message::Kind::Request) {
+            auto request = static_cast<Lsp::Request*>(msg.get());
+            int span = summary.open(request->getTimestamp(), request->getIndex(), request->getMethod(), request->getSender() == Lsp::Entity::Server);
+            pendingSpans.insert(request->getIndex(), span);
+        } else if (msg->getKind() == Lsp::Message::Kind::Response) {
+            auto response = static_cast<Lsp::Response*>(msg.get());
+            if (!response->getRequest()) {
+                continue;
+            }
+
+            auto it = pendingSpans.find(response->getRequest()->getIndex());
+            if (it != pendingSpans.end()) {
+                summary.close(it.value(), response->getTimestamp());
+                pendingSpans.erase(it);
+            }
+        }
+    }
+
+    update();
+}
+
+void TimelineView::onTick() {
+    if (following || !summary.getOpenSpans().isEmpty()) {
+        update();
+    }
+}
+
+qint64 TimelineView::now() const {
+    return model ? model->getClock()->timestamp() : QDateTime::currentMSecsSinceEpoch();
+}
+
+double TimelineView::timeAt(double x) const {
+    return viewStart + x * msPerPixel;
+}
+
+double TimelineView::xAt(qint64 time) const {
+    return (time - viewStart) / msPerPixel;
+}
+
+double TimelineView::laneHeight() const {
+    int lanes = std::max(1, summary.laneCount());
+    return std::max(1.0, std::min(8.0, double(height() - axisHeight) / lanes));
+}
+
+QColor TimelineView::methodColor(int method) const {
+    return QColor::fromHsv((qHash(summary.getMethods()[method]) % 360), 160, 200);
+}
+
+void TimelineView::paintEvent(QPaintEvent *) {
+    if (following) {
+        viewStart = now() - width() * msPerPixel * 0.9;
+    }
+
+    QPainter painter (this);
+    painter.fillRect(rect(), palette().base());
+
+    qint64 from = std::floor(timeAt(0));
+    qint64 to = std::ceil(timeAt(width()));
+
+    int first = summary.firstEndingAfter(from);
+    int last = summary.lowerBound(to);
+    int level = summary.levelFor(std::floor(msPerPixel));
+
+    paintResources(painter, from, to);
+
+    if (last - first > maxRawSpans && level >= 0) {
+        paintSummary(painter, level, from, to);
+    } else {
+        paintSpans(painter, from, to);
+    }
+
+    // Pending spans may have started long before the view, so they are not
+    // covered by the ranges above
+    qint64 current = now();
+    for (int id : summary.getOpenSpans()) {
+        paintSpan(painter, summary.getSpans()[id], current);
+    }
+
+    paintAxis(painter);
+}
+
+void TimelineView::paintAxis(QPainter &painter) {
+    painter.fillRect(0, 0, width(), axisHeight, palette().window());
+    painter.setPen(palette().text().color());
+
+    // Pick the smallest "nice" interval leaving at least 100px between ticks
+    qint64 interval = std::numeric_limits<qint64>::max();
+    for (qint64 candidate : {1, 2, 5}) {
+        qint64 scaled = candidate;
+        while (scaled < msPerPixel * 100) {
+            scaled *= 10;
+        }
+        interval = std::min(interval, scaled);
+    }
+
+    QString format = interval < 1000 ? "hh:mm:ss.zzz" : "hh:mm:ss";
+
+    qint64 tickTime = std::floor(timeAt(0) / interval) * interval;
+    for (; tickTime < timeAt(width()); tickTime += interval) {
+        int x = std::round(xAt(tickTime));
+        painter.drawLine(x, axisHeight - 4, x, axisHeight);
+        painter.drawText(x + 2, axisHeight - 5, QDateTime::fromMSecsSinceEpoch(tickTime).toString(format));
+    }
+}
+
+void TimelineView::paintResources(QPainter &painter, qint64 from, qint64 to) {
+    if (!resources || resources->getSamples().size() < 2) {
+        return;
+    }
+
+    using Sample = ResourceSampler::Sample;
+    const auto &samples = resources->getSamples();
+
+    // Include the samples just outside the view, so the lines reach its edges
+    auto first = std::lower_bound(samples.begin(), samples.end(), from, [](const Sample &sample, qint64 time) { return sample.timestamp < time; });
+    auto last = std::upper_bound(first, samples.end(), to, [](qint64 time, const Sample &sample) { return time < sample.timestamp; });
+    first = first == samples.begin() ? first : first - 1;
+    last = last == samples.end() ? last : last + 1;
+
+    if (last - first < 2) {
+        return;
+    }
+
+    // CPU is scaled so one core fills the height, unless more are used; memory to the most in view
+    double maxLoad = 1;
+    qint64 maxResident = 1;
+    for (auto it = first + 1; it != last; ++it) {
+        qint64 elapsed = it->monotonic - (it - 1)->monotonic;
+        if (elapsed > 0) {
+            maxLoad = std::max(maxLoad, (it->cpuSeconds - (it - 1)->cpuSeconds) * 1e9 / elapsed);
+        }
+        maxResident = std::max(maxResident, it->residentBytes);
+    }
+
+    double top = axisHeight;
+    double bottom = height();
+
+    QPolygonF cpu;
+    QPolygonF resident;
+    cpu.append(QPointF(xAt(first->timestamp), bottom));
+
+    for (auto it = first + 1; it != last; ++it) {
+        qint64 elapsed = it->monotonic - (it - 1)->monotonic;
+        double load = elapsed > 0 ? std::max(it->cpuSeconds - (it - 1)->cpuSeconds, 0.0) * 1e9 / elapsed : 0;
+        double y = bottom - (bottom - top) * load / maxLoad;
+
+        // The load is an average over the interval, so it is drawn as a step
+        cpu.append(QPointF(xAt((it - 1)->timestamp), y));
+        cpu.append(QPointF(xAt(it->timestamp), y));
+    }
+
+    cpu.append(QPointF(xAt((last - 1)->timestamp), bottom));
+
+    for (auto it = first; it != last; ++it) {
+        resident.append(QPointF(xAt(it->timestamp), bottom - (bottom - top) * it->residentBytes / maxResident));
+    }
+
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(255, 140, 0, 50));
+    painter.drawPolygon(cpu);
+
+    painter.setBrush(Qt::NoBrush);
+    painter.setPen(QColor(70, 130, 180, 160));
+    painter.drawPolyline(resident);
+
+    painter.setPen(palette().text().color());
+    painter.drawText(QRectF(0, top, width() - 4, bottom - top), Qt::AlignTop | Qt::AlignRight,
+        QString("Top: CPU %1%, RSS %2 MiB").arg(maxLoad * 100, 0, 'f', 0).arg(maxResident / (1024.0 * 1024.0), 0, 'f', 0));
+}
+
+void TimelineView::paintSpans(QPainter &painter, qint64 from, qint64 to) {
+    const auto &spans = summary.getSpans();
+
+    int first = summary.firstEndingAfter(from);
+    int last = summary.lowerBound(to);
+
+    for (int i = first; i < last; i++) {
+        const Span &span = spans[i];
+        if (span.end >= from) {
+            paintSpan(painter, span, span.end);
+        }
+    }
+}
+
+void TimelineView::paintSummary(QPainter &painter, int level, qint64 from, qint64 to) {
+    double height = laneHeight();
+
+    summary.forEachBucket(level, from, to, [&](int lane, const SpanBucket &bucket) {
+        double left = xAt(bucket.minStart);
+        double right = std::max(xAt(bucket.maxEnd), left + 1);
+
+        QColor color = methodColor(bucket.method);
+        if (bucket.count > 1) {
+            color = color.darker(100 + std::min(bucket.count, 100));
+        }
+
+        painter.fillRect(QRectF(left, axisHeight + lane * height, right - left, height), color);
+    });
+}
+
+void TimelineView::paintSpan(QPainter &painter, const Span &span, qint64 end) {
+    double height = laneHeight();
+    double left = xAt(span.start);
+    double right = std::max(xAt(end), left + 1);
+
+    QRectF rect (left, axisHeight + span.lane * height, right - left, height);
+    painter.fillRect(rect, methodColor(span.method));
+
+    if (span.fromServer || span.end < 0) {
+        painter.setPen(span.end < 0 ? palette().highlight().color() : palette().text().color());
+        painter.drawRect(rect.adjusted(0, 0, -1, -1));
+    }
+}
+
+int TimelineView::spanAt(QPoint pos) const {
+    int lane = std::floor((pos.y() - axisHeight) / laneHeight());
+    double slack = 2 * msPerPixel;
+    double time = timeAt(pos.x());
+    qint64 current = now();
+
+    const auto &spans = summary.getSpans();
+
+    auto hit = [&](const Span &span) {
+        qint64 end = span.end < 0 ? current : span.end;
+        return span.lane == lane && span.start - slack <= time && time <= end + slack;
+    };
+
+    int first = summary.firstEndingAfter(time - slack);
+    int last = summary.lowerBound(time + slack + 1);
+
+    for (int i = first; i < last; i++) {
+        if (hit(spans[i])) {
+            return spans[i].index;
+        }
+    }
+
+    for (int id : summary.getOpenSpans()) {
+        if (hit(spans[id])) {
+            return spans[id].index;
+        }
+    }
+
+    return -1;
+}
+
+void TimelineView::wheelEvent(QWheelEvent *event) {
+    double x = event->position().x();
+    double anchor = timeAt(x);
+
+    double factor = std::pow(1.2, -event->angleDelta().y() / 120.0);
+    msPerPixel = std::clamp(msPerPixel * factor, 0.01, 24.0 * 60 * 60 * 1000 / 100);
+
+    viewStart = anchor - x * msPerPixel;
+    following = false;
+    update();
+}
+
+void TimelineView::mousePressEvent(QMouseEvent *event) {
+    if (event->button() != Qt::LeftButton) {
+        return;
+    }
+
+    dragging = true;
+    dragMoved = false;
+    dragOrigin = event->x();
+    dragViewStart = viewStart;
+}
+
+void TimelineView::mouseMoveEvent(QMouseEvent *event) {
+    if (!dragging) {
+        return;
+    }
+
+    if (std::abs(event->x() - dragOrigin) > 3) {
+        dragMoved = true;
+        following = false;
+    }
+
+    if (dragMoved) {
+        viewStart = dragViewStart - (event->x() - dragOrigin) * msPerPixel;
+        update();
+    }
+}
+
+void TimelineView::mouseReleaseEvent(QMouseEvent *event) {
+    if (!dragging || event->button() != Qt::LeftButton) {
+        return;
+    }
+
+    dragging = false;
+
+    if (dragMoved) {
+        // Dragging the latest activity back into view resumes following
+        following = timeAt(width()) >= now();
+        return;
+    }
+
+    int index = spanAt(event->pos());
+    if (index >= 0) {
+        emit spanSelected(index);
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef TIMELINEVIEW_H
+#define TIMELINEVIEW_H
+
+#include <QWidget>
+#include <QTimer>
+
+#include "communicationmodel.h"
+#include "spansummary.h"
+#include "resourcesampler.h"
+
+/**
+ * Draws every Request as a span from Request to Response, in lanes, so
+ * overlapping requests and head-of-line blocking are visible.
+ *
+ * Scroll to zoom around the cursor, drag to pan, and click a span to select
+ * its Request. When zoomed out far enough that drawing every span would be
+ * too slow, the view draws from the SpanSummary instead.
+ *
+ * If the server's resources are sampled, its CPU use and resident memory are
+ * drawn behind the spans.
+ */
+class TimelineView : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit TimelineView(QWidget *parent = nullptr);
+
+    void setModel(CommunicationModel *model);
+
+    void setResources(const ResourceSampler *sampler);
+
+    QSize sizeHint() const override;
+
+signals:
+    /** Fired when a span is clicked, with the index of its Request in the model */
+    void spanSelected(int index);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+    void wheelEvent(QWheelEvent *event) override;
+
+    void mousePressEvent(QMouseEvent *event) override;
+
+    void mouseMoveEvent(QMouseEvent *event) override;
+
+    void mouseReleaseEvent(QMouseEvent *event) override;
+
+private slots:
+    void onRowsInserted(const QModelIndex &parent, int first, int last);
+
+    void onTick();
+
+private:
+    /** Spans in view above this count are drawn from the summary */
+    static constexpr int maxRawSpans = 20000;
+
+    static constexpr int axisHeight = 18;
+
+    CommunicationModel *model = nullptr;
+
+    const ResourceSampler *resources = nullptr;
+
+    SpanSummary summary {};
+
+    /** Request model index -> span, for Requests still waiting on a Response */
+    QHash<int, int> pendingSpans {};
+
+    QTimer tick {};
+
+    /** The time at the left edge of the view */
+    double viewStart = 0;
+
+    double msPerPixel = 10;
+
+    /** If the view should keep the latest activity in view */
+    bool following = true;
+
+    bool dragging = false;
+
+    bool dragMoved = false;
+
+    int dragOrigin = 0;
+
+    double dragViewStart = 0;
+
+    qint64 now() const;
+
+    double timeAt(double x) const;
+
+    double xAt(qint64 time) const;
+
+    double laneHeight() const;
+
+    QColor methodColor(int method) const;
+
+    void paintAxis(QPainter &painter);
+
+    void paintResources(QPainter &painter, qint64 from, qint64 to);
+
+    void paintSpans(QPainter &painter, qint64 from, qint64 to);
+
+    void paintSummary(QPainter &painter, int level, qint64 from, qint64 to);
+
+    void paintSpan(QPainter &painter, const Span &span, qint64 end);
+
+    int spanAt(QPoint pos) const;
+};
+
+#endif // TIMELINEVIEW_H
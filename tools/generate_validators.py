@@ -0,0 +1,581 @@
+#!/usr/bin/env python3
+"""
+Generates the LSP validators declared in lspvalidators.h from the LSP
+metaModel.json (https://microsoft.github.io/language-server-protocol/).
+
+    generate_validators.py <metaModel.json> <output.cpp>
+
+Every structure, enumeration and type alias gets a validator function, and
+anonymous types (arrays, "or" types, literals, ...) get one per distinct
+shape. "or" types are resolved by the JSON type of the value where possible,
+so most values are only walked once. Requests and notifications are emitted
+as a table sorted by method, for binary search.
+"""
+
+import json
+import sys
+
+# JSON kinds a type can accept, to resolve "or" types by the value's type
+OBJECT, ARRAY, STRING, NUMBER, BOOLEAN, NULL = 1, 2, 4, 8, 16, 32
+ANY = OBJECT | ARRAY | STRING | NUMBER | BOOLEAN | NULL
+
+QJSON_TYPES = [
+    (OBJECT, "QJsonValue::Object"),
+    (ARRAY, "QJsonValue::Array"),
+    (STRING, "QJsonValue::String"),
+    (NUMBER, "QJsonValue::Double"),
+    (BOOLEAN, "QJsonValue::Bool"),
+    (NULL, "QJsonValue::Null"),
+]
+
+BASE_TYPES = {
+    "integer": ("validateBaseInteger", NUMBER),
+    "uinteger": ("validateBaseUinteger", NUMBER),
+    "decimal": ("validateBaseDecimal", NUMBER),
+    "string": ("validateBaseString", STRING),
+    "DocumentUri": ("validateBaseString", STRING),
+    "URI": ("validateBaseString", STRING),
+    "RegExp": ("validateBaseString", STRING),
+    "boolean": ("validateBaseBoolean", BOOLEAN),
+    "null": ("validateBaseNull", NULL),
+}
+
+# Arbitrary data; walking it would be pure cost
+SPECIAL_REFERENCES = {
+    "LSPAny": ("validateBaseAny", ANY),
+    "LSPObject": ("validateBaseObject", OBJECT),
+    "LSPArray": ("validateBaseArray", ARRAY),
+}
+
+INTEGER_RANGES = {
+    "integer": ("-2147483648.0", "2147483647.0"),
+    "uinteger": ("0.0", "2147483647.0"),
+}
+
+PRELUDE = """\
+// Generated by tools/generate_validators.py from metaModel.json (LSP {version}). Do not edit.
+
+#include "lspvalidators.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace Lsp::Validators {{
+
+namespace {{
+
+using Cursor = SchemaIssues::Cursor;
+
+bool isInteger(const QJsonValue &value, double min, double max) {{
+    if (!value.isDouble()) {{
+        return false;
+    }}
+
+    double number = value.toDouble();
+    return number == std::floor(number) && number >= min && number <= max;
+}}
+
+[[maybe_unused]] void validateBaseInteger(const QJsonValue &value, const Cursor &at) {{
+    if (!isInteger(value, -2147483648.0, 2147483647.0)) {{
+        at.error(QStringLiteral("Expected an integer"));
+    }}
+}}
+
+[[maybe_unused]] void validateBaseUinteger(const QJsonValue &value, const Cursor &at) {{
+    if (!isInteger(value, 0.0, 2147483647.0)) {{
+        at.error(QStringLiteral("Expected an unsigned integer"));
+    }}
+}}
+
+[[maybe_unused]] void validateBaseDecimal(const QJsonValue &value, const Cursor &at) {{
+    if (!value.isDouble()) {{
+        at.error(QStringLiteral("Expected a number"));
+    }}
+}}
+
+[[maybe_unused]] void validateBaseString(const QJsonValue &value, const Cursor &at) {{
+    if (!value.isString()) {{
+        at.error(QStringLiteral("Expected a string"));
+    }}
+}}
+
+[[maybe_unused]] void validateBaseBoolean(const QJsonValue &value, const Cursor &at) {{
+    if (!value.isBool()) {{
+        at.error(QStringLiteral("Expected a boolean"));
+    }}
+}}
+
+[[maybe_unused]] void validateBaseNull(const QJsonValue &value, const Cursor &at) {{
+    if (!value.isNull()) {{
+        at.error(QStringLiteral("Expected null"));
+    }}
+}}
+
+[[maybe_unused]] void validateBaseObject(const QJsonValue &value, const Cursor &at) {{
+    if (!value.isObject()) {{
+        at.error(QStringLiteral("Expected an object"));
+    }}
+}}
+
+[[maybe_unused]] void validateBaseArray(const QJsonValue &value, const Cursor &at) {{
+    if (!value.isArray()) {{
+        at.error(QStringLiteral("Expected an array"));
+    }}
+}}
+
+[[maybe_unused]] void validateBaseAny(const QJsonValue &, const Cursor &) {{}}
+
+/** Whether the value is valid against a validator, without reporting anything (allocation free if it is) */
+bool matches(Validator validator, const QJsonValue &value) {{
+    SchemaIssues scratch;
+    validator(value, scratch.root());
+    return scratch.errorCount() == 0;
+}}
+"""
+
+EPILOGUE = """\
+constexpr bool lessThan(const char *a, const char *b) {
+    while (*a != '\\0' && *a == *b) {
+        a++;
+        b++;
+    }
+    return static_cast<unsigned char>(*a) < static_cast<unsigned char>(*b);
+}
+
+constexpr bool isSorted() {
+    for (std::size_t i = 1; i < std::size(methods); i++) {
+        if (!lessThan(methods[i - 1].method, methods[i].method)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(isSorted(), "The method table must be sorted for binary search");
+
+}
+
+const MethodInfo* findMethod(const QString &method) {
+    auto it = std::lower_bound(std::begin(methods), std::end(methods), method, [](const MethodInfo &info, const QString &method) {
+        return QLatin1String(info.method) < method;
+    });
+
+    if (it == std::end(methods) || QLatin1String(it->method) != method) {
+        return nullptr;
+    }
+
+    return it;
+}
+
+const char* specVersion() {
+    return metaModelVersion;
+}
+
+}
+"""
+
+DIRECTIONS = {
+    "clientToServer": "Direction::ClientToServer",
+    "serverToClient": "Direction::ServerToClient",
+    "both": "Direction::Both",
+}
+
+
+def cpp_string(value):
+    return json.dumps(value)
+
+
+def qstring(value):
+    return "QStringLiteral(" + cpp_string(value) + ")"
+
+
+def indent(lines, levels=1):
+    return ["    " * levels + line if line else line for line in lines]
+
+
+class Generator:
+    def __init__(self, model):
+        self.version = model.get("metaData", {}).get("version", "unknown")
+        self.structures = {s["name"]: s for s in model.get("structures", [])}
+        self.enumerations = {e["name"]: e for e in model.get("enumerations", [])}
+        self.aliases = {a["name"]: a for a in model.get("typeAliases", [])}
+        self.requests = model.get("requests", [])
+        self.notifications = model.get("notifications", [])
+
+        # (name, body lines) of every generated validator, in generation order
+        self.functions = []
+        self.anonymous = {}
+
+    def fail(self, message):
+        sys.exit("generate_validators.py: " + message)
+
+    def describe(self, t):
+        kind = t["kind"]
+        if kind in ("base", "reference"):
+            return t["name"]
+        if kind == "array":
+            element = self.describe(t["element"])
+            return ("(" + element + ")[]") if t["element"]["kind"] == "or" else element + "[]"
+        if kind == "map":
+            return "{ [key: " + self.describe(t["key"]) + "]: " + self.describe(t["value"]) + " }"
+        if kind == "or":
+            return " | ".join(self.describe(item) for item in t["items"])
+        if kind == "and":
+            return " & ".join(self.describe(item) for item in t["items"])
+        if kind == "tuple":
+            return "[" + ", ".join(self.describe(item) for item in t["items"]) + "]"
+        if kind == "literal":
+            return "{ " + "; ".join(p["name"] + ("?" if p.get("optional") else "") for p in t["value"]["properties"]) + " }"
+        if kind == "stringLiteral":
+            return json.dumps(t["value"])
+        if kind in ("integerLiteral", "booleanLiteral"):
+            return json.dumps(t["value"])
+        self.fail("unknown type kind '" + kind + "'")
+
+    def kinds(self, t, seen=frozenset()):
+        kind = t["kind"]
+        if kind == "base":
+            return BASE_TYPES[t["name"]][1]
+        if kind == "reference":
+            name = t["name"]
+            if name in SPECIAL_REFERENCES:
+                return SPECIAL_REFERENCES[name][1]
+            if name in self.structures:
+                return OBJECT
+            if name in self.enumerations:
+                return STRING if self.enumerations[name]["type"]["name"] == "string" else NUMBER
+            if name in self.aliases:
+                return 0 if name in seen else self.kinds(self.aliases[name]["type"], seen | {name})
+            self.fail("unknown reference '" + name + "'")
+        if kind in ("array", "tuple"):
+            return ARRAY
+        if kind in ("map", "literal", "and"):
+            return OBJECT
+        if kind == "or":
+            result = 0
+            for item in t["items"]:
+                result |= self.kinds(item, seen)
+            return result
+        if kind == "stringLiteral":
+            return STRING
+        if kind == "integerLiteral":
+            return NUMBER
+        if kind == "booleanLiteral":
+            return BOOLEAN
+        self.fail("unknown type kind '" + kind + "'")
+
+    def validator(self, t):
+        """The name of the C++ function validating the type, generating it if needed"""
+        kind = t["kind"]
+        if kind == "base":
+            if t["name"] not in BASE_TYPES:
+                self.fail("unknown base type '" + t["name"] + "'")
+            return BASE_TYPES[t["name"]][0]
+        if kind == "reference":
+            name = t["name"]
+            if name in SPECIAL_REFERENCES:
+                return SPECIAL_REFERENCES[name][0]
+            if name not in self.structures and name not in self.enumerations and name not in self.aliases:
+                self.fail("unknown reference '" + name + "'")
+            return "validate" + name
+
+        key = json.dumps(t, sort_keys=True)
+        if key not in self.anonymous:
+            name = "validateAnonymous" + str(len(self.anonymous))
+            self.anonymous[key] = name
+            self.functions.append((name, self.anonymous_body(t)))
+        return self.anonymous[key]
+
+    def properties(self, structure, seen=frozenset()):
+        """Properties of a structure, including those it extends / mixes in"""
+        if structure["name"] in seen:
+            self.fail("structure '" + structure["name"] + "' extends itself")
+
+        result = {}
+        for parent in structure.get("extends", []) + structure.get("mixins", []):
+            if parent["kind"] != "reference" or parent["name"] not in self.structures:
+                self.fail("structure '" + structure["name"] + "' extends a non-structure")
+            for prop in self.properties(self.structures[parent["name"]], seen | {structure["name"]}):
+                result[prop["name"]] = prop
+
+        for prop in structure["properties"]:
+            result[prop["name"]] = prop
+
+        return list(result.values())
+
+    def object_body(self, description, properties):
+        lines = [
+            "if (!value.isObject()) {",
+            "    at.error(" + qstring("Expected " + description) + ");",
+            "    return;",
+            "}",
+        ]
+
+        if not properties:
+            return lines
+
+        lines += ["", "const QJsonObject object = value.toObject();"]
+
+        for prop in properties:
+            name = prop["name"]
+            validator = self.validator(prop["type"])
+            member = "at.member(" + qstring(name) + ")"
+
+            lines += ["", "{", "    const QJsonValue member = object.value(QLatin1String(" + cpp_string(name) + "));"]
+
+            if not prop.get("optional"):
+                lines += [
+                    "    if (member.isUndefined()) {",
+                    "        at.error(" + qstring("Missing required member '" + name + "'") + ");",
+                    "    } else {",
+                    "        " + validator + "(member, " + member + ");",
+                    "    }",
+                ]
+            elif not self.kinds(prop["type"]) & NULL:
+                # Commonly sent instead of omitting the member, and mostly harmless
+                lines += [
+                    "    if (member.isNull()) {",
+                    "        " + member + ".warning(" + qstring("Optional member is null; it should be omitted instead") + ");",
+                    "    } else if (!member.isUndefined()) {",
+                    "        " + validator + "(member, " + member + ");",
+                    "    }",
+                ]
+            else:
+                lines += [
+                    "    if (!member.isUndefined()) {",
+                    "        " + validator + "(member, " + member + ");",
+                    "    }",
+                ]
+
+            lines += ["}"]
+
+        return lines
+
+    def or_body(self, t):
+        items = t["items"]
+        lines = ["switch (value.type()) {"]
+
+        for kind, qtype in QJSON_TYPES:
+            candidates = [self.validator(item) for item in items if self.kinds(item) & kind]
+            if not candidates:
+                continue
+
+            lines += ["    case " + qtype + ":"]
+            if len(candidates) == 1:
+                lines += ["        " + candidates[0] + "(value, at);", "        return;"]
+            else:
+                for candidate in candidates:
+                    lines += ["        if (matches(" + candidate + ", value)) {", "            return;", "        }"]
+                lines += ["        break;"]
+
+        lines += [
+            "    default:",
+            "        break;",
+            "}",
+            "",
+            "at.error(" + qstring("Expected " + self.describe(t)) + ");",
+        ]
+        return lines
+
+    def anonymous_body(self, t):
+        kind = t["kind"]
+
+        if kind == "array":
+            return [
+                "if (!value.isArray()) {",
+                "    at.error(" + qstring("Expected " + self.describe(t)) + ");",
+                "    return;",
+                "}",
+                "",
+                "const QJsonArray array = value.toArray();",
+                "for (int i = 0; i < array.size(); i++) {",
+                "    " + self.validator(t["element"]) + "(array.at(i), at.element(i));",
+                "}",
+            ]
+
+        if kind == "map":
+            return [
+                "if (!value.isObject()) {",
+                "    at.error(" + qstring("Expected " + self.describe(t)) + ");",
+                "    return;",
+                "}",
+                "",
+                "const QJsonObject object = value.toObject();",
+                "for (auto it = object.constBegin(); it != object.constEnd(); it++) {",
+                "    " + self.validator(t["value"]) + "(it.value(), at.member(it.key()));",
+                "}",
+            ]
+
+        if kind == "tuple":
+            lines = [
+                "if (!value.isArray() || value.toArray().size() != " + str(len(t["items"])) + ") {",
+                "    at.error(" + qstring("Expected " + self.describe(t)) + ");",
+                "    return;",
+                "}",
+                "",
+                "const QJsonArray array = value.toArray();",
+            ]
+            for i, item in enumerate(t["items"]):
+                lines += [self.validator(item) + "(array.at(" + str(i) + "), at.element(" + str(i) + "));"]
+            return lines
+
+        if kind == "or":
+            return self.or_body(t)
+
+        if kind == "and":
+            return [self.validator(item) + "(value, at);" for item in t["items"]]
+
+        if kind == "literal":
+            return self.object_body("an object " + self.describe(t), t["value"]["properties"])
+
+        if kind == "stringLiteral":
+            return [
+                "if (!value.isString() || value.toString() != QLatin1String(" + cpp_string(t["value"]) + ")) {",
+                "    at.error(" + qstring("Expected " + self.describe(t)) + ");",
+                "}",
+            ]
+
+        if kind == "integerLiteral":
+            return [
+                "if (!value.isDouble() || value.toDouble() != " + str(t["value"]) + ") {",
+                "    at.error(" + qstring("Expected " + self.describe(t)) + ");",
+                "}",
+            ]
+
+        if kind == "booleanLiteral":
+            return [
+                "if (!value.isBool() || value.toBool() != " + ("true" if t["value"] else "false") + ") {",
+                "    at.error(" + qstring("Expected " + self.describe(t)) + ");",
+                "}",
+            ]
+
+        self.fail("unexpected anonymous type kind '" + kind + "'")
+
+    def enumeration_body(self, enumeration):
+        name = enumeration["name"]
+        base = enumeration["type"]["name"]
+        custom = enumeration.get("supportsCustomValues", False)
+
+        if base == "string":
+            lines = [
+                "if (!value.isString()) {",
+                "    at.error(" + qstring("Expected " + name + " (a string)") + ");",
+                "    return;",
+                "}",
+            ]
+            if custom:
+                return lines
+
+            conditions = " || ".join("string == QLatin1String(" + cpp_string(v["value"]) + ")" for v in enumeration["values"])
+            return lines + [
+                "",
+                "const QString string = value.toString();",
+                "if (" + conditions + ") {",
+                "    return;",
+                "}",
+                "",
+                "at.warning(" + qstring("Not a known " + name + " value") + ");",
+            ]
+
+        low, high = INTEGER_RANGES.get(base, INTEGER_RANGES["integer"])
+        lines = [
+            "if (!isInteger(value, " + low + ", " + high + ")) {",
+            "    at.error(" + qstring("Expected " + name + " (an integer)") + ");",
+            "    return;",
+            "}",
+        ]
+        if custom:
+            return lines
+
+        lines += ["", "switch (value.toInt()) {"]
+        lines += ["    case " + str(v["value"]) + ":" for v in enumeration["values"]]
+        lines += [
+            "        return;",
+            "    default:",
+            "        at.warning(" + qstring("Not a known " + name + " value") + ");",
+            "}",
+        ]
+        return lines
+
+    def generate(self):
+        # Named types first, so they keep a stable order in the output
+        for name, structure in self.structures.items():
+            self.functions.append(("validate" + name, None))
+        for name in self.enumerations:
+            self.functions.append(("validate" + name, None))
+        for name in self.aliases:
+            if name not in SPECIAL_REFERENCES:
+                self.functions.append(("validate" + name, None))
+
+        bodies = {}
+        for name, structure in self.structures.items():
+            bodies["validate" + name] = self.object_body(name, self.properties(structure))
+        for name, enumeration in self.enumerations.items():
+            bodies["validate" + name] = self.enumeration_body(enumeration)
+        for name, alias in self.aliases.items():
+            if name not in SPECIAL_REFERENCES:
+                bodies["validate" + name] = [self.validator(alias["type"]) + "(value, at);"]
+
+        methods = []
+        for request in self.requests:
+            methods.append((request["method"], request["messageDirection"], True, request.get("params"), request.get("result")))
+        for notification in self.notifications:
+            methods.append((notification["method"], notification["messageDirection"], False, notification.get("params"), None))
+        methods.sort(key=lambda m: m[0].encode("utf-8"))
+
+        table = []
+        for method, direction, is_request, params, result in methods:
+            params_validator = self.validator(params) if params else "nullptr"
+            result_validator = self.validator(result) if result else "nullptr"
+            table.append("    {" + ", ".join([
+                cpp_string(method),
+                DIRECTIONS[direction],
+                "true" if is_request else "false",
+                params_validator,
+                result_validator,
+            ]) + "},")
+
+        out = [PRELUDE.format(version=self.version)]
+
+        # Not every named type is reachable from a method
+        for name, _ in self.functions:
+            out.append("[[maybe_unused]] void " + name + "(const QJsonValue &value, const Cursor &at);")
+        out.append("")
+
+        for name, body in self.functions:
+            body = body if body is not None else bodies[name]
+            out.append("void " + name + "(const QJsonValue &value, const Cursor &at) {")
+            out.extend(indent(body))
+            out.append("}")
+            out.append("")
+
+        out.append("constexpr char metaModelVersion[] = " + cpp_string(self.version) + ";")
+        out.append("")
+        out.append("constexpr MethodInfo methods[] = {")
+        out.extend(table)
+        out.append("};")
+        out.append("")
+        out.append(EPILOGUE)
+
+        return "\n".join(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: generate_validators.py <metaModel.json> <output.cpp>")
+
+    with open(sys.argv[1], encoding="utf-8") as f:
+        model = json.load(f)
+
+    output = Generator(model).generate()
+
+    with open(sys.argv[2], "w", encoding="utf-8") as f:
+        f.write(output)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,435 @@
+#include "traceexporter.h"
+
+#include <cstring>
+
+namespace Trace {
+
+namespace {
+
+// Minimal protobuf encoding, enough for the handful of Perfetto messages we write
+
+enum WireType {
+    Varint = 0,
+    Fixed64 = 1,
+    LengthDelimited = 2,
+};
+
+void appendVarint(QByteArray &out, quint64 value) {
+    while (value >= 0x80) {
+        out.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+void appendTag(QByteArray &out, int field, WireType type) {
+    appendVarint(out, (quint64(field) << 3) | type);
+}
+
+void appendUint(QByteArray &out, int field, quint64 value) {
+    appendTag(out, field, Varint);
+    appendVarint(out, value);
+}
+
+void appendDouble(QByteArray &out, int field, double value) {
+    appendTag(out, field, Fixed64);
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; i++) {
+        out.append(char(bits >> (8 * i)));
+    }
+}
+
+void appendBytes(QByteArray &out, int field, const QByteArray &value) {
+    appendTag(out, field, LengthDelimited);
+    appendVarint(out, value.size());
+    out.append(value);
+}
+
+void appendString(QByteArray &out, int field, const QString &value) {
+    appendBytes(out, field, value.toUtf8());
+}
+
+// Field numbers from perfetto/trace/trace_packet.proto and friends
+namespace TracePacket {
+    constexpr int timestamp = 8;
+    constexpr int trustedPacketSequenceId = 10;
+    constexpr int trackEvent = 11;
+    constexpr int sequenceFlags = 13;
+    constexpr int trackDescriptor = 60;
+}
+
+namespace TrackDescriptor {
+    constexpr int uuid = 1;
+    constexpr int name = 2;
+    constexpr int counter = 8;
+}
+
+namespace TrackEvent {
+    constexpr int debugAnnotations = 4;
+    constexpr int type = 9;
+    constexpr int trackUuid = 11;
+    constexpr int name = 23;
+    constexpr int doubleCounterValue = 44;
+
+    constexpr int typeSliceBegin = 1;
+    constexpr int typeSliceEnd = 2;
+    constexpr int typeInstant = 3;
+    constexpr int typeCounter = 4;
+}
+
+namespace DebugAnnotation {
+    constexpr int stringValue = 6;
+    constexpr int name = 10;
+}
+
+constexpr int sequenceIncrementalStateCleared = 1;
+
+constexpr quint64 sequenceId = 1;
+
+}
+
+ChromeTraceWriter::ChromeTraceWriter(QIODevice *device) : device(device) {
+    device->write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+}
+
+int ChromeTraceWriter::threadFor(const QString &track) {
+    auto it = threadIds.find(track);
+    if (it != threadIds.end()) {
+        return it.value();
+    }
+
+    int tid = threadIds.size() + 1;
+    threadIds.insert(track, tid);
+
+    writeEvent(QJsonObject {
+        {"ph", "M"},
+        {"name", "thread_name"},
+        {"pid", 1},
+        {"tid", tid},
+        {"args", QJsonObject {{"name", track}}},
+    });
+
+    writeEvent(QJsonObject {
+        {"ph", "M"},
+        {"name", "thread_sort_index"},
+        {"pid", 1},
+        {"tid", tid},
+        {"args", QJsonObject {{"sort_index", tid}}},
+    });
+
+    return tid;
+}
+
+void ChromeTraceWriter::writeEvent(const QJsonObject &event) {
+    if (!first) {
+        device->write(",\n");
+    }
+    first = false;
+
+    device->write(QJsonDocument(event).toJson(QJsonDocument::Compact));
+}
+
+static QJsonObject argsToJson(const Args &args) {
+    QJsonObject result;
+    for (auto arg : args) {
+        result.insert(arg.first, arg.second);
+    }
+    return result;
+}
+
+void ChromeTraceWriter::slice(const QString &track, const QString &name, qint64 start, qint64 end, const Args &args) {
+    int tid = threadFor(track);
+
+    writeEvent(QJsonObject {
+        {"ph", "X"},
+        {"cat", "lsp"},
+        {"name", name},
+        {"pid", 1},
+        {"tid", tid},
+        {"ts", double(start) * 1000},
+        {"dur", double(end - start) * 1000},
+        {"args", argsToJson(args)},
+    });
+}
+
+void ChromeTraceWriter::instant(const QString &track, const QString &name, qint64 time, const Args &args) {
+    int tid = threadFor(track);
+
+    writeEvent(QJsonObject {
+        {"ph", "i"},
+        {"s", "t"},
+        {"cat", "lsp"},
+        {"name", name},
+        {"pid", 1},
+        {"tid", tid},
+        {"ts", double(time) * 1000},
+        {"args", argsToJson(args)},
+    });
+}
+
+void ChromeTraceWriter::counter(const QString &name, qint64 time, double value) {
+    writeEvent(QJsonObject {
+        {"ph", "C"},
+        {"name", name},
+        {"pid", 1},
+        {"ts", double(time) * 1000},
+        {"args", QJsonObject {{"value", value}}},
+    });
+}
+
+void ChromeTraceWriter::finish() {
+    device->write("\n]}\n");
+}
+
+PerfettoTraceWriter::PerfettoTraceWriter(QIODevice *device) : device(device) {}
+
+void PerfettoTraceWriter::writePacket(qint64 time, int field, const QByteArray &payload) {
+    QByteArray packet;
+
+    if (time >= 0) {
+        appendUint(packet, TracePacket::timestamp, quint64(time) * 1000000);
+    }
+
+    appendUint(packet, TracePacket::trustedPacketSequenceId, sequenceId);
+
+    if (first) {
+        appendUint(packet, TracePacket::sequenceFlags, sequenceIncrementalStateCleared);
+        first = false;
+    }
+
+    appendBytes(packet, field, payload);
+
+    // Trace.packet is field 1; a trace file is just the concatenation of these
+    QByteArray framed;
+    appendBytes(framed, 1, packet);
+    device->write(framed);
+}
+
+quint64 PerfettoTraceWriter::trackFor(const QString &track) {
+    auto it = trackUuids.find(track);
+    if (it != trackUuids.end()) {
+        return it.value();
+    }
+
+    quint64 uuid = trackUuids.size() + counterUuids.size() + 1;
+    trackUuids.insert(track, uuid);
+
+    QByteArray descriptor;
+    appendUint(descriptor, TrackDescriptor::uuid, uuid);
+    appendString(descriptor, TrackDescriptor::name, track);
+    writePacket(-1, TracePacket::trackDescriptor, descriptor);
+
+    return uuid;
+}
+
+quint64 PerfettoTraceWriter::counterFor(const QString &name) {
+    auto it = counterUuids.find(name);
+    if (it != counterUuids.end()) {
+        return it.value();
+    }
+
+    quint64 uuid = trackUuids.size() + counterUuids.size() + 1;
+    counterUuids.insert(name, uuid);
+
+    QByteArray descriptor;
+    appendUint(descriptor, TrackDescriptor::uuid, uuid);
+    appendString(descriptor, TrackDescriptor::name, name);
+    appendBytes(descriptor, TrackDescriptor::counter, QByteArray());
+    writePacket(-1, TracePacket::trackDescriptor, descriptor);
+
+    return uuid;
+}
+
+QByteArray PerfettoTraceWriter::trackEvent(int type, quint64 track, const QString &name, const Args &args) {
+    QByteArray event;
+    appendUint(event, TrackEvent::type, type);
+    appendUint(event, TrackEvent::trackUuid, track);
+
+    if (!name.isEmpty()) {
+        appendString(event, TrackEvent::name, name);
+    }
+
+    for (auto arg : args) {
+        QByteArray annotation;
+        appendString(annotation, DebugAnnotation::name, arg.first);
+        appendString(annotation, DebugAnnotation::stringValue, arg.second);
+        appendBytes(event, TrackEvent::debugAnnotations, annotation);
+    }
+
+    return event;
+}
+
+void PerfettoTraceWriter::slice(const QString &track, const QString &name, qint64 start, qint64 end, const Args &args) {
+    quint64 uuid = trackFor(track);
+    writePacket(start, TracePacket::trackEvent, trackEvent(TrackEvent::typeSliceBegin, uuid, name, args));
+    writePacket(end, TracePacket::trackEvent, trackEvent(TrackEvent::typeSliceEnd, uuid, "", {}));
+}
+
+void PerfettoTraceWriter::instant(const QString &track, const QString &name, qint64 time, const Args &args) {
+    quint64 uuid = trackFor(track);
+    writePacket(time, TracePacket::trackEvent, trackEvent(TrackEvent::typeInstant, uuid, name, args));
+}
+
+void PerfettoTraceWriter::counter(const QString &name, qint64 time, double value) {
+    QByteArray event = trackEvent(TrackEvent::typeCounter, counterFor(name), "", {});
+    appendDouble(event, TrackEvent::doubleCounterValue, value);
+    writePacket(time, TracePacket::trackEvent, event);
+}
+
+void PerfettoTraceWriter::finish() {}
+
+TraceExporter::TraceExporter(TraceWriter &writer, QObject *parent) : QObject(parent), writer(writer) {}
+
+bool TraceExporter::exportCapture(QIODevice *capture, QString *error) {
+    Lsp::LspSchemaValidator clientValidator (Lsp::Entity::Client);
+    Lsp::LspSchemaValidator serverValidator (Lsp::Entity::Server);
+    clientValidator.linkWith(serverValidator);
+
+    connect(&clientValidator, &Lsp::LspSchemaValidator::emitLspMessage, this, &TraceExporter::onLspMessage);
+    connect(&serverValidator, &Lsp::LspSchemaValidator::emitLspMessage, this, &TraceExporter::onLspMessage);
+
+    Capture::Reader reader (capture);
+    Capture::Record record;
+
+    while (reader.next(record)) {
+        switch (record.kind) {
+            case Capture::Record::Kind::ClientMessage:
+            case Capture::Record::Kind::ServerMessage: {
+                QJsonParseError parseError;
+                QJsonDocument doc = QJsonDocument::fromJson(record.data, &parseError);
+                if (parseError.error != QJsonParseError::NoError) {
+                    onStderr(record.timestamp, "lspmonitor: unparseable message in capture: " + parseError.errorString());
+                    break;
+                }
+
+                MessageBuilder::Message message (record.timestamp, doc, record.data.size());
+                if (record.kind == Capture::Record::Kind::ClientMessage) {
+                    clientValidator.onMessage(message);
+                } else {
+                    serverValidator.onMessage(message);
+                }
+                break;
+            }
+            case Capture::Record::Kind::Stderr:
+                onStderr(record.timestamp, QString::fromUtf8(record.data));
+                break;
+            case Capture::Record::Kind::Counter:
+                onCounter(record.timestamp, QString::fromUtf8(record.data), record.value);
+                break;
+        }
+    }
+
+    finish();
+
+    if (reader.errorOccurred()) {
+        if (error) {
+            *error = reader.errorString();
+        }
+        return false;
+    }
+
+    return true;
+}
+
+void TraceExporter::finish() {
+    for (auto &lane : lanes) {
+        if (lane.request) {
+            closeSpan(lane.request, lastTimestamp, {{"pending", "true"}});
+        }
+    }
+
+    writer.finish();
+}
+
+QString TraceExporter::senderName(Lsp::Entity sender) {
+    return sender == Lsp::Entity::Client ? "Client" : "Server";
+}
+
+QString TraceExporter::idToQString(Lsp::Id id) {
+    if (id.isNumber()) {
+        return QString::number(id.getNumber());
+    } else if (id.isString()) {
+        return id.getString();
+    } else {
+        return "invalid";
+    }
+}
+
+void TraceExporter::openSpan(std::shared_ptr<Lsp::Request> request) {
+    for (auto &lane : lanes) {
+        if (!lane.request) {
+            lane.request = request;
+            return;
+        }
+    }
+
+    lanes.append(Lane {"Requests " + QString::number(lanes.size() + 1), request});
+}
+
+void TraceExporter::closeSpan(std::shared_ptr<Lsp::Request> request, qint64 end, const Args &extra) {
+    for (auto &lane : lanes) {
+        if (lane.request != request) {
+            continue;
+        }
+
+        Args args {
+            {"sender", senderName(request->getSender())},
+            {"id", idToQString(request->getId())},
+            {"size", QString::number(request->getSize())},
+        };
+        args.append(extra);
+
+        writer.slice(lane.track, request->getMethod(), request->getTimestamp(), end, args);
+        lane.request.reset();
+        return;
+    }
+}
+
+void TraceExporter::onLspMessage(std::shared_ptr<Lsp::Message> message) {
+    lastTimestamp = std::max(lastTimestamp, message->getTimestamp());
+
+    switch (message->getKind()) {
+        case Lsp::Message::Kind::Request:
+            openSpan(std::static_pointer_cast<Lsp::Request>(message));
+            break;
+        case Lsp::Message::Kind::Response: {
+            auto response = std::static_pointer_cast<Lsp::Response>(message);
+            auto request = response->getRequest();
+
+            if (!request) {
+                writer.instant(senderName(message->getSender()) + " unmatched responses", "response " + idToQString(response->getId()), message->getTimestamp(), {});
+                break;
+            }
+
+            Args args {
+                {"responseSize", QString::number(response->getSize())},
+                {"outcome", response->getContents().object().contains("error") ? "error" : "result"},
+            };
+            if (request->isCancelled()) {
+                args.append({"afterCancelMs", QString::number(response->getTimeAfterCancel() / 1e6, 'f', 3)});
+            }
+            closeSpan(request, response->getTimestamp(), args);
+            break;
+        }
+        case Lsp::Message::Kind::Notification:
+            writer.instant(senderName(message->getSender()) + " notifications", message->tryGetMethod().value_or("notification"), message->getTimestamp(), {});
+            break;
+        case Lsp::Message::Kind::Batch:
+        case Lsp::Message::Kind::Unknown:
+            writer.instant(senderName(message->getSender()) + " notifications", "unknown message", message->getTimestamp(), {});
+            break;
+    }
+}
+
+void TraceExporter::onStderr(qint64 timestamp, QString line) {
+    lastTimestamp = std::max(lastTimestamp, timestamp);
+    writer.instant("Server stderr", line.left(120), timestamp, {{"text", line}});
+}
+
+void TraceExporter::onCounter(qint64 timestamp, QString name, double value) {
+    lastTimestamp = std::max(lastTimestamp, timestamp);
+    writer.counter(name, timestamp, value);
+}
+
+}
@@ -0,0 +1,161 @@
+#ifndef TRACEEXPORTER_H
+#define TRACEEXPORTER_H
+
+#include <QtCore>
+
+#include <utility>
+
+#include "lspschemavalidator.h"
+#include "capture.h"
+
+namespace Trace {
+
+using Args = QVector<std::pair<QString, QString>>;
+
+/**
+ * Destination for trace events. Events are written as soon as they are
+ * known, so implementations must not need to see the whole trace first.
+ *
+ * Tracks are identified by name; the writer is responsible for declaring
+ * a track the first time it is used. All times are ms since epoch.
+ */
+class TraceWriter {
+public:
+    virtual ~TraceWriter() = default;
+
+    /** A complete span on the track */
+    virtual void slice(const QString &track, const QString &name, qint64 start, qint64 end, const Args &args) = 0;
+
+    /** A zero duration event on the track */
+    virtual void instant(const QString &track, const QString &name, qint64 time, const Args &args) = 0;
+
+    /** A sample of the named counter */
+    virtual void counter(const QString &name, qint64 time, double value) = 0;
+
+    /** Writes anything needed to end the trace */
+    virtual void finish() = 0;
+};
+
+/**
+ * Writes the Chrome Trace Event JSON format, as read by chrome://tracing,
+ * Perfetto UI and speedscope.
+ *
+ * https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+ */
+class ChromeTraceWriter : public TraceWriter {
+public:
+    explicit ChromeTraceWriter(QIODevice *device);
+
+    void slice(const QString &track, const QString &name, qint64 start, qint64 end, const Args &args) override;
+
+    void instant(const QString &track, const QString &name, qint64 time, const Args &args) override;
+
+    void counter(const QString &name, qint64 time, double value) override;
+
+    void finish() override;
+
+private:
+    QIODevice *device;
+
+    QHash<QString, int> threadIds {};
+
+    bool first = true;
+
+    int threadFor(const QString &track);
+
+    void writeEvent(const QJsonObject &event);
+};
+
+/**
+ * Writes the Perfetto protobuf trace format (a stream of TracePacket's
+ * holding TrackDescriptor's and TrackEvent's).
+ *
+ * https://perfetto.dev/docs/reference/trace-packet-proto
+ */
+class PerfettoTraceWriter : public TraceWriter {
+public:
+    explicit PerfettoTraceWriter(QIODevice *device);
+
+    void slice(const QString &track, const QString &name, qint64 start, qint64 end, const Args &args) override;
+
+    void instant(const QString &track, const QString &name, qint64 time, const Args &args) override;
+
+    void counter(const QString &name, qint64 time, double value) override;
+
+    void finish() override;
+
+private:
+    QIODevice *device;
+
+    QHash<QString, quint64> trackUuids {};
+
+    QHash<QString, quint64> counterUuids {};
+
+    bool first = true;
+
+    quint64 trackFor(const QString &track);
+
+    quint64 counterFor(const QString &name);
+
+    QByteArray trackEvent(int type, quint64 track, const QString &name, const Args &args);
+
+    void writePacket(qint64 time, int field, const QByteArray &payload);
+};
+
+/**
+ * Converts a stream of LSP messages into trace events: Requests become spans
+ * ending at their Response (laid out in non-overlapping lanes), and Notifications
+ * become instant events. Stderr lines and counters are passed through.
+ *
+ * Only Requests still waiting on a Response are held in memory, so any size
+ * of capture can be exported.
+ */
+class TraceExporter : public QObject {
+    Q_OBJECT
+
+public:
+    explicit TraceExporter(TraceWriter &writer, QObject *parent = nullptr);
+
+    /**
+     * Runs the capture through the parsing and validation pipeline and
+     * writes the result. Returns false (with error set) if the capture
+     * could not be read.
+     */
+    bool exportCapture(QIODevice *capture, QString *error = nullptr);
+
+    /** Writes pending Requests as spans ending at the last seen time, and finishes the trace */
+    void finish();
+
+public slots:
+    void onLspMessage(std::shared_ptr<Lsp::Message> message);
+
+    void onStderr(qint64 timestamp, QString line);
+
+    void onCounter(qint64 timestamp, QString name, double value);
+
+private:
+    struct Lane {
+        QString track;
+
+        /** The Request currently occupying the lane, if any */
+        std::shared_ptr<Lsp::Request> request;
+    };
+
+    TraceWriter &writer;
+
+    QVector<Lane> lanes {};
+
+    qint64 lastTimestamp = 0;
+
+    void openSpan(std::shared_ptr<Lsp::Request> request);
+
+    void closeSpan(std::shared_ptr<Lsp::Request> request, qint64 end, const Args &extra);
+
+    static QString senderName(Lsp::Entity sender);
+
+    static QString idToQString(Lsp::Id id);
+};
+
+}
+
+#endif // TRACEEXPORTER_H
@@ -0,0 +1,214 @@
+#include "validationpolicy.h"
+
+bool ValidationPolicy::Sampler::sample() {
+    if (rate >= 1) {
+        return true;
+    }
+
+    // Spreads the sampled messages evenly, rather than randomly, so a rate of
+    // 0.25 validates exactly every fourth message
+    credit += rate;
+    if (credit >= 1) {
+        credit -= 1;
+        return true;
+    }
+
+    return false;
+}
+
+ValidationPolicy::ValidationPolicy(QObject *parent) : QObject(parent) {}
+
+void ValidationPolicy::setMode(Mode mode) {
+    this->mode = mode;
+}
+
+ValidationPolicy::Mode ValidationPolicy::getMode() const {
+    return mode;
+}
+
+void ValidationPolicy::setSampleRate(const QString &method, double rate) {
+    samplers[method].rate = qBound(0.0, rate, 1.0);
+    sampling = true;
+}
+
+void ValidationPolicy::setDefaultSampleRate(double rate) {
+    defaultSampler.rate = qBound(0.0, rate, 1.0);
+    sampling = true;
+}
+
+void ValidationPolicy::setQueueLimit(qint64 bytes) {
+    queueLimit = std::max<qint64>(bytes, 0);
+    onQueueSize(queueSize);
+}
+
+ValidationPolicy::Level ValidationPolicy::levelFor(qint64 bytes) const {
+    if (queueLimit == 0 || bytes < queueLimit) {
+        return Level::Full;
+    } else if (bytes < queueLimit * 2) {
+        return Level::NoDeepValidation;
+    } else if (bytes < queueLimit * 4) {
+        return Level::NoParsing;
+    } else {
+        return Level::FramingOnly;
+    }
+}
+
+void ValidationPolicy::onQueueSize(qint64 bytes) {
+    queueSize = bytes;
+
+    // Degrade as soon as a limit is crossed, but only recover once the queue is
+    // down to half of it, so a queue hovering around a limit doesn't flap
+    Level next = levelFor(bytes);
+    Level current = level.load();
+    if (next < current) {
+        next = std::max(levelFor(bytes * 2), next);
+    }
+
+    if (next != current) {
+        level.store(next);
+        emit emitLevelChanged(next);
+    }
+}
+
+ValidationPolicy::Level ValidationPolicy::getLevel() const {
+    return level.load();
+}
+
+qint64 ValidationPolicy::getQueueSize() const {
+    return queueSize;
+}
+
+bool ValidationPolicy::shouldValidateDeeply(const QString &method) {
+    if (mode == Mode::EnvelopeOnly) {
+        envelopeOnly.add();
+        return false;
+    }
+
+    if (level.load() >= Level::NoDeepValidation) {
+        shedValidations.add();
+        return false;
+    }
+
+    if (!sampling) {
+        return true;
+    }
+
+    QMutexLocker lock (&samplersMutex);
+
+    auto it = samplers.find(method);
+    Sampler &sampler = it != samplers.end() ? it.value() : defaultSampler;
+    if (!sampler.sample()) {
+        sampledOut.add();
+        return false;
+    }
+
+    return true;
+}
+
+bool ValidationPolicy::shouldParse(const FrameBuilder::Frame &frame) {
+    if (frame.payloadDiscarded) {
+        discardedFrames.add();
+        return false;
+    }
+
+    // Frames buffered before the level rose to FramingOnly are still skipped
+    if (level.load() >= Level::NoParsing) {
+        unparsedFrames.add();
+        return false;
+    }
+
+    return true;
+}
+
+bool ValidationPolicy::shouldDiscardPayloads() const {
+    return level.load() >= Level::FramingOnly;
+}
+
+quint64 ValidationPolicy::getEnvelopeOnlyCount() const {
+    return envelopeOnly.get();
+}
+
+quint64 ValidationPolicy::getSampledOutCount() const {
+    return sampledOut.get();
+}
+
+quint64 ValidationPolicy::getShedValidationCount() const {
+    return shedValidations.get();
+}
+
+quint64 ValidationPolicy::getUnparsedFrameCount() const {
+    return unparsedFrames.get();
+}
+
+quint64 ValidationPolicy::getDiscardedFrameCount() const {
+    return discardedFrames.get();
+}
+
+void ValidationPolicy::appendOpenMetrics(QByteArray &out) const {
+    using namespace Metrics::Exposition;
+
+    family(out, "lspmonitor_analysis_level", "gauge", "How far analysis is degraded: 0 full, 1 no deep validation, 2 no parsing, 3 framing only");
+    sample(out, "lspmonitor_analysis_level", "", int(level.load()));
+
+    family(out, "lspmonitor_analysis_queue_bytes", "gauge", "Bytes forwarded but not yet analysed");
+    sample(out, "lspmonitor_analysis_queue_bytes", "", queueSize);
+
+    family(out, "lspmonitor_validation_skipped_total", "counter", "Params and results not validated because of the configured policy, by reason");
+    sample(out, "lspmonitor_validation_skipped_total", "reason=\"envelope_only\"", envelopeOnly.get());
+    sample(out, "lspmonitor_validation_skipped_total", "reason=\"sampled\"", sampledOut.get());
+
+    family(out, "lspmonitor_analysis_shed_total", "counter", "Work dropped because the analysis queue backed up, by stage");
+    sample(out, "lspmonitor_analysis_shed_total", "stage=\"deep_validation\"", shedValidations.get());
+    sample(out, "lspmonitor_analysis_shed_total", "stage=\"parsing\"", unparsedFrames.get());
+    sample(out, "lspmonitor_analysis_shed_total", "stage=\"analysis\"", discardedFrames.get());
+}
+
+option<ValidationPolicy::Mode> ValidationPolicy::parseMode(const QString &name) {
+    if (name == "full") {
+        return Mode::Full;
+    } else if (name == "envelope") {
+        return Mode::EnvelopeOnly;
+    }
+
+    return {};
+}
+
+QString ValidationPolicy::levelName(Level level) {
+    switch (level) {
+        case Level::Full:
+            return "full";
+        case Level::NoDeepValidation:
+            return "no deep validation";
+        case Level::NoParsing:
+            return "no parsing";
+        case Level::FramingOnly:
+            return "framing only";
+    }
+
+    return QString();
+}
+
+ValidationStatusLabel::ValidationStatusLabel(const ValidationPolicy &policy, QWidget *parent) : QLabel(parent), policy(policy) {
+    connect(&timer, &QTimer::timeout, this, &ValidationStatusLabel::refresh);
+    timer.start(1000);
+    refresh();
+}
+
+void ValidationStatusLabel::refresh() {
+    QString text = policy.getMode() == ValidationPolicy::Mode::Full ? "Validation: full" : "Validation: envelope only";
+
+    if (policy.getSampledOutCount() > 0) {
+        text += QString(", %1 sampled out").arg(policy.getSampledOutCount());
+    }
+
+    if (policy.getLevel() != ValidationPolicy::Level::Full) {
+        text += QString(" | Degraded to %1 (%2 MiB queued)").arg(ValidationPolicy::levelName(policy.getLevel())).arg(policy.getQueueSize() / (1024.0 * 1024.0), 0, 'f', 1);
+    }
+
+    quint64 shed = policy.getShedValidationCount() + policy.getUnparsedFrameCount() + policy.getDiscardedFrameCount();
+    if (shed > 0) {
+        text += QString(" | Shed: %1 validations, %2 unparsed, %3 unanalysed").arg(policy.getShedValidationCount()).arg(policy.getUnparsedFrameCount()).arg(policy.getDiscardedFrameCount());
+    }
+
+    setText(text);
+}
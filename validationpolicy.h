@@ -0,0 +1,173 @@
+#ifndef VALIDATIONPOLICY_H
+#define VALIDATIONPOLICY_H
+
+#include <QLabel>
+#include <QTimer>
+
+#include <atomic>
+
+#include "framebuilder.h"
+#include "metrics.h"
+#include "option.h"
+
+/**
+ * Decides how much analysis each message gets. The configured mode and the
+ * per-method sample rates pick which messages have their params and results
+ * validated. On top of that, analysis degrades in steps as the analysis queue
+ * backs up (see StdioMitm), shedding the most expensive work first, and
+ * recovers as the queue drains.
+ *
+ * Forwarding never goes through the policy; only the analysis of what was
+ * already forwarded is skipped. shouldValidateDeeply() may be called from
+ * the analysis pool (see LspSchemaValidator::onMessageBatch); everything else
+ * is only used from the main thread.
+ */
+class ValidationPolicy : public QObject {
+    Q_OBJECT
+
+public:
+    enum class Mode {
+        /** Validate params and results with the generated validators */
+        Full,
+
+        /** Only validate the JSON-RPC envelope (jsonrpc, id, method, result / error members) */
+        EnvelopeOnly,
+    };
+
+    /** How far analysis is degraded, in the order work is shed */
+    enum class Level {
+        Full,
+
+        /** Messages are parsed and tracked, but params and results are not validated */
+        NoDeepValidation,
+
+        /** Frames are buffered, but not parsed */
+        NoParsing,
+
+        /** Payloads are skipped (unless recording); the streams are only framed so they stay in sync */
+        FramingOnly,
+    };
+
+    /** Queued bytes (not yet analysed) at which analysis first degrades */
+    static constexpr qint64 defaultQueueLimit = 16 * 1024 * 1024;
+
+    explicit ValidationPolicy(QObject *parent = nullptr);
+
+    void setMode(Mode mode);
+
+    Mode getMode() const;
+
+    /** Fraction (0 to 1) of messages with the method that have their params or result validated */
+    void setSampleRate(const QString &method, double rate);
+
+    /** Sample rate of methods without their own */
+    void setDefaultSampleRate(double rate);
+
+    /**
+     * Queued bytes at which analysis degrades to NoDeepValidation. Each further
+     * level starts at twice the bytes of the previous. 0 never degrades.
+     */
+    void setQueueLimit(qint64 bytes);
+
+    /** Updates the level from the number of bytes waiting in the analysis queue */
+    void onQueueSize(qint64 bytes);
+
+    Level getLevel() const;
+
+    qint64 getQueueSize() const;
+
+    /** Whether to validate the params or result of a message with the method. Counts it as skipped if not */
+    bool shouldValidateDeeply(const QString &method);
+
+    /** Whether to parse the frame. Counts it as shed if not */
+    bool shouldParse(const FrameBuilder::Frame &frame);
+
+    /** If frame payloads should be skipped entirely */
+    bool shouldDiscardPayloads() const;
+
+    /** Validations skipped because of the mode */
+    quint64 getEnvelopeOnlyCount() const;
+
+    /** Validations skipped by sampling */
+    quint64 getSampledOutCount() const;
+
+    /** Work shed under load, at each of the stages in Level */
+    quint64 getShedValidationCount() const;
+
+    quint64 getUnparsedFrameCount() const;
+
+    quint64 getDiscardedFrameCount() const;
+
+    /** Appends the policy metrics in the OpenMetrics text format */
+    void appendOpenMetrics(QByteArray &out) const;
+
+    /** Parses "full" or "envelope" */
+    static option<Mode> parseMode(const QString &name);
+
+    static QString levelName(Level level);
+
+signals:
+    void emitLevelChanged(Level level);
+
+private:
+    /** Deterministic sampling: a message is validated each time the credit reaches 1 */
+    struct Sampler {
+        double rate = 1;
+
+        double credit = 0;
+
+        bool sample();
+    };
+
+    Level levelFor(qint64 bytes) const;
+
+    Mode mode = Mode::Full;
+
+    QHash<QString, Sampler> samplers {};
+
+    /** Shared by every method without its own sample rate */
+    Sampler defaultSampler {};
+
+    /** If any sample rate was set, so messages can skip the samplers otherwise */
+    bool sampling = false;
+
+    qint64 queueLimit = defaultQueueLimit;
+
+    qint64 queueSize = 0;
+
+    /** Guards the samplers */
+    QMutex samplersMutex {};
+
+    std::atomic<Level> level {Level::Full};
+
+    Metrics::Counter envelopeOnly {};
+
+    Metrics::Counter sampledOut {};
+
+    Metrics::Counter shedValidations {};
+
+    Metrics::Counter unparsedFrames {};
+
+    Metrics::Counter discardedFrames {};
+};
+
+/**
+ * Status bar summary of the validation mode, the current level, and what has
+ * been skipped, refreshed periodically
+ */
+class ValidationStatusLabel : public QLabel {
+    Q_OBJECT
+
+public:
+    ValidationStatusLabel(const ValidationPolicy &policy, QWidget *parent = nullptr);
+
+public slots:
+    void refresh();
+
+private:
+    const ValidationPolicy &policy;
+
+    QTimer timer {};
+};
+
+#endif // VALIDATIONPOLICY_H
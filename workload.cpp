@@ -0,0 +1,494 @@
+#include "workload.h"
+#include "monotonic.h"
+
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QRegularExpression>
+#include <QUrl>
+
+#include <iostream>
+
+namespace Workload {
+
+namespace {
+    QString languageIdFor(const QString &path) {
+        static const QHash<QString, QString> languages {
+            {"c", "c"}, {"h", "cpp"}, {"cc", "cpp"}, {"cpp", "cpp"}, {"cxx", "cpp"}, {"hpp", "cpp"},
+            {"py", "python"}, {"rs", "rust"}, {"go", "go"}, {"java", "java"}, {"kt", "kotlin"},
+            {"js", "javascript"}, {"jsx", "javascriptreact"}, {"ts", "typescript"}, {"tsx", "typescriptreact"},
+            {"cs", "csharp"}, {"rb", "ruby"}, {"php", "php"}, {"lua", "lua"}, {"zig", "zig"},
+        };
+
+        QString suffix = QFileInfo(path).suffix().toLower();
+        return languages.value(suffix, suffix);
+    }
+
+    QJsonObject toJson(DocumentRope::Position position) {
+        return QJsonObject {{"line", position.line}, {"character", position.character}};
+    }
+}
+
+option<Scenario> Scenario::fromJson(const QJsonObject &json, QString *error) {
+    Scenario scenario;
+
+    scenario.duration = json.value("duration").toDouble(scenario.duration);
+    scenario.maxFiles = json.value("maxFiles").toInt(scenario.maxFiles);
+    scenario.seed = quint32(json.value("seed").toDouble(scenario.seed));
+    scenario.documentSymbol = json.value("documentSymbol").toBool(false);
+
+    if (json.contains("files")) {
+        scenario.files.clear();
+        for (const QJsonValue &filter : json.value("files").toArray()) {
+            scenario.files.append(filter.toString());
+        }
+    }
+
+    QJsonObject typing = json.value("typing").toObject();
+    scenario.typingRate = typing.value("rate").toDouble(0);
+    scenario.burstLength = typing.value("burst").toInt(scenario.burstLength);
+    scenario.burstPause = typing.value("pause").toDouble(scenario.burstPause);
+    scenario.completion = typing.value("completion").toBool(false);
+
+    scenario.hoverRate = json.value("hover").toObject().value("rate").toDouble(0);
+    scenario.referencesRate = json.value("references").toObject().value("rate").toDouble(0);
+
+    if (scenario.duration <= 0) {
+        *error = "duration must be positive";
+        return {};
+    }
+
+    if (scenario.maxFiles <= 0 || scenario.files.isEmpty()) {
+        *error = "No files to open";
+        return {};
+    }
+
+    if (scenario.typingRate < 0 || scenario.hoverRate < 0 || scenario.referencesRate < 0 || scenario.burstPause < 0) {
+        *error = "Rates and pauses can't be negative";
+        return {};
+    }
+
+    if (scenario.burstLength <= 0) {
+        *error = "typing.burst must be positive";
+        return {};
+    }
+
+    return scenario;
+}
+
+Generator::Generator(Scenario scenario, QString projectPath, QObject *parent) : QObject(parent), scenario(scenario), projectPath(QDir(projectPath).absolutePath()), random(scenario.seed) {
+    for (Arrivals *arrivals : {&typing, &hovers, &lookups}) {
+        arrivals->timer.setSingleShot(true);
+        arrivals->timer.setTimerType(Qt::PreciseTimer);
+    }
+
+    connect(&typing.timer, &QTimer::timeout, this, &Generator::keystroke);
+    connect(&hovers.timer, &QTimer::timeout, this, &Generator::hover);
+    connect(&lookups.timer, &QTimer::timeout, this, &Generator::references);
+
+    loadTimer.setSingleShot(true);
+    connect(&loadTimer, &QTimer::timeout, this, &Generator::stopLoad);
+
+    drainTimer.setSingleShot(true);
+    connect(&drainTimer, &QTimer::timeout, this, &Generator::finish);
+}
+
+void Generator::start(const QStringList &command) {
+    server = std::make_unique<ServerSession>(command, this);
+    connect(server.get(), &ServerSession::emitMessage, this, &Generator::onServerMessage);
+    connect(server.get(), &ServerSession::emitFinished, this, &Generator::onServerFinished);
+
+    QString rootUri = QUrl::fromLocalFile(projectPath).toString();
+
+    QJsonObject capabilities {
+        {"textDocument", QJsonObject {
+            {"synchronization", QJsonObject {{"dynamicRegistration", false}}},
+            {"completion", QJsonObject {{"completionItem", QJsonObject {{"snippetSupport", false}}}}},
+            {"hover", QJsonObject {{"contentFormat", QJsonArray {"markdown", "plaintext"}}}},
+            {"documentSymbol", QJsonObject {{"hierarchicalDocumentSymbolSupport", true}}},
+            {"references", QJsonObject {}},
+        }},
+        {"workspace", QJsonObject {{"configuration", true}, {"workspaceFolders", true}}},
+    };
+
+    initializeId = request("initialize", QJsonObject {
+        {"processId", QCoreApplication::applicationPid()},
+        {"rootUri", rootUri},
+        {"workspaceFolders", QJsonArray {QJsonObject {{"uri", rootUri}, {"name", QDir(projectPath).dirName()}}}},
+        {"capabilities", capabilities},
+    });
+}
+
+QString Generator::report() const {
+    double seconds = std::max<qint64>(loadEndNs - loadStartNs, 1) / 1e9;
+
+    auto activity = [&](const char *name, const Arrivals &arrivals, double target) {
+        return QString("  %1: %2 (%3/s, %4/s offered)\n").arg(name).arg(arrivals.count).arg(arrivals.count / seconds, 0, 'f', 2).arg(target, 0, 'f', 2);
+    };
+
+    // Typing pauses between bursts, so its average rate is lower than the rate within a burst
+    double burstSeconds = scenario.typingRate > 0 ? scenario.burstLength / scenario.typingRate : 0;
+    double typingRate = scenario.typingRate > 0 ? scenario.burstLength / (burstSeconds + scenario.burstPause) : 0;
+
+    QString out = QString("Generated %1 s of open loop load on %2 files\n").arg(seconds, 0, 'f', 1).arg(documents.size());
+    out += activity("keystrokes", typing, typingRate);
+    out += activity("hovers", hovers, scenario.hoverRate);
+    out += activity("references", lookups, scenario.referencesRate);
+    out += "\n";
+
+    return out + Replay::latencyTable(methods, unanswered);
+}
+
+void Generator::onServerMessage(QJsonObject message, qint64 arrival) {
+    if (!message.contains("method")) {
+        onResponse(message, arrival);
+    } else if (message.contains("id")) {
+        answer(message);
+    }
+}
+
+void Generator::onServerFinished(int exitCode) {
+    if (!finishing) {
+        std::cerr << "Server exited with code " << exitCode << " before the load finished" << std::endl;
+    }
+
+    for (auto &request : pending) {
+        unanswered[request.method] += 1;
+    }
+    pending.clear();
+
+    finishing = true;
+    loading = false;
+    for (Arrivals *arrivals : {&typing, &hovers, &lookups}) {
+        arrivals->timer.stop();
+    }
+    loadTimer.stop();
+    drainTimer.stop();
+
+    if (!finished) {
+        finished = true;
+        emit emitFinished();
+    }
+}
+
+void Generator::onInitialized() {
+    notify("initialized", QJsonObject {});
+    openFiles();
+
+    if (documents.empty()) {
+        std::cerr << "No files in " << projectPath.toStdString() << " match " << scenario.files.join(' ').toStdString() << std::endl;
+        finish();
+        return;
+    }
+
+    startLoad();
+}
+
+void Generator::openFiles() {
+    QStringList paths;
+
+    QDirIterator it (projectPath, scenario.files, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        paths.append(it.next());
+    }
+
+    // The same files for the same project, whatever order the file system lists them in
+    std::sort(paths.begin(), paths.end());
+
+    for (const QString &path : paths.mid(0, scenario.maxFiles)) {
+        QFile file (path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        auto document = std::make_unique<Document>();
+        document->uri = QUrl::fromLocalFile(path).toString();
+        document->languageId = languageIdFor(path);
+        document->text = DocumentRope(QString::fromUtf8(file.readAll()));
+
+        // Type at the start of the middle line
+        document->cursor = document->text.offsetOf({document->text.lineCount() / 2, 0}, DocumentRope::Encoding::Utf16).value_or(0);
+
+        notify("textDocument/didOpen", QJsonObject {{"textDocument", QJsonObject {
+            {"uri", document->uri},
+            {"languageId", document->languageId},
+            {"version", document->version},
+            {"text", document->text.toString()},
+        }}});
+
+        if (scenario.documentSymbol) {
+            request("textDocument/documentSymbol", QJsonObject {{"textDocument", QJsonObject {{"uri", document->uri}}}});
+        }
+
+        documents.push_back(std::move(document));
+    }
+}
+
+void Generator::startLoad() {
+    loading = true;
+    loadStartNs = monotonicNs();
+    loadEndNs = loadStartNs + qint64(scenario.duration * 1e9);
+
+    for (Arrivals *arrivals : {&typing, &hovers, &lookups}) {
+        arrivals->due = loadStartNs;
+    }
+
+    typing.rate = scenario.typingRate;
+    hovers.rate = scenario.hoverRate;
+    lookups.rate = scenario.referencesRate;
+
+    for (Arrivals *arrivals : {&typing, &hovers, &lookups}) {
+        if (arrivals->rate > 0) {
+            schedule(*arrivals, nextGap(arrivals->rate));
+        }
+    }
+
+    loadTimer.start(int(scenario.duration * 1000));
+}
+
+void Generator::schedule(Arrivals &arrivals, double gap) {
+    // Arrivals are scheduled from when the last one was due rather than when it happened, so a late timer doesn't lower the rate
+    arrivals.due += qint64(gap * 1e9);
+    if (arrivals.due > loadEndNs) {
+        return;
+    }
+
+    arrivals.timer.start(int(std::max<qint64>(arrivals.due - monotonicNs(), 0) / 1000000));
+}
+
+double Generator::nextGap(double rate) {
+    return std::exponential_distribution<double>(rate)(random);
+}
+
+void Generator::keystroke() {
+    if (!loading) {
+        return;
+    }
+
+    Document &document = *documents.front();
+    typing.count += 1;
+
+    static const QString word = "generated_identifier_";
+    edit(document, document.cursor + burstTyped, document.cursor + burstTyped, word.at(burstTyped % word.size()));
+    burstTyped += 1;
+
+    if (scenario.completion) {
+        QJsonObject params = textDocumentPosition(document, document.cursor + burstTyped);
+        params["context"] = QJsonObject {{"triggerKind", 1}};
+        request("textDocument/completion", params, typing.due);
+    }
+
+    if (burstTyped < scenario.burstLength) {
+        schedule(typing, nextGap(typing.rate));
+        return;
+    }
+
+    // Delete the burst, as an undo would
+    edit(document, document.cursor, document.cursor + burstTyped, QString());
+    burstTyped = 0;
+
+    schedule(typing, scenario.burstPause + nextGap(typing.rate));
+}
+
+void Generator::hover() {
+    if (!loading) {
+        return;
+    }
+
+    // Sweep each file in turn from top to bottom
+    Document &document = *documents[hovers.count % documents.size()];
+    hovers.count += 1;
+
+    qint64 offset = nextIdentifier(document, document.sweep);
+    if (offset >= 0) {
+        document.sweep = offset + 1;
+        request("textDocument/hover", textDocumentPosition(document, offset), hovers.due);
+    }
+
+    schedule(hovers, nextGap(hovers.rate));
+}
+
+void Generator::references() {
+    if (!loading) {
+        return;
+    }
+
+    Document &document = *documents[random() % documents.size()];
+    lookups.count += 1;
+
+    qint64 offset = nextIdentifier(document, std::uniform_int_distribution<qint64>(0, document.text.length())(random));
+    if (offset >= 0) {
+        QJsonObject params = textDocumentPosition(document, offset);
+        params["context"] = QJsonObject {{"includeDeclaration", true}};
+        request("textDocument/references", params, lookups.due);
+    }
+
+    schedule(lookups, nextGap(lookups.rate));
+}
+
+qint64 Generator::request(const QString &name, const QJsonObject &params, option<qint64> due) {
+    qint64 id = nextId++;
+
+    method(name).sent += 1;
+    pending.insert(id, Pending {name, due.value_or(monotonicNs())});
+
+    server->send(QJsonObject {{"jsonrpc", "2.0"}, {"id", id}, {"method", name}, {"params", params}});
+    return id;
+}
+
+void Generator::notify(const QString &name, const QJsonObject &params) {
+    server->send(QJsonObject {{"jsonrpc", "2.0"}, {"method", name}, {"params", params}});
+}
+
+void Generator::edit(Document &document, qint64 start, qint64 end, const QString &text) {
+    QJsonObject range {
+        {"start", toJson(document.text.positionOf(start, DocumentRope::Encoding::Utf16))},
+        {"end", toJson(document.text.positionOf(end, DocumentRope::Encoding::Utf16))},
+    };
+
+    document.text = document.text.replaced(start, end, text);
+    document.version += 1;
+
+    notify("textDocument/didChange", QJsonObject {
+        {"textDocument", QJsonObject {{"uri", document.uri}, {"version", document.version}}},
+        {"contentChanges", QJsonArray {QJsonObject {{"range", range}, {"text", text}}}},
+    });
+}
+
+QJsonObject Generator::textDocumentPosition(const Document &document, qint64 offset) const {
+    return QJsonObject {
+        {"textDocument", QJsonObject {{"uri", document.uri}}},
+        {"position", toJson(document.text.positionOf(offset, DocumentRope::Encoding::Utf16))},
+    };
+}
+
+qint64 Generator::nextIdentifier(const Document &document, qint64 offset) const {
+    static const QRegularExpression identifier ("(?<!\\w)[A-Za-z_]");
+    static constexpr qint64 window = 4096;
+
+    qint64 length = document.text.length();
+    if (length == 0) {
+        return -1;
+    }
+
+    // Scan to the end, then once more from the start
+    for (qint64 scanned = 0; scanned < length + window; scanned += window) {
+        qint64 from = (offset + scanned) % length;
+
+        // One character of context, so an identifier continuing from before the window isn't matched
+        qint64 context = from > 0 ? 1 : 0;
+        QString text = document.text.mid(from - context, window + context);
+
+        auto match = identifier.match(text, context);
+        if (match.hasMatch()) {
+            return from - context + match.capturedStart();
+        }
+    }
+
+    return -1;
+}
+
+void Generator::answer(const QJsonObject &request) {
+    QString name = request.value("method").toString();
+    QJsonObject response {{"jsonrpc", "2.0"}, {"id", request.value("id")}};
+
+    if (name == "workspace/configuration") {
+        QJsonArray result;
+        for (int i = 0; i < request.value("params").toObject().value("items").toArray().size(); i++) {
+            result.append(QJsonValue::Null);
+        }
+        response["result"] = result;
+    } else {
+        response["result"] = QJsonValue::Null;
+    }
+
+    server->send(response);
+}
+
+void Generator::onResponse(const QJsonObject &response, qint64 arrival) {
+    QJsonValue id = response.value("id");
+    if (!id.isDouble()) {
+        return;
+    }
+
+    qint64 key = qint64(id.toDouble());
+
+    if (shutdownId == key) {
+        notify("exit", QJsonObject {});
+        return;
+    }
+
+    auto it = pending.find(key);
+    if (it == pending.end()) {
+        return;
+    }
+
+    Replay::MethodReport &report = method(it->method);
+    quint64 latency = std::max<qint64>(arrival - it->sentAt, 0) / 1000;
+    report.latency.record(latency);
+    report.samples.append(latency);
+    if (response.contains("error")) {
+        report.errors += 1;
+    }
+
+    pending.erase(it);
+
+    if (initializeId == key) {
+        initializeId = {};
+        onInitialized();
+    } else if (!loading && !finishing && pending.isEmpty() && loadStartNs > 0) {
+        finish();
+    }
+}
+
+void Generator::stopLoad() {
+    loading = false;
+    loadEndNs = monotonicNs();
+
+    for (Arrivals *arrivals : {&typing, &hovers, &lookups}) {
+        arrivals->timer.stop();
+    }
+
+    if (pending.isEmpty()) {
+        finish();
+    } else {
+        drainTimer.start(drainTimeout);
+    }
+}
+
+void Generator::finish() {
+    if (finishing) {
+        return;
+    }
+
+    finishing = true;
+    loading = false;
+    drainTimer.stop();
+
+    for (auto &request : pending) {
+        unanswered[request.method] += 1;
+    }
+    pending.clear();
+
+    if (server->getProcess()->state() == QProcess::NotRunning) {
+        onServerFinished(server->getProcess()->exitCode());
+        return;
+    }
+
+    shutdownId = nextId++;
+    server->send(QJsonObject {{"jsonrpc", "2.0"}, {"id", shutdownId.value()}, {"method", "shutdown"}});
+
+    // A server that ignores exit is not waited for
+    QTimer::singleShot(5000, server->getProcess(), &QProcess::kill);
+}
+
+Replay::MethodReport& Generator::method(const QString &name) {
+    auto &report = methods[name];
+    if (!report) {
+        report = std::make_unique<Replay::MethodReport>();
+    }
+    return *report;
+}
+
+}
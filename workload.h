@@ -0,0 +1,228 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <QObject>
+#include <QTimer>
+#include <QJsonObject>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "documentrope.h"
+#include "option.h"
+#include "replay.h"
+#include "serversession.h"
+
+namespace Workload {
+
+/**
+ * What to generate, read from a JSON file. Rates are per second, and every
+ * activity is optional:
+ *
+ *     {
+ *         "duration": 60,
+ *         "files": ["*.cpp", "*.h"],
+ *         "maxFiles": 20,
+ *         "seed": 1,
+ *         "documentSymbol": true,
+ *         "typing": { "rate": 8, "burst": 20, "pause": 2, "completion": true },
+ *         "hover": { "rate": 10 },
+ *         "references": { "rate": 0.2 }
+ *     }
+ */
+struct Scenario {
+    /** Seconds of load, after the files are opened */
+    double duration = 60;
+
+    /** Name filters of the files in the project to open */
+    QStringList files {"*"};
+
+    int maxFiles = 20;
+
+    quint32 seed = 1;
+
+    /** Request textDocument/documentSymbol for each file as it is opened */
+    bool documentSymbol = false;
+
+    /** Keystrokes per second during a burst, 0 for no typing */
+    double typingRate = 0;
+
+    int burstLength = 20;
+
+    /** Seconds between bursts */
+    double burstPause = 2;
+
+    /** Request completion after each keystroke */
+    bool completion = false;
+
+    double hoverRate = 0;
+
+    double referencesRate = 0;
+
+    /** Reads a scenario, returning nothing with an error if it is invalid */
+    static option<Scenario> fromJson(const QJsonObject &json, QString *error);
+};
+
+/**
+ * Drives a server with a synthetic session on a real project: it opens files
+ * from the project, then types into them (as incremental didChange), hovers
+ * over them from top to bottom, and looks for references, for the duration
+ * of the scenario.
+ *
+ * Load is open loop: each activity is a Poisson process at its rate, so
+ * messages are sent on schedule however far behind the server is, and its
+ * latency is measured at the offered rate rather than at whatever rate it
+ * can keep up with. Typing happens in bursts of keystrokes at the typing
+ * rate, after which the burst is deleted again so files don't grow.
+ */
+class Generator : public QObject {
+    Q_OBJECT
+
+public:
+    /** How long (ms) to wait for outstanding Responses once the load stops */
+    static constexpr int drainTimeout = 30000;
+
+    Generator(Scenario scenario, QString projectPath, QObject *parent = nullptr);
+
+    /** Spawns the server and initializes it, then starts the load */
+    void start(const QStringList &command);
+
+    /** The load generated, and the latency of each method */
+    QString report() const;
+
+signals:
+    void emitFinished();
+
+private slots:
+    void onServerMessage(QJsonObject message, qint64 arrival);
+
+    void onServerFinished(int exitCode);
+
+private:
+    struct Document {
+        QString uri;
+
+        QString languageId;
+
+        qint64 version = 1;
+
+        DocumentRope text;
+
+        /** Where the next hover of the sweep is, and where typing happens (UTF-16 offsets) */
+        qint64 sweep = 0;
+
+        qint64 cursor = 0;
+    };
+
+    /** One activity's Poisson process: when it next happens (ns, monotonic), and how often */
+    struct Arrivals {
+        double rate = 0;
+
+        qint64 due = 0;
+
+        quint64 count = 0;
+
+        QTimer timer {};
+    };
+
+    struct Pending {
+        QString method;
+
+        /** When it was due to be sent, or sent if it wasn't scheduled (ns, monotonic) */
+        qint64 sentAt;
+    };
+
+    void onInitialized();
+
+    void openFiles();
+
+    void startLoad();
+
+    /** Schedules the next arrival of the activity after gap seconds, calling action then */
+    void schedule(Arrivals &arrivals, double gap);
+
+    double nextGap(double rate);
+
+    void keystroke();
+
+    void hover();
+
+    void references();
+
+    /**
+     * Sends a Request. The latency of a scheduled one is measured from when it
+     * was due, so a generator that falls behind doesn't hide the delay.
+     */
+    qint64 request(const QString &method, const QJsonObject &params, option<qint64> due = {});
+
+    void notify(const QString &method, const QJsonObject &params);
+
+    /** Replaces the text between the offsets, sending the change */
+    void edit(Document &document, qint64 start, qint64 end, const QString &text);
+
+    QJsonObject textDocumentPosition(const Document &document, qint64 offset) const;
+
+    /** The start of the identifier at or after the offset, wrapping around at the end */
+    qint64 nextIdentifier(const Document &document, qint64 offset) const;
+
+    void answer(const QJsonObject &request);
+
+    void onResponse(const QJsonObject &response, qint64 arrival);
+
+    void stopLoad();
+
+    void finish();
+
+    Replay::MethodReport& method(const QString &name);
+
+    Scenario scenario;
+
+    QString projectPath;
+
+    std::unique_ptr<ServerSession> server;
+
+    std::mt19937 random;
+
+    std::vector<std::unique_ptr<Document>> documents {};
+
+    Arrivals typing {};
+
+    Arrivals hovers {};
+
+    Arrivals lookups {};
+
+    /** Keystrokes typed in the current burst */
+    int burstTyped = 0;
+
+    QTimer loadTimer {};
+
+    QTimer drainTimer {};
+
+    QHash<qint64, Pending> pending {};
+
+    qint64 nextId = 1;
+
+    option<qint64> initializeId {};
+
+    option<qint64> shutdownId {};
+
+    qint64 loadStartNs = 0;
+
+    qint64 loadEndNs = 0;
+
+    bool loading = false;
+
+    bool finishing = false;
+
+    bool finished = false;
+
+    std::map<QString, std::unique_ptr<Replay::MethodReport>> methods {};
+
+    QHash<QString, int> unanswered {};
+};
+
+}
+
+#endif // WORKLOAD_H